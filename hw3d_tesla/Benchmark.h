@@ -0,0 +1,69 @@
+#pragma once
+#include "Simd.h"
+#include "TeslaTimer.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Benchmark and check modes of the headless build (see HeadlessMain.cpp). Every mode prints its
+// results and returns the exit code of the program: -1 when a check failed, 0 otherwise
+namespace Benchmark
+{
+	// Shortest of nRuns timings of run(), in seconds. prepare() is called before every run
+	// without being timed
+	template<typename P, typename F>
+	float BestOf(unsigned int nRuns, P&& prepare, F&& run)
+	{
+		float best = 0.0f;
+		for (unsigned int r = 0u; r < nRuns; r++)
+		{
+			prepare();
+			TeslaTimer<float> timer;
+			run();
+			const float time = timer.Mark();
+			best = r == 0u ? time : std::min(best, time);
+		}
+		return best;
+	}
+	template<typename F>
+	float BestOf(unsigned int nRuns, F&& run)
+	{
+		return BestOf(nRuns, []() {}, run);
+	}
+	// Calls fn(level) with the SIMD kernels forced down to every level the CPU supports, from
+	// Level::None up, then restores the level they were using
+	template<typename F>
+	void ForEachLevel(F&& fn)
+	{
+		const Simd::Level initial = Simd::GetLevel();
+		for (const Simd::Level level : { Simd::Level::None, Simd::Level::SSE2, Simd::Level::AVX2 })
+		{
+			if (level <= Simd::GetSupportedLevel())
+			{
+				Simd::SetLevel(level);
+				fn(level);
+			}
+		}
+		Simd::SetLevel(initial);
+	}
+
+	// SurfaceBenchmarks.cpp
+	int Clear();
+	int Effect(int nWorkers, unsigned int nFrames);
+	int Decode(const std::vector<std::string>& filenames, unsigned int nRuns);
+	int Blit(unsigned int nRuns);
+	int Sprites(unsigned int nFrames);
+	int Text(const std::string& fontFile, unsigned int nFrames);
+	int Fill(unsigned int nFrames);
+
+	// RenderBenchmarks.cpp
+	int Raster(const std::string& filename, unsigned int nFrames);
+	int CheckWatertight();
+	int Lines(unsigned int nFrames);
+	int Transform(unsigned int nRuns);
+
+	// MeshBenchmarks.cpp
+	int OBJ(const std::string& filename, unsigned int nRuns);
+	int MeshLoad(const std::string& filename, unsigned int nRuns);
+	int CheckOBJCorpus(const std::string& folder);
+}
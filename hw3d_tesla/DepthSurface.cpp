@@ -0,0 +1,183 @@
+#include "DepthSurface.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace
+{
+	constexpr unsigned int CountBlocks(unsigned int pixels) noexcept
+	{
+		return (pixels + DepthSurface::BlockSize - 1u) / DepthSurface::BlockSize;
+	}
+
+	constexpr unsigned int AlignPitch(unsigned int pitch) noexcept
+	{
+		constexpr unsigned int floatsPerAlignment = DepthSurface::Alignment / sizeof(float);
+		return (pitch + floatsPerAlignment - 1u) / floatsPerAlignment * floatsPerAlignment;
+	}
+
+	static_assert(DepthSurface::Alignment / sizeof(float) % DepthSurface::BlockSize == 0u, "Rows must hold whole blocks");
+
+	unsigned int ToBits(float value) noexcept
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+}
+
+DepthSurface::DepthSurface(unsigned int width, unsigned int height)
+	:
+	width(width),
+	height(height),
+	pitch(AlignPitch(width)),
+	nBlocksX(CountBlocks(width)),
+	nBlocksY(CountBlocks(height)),
+	pBuffer(Allocate((size_t)pitch * nBlocksY * BlockSize)),
+	pBlockMin(Allocate((size_t)nBlocksX * nBlocksY)),
+	pBlockMax(Allocate((size_t)nBlocksX * nBlocksY))
+{
+	Clear();
+}
+
+DepthSurface::DepthSurface(DepthSurface&& source) noexcept
+	:
+	width(source.width),
+	height(source.height),
+	pitch(source.pitch),
+	nBlocksX(source.nBlocksX),
+	nBlocksY(source.nBlocksY),
+	pBuffer(std::move(source.pBuffer)),
+	pBlockMin(std::move(source.pBlockMin)),
+	pBlockMax(std::move(source.pBlockMax))
+{
+	source.width = 0u;
+	source.height = 0u;
+	source.nBlocksX = 0u;
+	source.nBlocksY = 0u;
+}
+
+DepthSurface& DepthSurface::operator=(DepthSurface&& donor) noexcept
+{
+	width = donor.width;
+	height = donor.height;
+	pitch = donor.pitch;
+	nBlocksX = donor.nBlocksX;
+	nBlocksY = donor.nBlocksY;
+	pBuffer = std::move(donor.pBuffer);
+	pBlockMin = std::move(donor.pBlockMin);
+	pBlockMax = std::move(donor.pBlockMax);
+	donor.width = 0u;
+	donor.height = 0u;
+	donor.nBlocksX = 0u;
+	donor.nBlocksY = 0u;
+	return *this;
+}
+
+void DepthSurface::Clear(float value) noexcept
+{
+	// The padding is cleared too: whole blocks can be read without looking at garbage
+	const unsigned int bits = ToBits(value);
+	Simd::Fill32(reinterpret_cast<unsigned int*>(pBuffer.get()), (size_t)pitch * nBlocksY * BlockSize, bits);
+	Simd::Fill32Cached(reinterpret_cast<unsigned int*>(pBlockMin.get()), (size_t)nBlocksX * nBlocksY, bits);
+	Simd::Fill32Cached(reinterpret_cast<unsigned int*>(pBlockMax.get()), (size_t)nBlocksX * nBlocksY, bits);
+}
+
+unsigned int DepthSurface::GetWidth() const noexcept
+{
+	return width;
+}
+
+unsigned int DepthSurface::GetHeight() const noexcept
+{
+	return height;
+}
+
+unsigned int DepthSurface::GetPitch() const noexcept
+{
+	return pitch;
+}
+
+float* DepthSurface::GetRowPtr(unsigned int y) const noexcept
+{
+	assert(y < nBlocksY * BlockSize);
+	return &pBuffer[(size_t)pitch * y];
+}
+
+float DepthSurface::GetDepth(unsigned int x, unsigned int y) const noexcept
+{
+	assert(x < width);
+	assert(y < height);
+	return pBuffer[x + (size_t)pitch * y];
+}
+
+unsigned int DepthSurface::GetBlocksX() const noexcept
+{
+	return nBlocksX;
+}
+
+unsigned int DepthSurface::GetBlocksY() const noexcept
+{
+	return nBlocksY;
+}
+
+float DepthSurface::GetBlockMin(unsigned int bx, unsigned int by) const noexcept
+{
+	assert(bx < nBlocksX);
+	assert(by < nBlocksY);
+	return pBlockMin[bx + (size_t)nBlocksX * by];
+}
+
+float DepthSurface::GetBlockMax(unsigned int bx, unsigned int by) const noexcept
+{
+	assert(bx < nBlocksX);
+	assert(by < nBlocksY);
+	return pBlockMax[bx + (size_t)nBlocksX * by];
+}
+
+float* DepthSurface::GetBlockMinRow(unsigned int by) const noexcept
+{
+	assert(by < nBlocksY);
+	return &pBlockMin[(size_t)nBlocksX * by];
+}
+
+float* DepthSurface::GetBlockMaxRow(unsigned int by) const noexcept
+{
+	assert(by < nBlocksY);
+	return &pBlockMax[(size_t)nBlocksX * by];
+}
+
+void DepthSurface::UpdateBlock(unsigned int bx, unsigned int by) noexcept
+{
+	assert(bx < nBlocksX);
+	assert(by < nBlocksY);
+	// Only the pixels inside the surface count, the padding keeps the value of the last Clear
+	const unsigned int nCols = std::min(BlockSize, width - bx * BlockSize);
+	const unsigned int nRows = std::min(BlockSize, height - by * BlockSize);
+	const float* pRow = &pBuffer[(size_t)pitch * by * BlockSize + bx * BlockSize];
+	float lo = pRow[0];
+	float hi = pRow[0];
+	for (unsigned int r = 0u; r < nRows; r++, pRow += pitch)
+	{
+		for (unsigned int c = 0u; c < nCols; c++)
+		{
+			lo = std::min(lo, pRow[c]);
+			hi = std::max(hi, pRow[c]);
+		}
+	}
+	pBlockMin[bx + (size_t)nBlocksX * by] = lo;
+	pBlockMax[bx + (size_t)nBlocksX * by] = hi;
+}
+
+std::unique_ptr<float[], DepthSurface::AlignedDeleter> DepthSurface::Allocate(size_t count)
+{
+	float* p = static_cast<float*>(::operator new[](std::max(count, (size_t)1u) * sizeof(float), std::align_val_t(Alignment)));
+	return std::unique_ptr<float[], AlignedDeleter>(p);
+}
+
+void DepthSurface::AlignedDeleter::operator()(float* p) const noexcept
+{
+	::operator delete[](p, std::align_val_t(Alignment));
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <memory>
+
+// Depth buffer companion of a Surface: one float per pixel, from 0 (near plane) to 1 (far plane).
+// On top of the pixels it keeps the depth range of every BlockSize x BlockSize block (a coarse
+// hierarchical Z), so that a rasterizer can tell whether a triangle is hidden in a block, or in
+// front of everything there, without reading the pixels.
+// The ranges are conservative: the pixels of a block are always inside [min, max], but writes
+// through the raw pointers only have to keep it that way (lower the min, and leave the max or
+// recompute it with UpdateBlock), so a range can be wider than the pixels it holds.
+class DepthSurface
+{
+public:
+	// Side of the blocks of the hierarchy (in pixels)
+	static constexpr unsigned int BlockSize = 4u;
+	// Rows start on this boundary (in bytes), same as Surface
+	static constexpr unsigned int Alignment = 64u;
+public:
+	// The pixels are cleared to the far plane
+	DepthSurface(unsigned int width, unsigned int height);
+	DepthSurface(DepthSurface&& source) noexcept;
+	DepthSurface(const DepthSurface&) = delete;
+	DepthSurface& operator = (DepthSurface&& donor) noexcept;
+	DepthSurface& operator = (const DepthSurface&) = delete;
+	~DepthSurface() = default;
+	// Set every pixel, and every block range, to value
+	void Clear(float value = 1.0f) noexcept;
+	unsigned int GetWidth() const noexcept;
+	unsigned int GetHeight() const noexcept;
+	// Distance between two rows (in floats). Rows are padded up to a multiple of BlockSize
+	// pixels, and there are rows up to a multiple of BlockSize: a block can always be read whole
+	unsigned int GetPitch() const noexcept;
+	float* GetRowPtr(unsigned int y) const noexcept;
+	float GetDepth(unsigned int x, unsigned int y) const noexcept;
+	// Number of blocks in a row and in a column
+	unsigned int GetBlocksX() const noexcept;
+	unsigned int GetBlocksY() const noexcept;
+	// Range of block (bx, by), which holds pixels [bx * BlockSize, (bx + 1) * BlockSize) x ...
+	float GetBlockMin(unsigned int bx, unsigned int by) const noexcept;
+	float GetBlockMax(unsigned int bx, unsigned int by) const noexcept;
+	// Block ranges of block row by (GetBlocksX floats each), for the rasterizers
+	float* GetBlockMinRow(unsigned int by) const noexcept;
+	float* GetBlockMaxRow(unsigned int by) const noexcept;
+	// Shrink the range of block (bx, by) to the pixels it holds
+	void UpdateBlock(unsigned int bx, unsigned int by) noexcept;
+private:
+	struct AlignedDeleter
+	{
+		void operator()(float* p) const noexcept;
+	};
+	static std::unique_ptr<float[], AlignedDeleter> Allocate(size_t count);
+private:
+	unsigned int width;
+	unsigned int height;
+	unsigned int pitch;
+	unsigned int nBlocksX;
+	unsigned int nBlocksY;
+	// pitch * nBlocksY * BlockSize pixels
+	std::unique_ptr<float[], AlignedDeleter> pBuffer;
+	// nBlocksX * nBlocksY each
+	std::unique_ptr<float[], AlignedDeleter> pBlockMin;
+	std::unique_ptr<float[], AlignedDeleter> pBlockMax;
+};
@@ -0,0 +1,119 @@
+#include "Font.h"
+#include <atomic>
+#include <cmath>
+#include <sstream>
+// imgui compiles its own static copy, this one is private to the Font as well
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imgui/imstb_truetype.h"
+
+Font::Font(const std::string& filename)
+	:
+	file(filename),
+	pInfo(std::make_unique<stbtt_fontinfo>())
+{
+	static std::atomic<unsigned int> nextId = 0u;
+	id = nextId++;
+
+	// stbtt trusts the tables it finds, but at least the header has to be there
+	const unsigned char* pData = file.GetData();
+	const int offset = file.GetSize() >= 12u ? stbtt_GetFontOffsetForIndex(pData, 0) : -1;
+	if (offset < 0 || !stbtt_InitFont(pInfo.get(), pData, offset))
+	{
+		throw Exception(__LINE__, __FILE__, "Loading font [" + filename + "]: not a TrueType font.");
+	}
+	hasKerning = pInfo->kern != 0 || pInfo->gpos != 0;
+	for (int c = 0; c < 128; c++)
+	{
+		asciiGlyphs[c] = stbtt_FindGlyphIndex(pInfo.get(), c);
+	}
+}
+
+Font::~Font() = default;
+
+unsigned int Font::GetId() const noexcept
+{
+	return id;
+}
+
+int Font::GetGlyphIndex(unsigned int codepoint) const noexcept
+{
+	if (codepoint < 128u)
+	{
+		return asciiGlyphs[codepoint];
+	}
+	return stbtt_FindGlyphIndex(pInfo.get(), (int)codepoint);
+}
+
+float Font::GetScale(unsigned int pixelHeight) const noexcept
+{
+	return stbtt_ScaleForPixelHeight(pInfo.get(), (float)pixelHeight);
+}
+
+Font::LineMetrics Font::GetLineMetrics(float scale) const noexcept
+{
+	int ascent;
+	int descent;
+	int lineGap;
+	stbtt_GetFontVMetrics(pInfo.get(), &ascent, &descent, &lineGap);
+	// Font units have y going up
+	const int top = -(int)std::ceil((float)ascent * scale);
+	const int bottom = -(int)std::floor((float)descent * scale);
+	return { top, bottom, bottom - top + (int)std::lround((float)lineGap * scale) };
+}
+
+int Font::GetAdvance(int glyph) const noexcept
+{
+	int advance;
+	int leftSideBearing;
+	stbtt_GetGlyphHMetrics(pInfo.get(), glyph, &advance, &leftSideBearing);
+	return advance;
+}
+
+int Font::GetKerning(int glyph1, int glyph2) const noexcept
+{
+	return stbtt_GetGlyphKernAdvance(pInfo.get(), glyph1, glyph2);
+}
+
+bool Font::HasKerning() const noexcept
+{
+	return hasKerning;
+}
+
+Font::GlyphBox Font::GetGlyphBox(int glyph, float scale) const noexcept
+{
+	GlyphBox box;
+	stbtt_GetGlyphBitmapBox(pInfo.get(), glyph, scale, scale, &box.x0, &box.y0, &box.x1, &box.y1);
+	return box;
+}
+
+void Font::RasterizeGlyph(int glyph, float scale, unsigned char* pDst, int width, int height, int stride) const noexcept
+{
+	stbtt_MakeGlyphBitmap(pInfo.get(), pDst, width, height, stride, scale, scale, glyph);
+}
+
+Font::Exception::Exception(int line, const char* file, std::string note) noexcept
+	:
+	TeslaException(line, file),
+	note(std::move(note))
+{
+}
+
+const char* Font::Exception::what() const noexcept
+{
+	std::ostringstream oss;
+	oss << TeslaException::what() << std::endl
+		<< "[Note] " << GetNote();
+	whatBuffer = oss.str();
+	return whatBuffer.c_str();
+}
+
+const char* Font::Exception::GetType() const noexcept
+{
+	return "Tesla Font Exception!";
+}
+
+const std::string& Font::Exception::GetNote() const noexcept
+{
+	return note;
+}
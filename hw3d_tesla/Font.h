@@ -0,0 +1,63 @@
+#pragma once
+#include "MappedFile.h"
+#include <memory>
+#include <string>
+
+struct stbtt_fontinfo;
+
+// TrueType font read in place from a mapped .ttf file (rasterized by imstb_truetype)
+class Font
+{
+public:
+	class Exception : public TeslaException
+	{
+	public:
+		Exception(int line, const char* file, std::string note) noexcept;
+		virtual const char* what() const noexcept override;
+		virtual const char* GetType() const noexcept override;
+		const std::string& GetNote() const noexcept;
+	private:
+		std::string note;
+	};
+	// Vertical metrics at a given pixel height (in pixels, y going down from the baseline)
+	struct LineMetrics
+	{
+		int ascent;      // top of the tallest glyphs (negative)
+		int descent;     // bottom of the lowest glyphs (positive)
+		int lineAdvance; // distance between two baselines
+	};
+	// Pixel rectangle of a rasterized glyph, relative to its origin on the baseline
+	struct GlyphBox
+	{
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+	};
+public:
+	Font(const std::string& filename);
+	Font(const Font&) = delete;
+	Font& operator = (const Font&) = delete;
+	~Font();
+	// Unique among all the Fonts created so far (used as a cache key)
+	unsigned int GetId() const noexcept;
+	// Glyph of a unicode codepoint, 0 (the missing glyph) if the font doesn't have it
+	int GetGlyphIndex(unsigned int codepoint) const noexcept;
+	// Scale from font units to pixels so that ascent - descent spans pixelHeight
+	float GetScale(unsigned int pixelHeight) const noexcept;
+	LineMetrics GetLineMetrics(float scale) const noexcept;
+	// Horizontal pen advance of a glyph, and the kerning to add between two glyphs (in font units)
+	int GetAdvance(int glyph) const noexcept;
+	int GetKerning(int glyph1, int glyph2) const noexcept;
+	bool HasKerning() const noexcept;
+	GlyphBox GetGlyphBox(int glyph, float scale) const noexcept;
+	// Write the glyph coverage (0-255) into a GetGlyphBox sized bitmap
+	void RasterizeGlyph(int glyph, float scale, unsigned char* pDst, int width, int height, int stride) const noexcept;
+private:
+	MappedFile file;
+	std::unique_ptr<stbtt_fontinfo> pInfo;
+	unsigned int id;
+	bool hasKerning;
+	// Glyphs of the ASCII codepoints, looked up once
+	int asciiGlyphs[128];
+};
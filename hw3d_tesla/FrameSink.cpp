@@ -0,0 +1,80 @@
+#include "FrameSink.h"
+#include <sstream>
+#include <iomanip>
+#include <cassert>
+#include <thread>
+
+void DiscardSink::Consume(const Surface&)
+{
+}
+
+RingSink::RingSink(unsigned int width, unsigned int height, unsigned int capacity)
+{
+	assert(capacity > 0u && "The ring needs room for at least one frame");
+	// All the frames are allocated upfront, so Consume is just a copy
+	frames.reserve(capacity);
+	for (unsigned int i = 0u; i < capacity; i++)
+	{
+		frames.emplace_back(width, height);
+	}
+}
+
+void RingSink::Consume(const Surface& frame)
+{
+	frames[next].Copy(frame);
+	next = (next + 1u) % GetCapacity();
+	if (size < GetCapacity())
+	{
+		size++;
+	}
+}
+
+unsigned int RingSink::GetSize() const noexcept
+{
+	return size;
+}
+
+unsigned int RingSink::GetCapacity() const noexcept
+{
+	return (unsigned int)frames.size();
+}
+
+const Surface& RingSink::GetFrame(unsigned int age) const noexcept
+{
+	assert(age < size && "This frame was never stored (or it was overwritten)");
+	return frames[(next + GetCapacity() - 1u - age) % GetCapacity()];
+}
+
+LatencySink::LatencySink(std::chrono::microseconds latency)
+	:
+	latency(latency)
+{}
+
+void LatencySink::Consume(const Surface&)
+{
+	std::this_thread::sleep_for(latency);
+}
+
+FileSink::FileSink(std::string prefix, ImageEncoder::Format format, unsigned int nThreads)
+	:
+	prefix(std::move(prefix)),
+	extension(format == ImageEncoder::Format::PNG ? ".png" : format == ImageEncoder::Format::QOI ? ".qoi" : ".bmp"),
+	writer(4u, ImageWriter::OverflowPolicy::Block, nThreads)
+{}
+
+void FileSink::Consume(const Surface& frame)
+{
+	std::stringstream ss;
+	ss << prefix << std::setw(5) << std::setfill('0') << frameIndex++ << extension;
+	writer.Submit(frame, ss.str());
+}
+
+const ImageWriter& FileSink::GetWriter() const noexcept
+{
+	return writer;
+}
+
+ImageWriter& FileSink::GetWriter() noexcept
+{
+	return writer;
+}
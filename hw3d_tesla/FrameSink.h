@@ -0,0 +1,65 @@
+#pragma once
+#include "Surface.h"
+#include "ImageWriter.h"
+#include <string>
+#include <vector>
+#include <chrono>
+
+// Receives every finished frame from a headless Graphics
+class FrameSink
+{
+public:
+	virtual ~FrameSink() = default;
+	// Called once per frame with the composed framebuffer
+	virtual void Consume(const Surface& frame) = 0;
+};
+
+// Throws every frame away (pure CPU benchmarking)
+class DiscardSink : public FrameSink
+{
+public:
+	void Consume(const Surface& frame) override;
+};
+
+// Keeps a copy of the last N frames in memory
+class RingSink : public FrameSink
+{
+public:
+	RingSink(unsigned int width, unsigned int height, unsigned int capacity = 4u);
+	void Consume(const Surface& frame) override;
+	// Number of frames currently stored
+	unsigned int GetSize() const noexcept;
+	unsigned int GetCapacity() const noexcept;
+	// Get a stored frame, 0 being the most recent one
+	const Surface& GetFrame(unsigned int age) const noexcept;
+private:
+	std::vector<Surface> frames;
+	unsigned int next = 0u;
+	unsigned int size = 0u;
+};
+
+// Mock present stage: takes a fixed time per frame, like a blocking upload + Present would
+class LatencySink : public FrameSink
+{
+public:
+	LatencySink(std::chrono::microseconds latency);
+	void Consume(const Surface& frame) override;
+private:
+	std::chrono::microseconds latency;
+};
+
+// Writes every frame to <prefix>NNNNN.bmp (or .png, .qoi), encoded on background threads.
+// Consume blocks when the writers fall behind, so no frame is lost
+class FileSink : public FrameSink
+{
+public:
+	FileSink(std::string prefix, ImageEncoder::Format format = ImageEncoder::Format::BMP, unsigned int nThreads = 1u);
+	void Consume(const Surface& frame) override;
+	const ImageWriter& GetWriter() const noexcept;
+	ImageWriter& GetWriter() noexcept;
+private:
+	std::string prefix;
+	const char* extension;
+	unsigned int frameIndex = 0u;
+	ImageWriter writer;
+};
@@ -1,4 +1,5 @@
 #include "Game.h"
+#ifndef TESLA_HEADLESS
 #include "imgui/imgui.h"
 
 Game::Game()
@@ -7,6 +8,18 @@ Game::Game()
 	gfx(wnd.GetHwnd())
 {
 }
+#else
+Game::Game(std::unique_ptr<FrameSink> pSink)
+	:
+	gfx(std::move(pSink))
+{
+}
+
+Graphics& Game::GetGraphics() noexcept
+{
+	return gfx;
+}
+#endif
 
 void Game::Go()
 {
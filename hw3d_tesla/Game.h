@@ -1,11 +1,20 @@
 #pragma once
+#ifndef TESLA_HEADLESS
 #include "Window.h"
 #include "ImGuiManager.h"
+#else
+#include "Graphics.h"
+#endif
 
 class Game
 {
 public:
+#ifndef TESLA_HEADLESS
 	Game();
+#else
+	Game(std::unique_ptr<FrameSink> pSink = std::make_unique<DiscardSink>());
+	Graphics& GetGraphics() noexcept;
+#endif
 	Game(const Game&) = delete;
 	Game& operator = (const Game&) = delete;
 	void Go();
@@ -16,8 +25,10 @@ private:
 	/*******User Functions*********/
 	/******************************/
 private:
+#ifndef TESLA_HEADLESS
 	ImGuiManager imgui;
 	Window wnd;
+#endif
 	Graphics gfx;
 	/******************************/
 	/*******User Variables*********/
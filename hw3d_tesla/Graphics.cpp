@@ -1,4 +1,8 @@
 #include "Graphics.h"
+#include <algorithm>
+#include <cassert>
+
+#ifndef TESLA_HEADLESS
 #include "dxerr.h"
 #include "imgui\imgui_impl_dx11.h"
 #include "imgui\imgui_impl_win32.h"
@@ -207,7 +211,7 @@ float4 main(float2 tc : TexCoord) : SV_Target\
 	texDesc.MiscFlags            = 0u;
 	D3D11_SUBRESOURCE_DATA srd   = {};
 	srd.pSysMem                  = pBuffer.GetBufferPtrConst();
-	srd.SysMemPitch              = ScreenWidth * sizeof(Color);
+	srd.SysMemPitch              = pBuffer.GetRowPitch();
 	GFX_THROW_INFO(pDevice->CreateTexture2D(&texDesc, &srd, &pTexture));
 
 	// Creation of the view on the texture
@@ -254,17 +258,14 @@ void Graphics::UpdateFrameStatistics() noexcept
 	ss.precision(3);
 	ss << std::fixed << 1000.0f / frame_rate;
 	ss.precision(0);
-	ss << std::fixed << " ms/frame (" << frame_rate << " FPS)] (" << ScreenWidth << "x" << ScreenHeight << ")";
+	ss << std::fixed << " ms/frame (" << frame_rate << " FPS)] (" << ScreenWidth << "x" << ScreenHeight << ")"
+		<< " upload " << lastUploadSize / 1024u << " KB";
 	statsInfo = ss.str();
 }
 
-std::string Graphics::GetFrameStatistics() const noexcept
-{
-	return statsInfo;
-}
-
 Graphics::~Graphics()
 {
+	DisablePipelining();
 	ImGui_ImplDX11_Shutdown();
 }
 
@@ -274,6 +275,10 @@ void Graphics::BeginFrame(bool clear, Color clearColor)
 	{
 		Clear(clearColor);
 	}
+	else
+	{
+		RestoreLastFrame();
+	}
 	// We always do an ImGui NewFrame because of the useful framerate counter 
 	ImGui_ImplDX11_NewFrame();
 	ImGui_ImplWin32_NewFrame();
@@ -282,12 +287,24 @@ void Graphics::BeginFrame(bool clear, Color clearColor)
 
 void Graphics::EndFrame() 
 {
-	HRESULT hr;
+	if (pPipeline)
+	{
+		// Close the ImGui frame anyway, its draw data can't cross threads
+		ImGui::Render();
+		PublishFrame();
+		UpdateFrameStatistics();
+		return;
+	}
 
+	// Update the framebuffer stored in the GPU memory with the regions of pBuffer that changed
+	// (the statistics report the size of this frame's upload)
+	CollectUploadRects();
 	UpdateFrameStatistics();
-
-	// Update the framebuffer stored in the GPU memory with our color pBuffer 
-	GFX_THROW_INFO_ONLY(pContext->UpdateSubresource(pTexture.Get(), 0u, nullptr, pBuffer.GetBufferPtrConst(), (UINT)pBuffer.GetRowPitch(), 0u));
+	for (const auto& r : uploadRects)
+	{
+		const D3D11_BOX box = { r.left, r.top, 0u, r.right, r.bottom, 1u };
+		GFX_THROW_INFO_ONLY(pContext->UpdateSubresource(pTexture.Get(), 0u, &box, pBuffer.GetRowPtr(r.top) + r.left, (UINT)pBuffer.GetRowPitch(), 0u));
+	}
 
 	// Draw the CPU Frame Buffer
 	GFX_THROW_INFO_ONLY(pContext->Draw(6u, 0u));
@@ -299,6 +316,21 @@ void Graphics::EndFrame()
 		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 	}
 
+	PresentSwapChain();
+	presentedFrames++;
+}
+
+void Graphics::PresentFrame(const Surface& frame)
+{
+	// The whole frame: the dirty flags of a pipelined frame don't match what the texture holds
+	GFX_THROW_INFO_ONLY(pContext->UpdateSubresource(pTexture.Get(), 0u, nullptr, frame.GetBufferPtrConst(), (UINT)frame.GetRowPitch(), 0u));
+	GFX_THROW_INFO_ONLY(pContext->Draw(6u, 0u));
+	PresentSwapChain();
+}
+
+void Graphics::PresentSwapChain()
+{
+	HRESULT hr;
 #ifndef NDEBUG
 	infoManager.Set();
 #endif
@@ -315,6 +347,55 @@ void Graphics::EndFrame()
 	}
 }
 
+#endif
+
+std::string Graphics::GetFrameStatistics() const noexcept
+{
+	return statsInfo;
+}
+
+size_t Graphics::GetLastUploadSize() const noexcept
+{
+	return lastUploadSize;
+}
+
+unsigned long long Graphics::GetTotalUploadSize() const noexcept
+{
+	return totalUploadSize;
+}
+
+const std::vector<Surface::Rect>& Graphics::GetLastUploadRects() const noexcept
+{
+	return uploadRects;
+}
+
+void Graphics::CollectUploadRects()
+{
+	pBuffer.GetDirtyRects(uploadRects);
+	pBuffer.ClearDirty();
+
+	// Every UpdateSubresource has a fixed cost, too many small boxes are worse than a big one
+	if (uploadRects.size() > MaxUploadRects)
+	{
+		Surface::Rect bounds = uploadRects.front();
+		for (const auto& r : uploadRects)
+		{
+			bounds.left   = std::min(bounds.left, r.left);
+			bounds.top    = std::min(bounds.top, r.top);
+			bounds.right  = std::max(bounds.right, r.right);
+			bounds.bottom = std::max(bounds.bottom, r.bottom);
+		}
+		uploadRects.assign(1u, bounds);
+	}
+
+	lastUploadSize = 0u;
+	for (const auto& r : uploadRects)
+	{
+		lastUploadSize += (size_t)(r.right - r.left) * (r.bottom - r.top) * sizeof(Color);
+	}
+	totalUploadSize += lastUploadSize;
+}
+
 void Graphics::Clear(Color c) noexcept
 {
 	pBuffer.Clear(c);
@@ -330,7 +411,7 @@ void Graphics::DisableVSync() noexcept
 	syncInterval = 0u;
 }
 
-void Graphics::SetVSyncInterval(const UINT verticalSyncInterval) noexcept
+void Graphics::SetVSyncInterval(const unsigned int verticalSyncInterval) noexcept
 {
 	syncInterval = verticalSyncInterval;
 }
@@ -355,8 +436,14 @@ bool Graphics::IsImGuiEnabled() const noexcept
 	return imGuiEnabled;
 }
 
-Color* Graphics::GetFramebufferPtr() const noexcept
+Surface& Graphics::GetFramebuffer() noexcept
 {
+	return pBuffer;
+}
+
+Color* Graphics::GetFramebufferPtr() noexcept
+{
+	pBuffer.MarkAllDirty();
 	return pBuffer.GetBufferPtr();
 }
 
@@ -365,6 +452,11 @@ const Color* Graphics::GetFramebufferPtrConst() const noexcept
 	return pBuffer.GetBufferPtrConst();
 }
 
+unsigned int Graphics::GetFramebufferPitch() const noexcept
+{
+	return pBuffer.GetPitch();
+}
+
 void Graphics::PutPixel(const std::pair<unsigned int, unsigned int>& p, Color c)
 {
 	PutPixel(p.first, p.second, c);
@@ -380,6 +472,154 @@ void Graphics::PutPixel(unsigned int x, unsigned int y, unsigned int r, unsigned
 	PutPixel(x, y, Color(r, g, b));
 }
 
+void Graphics::ParallelForTiles(Surface& surface, unsigned int tileSize, const std::function<void(SurfaceTile&)>& fn)
+{
+	assert(tileSize > 0u);
+	const unsigned int nTilesX = (surface.GetWidth() + tileSize - 1u) / tileSize;
+	const unsigned int nTilesY = (surface.GetHeight() + tileSize - 1u) / tileSize;
+	threadPool.ParallelFor(nTilesX * nTilesY, [&](unsigned int i)
+	{
+		const unsigned int left = (i % nTilesX) * tileSize;
+		const unsigned int top  = (i / nTilesX) * tileSize;
+		SurfaceTile tile(surface, { left, top, std::min(left + tileSize, surface.GetWidth()), std::min(top + tileSize, surface.GetHeight()) });
+		fn(tile);
+	});
+	// Done here and not per tile: neighbouring tiles may share a dirty flag
+	surface.MarkAllDirty();
+}
+
+void Graphics::ParallelForTiles(unsigned int tileSize, const std::function<void(SurfaceTile&)>& fn)
+{
+	ParallelForTiles(pBuffer, tileSize, fn);
+}
+
+ThreadPool& Graphics::GetThreadPool() noexcept
+{
+	return threadPool;
+}
+
+bool Graphics::SaveScreenshot(const std::string& filename)
+{
+	return GetScreenshotWriter().Submit(pBuffer, filename);
+}
+
+ImageWriter& Graphics::GetScreenshotWriter()
+{
+	if (!pScreenshotWriter)
+	{
+		pScreenshotWriter = std::make_unique<ImageWriter>();
+	}
+	return *pScreenshotWriter;
+}
+
+void Graphics::EnablePipelining(TripleBufferMode mode)
+{
+	if (pPipeline)
+	{
+		return;
+	}
+	// The back slot gets swapped with pBuffer at every EndFrame
+	pPipeline = std::make_unique<TripleBuffer<Surface>>(
+		Surface(ScreenWidth, ScreenHeight),
+		Surface(ScreenWidth, ScreenHeight),
+		Surface(ScreenWidth, ScreenHeight),
+		mode
+	);
+	pLastPublished = nullptr;
+	presentThread = std::thread(&Graphics::PresentLoop, this);
+}
+
+void Graphics::DisablePipelining()
+{
+	if (!pPipeline)
+	{
+		return;
+	}
+	// The present thread still shows the last published frame before leaving
+	pPipeline->Cancel();
+	presentThread.join();
+	if (pLastPublished)
+	{
+		pBuffer.Copy(*pLastPublished);
+	}
+	pLastPublished = nullptr;
+	pPipeline.reset();
+}
+
+bool Graphics::IsPipeliningEnabled() const noexcept
+{
+	return (bool)pPipeline;
+}
+
+unsigned long long Graphics::GetPresentedFrameCount() const noexcept
+{
+	return presentedFrames.load();
+}
+
+unsigned long long Graphics::GetDroppedFrameCount() const noexcept
+{
+	return droppedFrames;
+}
+
+void Graphics::RestoreLastFrame()
+{
+	// The pipelined compose buffer holds a frame from a while ago: BeginFrame(false)
+	// must keep drawing on top of the last frame, like in the serial case
+	if (pPipeline && pLastPublished)
+	{
+		pBuffer.Copy(*pLastPublished);
+	}
+}
+
+void Graphics::PublishFrame()
+{
+	{
+		std::lock_guard<std::mutex> lock(presentExceptionMutex);
+		if (pPresentException)
+		{
+			std::exception_ptr e = nullptr;
+			std::swap(e, pPresentException);
+			std::rethrow_exception(e);
+		}
+	}
+
+	// The present thread uploads whole frames
+	uploadRects.assign(1u, { 0u, 0u, pBuffer.GetWidth(), pBuffer.GetHeight() });
+	lastUploadSize = (size_t)pBuffer.GetWidth() * pBuffer.GetHeight() * sizeof(Color);
+	totalUploadSize += lastUploadSize;
+	pBuffer.ClearDirty();
+
+	// Cheap: swapping Surfaces only swaps their buffer pointers
+	std::swap(pBuffer, pPipeline->GetBack());
+	pLastPublished = &pPipeline->GetBack();
+	if (pPipeline->Publish())
+	{
+		droppedFrames++;
+	}
+}
+
+void Graphics::PresentLoop()
+{
+	while (pPipeline->AcquireFront())
+	{
+		try
+		{
+			PresentFrame(pPipeline->GetFront());
+			presentedFrames++;
+		}
+		catch (...)
+		{
+			// Rethrown on the main thread by the next EndFrame
+			std::lock_guard<std::mutex> lock(presentExceptionMutex);
+			if (!pPresentException)
+			{
+				pPresentException = std::current_exception();
+			}
+		}
+	}
+}
+
+#ifndef TESLA_HEADLESS
 Graphics::HrException::HrException(int line, const char* file, HRESULT hr, std::vector<std::string> infoMsgs) noexcept
 	:
 	Exception(line, file),
@@ -480,4 +720,5 @@ const char* Graphics::InfoException::GetType() const noexcept
 std::string Graphics::InfoException::GetErrorInfo() const noexcept
 {
 	return info;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -1,11 +1,22 @@
 #pragma once
-#include "TeslaWin.h"
 #include "TeslaException.h"
-#include "DxgiInfoManager.h"
 #include "Surface.h"
+#include "SurfaceTile.h"
+#include "ThreadPool.h"
+#include "TripleBuffer.h"
+#include "ImageWriter.h"
+#include <sstream>
+#ifndef TESLA_HEADLESS
+#include "TeslaWin.h"
+#include "DxgiInfoManager.h"
 #include <d3d11.h>
 #include <wrl.h>
-#include <sstream>
+#else
+#include "FrameSink.h"
+#include "TeslaTimer.h"
+#include <memory>
+#endif
+#include <vector>
 
 class Graphics
 {
@@ -15,6 +26,7 @@ public:
 	{
 		using TeslaException::TeslaException;
 	};
+#ifndef TESLA_HEADLESS
 	class HrException : public Exception
 	{
 	public:
@@ -47,8 +59,21 @@ public:
 	private:
 		std::string reason;
 	};
+#else
+	// Time spent in every headless frame (in seconds)
+	struct FrameTiming
+	{
+		float composeTime; // BeginFrame -> EndFrame
+		float sinkTime;    // time spent by the FrameSink
+	};
+#endif
 public:
+#ifndef TESLA_HEADLESS
 	Graphics(HWND hWnd);
+#else
+	// nWorkers: threads of the pool of ParallelForTiles besides the calling one
+	Graphics(std::unique_ptr<FrameSink> pSink = std::make_unique<DiscardSink>(), unsigned int nWorkers = ThreadPool::DefaultWorkerCount());
+#endif
 	Graphics(const Graphics&) = delete;
 	Graphics& operator = (const Graphics&) = delete;
 	~Graphics();
@@ -58,24 +83,72 @@ public:
 	void Clear(Color fillColor) noexcept;
 	void EnableVSync() noexcept;
 	void DisableVSync() noexcept;
-	void SetVSyncInterval(const UINT verticalSyncInterval) noexcept;
+	void SetVSyncInterval(const unsigned int verticalSyncInterval) noexcept;
 	bool IsVSyncEnabled() const noexcept;
 	void EnableImGui() noexcept;
 	void DisableImGui() noexcept;
 	bool IsImGuiEnabled() const noexcept;
-	Color* GetFramebufferPtr() const noexcept;
+	// Draw with the Surface methods (Blit, TextRenderer, ...): only what they touch gets uploaded
+	Surface& GetFramebuffer() noexcept;
+	// Writing through this pointer can't be tracked: the whole framebuffer gets uploaded
+	Color* GetFramebufferPtr() noexcept;
 	const Color* GetFramebufferPtrConst() const noexcept;
+	// Distance between two framebuffer rows (in pixels)
+	unsigned int GetFramebufferPitch() const noexcept;
 	void PutPixel(const std::pair<unsigned int, unsigned int>& p, Color c);
 	void PutPixel(unsigned int x, unsigned int y, Color c);
 	void PutPixel(unsigned int x, unsigned int y, unsigned int r, unsigned int g, unsigned int b);
+	// Split the surface in tileSize x tileSize tiles and run fn on all of them, spread over the
+	// thread pool. Tiles don't overlap; the whole surface is flagged as modified afterwards
+	void ParallelForTiles(Surface& surface, unsigned int tileSize, const std::function<void(SurfaceTile&)>& fn);
+	// Same as above, on the framebuffer
+	void ParallelForTiles(unsigned int tileSize, const std::function<void(SurfaceTile&)>& fn);
+	ThreadPool& GetThreadPool() noexcept;
+	// Snapshot the framebuffer as it is now (call it once the frame is drawn, before EndFrame),
+	// then encode and write it to a .bmp, .png or .qoi file in the background
+	bool SaveScreenshot(const std::string& filename);
+	// Queue depth and timings of the screenshots (the writer thread starts with the first one)
+	ImageWriter& GetScreenshotWriter();
 	std::string GetFrameStatistics() const noexcept;
+	// Bytes sent to the framebuffer texture by the last EndFrame and since the start
+	size_t GetLastUploadSize() const noexcept;
+	unsigned long long GetTotalUploadSize() const noexcept;
+	// Regions uploaded by the last EndFrame (recorded in the headless build too)
+	const std::vector<Surface::Rect>& GetLastUploadRects() const noexcept;
+	// Opt-in pipelining: EndFrame hands the frame to a present thread through a triple buffer and
+	// returns right away, so frame N+1 is composed while frame N is uploaded and presented.
+	// FIFO presents every frame (EndFrame waits when the present thread is a frame behind),
+	// Mailbox never waits and drops the frames the present thread had no time for.
+	// ImGui is not drawn while pipelining, the D3D context belongs to the present thread
+	void EnablePipelining(TripleBufferMode mode = TripleBufferMode::FIFO);
+	void DisablePipelining();
+	bool IsPipeliningEnabled() const noexcept;
+	// Frames that reached the screen (or the FrameSink), and frames composed but overwritten
+	// in the triple buffer before the present thread could pick them up (Mailbox mode only)
+	unsigned long long GetPresentedFrameCount() const noexcept;
+	unsigned long long GetDroppedFrameCount() const noexcept;
+#ifdef TESLA_HEADLESS
+	void SetFrameSink(std::unique_ptr<FrameSink> pSink) noexcept;
+	FrameSink& GetFrameSink() const noexcept;
+	const std::vector<FrameTiming>& GetFrameTimings() const noexcept;
+#endif
 private:
 	void UpdateFrameStatistics() noexcept;
+	void CollectUploadRects();
+	void RestoreLastFrame();
+	void PublishFrame();
+	void PresentLoop();
+	// Backend specific: upload and show a whole frame (runs on the present thread)
+	void PresentFrame(const Surface& frame);
 private:
 	bool imGuiEnabled = true;
-	UINT syncInterval = 1u;
+	unsigned int syncInterval = 1u;
 	std::string statsInfo;
 	std::string title = "Adrian Tesla DirectX Framework";
+	std::vector<Surface::Rect> uploadRects;
+	size_t lastUploadSize = 0u;
+	unsigned long long totalUploadSize = 0u;
+#ifndef TESLA_HEADLESS
 private:
 	Microsoft::WRL::ComPtr<ID3D11Device>           pDevice;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext>    pContext;
@@ -83,14 +156,34 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> pTargetView;
 	Microsoft::WRL::ComPtr<ID3D11Texture2D>        pTexture;
 	D3D11_MAPPED_SUBRESOURCE msr;
+private:
+	void PresentSwapChain();
 private:
 #ifndef NDEBUG
 	DxgiInfoManager infoManager;
 #endif
+#else
+private:
+	std::unique_ptr<FrameSink> pSink;
+	std::vector<FrameTiming> frameTimings;
+	TeslaTimer<float> frameTimer;
+#endif
 private:
 	Surface pBuffer;
+	ThreadPool threadPool;
+	std::unique_ptr<ImageWriter> pScreenshotWriter;
+private:
+	std::unique_ptr<TripleBuffer<Surface>> pPipeline;
+	const Surface* pLastPublished = nullptr;
+	std::thread presentThread;
+	std::atomic<unsigned long long> presentedFrames{ 0u };
+	unsigned long long droppedFrames = 0u;
+	std::mutex presentExceptionMutex;
+	std::exception_ptr pPresentException;
 public:
 	static constexpr unsigned int PixelSize    = 1u;
 	static constexpr unsigned int ScreenWidth  = 800u;
 	static constexpr unsigned int ScreenHeight = 600u;
+	// Above this many dirty rects a single box around all of them is uploaded
+	static constexpr unsigned int MaxUploadRects = 32u;
 };
\ No newline at end of file
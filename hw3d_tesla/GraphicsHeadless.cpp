@@ -0,0 +1,91 @@
+#include "Graphics.h"
+#include <cassert>
+
+#ifdef TESLA_HEADLESS
+// Headless backend: no window, no D3D11 device. The frame is composed in pBuffer
+// exactly like on the GPU path, then EndFrame hands it to the FrameSink.
+
+Graphics::Graphics(std::unique_ptr<FrameSink> pSink, unsigned int nWorkers)
+	:
+	pSink(std::move(pSink)),
+	pBuffer(ScreenWidth, ScreenHeight),
+	threadPool(nWorkers)
+{
+	// There is no ImGui context without a window
+	imGuiEnabled = false;
+}
+
+Graphics::~Graphics()
+{
+	DisablePipelining();
+}
+
+void Graphics::BeginFrame(bool clear, Color clearColor)
+{
+	frameTimer.Mark();
+	if (clear)
+	{
+		Clear(clearColor);
+	}
+	else
+	{
+		RestoreLastFrame();
+	}
+}
+
+void Graphics::EndFrame()
+{
+	FrameTiming timing;
+	timing.composeTime = frameTimer.Mark();
+	if (pPipeline)
+	{
+		// The sink runs on the present thread, here we only pay for the hand-off
+		PublishFrame();
+	}
+	else
+	{
+		// Nothing to upload, but the regions a GPU backend would send are recorded all the same
+		CollectUploadRects();
+		pSink->Consume(pBuffer);
+		presentedFrames++;
+	}
+	timing.sinkTime = frameTimer.Mark();
+	frameTimings.push_back(timing);
+
+	UpdateFrameStatistics();
+}
+
+void Graphics::UpdateFrameStatistics() noexcept
+{
+	const FrameTiming& last = frameTimings.back();
+	const float frameTime = last.composeTime + last.sinkTime;
+	std::stringstream ss;
+	ss.precision(3);
+	ss << std::fixed << 1000.0f * frameTime << " ms/frame (compose " << 1000.0f * last.composeTime
+		<< " ms, sink " << 1000.0f * last.sinkTime << " ms, upload " << lastUploadSize / 1024u << " KB)";
+	ss.precision(0);
+	ss << " (" << 1.0f / frameTime << " FPS) (" << ScreenWidth << "x" << ScreenHeight << ")";
+	statsInfo = ss.str();
+}
+
+void Graphics::PresentFrame(const Surface& frame)
+{
+	pSink->Consume(frame);
+}
+
+void Graphics::SetFrameSink(std::unique_ptr<FrameSink> pSink) noexcept
+{
+	assert(!pPipeline && "The present thread is using the sink, disable pipelining first");
+	this->pSink = std::move(pSink);
+}
+
+FrameSink& Graphics::GetFrameSink() const noexcept
+{
+	return *pSink;
+}
+
+const std::vector<Graphics::FrameTiming>& Graphics::GetFrameTimings() const noexcept
+{
+	return frameTimings;
+}
+#endif
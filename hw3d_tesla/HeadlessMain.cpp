@@ -0,0 +1,200 @@
+#ifdef TESLA_HEADLESS
+#include "Game.h"
+#include "Benchmark.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include "TeslaTimer.h"
+
+// Count argument of the benchmark modes (at least 1), 'fallback' when it is missing
+static unsigned int CountArg(int argc, char** argv, int index, unsigned int fallback)
+{
+	return argc > index ? std::max(1u, (unsigned int)std::strtoul(argv[index], nullptr, 10)) : fallback;
+}
+
+// This is the entry point of the headless build (no window, no GPU).
+// Usage: hw3d_tesla_headless [nFrames] [discard|ring|file|png|qoi|latency] [file prefix|latency ms] [serial|pipelined|mailbox]
+//        hw3d_tesla_headless clear
+//        hw3d_tesla_headless effect [nWorkers (all counts)] [nFrames]
+//        hw3d_tesla_headless decode [image files]
+//        hw3d_tesla_headless blit [nRuns]
+//        hw3d_tesla_headless sprites [nFrames]
+//        hw3d_tesla_headless text <font.ttf> [nFrames]
+//        hw3d_tesla_headless raster [file.obj] [nFrames]
+//        hw3d_tesla_headless watertight
+//        hw3d_tesla_headless lines [nFrames]
+//        hw3d_tesla_headless fill [nFrames]
+//        hw3d_tesla_headless transform [nRuns]
+//        hw3d_tesla_headless obj <file.obj> [nRuns]
+//        hw3d_tesla_headless mesh <file.obj> [nRuns]
+//        hw3d_tesla_headless objcheck [folder (Models/ObjCorpus)]
+int main(int argc, char** argv)
+{
+	try
+	{
+		if (argc > 1 && std::string(argv[1]) == "clear")
+		{
+			return Benchmark::Clear();
+		}
+		if (argc > 1 && std::string(argv[1]) == "effect")
+		{
+			return Benchmark::Effect(argc > 2 ? std::atoi(argv[2]) : -1, CountArg(argc, argv, 3, 20u));
+		}
+		if (argc > 1 && std::string(argv[1]) == "decode")
+		{
+			return Benchmark::Decode(std::vector<std::string>(argv + 2, argv + argc), 10u);
+		}
+		if (argc > 1 && std::string(argv[1]) == "blit")
+		{
+			return Benchmark::Blit(CountArg(argc, argv, 2, 5u));
+		}
+		if (argc > 1 && std::string(argv[1]) == "sprites")
+		{
+			return Benchmark::Sprites(CountArg(argc, argv, 2, 10u));
+		}
+		if (argc > 2 && std::string(argv[1]) == "text")
+		{
+			return Benchmark::Text(argv[2], CountArg(argc, argv, 3, 20u));
+		}
+		if (argc > 1 && std::string(argv[1]) == "raster")
+		{
+			return Benchmark::Raster(argc > 2 ? argv[2] : "", CountArg(argc, argv, 3, 100u));
+		}
+		if (argc > 1 && std::string(argv[1]) == "watertight")
+		{
+			return Benchmark::CheckWatertight();
+		}
+		if (argc > 1 && std::string(argv[1]) == "lines")
+		{
+			return Benchmark::Lines(CountArg(argc, argv, 2, 20u));
+		}
+		if (argc > 1 && std::string(argv[1]) == "fill")
+		{
+			return Benchmark::Fill(CountArg(argc, argv, 2, 3u));
+		}
+		if (argc > 1 && std::string(argv[1]) == "transform")
+		{
+			return Benchmark::Transform(CountArg(argc, argv, 2, 10u));
+		}
+		if (argc > 2 && std::string(argv[1]) == "obj")
+		{
+			return Benchmark::OBJ(argv[2], CountArg(argc, argv, 3, 5u));
+		}
+		if (argc > 2 && std::string(argv[1]) == "mesh")
+		{
+			return Benchmark::MeshLoad(argv[2], CountArg(argc, argv, 3, 5u));
+		}
+		if (argc > 1 && std::string(argv[1]) == "objcheck")
+		{
+			return Benchmark::CheckOBJCorpus(argc > 2 ? argv[2] : "Models/ObjCorpus");
+		}
+		const unsigned int nFrames = argc > 1 ? (unsigned int)std::strtoul(argv[1], nullptr, 10) : 600u;
+		const std::string sinkName = argc > 2 ? argv[2] : "discard";
+		const std::string mode     = argc > 4 ? argv[4] : "serial";
+
+		std::unique_ptr<FrameSink> pSink;
+		if (sinkName == "discard")
+		{
+			pSink = std::make_unique<DiscardSink>();
+		}
+		else if (sinkName == "ring")
+		{
+			pSink = std::make_unique<RingSink>(Graphics::ScreenWidth, Graphics::ScreenHeight);
+		}
+		else if (sinkName == "file" || sinkName == "png" || sinkName == "qoi")
+		{
+			// Frames are encoded on one writer thread per core
+			const auto format = sinkName == "png" ? ImageEncoder::Format::PNG : sinkName == "qoi" ? ImageEncoder::Format::QOI : ImageEncoder::Format::BMP;
+			pSink = std::make_unique<FileSink>(argc > 3 ? argv[3] : "frame_", format, std::max(1u, std::thread::hardware_concurrency()));
+		}
+		else if (sinkName == "latency")
+		{
+			// Simulates a present stage taking a fixed time
+			const double ms = argc > 3 ? std::strtod(argv[3], nullptr) : 8.0;
+			pSink = std::make_unique<LatencySink>(std::chrono::microseconds((long long)(ms * 1000.0)));
+		}
+		else
+		{
+			std::cerr << "Unknown frame sink [" << sinkName << "] (use discard, ring, file, png, qoi or latency)" << std::endl;
+			return -1;
+		}
+
+		// Create a game object and run the game loop a fixed number of times
+		Game game(std::move(pSink));
+		// pipelined presents every frame, mailbox drops the ones the present thread had no time for
+		if (mode == "pipelined")
+		{
+			game.GetGraphics().EnablePipelining(TripleBufferMode::FIFO);
+		}
+		else if (mode == "mailbox")
+		{
+			game.GetGraphics().EnablePipelining(TripleBufferMode::Mailbox);
+		}
+		TeslaTimer<float> wallTimer;
+		for (unsigned int i = 0u; i < nFrames; i++)
+		{
+			game.Go();
+		}
+		game.GetGraphics().DisablePipelining();
+		// File sinks: the frames still queued are part of the run
+		auto* pFileSink = dynamic_cast<FileSink*>(&game.GetGraphics().GetFrameSink());
+		if (pFileSink)
+		{
+			pFileSink->GetWriter().Flush();
+		}
+		const float wallTime = wallTimer.Mark();
+
+		// Report the per-frame timings
+		const auto& timings = game.GetGraphics().GetFrameTimings();
+		if (timings.empty())
+		{
+			return 0;
+		}
+		float composeSum = 0.0f;
+		float sinkSum    = 0.0f;
+		float frameMin   = timings.front().composeTime + timings.front().sinkTime;
+		float frameMax   = frameMin;
+		for (const auto& t : timings)
+		{
+			composeSum += t.composeTime;
+			sinkSum    += t.sinkTime;
+			frameMin    = std::min(frameMin, t.composeTime + t.sinkTime);
+			frameMax    = std::max(frameMax, t.composeTime + t.sinkTime);
+		}
+		const float n = (float)timings.size();
+		// Dropped frames cost compose time but never reached the sink
+		const unsigned long long nPresented = game.GetGraphics().GetPresentedFrameCount();
+		std::cout << "frames:  " << timings.size() << " (" << Graphics::ScreenWidth << "x" << Graphics::ScreenHeight << ", " << sinkName << " sink)" << std::endl
+			<< "compose: " << 1000.0f * composeSum / n << " ms/frame" << std::endl
+			<< "sink:    " << 1000.0f * sinkSum / n << " ms/frame" << std::endl
+			<< "frame:   " << 1000.0f * (composeSum + sinkSum) / n << " ms avg, "
+			<< 1000.0f * frameMin << " ms min, " << 1000.0f * frameMax << " ms max" << std::endl
+			<< "wall:    " << 1000.0f * wallTime / (float)std::max(1ull, nPresented) << " ms/presented frame (" << mode << ", "
+			<< nPresented << " presented, " << game.GetGraphics().GetDroppedFrameCount() << " dropped)" << std::endl;
+		if (pFileSink)
+		{
+			const auto stats = pFileSink->GetWriter().GetStatistics();
+			std::cout << "writer:  " << stats.written << " written, max queue depth " << stats.maxQueueDepth << "/" << pFileSink->GetWriter().GetCapacity()
+				<< ", copy " << 1000.0f * stats.copyTime / n << " ms/frame, blocked " << 1000.0f * stats.blockedTime / n << " ms/frame, encode "
+				<< 1000.0f * stats.encodeTime / (float)std::max(1ull, stats.written) << " ms/image" << std::endl;
+		}
+	}
+	catch (const TeslaException& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Standard Exception" << std::endl << e.what() << std::endl;
+		return -1;
+	}
+	catch (...)
+	{
+		std::cerr << "Unknown Exception" << std::endl << "No details available" << std::endl;
+		return -1;
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,1237 @@
+#include "ImageDecoder.h"
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+
+[[noreturn]] static void Fail(int line, const std::string& filename, const char* reason)
+{
+	std::stringstream ss;
+	ss << "Loading image [" << filename << "]: " << reason;
+	throw Surface::Exception(line, __FILE__, ss.str());
+}
+
+static unsigned int Read16LE(const unsigned char* p) noexcept
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static unsigned int Read32LE(const unsigned char* p) noexcept
+{
+	return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned int Read16BE(const unsigned char* p) noexcept
+{
+	return ((unsigned int)p[0] << 8) | (unsigned int)p[1];
+}
+
+static unsigned int Read32BE(const unsigned char* p) noexcept
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+static constexpr unsigned int MakeARGB(unsigned int r, unsigned int g, unsigned int b, unsigned int a = 255u) noexcept
+{
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// Refuse sizes that would not fit the 32 bit byte counts of the Surface
+static bool IsSizeValid(unsigned long long width, unsigned long long height) noexcept
+{
+	return width > 0u && height > 0u && width <= 0x8000u && height <= 0x8000u && width * height <= (1ull << 28);
+}
+
+ImageDecoder::Format ImageDecoder::DetectFormat(const unsigned char* pData, size_t size, const std::string& filename) noexcept
+{
+	static constexpr unsigned char pngSignature[8] = { 0x89u, 'P', 'N', 'G', '\r', '\n', 0x1Au, '\n' };
+	if (size >= 8u && memcmp(pData, pngSignature, 8u) == 0)
+	{
+		return Format::PNG;
+	}
+	if (size >= 4u && memcmp(pData, "qoif", 4u) == 0)
+	{
+		return Format::QOI;
+	}
+	if (size >= 2u && pData[0] == 'B' && pData[1] == 'M')
+	{
+		return Format::BMP;
+	}
+	if (filename.size() >= 4u)
+	{
+		std::string extension = filename.substr(filename.size() - 4u);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+		if (extension == ".tga")
+		{
+			return Format::TGA;
+		}
+	}
+	return Format::Unknown;
+}
+
+Surface ImageDecoder::Decode(const unsigned char* pData, size_t size, Format format, const std::string& filename)
+{
+	switch (format)
+	{
+	case Format::BMP:
+		return DecodeBMP(pData, size, filename);
+	case Format::TGA:
+		return DecodeTGA(pData, size, filename);
+	case Format::PNG:
+		return DecodePNG(pData, size, filename);
+	case Format::QOI:
+		return DecodeQOI(pData, size, filename);
+	default:
+		Fail(__LINE__, filename, "unknown image format.");
+	}
+}
+
+/***************************************************************************************/
+/*************************************** BMP *******************************************/
+Surface ImageDecoder::DecodeBMP(const unsigned char* pData, size_t size, const std::string& filename)
+{
+	if (size < 26u || pData[0] != 'B' || pData[1] != 'M')
+	{
+		Fail(__LINE__, filename, "not a bitmap file.");
+	}
+	const unsigned int dataOffset = Read32LE(pData + 10u);
+	const unsigned int headerSize = Read32LE(pData + 14u);
+	if ((headerSize != 12u && headerSize < 40u) || size < 14ull + headerSize)
+	{
+		Fail(__LINE__, filename, "unsupported or truncated bitmap header.");
+	}
+
+	// BITMAPCOREHEADER (OS/2) or BITMAPINFOHEADER and its V4/V5 extensions
+	long long fileWidth;
+	long long fileHeight;
+	unsigned int bpp;
+	unsigned int compression = 0u;
+	unsigned int nColorsUsed = 0u;
+	if (headerSize == 12u)
+	{
+		fileWidth  = Read16LE(pData + 18u);
+		fileHeight = Read16LE(pData + 20u);
+		bpp    = Read16LE(pData + 24u);
+	}
+	else
+	{
+		fileWidth   = (int)Read32LE(pData + 18u);
+		fileHeight  = (int)Read32LE(pData + 22u);
+		bpp         = Read16LE(pData + 28u);
+		compression = Read32LE(pData + 30u);
+		nColorsUsed = Read32LE(pData + 46u);
+	}
+	// A negative height means the rows are stored top-down
+	const bool topDown = fileHeight < 0;
+	if (fileWidth < 0 || !IsSizeValid((unsigned long long)fileWidth, (unsigned long long)(topDown ? -fileHeight : fileHeight)))
+	{
+		Fail(__LINE__, filename, "invalid bitmap size.");
+	}
+	const unsigned int width  = (unsigned int)fileWidth;
+	const unsigned int height = (unsigned int)(topDown ? -fileHeight : fileHeight);
+	// BI_RGB, BI_BITFIELDS and BI_ALPHABITFIELDS only
+	if (compression != 0u && compression != 3u && compression != 6u)
+	{
+		Fail(__LINE__, filename, "compressed bitmaps are not supported.");
+	}
+	if (bpp != 1u && bpp != 4u && bpp != 8u && bpp != 16u && bpp != 24u && bpp != 32u)
+	{
+		Fail(__LINE__, filename, "unsupported bit count.");
+	}
+
+	// Channel masks (the masks follow a 40 bytes header, and are inside the V4/V5 ones)
+	unsigned int masks[4] = { 0x00FF0000u, 0x0000FF00u, 0x000000FFu, 0u };
+	if (bpp == 16u)
+	{
+		masks[0] = 0x7C00u;
+		masks[1] = 0x03E0u;
+		masks[2] = 0x001Fu;
+	}
+	if (compression != 0u)
+	{
+		const unsigned int nMasks = (headerSize >= 56u || compression == 6u) ? 4u : 3u;
+		if (size < 54ull + 4u * nMasks)
+		{
+			Fail(__LINE__, filename, "truncated bitmap header.");
+		}
+		for (unsigned int i = 0u; i < nMasks; i++)
+		{
+			masks[i] = Read32LE(pData + 54u + 4u * i);
+		}
+	}
+
+	// Color table of the palettized formats (missing entries are black)
+	unsigned int palette[256];
+	std::fill(std::begin(palette), std::end(palette), MakeARGB(0u, 0u, 0u));
+	if (bpp <= 8u)
+	{
+		const size_t paletteOffset = 14ull + headerSize;
+		const unsigned int entrySize = headerSize == 12u ? 3u : 4u;
+		unsigned int nEntries = nColorsUsed != 0u ? std::min(nColorsUsed, 256u) : (1u << bpp);
+		nEntries = (unsigned int)std::min<size_t>(nEntries, (size - std::min(size, paletteOffset)) / entrySize);
+		for (unsigned int i = 0u; i < nEntries; i++)
+		{
+			const unsigned char* pEntry = pData + paletteOffset + (size_t)entrySize * i;
+			palette[i] = MakeARGB(pEntry[2], pEntry[1], pEntry[0]);
+		}
+	}
+
+	// Rows are padded to 4 bytes
+	const size_t stride = ((size_t)width * bpp + 31u) / 32u * 4u;
+	if (dataOffset > size || (size - dataOffset) / stride < (size_t)height)
+	{
+		Fail(__LINE__, filename, "truncated pixel data.");
+	}
+
+	Surface surface(width, height);
+	const bool standardMasks = masks[0] == 0x00FF0000u && masks[1] == 0x0000FF00u && masks[2] == 0x000000FFu;
+	if (bpp == 32u && standardMasks)
+	{
+		// Already in our layout: one copy per row. A declared alpha mask is trusted (like in the
+		// general path below); plain BI_RGB files keep their alpha unless it's all zero (which is
+		// what most writers put in the unused byte)
+		const unsigned int alphaMask = compression == 0u ? 0xFF000000u : masks[3];
+		unsigned int alphaSeen = 0u;
+		for (unsigned int y = 0u; y < height; y++)
+		{
+			const unsigned char* pSrc = pData + dataOffset + stride * (topDown ? y : height - 1u - y);
+			Color* pDst = surface.GetRowPtr(y);
+			memcpy(static_cast<void*>(pDst), pSrc, (size_t)width * sizeof(Color));
+			for (unsigned int x = 0u; x < width; x++)
+			{
+				alphaSeen |= pDst[x].dword;
+			}
+		}
+		if (alphaMask != 0xFF000000u || (compression == 0u && (alphaSeen & alphaMask) == 0u))
+		{
+			for (unsigned int y = 0u; y < height; y++)
+			{
+				Color* pDst = surface.GetRowPtr(y);
+				for (unsigned int x = 0u; x < width; x++)
+				{
+					pDst[x].dword |= 0xFF000000u;
+				}
+			}
+		}
+		return surface;
+	}
+
+	// Shift and bit count of each mask, to expand the channels to 8 bits
+	unsigned int shifts[4];
+	unsigned int maxValues[4];
+	for (int i = 0; i < 4; i++)
+	{
+		shifts[i] = 0u;
+		maxValues[i] = 0u;
+		if (masks[i] != 0u)
+		{
+			while (((masks[i] >> shifts[i]) & 1u) == 0u)
+			{
+				shifts[i]++;
+			}
+			maxValues[i] = masks[i] >> shifts[i];
+		}
+	}
+	auto Expand = [&](unsigned int value, int channel) -> unsigned int
+	{
+		if (maxValues[channel] == 0u)
+		{
+			return 255u;
+		}
+		const unsigned long long v = (value & masks[channel]) >> shifts[channel];
+		return (unsigned int)((v * 255u + maxValues[channel] / 2u) / maxValues[channel]);
+	};
+
+	for (unsigned int y = 0u; y < height; y++)
+	{
+		const unsigned char* pSrc = pData + dataOffset + stride * (topDown ? y : height - 1u - y);
+		Color* pDst = surface.GetRowPtr(y);
+		switch (bpp)
+		{
+		case 1u:
+		case 4u:
+		case 8u:
+		{
+			const unsigned int perByte = 8u / bpp;
+			const unsigned int indexMask = (1u << bpp) - 1u;
+			for (unsigned int x = 0u; x < width; x++)
+			{
+				const unsigned int shift = 8u - bpp * (x % perByte + 1u);
+				pDst[x] = palette[(pSrc[x / perByte] >> shift) & indexMask];
+			}
+			break;
+		}
+		case 16u:
+		case 32u:
+			for (unsigned int x = 0u; x < width; x++)
+			{
+				const unsigned int value = bpp == 16u ? Read16LE(pSrc + 2u * x) : Read32LE(pSrc + 4u * x);
+				pDst[x] = MakeARGB(Expand(value, 0), Expand(value, 1), Expand(value, 2), Expand(value, 3));
+			}
+			break;
+		case 24u:
+			for (unsigned int x = 0u; x < width; x++)
+			{
+				pDst[x] = MakeARGB(pSrc[3u * x + 2u], pSrc[3u * x + 1u], pSrc[3u * x]);
+			}
+			break;
+		}
+	}
+	return surface;
+}
+
+/***************************************************************************************/
+/*************************************** TGA *******************************************/
+Surface ImageDecoder::DecodeTGA(const unsigned char* pData, size_t size, const std::string& filename)
+{
+	if (size < 18u)
+	{
+		Fail(__LINE__, filename, "truncated targa header.");
+	}
+	const unsigned int idLength     = pData[0];
+	const unsigned int colorMapType = pData[1];
+	const unsigned int imageType    = pData[2];
+	const unsigned int mapFirst     = Read16LE(pData + 3u);
+	const unsigned int mapLength    = Read16LE(pData + 5u);
+	const unsigned int mapEntryBits = pData[7];
+	const unsigned int width        = Read16LE(pData + 12u);
+	const unsigned int height       = Read16LE(pData + 14u);
+	const unsigned int bpp          = pData[16];
+	const unsigned int descriptor   = pData[17];
+
+	// 1: color-mapped, 2: truecolor, 3: grayscale; +8 for the RLE variants
+	const unsigned int baseType = imageType & 7u;
+	const bool rle = (imageType & 8u) != 0u;
+	if (baseType < 1u || baseType > 3u || (imageType & ~0xBu) != 0u || colorMapType > 1u)
+	{
+		Fail(__LINE__, filename, "unsupported targa image type.");
+	}
+	if (!IsSizeValid(width, height))
+	{
+		Fail(__LINE__, filename, "invalid targa size.");
+	}
+	const bool bppValid =
+		(baseType == 1u && (bpp == 8u || bpp == 16u)) ||
+		(baseType == 2u && (bpp == 15u || bpp == 16u || bpp == 24u || bpp == 32u)) ||
+		(baseType == 3u && (bpp == 8u || bpp == 16u));
+	if (!bppValid)
+	{
+		Fail(__LINE__, filename, "unsupported targa pixel depth.");
+	}
+
+	// Converts one truecolor / grayscale value stored on (bits + 7) / 8 bytes
+	auto ToColor = [baseType](const unsigned char* p, unsigned int bits) -> unsigned int
+	{
+		if (baseType == 3u)
+		{
+			return bits == 8u ? MakeARGB(p[0], p[0], p[0]) : MakeARGB(p[0], p[0], p[0], p[1]);
+		}
+		switch (bits)
+		{
+		case 15u:
+		case 16u:
+		{
+			const unsigned int v = Read16LE(p);
+			return MakeARGB(((v >> 10) & 31u) * 255u / 31u, ((v >> 5) & 31u) * 255u / 31u, (v & 31u) * 255u / 31u);
+		}
+		case 24u:
+			return MakeARGB(p[2], p[1], p[0]);
+		default:
+			return MakeARGB(p[2], p[1], p[0], p[3]);
+		}
+	};
+
+	size_t offset = 18u + idLength;
+	unsigned int palette[256] = {};
+	if (colorMapType == 1u)
+	{
+		const unsigned int entryBytes = (mapEntryBits + 7u) / 8u;
+		if (mapEntryBits != 15u && mapEntryBits != 16u && mapEntryBits != 24u && mapEntryBits != 32u)
+		{
+			Fail(__LINE__, filename, "unsupported targa color map depth.");
+		}
+		if (offset + (size_t)entryBytes * mapLength > size)
+		{
+			Fail(__LINE__, filename, "truncated targa color map.");
+		}
+		if (baseType == 1u)
+		{
+			for (unsigned int i = 0u; i < std::min(mapLength, 256u); i++)
+			{
+				palette[i] = ToColor(pData + offset + (size_t)entryBytes * i, mapEntryBits == 15u ? 16u : mapEntryBits);
+			}
+		}
+		offset += (size_t)entryBytes * mapLength;
+	}
+	else if (baseType == 1u)
+	{
+		Fail(__LINE__, filename, "color-mapped targa without a color map.");
+	}
+
+	// Reads the pixels in file order, expanding the RLE packets on the fly
+	const unsigned int pixelBytes = (bpp + 7u) / 8u;
+	unsigned int packetLeft = 0u;
+	bool packetIsRun = false;
+	unsigned int runColor = 0u;
+	auto ReadPixel = [&]() -> unsigned int
+	{
+		if (offset + pixelBytes > size)
+		{
+			Fail(__LINE__, filename, "truncated pixel data.");
+		}
+		const unsigned char* p = pData + offset;
+		offset += pixelBytes;
+		if (baseType == 1u)
+		{
+			const unsigned int index = (pixelBytes == 1u ? p[0] : Read16LE(p)) - mapFirst;
+			return index < 256u ? palette[index] : MakeARGB(0u, 0u, 0u);
+		}
+		return ToColor(p, bpp);
+	};
+	auto NextPixel = [&]() -> unsigned int
+	{
+		if (!rle)
+		{
+			return ReadPixel();
+		}
+		if (packetLeft == 0u)
+		{
+			if (offset >= size)
+			{
+				Fail(__LINE__, filename, "truncated pixel data.");
+			}
+			const unsigned int header = pData[offset++];
+			packetIsRun = (header & 0x80u) != 0u;
+			packetLeft  = (header & 0x7Fu) + 1u;
+			if (packetIsRun)
+			{
+				runColor = ReadPixel();
+			}
+		}
+		packetLeft--;
+		return packetIsRun ? runColor : ReadPixel();
+	};
+
+	// Bottom-up unless bit 5 of the descriptor is set, right-to-left if bit 4 is
+	const bool topDown     = (descriptor & 0x20u) != 0u;
+	const bool rightToLeft = (descriptor & 0x10u) != 0u;
+	Surface surface(width, height);
+	for (unsigned int row = 0u; row < height; row++)
+	{
+		Color* pDst = surface.GetRowPtr(topDown ? row : height - 1u - row);
+		if (rightToLeft)
+		{
+			for (unsigned int x = width; x-- > 0u;)
+			{
+				pDst[x] = NextPixel();
+			}
+		}
+		else
+		{
+			for (unsigned int x = 0u; x < width; x++)
+			{
+				pDst[x] = NextPixel();
+			}
+		}
+	}
+	return surface;
+}
+
+/***************************************************************************************/
+/************************************* INFLATE *****************************************/
+namespace
+{
+	// LSB-first bit reader. Reading past the end yields zeros and is detected with Overrun()
+	class BitStream
+	{
+	public:
+		BitStream(const unsigned char* pData, size_t size) noexcept
+			:
+			p(pData),
+			end(pData + size)
+		{}
+		void Refill() noexcept
+		{
+			while (count <= 56u)
+			{
+				uint64_t byte = 0u;
+				if (p < end)
+				{
+					byte = *p++;
+				}
+				else
+				{
+					padBytes++;
+				}
+				bits |= byte << count;
+				count += 8u;
+			}
+		}
+		unsigned int Get(unsigned int n) noexcept
+		{
+			if (count < n)
+			{
+				Refill();
+			}
+			const unsigned int value = (unsigned int)(bits & ((1ull << n) - 1u));
+			bits >>= n;
+			count -= n;
+			return value;
+		}
+		// Drop the bits up to the next byte boundary and give the buffered bytes back
+		const unsigned char* AlignToByte() noexcept
+		{
+			const unsigned int bufferedBytes = (count - count % 8u) / 8u;
+			p -= bufferedBytes > padBytes ? bufferedBytes - padBytes : 0u;
+			bits = 0u;
+			count = 0u;
+			padBytes = 0u;
+			return p;
+		}
+		void Skip(size_t n) noexcept
+		{
+			p += n;
+		}
+		const unsigned char* GetEnd() const noexcept
+		{
+			return end;
+		}
+		bool Overrun() const noexcept
+		{
+			return (size_t)padBytes * 8u > count;
+		}
+	public:
+		uint64_t bits = 0u;
+		unsigned int count = 0u;
+	private:
+		const unsigned char* p;
+		const unsigned char* end;
+		unsigned int padBytes = 0u;
+	};
+
+	// Canonical Huffman decoder: a table lookup for the short codes, bit by bit for the rest
+	class Huffman
+	{
+	public:
+		static constexpr unsigned int FastBits = 10u;
+	public:
+		bool Build(const unsigned char* lengths, unsigned int n) noexcept
+		{
+			std::fill(std::begin(counts), std::end(counts), (uint16_t)0u);
+			std::fill(std::begin(fast), std::end(fast), (uint16_t)0u);
+			for (unsigned int s = 0u; s < n; s++)
+			{
+				counts[lengths[s]]++;
+			}
+			counts[0] = 0u;
+			// Over-subscribed sets are invalid (incomplete ones are allowed)
+			int left = 1;
+			for (unsigned int len = 1u; len < 16u; len++)
+			{
+				left = 2 * left - counts[len];
+				if (left < 0)
+				{
+					return false;
+				}
+			}
+			uint16_t offsets[16];
+			unsigned int nextCode[16];
+			offsets[1] = 0u;
+			nextCode[1] = 0u;
+			for (unsigned int len = 1u; len < 15u; len++)
+			{
+				offsets[len + 1] = offsets[len] + counts[len];
+				nextCode[len + 1] = (nextCode[len] + counts[len]) << 1;
+			}
+			for (unsigned int s = 0u; s < n; s++)
+			{
+				const unsigned int len = lengths[s];
+				if (len == 0u)
+				{
+					continue;
+				}
+				symbols[offsets[len]++] = (uint16_t)s;
+				const unsigned int code = nextCode[len]++;
+				if (len <= FastBits)
+				{
+					// The stream holds the codes starting from their most significant bit
+					unsigned int reversed = 0u;
+					for (unsigned int i = 0u; i < len; i++)
+					{
+						reversed |= ((code >> i) & 1u) << (len - 1u - i);
+					}
+					for (unsigned int k = reversed; k < (1u << FastBits); k += 1u << len)
+					{
+						fast[k] = (uint16_t)((s << 4) | len);
+					}
+				}
+			}
+			return true;
+		}
+		// Returns -1 for an invalid code
+		int Decode(BitStream& bs) const noexcept
+		{
+			if (bs.count < 15u)
+			{
+				bs.Refill();
+			}
+			const unsigned int entry = fast[bs.bits & ((1u << FastBits) - 1u)];
+			if (entry != 0u)
+			{
+				bs.bits >>= entry & 15u;
+				bs.count -= entry & 15u;
+				return (int)(entry >> 4);
+			}
+			int code = 0;
+			int first = 0;
+			int index = 0;
+			for (unsigned int len = 1u; len < 16u; len++)
+			{
+				code |= (int)(bs.bits & 1u);
+				bs.bits >>= 1;
+				bs.count--;
+				const int count = counts[len];
+				if (code - first < count)
+				{
+					return symbols[index + (code - first)];
+				}
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			return -1;
+		}
+	private:
+		// (symbol << 4) | length, indexed by the next FastBits bits of the stream (0: longer code)
+		uint16_t fast[1u << FastBits];
+		uint16_t counts[16];
+		uint16_t symbols[288];
+	};
+}
+
+bool ImageDecoder::Inflate(const unsigned char* pData, size_t size, std::vector<unsigned char>& out)
+{
+	static constexpr unsigned short lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+	static constexpr unsigned char lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+	static constexpr unsigned short distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+	static constexpr unsigned char distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+	static constexpr unsigned char lengthOrder[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+	BitStream bs(pData, size);
+	auto pLitLen = std::make_unique<Huffman>();
+	auto pDist   = std::make_unique<Huffman>();
+	bool final = false;
+	while (!final)
+	{
+		final = bs.Get(1u) != 0u;
+		const unsigned int type = bs.Get(2u);
+		if (type == 0u)
+		{
+			// Stored block: straight copy
+			const unsigned char* p = bs.AlignToByte();
+			if (bs.GetEnd() - p < 4)
+			{
+				return false;
+			}
+			const unsigned int len = Read16LE(p);
+			if ((len ^ 0xFFFFu) != Read16LE(p + 2))
+			{
+				return false;
+			}
+			if ((size_t)(bs.GetEnd() - p - 4) < len)
+			{
+				return false;
+			}
+			out.insert(out.end(), p + 4, p + 4 + len);
+			bs.Skip(4u + len);
+			continue;
+		}
+		unsigned char lengths[288 + 32];
+		if (type == 1u)
+		{
+			// Fixed codes
+			std::fill(lengths, lengths + 144, (unsigned char)8u);
+			std::fill(lengths + 144, lengths + 256, (unsigned char)9u);
+			std::fill(lengths + 256, lengths + 280, (unsigned char)7u);
+			std::fill(lengths + 280, lengths + 288, (unsigned char)8u);
+			std::fill(lengths + 288, lengths + 320, (unsigned char)5u);
+			pLitLen->Build(lengths, 288u);
+			pDist->Build(lengths + 288, 30u);
+		}
+		else if (type == 2u)
+		{
+			// Dynamic codes, their lengths are Huffman coded too
+			const unsigned int nLitLen = bs.Get(5u) + 257u;
+			const unsigned int nDist   = bs.Get(5u) + 1u;
+			const unsigned int nCodes  = bs.Get(4u) + 4u;
+			if (nLitLen > 286u || nDist > 30u)
+			{
+				return false;
+			}
+			unsigned char codeLengths[19] = {};
+			for (unsigned int i = 0u; i < nCodes; i++)
+			{
+				codeLengths[lengthOrder[i]] = (unsigned char)bs.Get(3u);
+			}
+			Huffman& lengthCode = *pDist;
+			if (!lengthCode.Build(codeLengths, 19u))
+			{
+				return false;
+			}
+			unsigned int n = 0u;
+			while (n < nLitLen + nDist)
+			{
+				const int symbol = lengthCode.Decode(bs);
+				if (symbol < 0 || bs.Overrun())
+				{
+					return false;
+				}
+				if (symbol < 16)
+				{
+					lengths[n++] = (unsigned char)symbol;
+					continue;
+				}
+				unsigned char value = 0u;
+				unsigned int repeat;
+				if (symbol == 16)
+				{
+					if (n == 0u)
+					{
+						return false;
+					}
+					value = lengths[n - 1u];
+					repeat = 3u + bs.Get(2u);
+				}
+				else if (symbol == 17)
+				{
+					repeat = 3u + bs.Get(3u);
+				}
+				else
+				{
+					repeat = 11u + bs.Get(7u);
+				}
+				if (n + repeat > nLitLen + nDist)
+				{
+					return false;
+				}
+				std::fill(lengths + n, lengths + n + repeat, value);
+				n += repeat;
+			}
+			if (lengths[256] == 0u || !pLitLen->Build(lengths, nLitLen) || !pDist->Build(lengths + nLitLen, nDist))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			return false;
+		}
+
+		// Literals and back-references up to the end of block code
+		while (true)
+		{
+			const int symbol = pLitLen->Decode(bs);
+			if (symbol < 0 || bs.Overrun())
+			{
+				return false;
+			}
+			if (symbol < 256)
+			{
+				out.push_back((unsigned char)symbol);
+				continue;
+			}
+			if (symbol == 256)
+			{
+				break;
+			}
+			if (symbol > 285)
+			{
+				return false;
+			}
+			const unsigned int length = lengthBase[symbol - 257] + bs.Get(lengthExtra[symbol - 257]);
+			const int distSymbol = pDist->Decode(bs);
+			if (distSymbol < 0 || distSymbol >= 30)
+			{
+				return false;
+			}
+			const size_t distance = distBase[distSymbol] + bs.Get(distExtra[distSymbol]);
+			if (distance > out.size())
+			{
+				return false;
+			}
+			// The source may overlap the bytes being written, so go byte by byte
+			const size_t from = out.size() - distance;
+			out.resize(out.size() + length);
+			unsigned char* pOut = out.data() + out.size() - length;
+			const unsigned char* pFrom = out.data() + from;
+			for (unsigned int i = 0u; i < length; i++)
+			{
+				pOut[i] = pFrom[i];
+			}
+		}
+	}
+	return !bs.Overrun();
+}
+
+/***************************************************************************************/
+/*************************************** PNG *******************************************/
+static unsigned char Paeth(unsigned char a, unsigned char b, unsigned char c) noexcept
+{
+	const int p  = (int)a + b - c;
+	const int pa = abs(p - a);
+	const int pb = abs(p - b);
+	const int pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+	{
+		return a;
+	}
+	return pb <= pc ? b : c;
+}
+
+// Undo the filter of one scanline in place. prior is the previous unfiltered row (zeros for the first one)
+static bool Unfilter(unsigned int filter, unsigned char* row, const unsigned char* prior, size_t rowBytes, unsigned int bpp) noexcept
+{
+	switch (filter)
+	{
+	case 0u:
+		break;
+	case 1u:
+		for (size_t i = bpp; i < rowBytes; i++)
+		{
+			row[i] = (unsigned char)(row[i] + row[i - bpp]);
+		}
+		break;
+	case 2u:
+		for (size_t i = 0u; i < rowBytes; i++)
+		{
+			row[i] = (unsigned char)(row[i] + prior[i]);
+		}
+		break;
+	case 3u:
+		for (size_t i = 0u; i < bpp; i++)
+		{
+			row[i] = (unsigned char)(row[i] + prior[i] / 2u);
+		}
+		for (size_t i = bpp; i < rowBytes; i++)
+		{
+			row[i] = (unsigned char)(row[i] + ((unsigned int)row[i - bpp] + prior[i]) / 2u);
+		}
+		break;
+	case 4u:
+		for (size_t i = 0u; i < bpp; i++)
+		{
+			row[i] = (unsigned char)(row[i] + prior[i]);
+		}
+		for (size_t i = bpp; i < rowBytes; i++)
+		{
+			row[i] = (unsigned char)(row[i] + Paeth(row[i - bpp], prior[i], prior[i - bpp]));
+		}
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+Surface ImageDecoder::DecodePNG(const unsigned char* pData, size_t size, const std::string& filename)
+{
+	if (size < 8u + 25u || DetectFormat(pData, size, filename) != Format::PNG)
+	{
+		Fail(__LINE__, filename, "not a png file.");
+	}
+
+	// Walk the chunks: header, palette, transparency and the compressed data
+	unsigned int width = 0u;
+	unsigned int height = 0u;
+	unsigned int bitDepth = 0u;
+	unsigned int colorType = 0u;
+	unsigned int interlace = 0u;
+	unsigned int palette[256];
+	std::fill(std::begin(palette), std::end(palette), MakeARGB(0u, 0u, 0u));
+	bool hasColorKey = false;
+	unsigned int colorKey[3] = {};
+	std::vector<unsigned char> idat;
+	const unsigned char* pSingleIdat = nullptr;
+	size_t singleIdatSize = 0u;
+	unsigned int nIdat = 0u;
+	bool hasHeader = false;
+	size_t offset = 8u;
+	while (true)
+	{
+		if (size - offset < 12u)
+		{
+			Fail(__LINE__, filename, "truncated png chunk.");
+		}
+		const unsigned int length = Read32BE(pData + offset);
+		const unsigned char* pType = pData + offset + 4u;
+		const unsigned char* pChunk = pData + offset + 8u;
+		if (length > size - offset - 12u)
+		{
+			Fail(__LINE__, filename, "truncated png chunk.");
+		}
+		offset += 12u + (size_t)length;
+		if (memcmp(pType, "IHDR", 4u) == 0)
+		{
+			if (length < 13u)
+			{
+				Fail(__LINE__, filename, "invalid png header.");
+			}
+			width     = Read32BE(pChunk);
+			height    = Read32BE(pChunk + 4u);
+			bitDepth  = pChunk[8];
+			colorType = pChunk[9];
+			interlace = pChunk[12];
+			if (pChunk[10] != 0u || pChunk[11] != 0u || interlace > 1u)
+			{
+				Fail(__LINE__, filename, "unsupported png compression, filter or interlace method.");
+			}
+			hasHeader = true;
+		}
+		else if (!hasHeader)
+		{
+			Fail(__LINE__, filename, "the png header is not the first chunk.");
+		}
+		else if (memcmp(pType, "PLTE", 4u) == 0)
+		{
+			for (unsigned int i = 0u; i < std::min(length / 3u, 256u); i++)
+			{
+				palette[i] = MakeARGB(pChunk[3u * i], pChunk[3u * i + 1u], pChunk[3u * i + 2u]);
+			}
+		}
+		else if (memcmp(pType, "tRNS", 4u) == 0)
+		{
+			if (colorType == 3u)
+			{
+				for (unsigned int i = 0u; i < std::min(length, 256u); i++)
+				{
+					palette[i] = (palette[i] & 0x00FFFFFFu) | ((unsigned int)pChunk[i] << 24);
+				}
+			}
+			else if (colorType == 0u && length >= 2u)
+			{
+				hasColorKey = true;
+				colorKey[0] = Read16BE(pChunk);
+			}
+			else if (colorType == 2u && length >= 6u)
+			{
+				hasColorKey = true;
+				for (unsigned int i = 0u; i < 3u; i++)
+				{
+					colorKey[i] = Read16BE(pChunk + 2u * i);
+				}
+			}
+		}
+		else if (memcmp(pType, "IDAT", 4u) == 0)
+		{
+			// Usually there's a single IDAT: no need to gather it then
+			if (nIdat++ == 0u)
+			{
+				pSingleIdat = pChunk;
+				singleIdatSize = length;
+			}
+			else
+			{
+				if (nIdat == 2u)
+				{
+					idat.assign(pSingleIdat, pSingleIdat + singleIdatSize);
+				}
+				idat.insert(idat.end(), pChunk, pChunk + length);
+			}
+		}
+		else if (memcmp(pType, "IEND", 4u) == 0)
+		{
+			break;
+		}
+		else if ((pType[0] & 0x20u) == 0u)
+		{
+			Fail(__LINE__, filename, "unknown critical png chunk.");
+		}
+	}
+
+	unsigned int nChannels;
+	switch (colorType)
+	{
+	case 0u: nChannels = 1u; break;
+	case 2u: nChannels = 3u; break;
+	case 3u: nChannels = 1u; break;
+	case 4u: nChannels = 2u; break;
+	case 6u: nChannels = 4u; break;
+	default:
+		Fail(__LINE__, filename, "invalid png color type.");
+	}
+	const bool depthValid = bitDepth == 8u || bitDepth == 16u ||
+		((colorType == 0u || colorType == 3u) && (bitDepth == 1u || bitDepth == 2u || bitDepth == 4u));
+	if (!depthValid || (colorType == 3u && bitDepth == 16u))
+	{
+		Fail(__LINE__, filename, "invalid png bit depth.");
+	}
+	if (!IsSizeValid(width, height))
+	{
+		Fail(__LINE__, filename, "invalid png size.");
+	}
+	if (nIdat == 0u)
+	{
+		Fail(__LINE__, filename, "no image data in the png.");
+	}
+
+	// The 7 passes of Adam7, or a single pass covering everything
+	struct Pass
+	{
+		unsigned int x0, y0, dx, dy;
+	};
+	static constexpr Pass adam7[7] = { { 0,0,8,8 },{ 4,0,8,8 },{ 0,4,4,8 },{ 2,0,4,4 },{ 0,2,2,4 },{ 1,0,2,2 },{ 0,1,1,2 } };
+	static constexpr Pass progressive[1] = { { 0,0,1,1 } };
+	const Pass* pPasses = interlace ? adam7 : progressive;
+	const unsigned int nPasses = interlace ? 7u : 1u;
+	const unsigned int bitsPerPixel = nChannels * bitDepth;
+	const unsigned int filterBpp = std::max(1u, bitsPerPixel / 8u);
+	auto PassSize = [&](const Pass& pass, unsigned int& passWidth, unsigned int& passHeight) -> size_t
+	{
+		passWidth  = width  > pass.x0 ? (width  - pass.x0 + pass.dx - 1u) / pass.dx : 0u;
+		passHeight = height > pass.y0 ? (height - pass.y0 + pass.dy - 1u) / pass.dy : 0u;
+		if (passWidth == 0u || passHeight == 0u)
+		{
+			return 0u;
+		}
+		return (size_t)passHeight * (1u + ((size_t)passWidth * bitsPerPixel + 7u) / 8u);
+	};
+	size_t expectedSize = 0u;
+	for (unsigned int i = 0u; i < nPasses; i++)
+	{
+		unsigned int passWidth, passHeight;
+		expectedSize += PassSize(pPasses[i], passWidth, passHeight);
+	}
+
+	// zlib wrapper: deflate method, no preset dictionary, then the raw deflate stream
+	const unsigned char* pZlib = nIdat == 1u ? pSingleIdat : idat.data();
+	const size_t zlibSize = nIdat == 1u ? singleIdatSize : idat.size();
+	if (zlibSize < 2u || (pZlib[0] & 0x0Fu) != 8u || Read16BE(pZlib) % 31u != 0u || (pZlib[1] & 0x20u) != 0u)
+	{
+		Fail(__LINE__, filename, "invalid zlib stream.");
+	}
+	std::vector<unsigned char> raw;
+	raw.reserve(expectedSize);
+	if (!Inflate(pZlib + 2u, zlibSize - 2u, raw) || raw.size() < expectedSize)
+	{
+		Fail(__LINE__, filename, "corrupt compressed data.");
+	}
+
+	// Unfilter every scanline and convert it straight into the Surface rows
+	Surface surface(width, height);
+	std::vector<unsigned char> zeros(((size_t)width * bitsPerPixel + 7u) / 8u, 0u);
+	std::vector<Color> passRow(interlace ? width : 0u);
+	unsigned char* pRaw = raw.data();
+	for (unsigned int i = 0u; i < nPasses; i++)
+	{
+		const Pass& pass = pPasses[i];
+		unsigned int passWidth, passHeight;
+		if (PassSize(pass, passWidth, passHeight) == 0u)
+		{
+			continue;
+		}
+		const size_t rowBytes = ((size_t)passWidth * bitsPerPixel + 7u) / 8u;
+		const unsigned char* pPrior = zeros.data();
+		for (unsigned int y = 0u; y < passHeight; y++)
+		{
+			unsigned char* pRow = pRaw + 1u;
+			if (!Unfilter(pRaw[0], pRow, pPrior, rowBytes, filterBpp))
+			{
+				Fail(__LINE__, filename, "invalid png filter type.");
+			}
+			pPrior = pRow;
+			pRaw += 1u + rowBytes;
+
+			Color* pDst = interlace ? passRow.data() : surface.GetRowPtr(y);
+			switch (bitDepth)
+			{
+			case 8u:
+				switch (colorType)
+				{
+				case 0u:
+					for (unsigned int x = 0u; x < passWidth; x++)
+					{
+						const unsigned int g = pRow[x];
+						pDst[x] = MakeARGB(g, g, g, hasColorKey && g == colorKey[0] ? 0u : 255u);
+					}
+					break;
+				case 2u:
+					for (unsigned int x = 0u; x < passWidth; x++)
+					{
+						const unsigned char* p = pRow + 3u * x;
+						const bool keyed = hasColorKey && p[0] == colorKey[0] && p[1] == colorKey[1] && p[2] == colorKey[2];
+						pDst[x] = MakeARGB(p[0], p[1], p[2], keyed ? 0u : 255u);
+					}
+					break;
+				case 3u:
+					for (unsigned int x = 0u; x < passWidth; x++)
+					{
+						pDst[x] = palette[pRow[x]];
+					}
+					break;
+				case 4u:
+					for (unsigned int x = 0u; x < passWidth; x++)
+					{
+						pDst[x] = MakeARGB(pRow[2u * x], pRow[2u * x], pRow[2u * x], pRow[2u * x + 1u]);
+					}
+					break;
+				case 6u:
+					for (unsigned int x = 0u; x < passWidth; x++)
+					{
+						const unsigned char* p = pRow + 4u * x;
+						pDst[x] = MakeARGB(p[0], p[1], p[2], p[3]);
+					}
+					break;
+				}
+				break;
+			case 16u:
+				// Keep the most significant byte of every channel (the color key is compared on 16 bits)
+				for (unsigned int x = 0u; x < passWidth; x++)
+				{
+					const unsigned char* p = pRow + 2u * nChannels * x;
+					switch (colorType)
+					{
+					case 0u:
+						pDst[x] = MakeARGB(p[0], p[0], p[0], hasColorKey && Read16BE(p) == colorKey[0] ? 0u : 255u);
+						break;
+					case 2u:
+					{
+						const bool keyed = hasColorKey && Read16BE(p) == colorKey[0] &&
+							Read16BE(p + 2u) == colorKey[1] && Read16BE(p + 4u) == colorKey[2];
+						pDst[x] = MakeARGB(p[0], p[2], p[4], keyed ? 0u : 255u);
+						break;
+					}
+					case 4u:
+						pDst[x] = MakeARGB(p[0], p[0], p[0], p[2]);
+						break;
+					case 6u:
+						pDst[x] = MakeARGB(p[0], p[2], p[4], p[6]);
+						break;
+					}
+				}
+				break;
+			default:
+			{
+				// 1, 2 or 4 bits per pixel, grayscale or palette indices packed from the high bits
+				const unsigned int perByte = 8u / bitDepth;
+				const unsigned int valueMask = (1u << bitDepth) - 1u;
+				const unsigned int scale = 255u / valueMask;
+				for (unsigned int x = 0u; x < passWidth; x++)
+				{
+					const unsigned int shift = 8u - bitDepth * (x % perByte + 1u);
+					const unsigned int v = (pRow[x / perByte] >> shift) & valueMask;
+					if (colorType == 3u)
+					{
+						pDst[x] = palette[v];
+					}
+					else
+					{
+						pDst[x] = MakeARGB(v * scale, v * scale, v * scale, hasColorKey && v == colorKey[0] ? 0u : 255u);
+					}
+				}
+				break;
+			}
+			}
+
+			// Scatter the pixels of an interlaced pass
+			if (interlace)
+			{
+				Color* pSurfaceRow = surface.GetRowPtr(pass.y0 + pass.dy * y);
+				for (unsigned int x = 0u; x < passWidth; x++)
+				{
+					pSurfaceRow[pass.x0 + pass.dx * x] = passRow[x];
+				}
+			}
+		}
+	}
+	return surface;
+}
+
+/***************************************************************************************/
+/*************************************** QOI *******************************************/
+Surface ImageDecoder::DecodeQOI(const unsigned char* pData, size_t size, const std::string& filename)
+{
+	if (size < 14u + 8u || memcmp(pData, "qoif", 4u) != 0)
+	{
+		Fail(__LINE__, filename, "not a qoi file.");
+	}
+	const unsigned int width  = Read32BE(pData + 4u);
+	const unsigned int height = Read32BE(pData + 8u);
+	if (!IsSizeValid(width, height) || pData[12] < 3u || pData[12] > 4u)
+	{
+		Fail(__LINE__, filename, "invalid qoi header.");
+	}
+
+	Surface surface(width, height);
+	unsigned int index[64] = {};
+	unsigned int px = MakeARGB(0u, 0u, 0u);
+	unsigned int run = 0u;
+	// The last 8 bytes are the end marker
+	const unsigned char* p = pData + 14u;
+	const unsigned char* const end = pData + size - 8u;
+	for (unsigned int y = 0u; y < height; y++)
+	{
+		Color* pDst = surface.GetRowPtr(y);
+		for (unsigned int x = 0u; x < width; x++)
+		{
+			if (run > 0u)
+			{
+				run--;
+				pDst[x] = px;
+				continue;
+			}
+			if (p >= end)
+			{
+				Fail(__LINE__, filename, "truncated pixel data.");
+			}
+			const unsigned int op = *p++;
+			if (op == 0xFEu || op == 0xFFu)
+			{
+				const unsigned int nBytes = op == 0xFEu ? 3u : 4u;
+				if ((size_t)(end - p) < nBytes)
+				{
+					Fail(__LINE__, filename, "truncated pixel data.");
+				}
+				px = MakeARGB(p[0], p[1], p[2], op == 0xFEu ? px >> 24 : p[3]);
+				p += nBytes;
+			}
+			else if ((op & 0xC0u) == 0x00u)
+			{
+				px = index[op];
+			}
+			else if ((op & 0xC0u) == 0x40u)
+			{
+				const unsigned int r = ((px >> 16) + ((op >> 4) & 3u) - 2u) & 0xFFu;
+				const unsigned int g = ((px >> 8) + ((op >> 2) & 3u) - 2u) & 0xFFu;
+				const unsigned int b = (px + (op & 3u) - 2u) & 0xFFu;
+				px = MakeARGB(r, g, b, px >> 24);
+			}
+			else if ((op & 0xC0u) == 0x80u)
+			{
+				if (p >= end)
+				{
+					Fail(__LINE__, filename, "truncated pixel data.");
+				}
+				const unsigned int second = *p++;
+				const unsigned int vg = (op & 0x3Fu) - 32u;
+				const unsigned int r = ((px >> 16) + vg - 8u + ((second >> 4) & 0xFu)) & 0xFFu;
+				const unsigned int g = ((px >> 8) + vg) & 0xFFu;
+				const unsigned int b = (px + vg - 8u + (second & 0xFu)) & 0xFFu;
+				px = MakeARGB(r, g, b, px >> 24);
+			}
+			else
+			{
+				// The pixel is repeated 1 to 62 times
+				run = op & 0x3Fu;
+			}
+			const unsigned int r = (px >> 16) & 0xFFu;
+			const unsigned int g = (px >> 8) & 0xFFu;
+			const unsigned int b = px & 0xFFu;
+			const unsigned int a = px >> 24;
+			index[(r * 3u + g * 5u + b * 7u + a * 11u) % 64u] = px;
+			pDst[x] = px;
+		}
+	}
+	return surface;
+}
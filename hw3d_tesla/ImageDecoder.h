@@ -0,0 +1,34 @@
+#pragma once
+#include "Surface.h"
+#include <string>
+#include <vector>
+
+// Portable decoders for the formats Surface::FromFile reads without GDI+.
+// Every decoder writes the Colors straight into the rows of the resulting Surface.
+class ImageDecoder
+{
+public:
+	enum class Format
+	{
+		Unknown,
+		BMP,
+		TGA,
+		PNG,
+		QOI
+	};
+public:
+	// Look at the magic numbers (TGA has none, so its extension is used)
+	static Format DetectFormat(const unsigned char* pData, size_t size, const std::string& filename) noexcept;
+	// The filename is only used for the error messages
+	static Surface Decode(const unsigned char* pData, size_t size, Format format, const std::string& filename);
+	// BMP: 1/4/8 bpp palettized, 16/24/32 bpp (BI_RGB or BI_BITFIELDS), bottom-up or top-down
+	static Surface DecodeBMP(const unsigned char* pData, size_t size, const std::string& filename);
+	// TGA: color-mapped, truecolor and grayscale, raw or RLE
+	static Surface DecodeTGA(const unsigned char* pData, size_t size, const std::string& filename);
+	// PNG: every color type and bit depth, tRNS transparency, Adam7 interlacing
+	static Surface DecodePNG(const unsigned char* pData, size_t size, const std::string& filename);
+	// QOI: 3 or 4 channels (the images written by ImageEncoder::EncodeQOI)
+	static Surface DecodeQOI(const unsigned char* pData, size_t size, const std::string& filename);
+	// Raw DEFLATE stream decoder (RFC 1951), appends to out. Returns false if the stream is corrupt
+	static bool Inflate(const unsigned char* pData, size_t size, std::vector<unsigned char>& out);
+};
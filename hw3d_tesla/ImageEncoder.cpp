@@ -0,0 +1,536 @@
+#include "ImageEncoder.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+static void Put16LE(unsigned char* p, unsigned int v) noexcept
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+static void Put32LE(unsigned char* p, unsigned int v) noexcept
+{
+	Put16LE(p, v);
+	Put16LE(p + 2, v >> 16);
+}
+
+static void Put32BE(unsigned char* p, unsigned int v) noexcept
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static void Append32BE(std::vector<unsigned char>& out, unsigned int v)
+{
+	out.resize(out.size() + 4u);
+	Put32BE(out.data() + out.size() - 4u, v);
+}
+
+ImageEncoder::Format ImageEncoder::FormatFromFilename(const std::string& filename)
+{
+	const size_t dot = filename.find_last_of('.');
+	std::string extension = dot == std::string::npos ? std::string() : filename.substr(dot + 1u);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+	if (extension == "bmp")
+	{
+		return Format::BMP;
+	}
+	if (extension == "png")
+	{
+		return Format::PNG;
+	}
+	if (extension == "qoi")
+	{
+		return Format::QOI;
+	}
+	throw Surface::Exception(__LINE__, __FILE__, "Saving surface to [" + filename + "]: unsupported format (use .bmp, .png or .qoi).");
+}
+
+void ImageEncoder::Save(const SurfaceView& src, const std::string& filename, bool alpha)
+{
+	const Format format = FormatFromFilename(filename);
+	std::vector<unsigned char> data;
+	Encode(src, format, alpha, data);
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		throw Surface::Exception(__LINE__, __FILE__, "Saving surface to [" + filename + "]: failed to open the file.");
+	}
+	file.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+	if (!file)
+	{
+		throw Surface::Exception(__LINE__, __FILE__, "Saving surface to [" + filename + "]: failed to write.");
+	}
+}
+
+void ImageEncoder::Encode(const SurfaceView& src, Format format, bool alpha, std::vector<unsigned char>& out)
+{
+	switch (format)
+	{
+	case Format::BMP:
+		EncodeBMP(src, alpha, out);
+		break;
+	case Format::PNG:
+		EncodePNG(src, alpha, out);
+		break;
+	case Format::QOI:
+		EncodeQOI(src, alpha, out);
+		break;
+	}
+}
+
+/***************************************************************************************/
+/*************************************** BMP *******************************************/
+void ImageEncoder::EncodeBMP(const SurfaceView& src, bool alpha, std::vector<unsigned char>& out)
+{
+	// The headers take 122 bytes: two bytes of padding put the pixels on a 4 bytes boundary
+	constexpr unsigned int dataOffset = 124u;
+	const unsigned int width     = src.GetWidth();
+	const unsigned int height    = src.GetHeight();
+	const unsigned int imageSize = width * height * (unsigned int)sizeof(Color);
+	out.assign(dataOffset + (size_t)imageSize, 0u);
+	unsigned char* p = out.data();
+
+	// BITMAPFILEHEADER
+	Put16LE(p, 0x4D42u);
+	Put32LE(p + 2, dataOffset + imageSize);
+	Put32LE(p + 10, dataOffset);
+	// BITMAPV4HEADER, 32bpp BI_BITFIELDS with a negative height (top-down rows), so the Color
+	// dwords (AARRGGBB, little endian BGRA in memory) can be written as they are. The alpha
+	// mask tells readers (and SurfaceView::MapFile) that the 4th byte is alpha
+	Put32LE(p + 14, 108u);
+	Put32LE(p + 18, width);
+	Put32LE(p + 22, (unsigned int)-(int)height);
+	Put16LE(p + 26, 1u);
+	Put16LE(p + 28, 32u);
+	Put32LE(p + 30, 3u);
+	Put32LE(p + 34, imageSize);
+	Put32LE(p + 38, 2835u);
+	Put32LE(p + 42, 2835u);
+	Put32LE(p + 54, 0x00FF0000u);
+	Put32LE(p + 58, 0x0000FF00u);
+	Put32LE(p + 62, 0x000000FFu);
+	Put32LE(p + 66, 0xFF000000u);
+	// LCS_sRGB
+	Put32LE(p + 70, 0x73524742u);
+
+	for (unsigned int y = 0u; y < height; y++)
+	{
+		unsigned char* pRow = p + dataOffset + (size_t)width * sizeof(Color) * y;
+		memcpy(pRow, src.GetRowPtr(y), (size_t)width * sizeof(Color));
+		if (!alpha)
+		{
+			for (unsigned int x = 0u; x < width; x++)
+			{
+				pRow[4u * x + 3u] = 255u;
+			}
+		}
+	}
+}
+
+/***************************************************************************************/
+/************************************* DEFLATE *****************************************/
+namespace
+{
+	// The fixed Huffman codes of RFC 1951, bit reversed (the stream is LSB first)
+	struct FixedCodes
+	{
+		unsigned short litCode[288];
+		unsigned char litLength[288];
+		unsigned char distCode[30];
+		// Length symbol (minus 257) for every match length
+		unsigned char lengthSymbol[259];
+		FixedCodes() noexcept
+		{
+			auto Reverse = [](unsigned int code, unsigned int length)
+			{
+				unsigned int reversed = 0u;
+				for (unsigned int i = 0u; i < length; i++)
+				{
+					reversed |= ((code >> i) & 1u) << (length - 1u - i);
+				}
+				return reversed;
+			};
+			for (unsigned int s = 0u; s < 288u; s++)
+			{
+				unsigned int code;
+				unsigned int length;
+				if (s < 144u)
+				{
+					code = 0x30u + s;
+					length = 8u;
+				}
+				else if (s < 256u)
+				{
+					code = 0x190u + s - 144u;
+					length = 9u;
+				}
+				else if (s < 280u)
+				{
+					code = s - 256u;
+					length = 7u;
+				}
+				else
+				{
+					code = 0xC0u + s - 280u;
+					length = 8u;
+				}
+				litCode[s] = (unsigned short)Reverse(code, length);
+				litLength[s] = (unsigned char)length;
+			}
+			for (unsigned int s = 0u; s < 30u; s++)
+			{
+				distCode[s] = (unsigned char)Reverse(s, 5u);
+			}
+			unsigned int symbol = 0u;
+			for (unsigned int length = 3u; length <= 258u; length++)
+			{
+				while (symbol < 28u && lengthBase[symbol + 1u] <= length)
+				{
+					symbol++;
+				}
+				lengthSymbol[length] = (unsigned char)symbol;
+			}
+		}
+		static constexpr unsigned short lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+		static constexpr unsigned char lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+		static constexpr unsigned short distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+		static constexpr unsigned char distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+	};
+
+	// LSB-first bit writer on a buffer sized for the worst case up front
+	class BitWriter
+	{
+	public:
+		BitWriter(unsigned char* p) noexcept
+			:
+			p(p)
+		{}
+		void Put(unsigned int value, unsigned int n) noexcept
+		{
+			bits |= (uint64_t)value << count;
+			count += n;
+			if (count >= 32u)
+			{
+				Put32LE(p, (unsigned int)bits);
+				p += 4;
+				bits >>= 32;
+				count -= 32u;
+			}
+		}
+		// Flush the last partial byte, returns the end of the written data
+		unsigned char* Finish() noexcept
+		{
+			while (count > 0u)
+			{
+				*p++ = (unsigned char)bits;
+				bits >>= 8;
+				count = count > 8u ? count - 8u : 0u;
+			}
+			return p;
+		}
+	private:
+		unsigned char* p;
+		uint64_t bits = 0u;
+		unsigned int count = 0u;
+	};
+}
+
+void ImageEncoder::Deflate(const unsigned char* pData, size_t size, std::vector<unsigned char>& out)
+{
+	static const FixedCodes codes;
+	constexpr unsigned int hashBits = 15u;
+	constexpr size_t windowSize = 32768u;
+	constexpr size_t maxMatch = 258u;
+
+	// Worst case: every byte is a 9 bits literal
+	const size_t start = out.size();
+	out.resize(start + size + size / 8u + 16u);
+	BitWriter bw(out.data() + start);
+
+	// A single final block with the fixed codes
+	bw.Put(1u, 1u);
+	bw.Put(1u, 2u);
+	auto PutLiteral = [&](unsigned int c)
+	{
+		bw.Put(codes.litCode[c], codes.litLength[c]);
+	};
+
+	// Greedy matching against the last position seen for every 4 bytes hash
+	std::unique_ptr<int[]> table(new int[1u << hashBits]);
+	std::fill(table.get(), table.get() + (1u << hashBits), -1);
+	size_t i = 0u;
+	while (i + 4u <= size)
+	{
+		uint32_t v;
+		memcpy(&v, pData + i, 4u);
+		const unsigned int h = (v * 2654435761u) >> (32u - hashBits);
+		const int candidate = table[h];
+		table[h] = (int)i;
+		uint32_t w = 0u;
+		if (candidate >= 0)
+		{
+			memcpy(&w, pData + candidate, 4u);
+		}
+		if (candidate < 0 || i - (size_t)candidate > windowSize || v != w)
+		{
+			PutLiteral(pData[i++]);
+			continue;
+		}
+		// Extend the match 8 bytes at a time
+		const size_t maxLength = std::min(maxMatch, size - i);
+		size_t length = 4u;
+		while (length + 8u <= maxLength)
+		{
+			uint64_t a;
+			uint64_t b;
+			memcpy(&a, pData + candidate + length, 8u);
+			memcpy(&b, pData + i + length, 8u);
+			if (a != b)
+			{
+				length += std::countr_zero(a ^ b) / 8u;
+				break;
+			}
+			length += 8u;
+		}
+		if (length + 8u > maxLength)
+		{
+			while (length < maxLength && pData[candidate + length] == pData[i + length])
+			{
+				length++;
+			}
+		}
+		const unsigned int distance = (unsigned int)(i - (size_t)candidate);
+		const unsigned int lengthSymbol = codes.lengthSymbol[length];
+		PutLiteral(257u + lengthSymbol);
+		bw.Put((unsigned int)length - FixedCodes::lengthBase[lengthSymbol], FixedCodes::lengthExtra[lengthSymbol]);
+		const unsigned int distSymbol = (unsigned int)(std::upper_bound(std::begin(FixedCodes::distBase), std::end(FixedCodes::distBase), distance) - std::begin(FixedCodes::distBase)) - 1u;
+		bw.Put(codes.distCode[distSymbol], 5u);
+		bw.Put(distance - FixedCodes::distBase[distSymbol], FixedCodes::distExtra[distSymbol]);
+		i += length;
+	}
+	while (i < size)
+	{
+		PutLiteral(pData[i++]);
+	}
+	PutLiteral(256u);
+	out.resize(bw.Finish() - out.data());
+}
+
+/***************************************************************************************/
+/*************************************** PNG *******************************************/
+static unsigned int Crc32(const unsigned char* p, size_t size) noexcept
+{
+	static const auto table = []()
+	{
+		std::array<unsigned int, 256> t;
+		for (unsigned int n = 0u; n < 256u; n++)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+			{
+				c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			t[n] = c;
+		}
+		return t;
+	}();
+	unsigned int crc = 0xFFFFFFFFu;
+	for (size_t i = 0u; i < size; i++)
+	{
+		crc = table[(crc ^ p[i]) & 0xFFu] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFFu;
+}
+
+static unsigned int Adler32(const unsigned char* p, size_t size) noexcept
+{
+	// 5552 is the largest n for which the sums can't overflow before the modulo
+	unsigned int a = 1u;
+	unsigned int b = 0u;
+	while (size > 0u)
+	{
+		const size_t n = std::min<size_t>(size, 5552u);
+		for (size_t i = 0u; i < n; i++)
+		{
+			a += p[i];
+			b += a;
+		}
+		a %= 65521u;
+		b %= 65521u;
+		p += n;
+		size -= n;
+	}
+	return (b << 16) | a;
+}
+
+void ImageEncoder::EncodePNG(const SurfaceView& src, bool alpha, std::vector<unsigned char>& out)
+{
+	const unsigned int width     = src.GetWidth();
+	const unsigned int height    = src.GetHeight();
+	const unsigned int nChannels = alpha ? 4u : 3u;
+	const size_t rowBytes = 1u + (size_t)width * nChannels;
+
+	// Scanlines with the Sub filter: flat areas become zeros, gradients become constants
+	std::vector<unsigned char> raw(rowBytes * height);
+	for (unsigned int y = 0u; y < height; y++)
+	{
+		const Color* pSrc = src.GetRowPtr(y);
+		unsigned char* pRow = raw.data() + rowBytes * y;
+		*pRow++ = 1u;
+		Color prev = 0u;
+		for (unsigned int x = 0u; x < width; x++)
+		{
+			const Color c = pSrc[x];
+			*pRow++ = (unsigned char)(c.GetR() - prev.GetR());
+			*pRow++ = (unsigned char)(c.GetG() - prev.GetG());
+			*pRow++ = (unsigned char)(c.GetB() - prev.GetB());
+			if (alpha)
+			{
+				*pRow++ = (unsigned char)(c.GetX() - prev.GetX());
+			}
+			prev = c;
+		}
+	}
+
+	out.clear();
+	static constexpr unsigned char signature[8] = { 0x89u, 'P', 'N', 'G', '\r', '\n', 0x1Au, '\n' };
+	out.insert(out.end(), signature, signature + 8);
+	// Chunks are length, type, data, CRC of type and data
+	auto BeginChunk = [&out](const char* type)
+	{
+		Append32BE(out, 0u);
+		out.insert(out.end(), type, type + 4);
+		return out.size() - 4u;
+	};
+	auto EndChunk = [&out](size_t typeOffset)
+	{
+		Put32BE(out.data() + typeOffset - 4u, (unsigned int)(out.size() - typeOffset - 4u));
+		Append32BE(out, Crc32(out.data() + typeOffset, out.size() - typeOffset));
+	};
+
+	size_t chunk = BeginChunk("IHDR");
+	Append32BE(out, width);
+	Append32BE(out, height);
+	const unsigned char header[5] = { 8u, (unsigned char)(alpha ? 6u : 2u), 0u, 0u, 0u };
+	out.insert(out.end(), header, header + 5);
+	EndChunk(chunk);
+
+	// One IDAT holding the whole zlib stream
+	chunk = BeginChunk("IDAT");
+	out.push_back(0x78u);
+	out.push_back(0x01u);
+	Deflate(raw.data(), raw.size(), out);
+	Append32BE(out, Adler32(raw.data(), raw.size()));
+	EndChunk(chunk);
+
+	chunk = BeginChunk("IEND");
+	EndChunk(chunk);
+}
+
+/***************************************************************************************/
+/*************************************** QOI *******************************************/
+void ImageEncoder::EncodeQOI(const SurfaceView& src, bool alpha, std::vector<unsigned char>& out)
+{
+	const unsigned int width  = src.GetWidth();
+	const unsigned int height = src.GetHeight();
+
+	// Worst case is 5 bytes per pixel, plus the header and the end marker
+	out.resize(14u + (size_t)width * height * 5u + 8u);
+	unsigned char* p = out.data();
+	memcpy(p, "qoif", 4u);
+	Put32BE(p + 4, width);
+	Put32BE(p + 8, height);
+	p[12] = (unsigned char)(alpha ? 4u : 3u);
+	p[13] = 0u;
+	p += 14;
+
+	unsigned int index[64] = {};
+	unsigned int prev = 0xFF000000u;
+	unsigned int run = 0u;
+	const unsigned int alphaMask = alpha ? 0u : 0xFF000000u;
+	for (unsigned int y = 0u; y < height; y++)
+	{
+		const Color* pSrc = src.GetRowPtr(y);
+		for (unsigned int x = 0u; x < width; x++)
+		{
+			const unsigned int px = pSrc[x].dword | alphaMask;
+			if (px == prev)
+			{
+				if (++run == 62u)
+				{
+					*p++ = (unsigned char)(0xC0u | (run - 1u));
+					run = 0u;
+				}
+				continue;
+			}
+			if (run > 0u)
+			{
+				*p++ = (unsigned char)(0xC0u | (run - 1u));
+				run = 0u;
+			}
+			const unsigned int r = (px >> 16) & 0xFFu;
+			const unsigned int g = (px >> 8) & 0xFFu;
+			const unsigned int b = px & 0xFFu;
+			const unsigned int a = px >> 24;
+			const unsigned int hash = (r * 3u + g * 5u + b * 7u + a * 11u) % 64u;
+			if (index[hash] == px)
+			{
+				*p++ = (unsigned char)hash;
+			}
+			else
+			{
+				index[hash] = px;
+				if (a == (prev >> 24))
+				{
+					const int vr = (signed char)(r - ((prev >> 16) & 0xFFu));
+					const int vg = (signed char)(g - ((prev >> 8) & 0xFFu));
+					const int vb = (signed char)(b - (prev & 0xFFu));
+					const int vgr = vr - vg;
+					const int vgb = vb - vg;
+					if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1)
+					{
+						*p++ = (unsigned char)(0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+					}
+					else if (vg >= -32 && vg <= 31 && vgr >= -8 && vgr <= 7 && vgb >= -8 && vgb <= 7)
+					{
+						*p++ = (unsigned char)(0x80 | (vg + 32));
+						*p++ = (unsigned char)(((vgr + 8) << 4) | (vgb + 8));
+					}
+					else
+					{
+						*p++ = 0xFEu;
+						*p++ = (unsigned char)r;
+						*p++ = (unsigned char)g;
+						*p++ = (unsigned char)b;
+					}
+				}
+				else
+				{
+					*p++ = 0xFFu;
+					*p++ = (unsigned char)r;
+					*p++ = (unsigned char)g;
+					*p++ = (unsigned char)b;
+					*p++ = (unsigned char)a;
+				}
+			}
+			prev = px;
+		}
+	}
+	if (run > 0u)
+	{
+		*p++ = (unsigned char)(0xC0u | (run - 1u));
+	}
+	static constexpr unsigned char endMarker[8] = { 0u, 0u, 0u, 0u, 0u, 0u, 0u, 1u };
+	memcpy(p, endMarker, 8u);
+	p += 8;
+	out.resize(p - out.data());
+}
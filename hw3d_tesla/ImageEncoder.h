@@ -0,0 +1,32 @@
+#pragma once
+#include "SurfaceView.h"
+#include <string>
+#include <vector>
+
+// Portable encoders used by Surface::Save and the ImageWriter. Everything is encoded in
+// memory first, the file is then written in one go.
+class ImageEncoder
+{
+public:
+	enum class Format
+	{
+		BMP,
+		PNG,
+		QOI
+	};
+public:
+	// Pick the format from the extension (.bmp, .png or .qoi), throws for anything else
+	static Format FormatFromFilename(const std::string& filename);
+	// Encode and write to a file. Without alpha the images are stored opaque
+	static void Save(const SurfaceView& src, const std::string& filename, bool alpha);
+	static void Encode(const SurfaceView& src, Format format, bool alpha, std::vector<unsigned char>& out);
+	// 32bpp BI_BITFIELDS with an alpha mask, top-down rows, pixels 4 bytes aligned in the file
+	// (SurfaceView::MapFile can use them in place)
+	static void EncodeBMP(const SurfaceView& src, bool alpha, std::vector<unsigned char>& out);
+	// 8 bits RGB or RGBA, Sub filter, fast deflate
+	static void EncodePNG(const SurfaceView& src, bool alpha, std::vector<unsigned char>& out);
+	// "Quite OK Image" format: lossless and a lot faster than PNG
+	static void EncodeQOI(const SurfaceView& src, bool alpha, std::vector<unsigned char>& out);
+	// Raw DEFLATE stream (RFC 1951): greedy LZ77 matching with fixed Huffman codes, appended to out
+	static void Deflate(const unsigned char* pData, size_t size, std::vector<unsigned char>& out);
+};
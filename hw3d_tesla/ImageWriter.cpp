@@ -0,0 +1,186 @@
+#include "ImageWriter.h"
+#include "TeslaTimer.h"
+#include <algorithm>
+#include <fstream>
+#include <optional>
+
+ImageWriter::ImageWriter(unsigned int capacity, OverflowPolicy policy, unsigned int nThreads)
+	:
+	capacity(std::max(capacity, 1u)),
+	nThreads(std::max(nThreads, 1u)),
+	policy(policy)
+{
+	for (unsigned int i = 0u; i < this->nThreads; i++)
+	{
+		threads.emplace_back(&ImageWriter::WriterLoop, this);
+	}
+}
+
+ImageWriter::~ImageWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		quitting = true;
+	}
+	cvJob.notify_all();
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+}
+
+bool ImageWriter::Submit(const SurfaceView& image, std::string filename, bool alpha)
+{
+	const ImageEncoder::Format format = ImageEncoder::FormatFromFilename(filename);
+
+	// Take a slot (or give up), and a pooled Surface of the right size if there's one
+	std::unique_lock<std::mutex> lock(mtx);
+	RethrowError();
+	if (nQueued >= capacity)
+	{
+		if (policy == OverflowPolicy::Drop)
+		{
+			stats.dropped++;
+			return false;
+		}
+		TeslaTimer<float> blockTimer;
+		cvSlot.wait(lock, [this] { return nQueued < capacity; });
+		stats.blockedTime += blockTimer.Mark();
+	}
+	nQueued++;
+	stats.maxQueueDepth = std::max(stats.maxQueueDepth, nQueued);
+	auto pooled = std::find_if(pool.begin(), pool.end(), [&image](const Surface& s)
+	{
+		return s.GetWidth() == image.GetWidth() && s.GetHeight() == image.GetHeight();
+	});
+	std::optional<Surface> snapshot;
+	if (pooled != pool.end())
+	{
+		snapshot.emplace(std::move(*pooled));
+		pool.erase(pooled);
+	}
+	lock.unlock();
+
+	// The copy is the only work done on the caller thread
+	TeslaTimer<float> copyTimer;
+	if (!snapshot)
+	{
+		snapshot.emplace(image.GetWidth(), image.GetHeight());
+	}
+	snapshot->Copy(image);
+	const float copyTime = copyTimer.Mark();
+
+	lock.lock();
+	jobs.push_back({ std::move(*snapshot), std::move(filename), format, alpha });
+	stats.submitted++;
+	stats.copyTime += copyTime;
+	lock.unlock();
+	cvJob.notify_one();
+	return true;
+}
+
+void ImageWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	cvIdle.wait(lock, [this] { return nQueued == 0u && nBusy == 0u; });
+	RethrowError();
+}
+
+ImageWriter::Statistics ImageWriter::GetStatistics() const noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	Statistics s = stats;
+	s.queueDepth = nQueued;
+	return s;
+}
+
+unsigned int ImageWriter::GetQueueDepth() const noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return nQueued;
+}
+
+unsigned int ImageWriter::GetCapacity() const noexcept
+{
+	return capacity;
+}
+
+void ImageWriter::WriterLoop()
+{
+	// Every thread reuses its encoding buffer
+	std::vector<unsigned char> encoded;
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		cvJob.wait(lock, [this] { return quitting || !jobs.empty(); });
+		// The queue is drained before quitting
+		if (jobs.empty())
+		{
+			return;
+		}
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+		nBusy++;
+		lock.unlock();
+
+		TeslaTimer<float> encodeTimer;
+		bool failed = false;
+		try
+		{
+			ImageEncoder::Encode(job.image, job.format, job.alpha, encoded);
+			std::ofstream file(job.filename, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(encoded.data()), (std::streamsize)encoded.size());
+			if (!file)
+			{
+				throw Surface::Exception(__LINE__, __FILE__, "Writing image to [" + job.filename + "]: failed to write the file.");
+			}
+		}
+		catch (...)
+		{
+			failed = true;
+			lock.lock();
+			if (!pError)
+			{
+				pError = std::current_exception();
+			}
+			lock.unlock();
+		}
+		const float encodeTime = encodeTimer.Mark();
+
+		lock.lock();
+		nBusy--;
+		nQueued--;
+		stats.encodeTime += encodeTime;
+		if (failed)
+		{
+			stats.failed++;
+		}
+		else
+		{
+			stats.written++;
+		}
+		// Keep enough snapshots around for a full queue
+		if (pool.size() < capacity + nThreads)
+		{
+			pool.push_back(std::move(job.image));
+		}
+		const bool idle = nQueued == 0u && nBusy == 0u;
+		lock.unlock();
+		cvSlot.notify_one();
+		if (idle)
+		{
+			cvIdle.notify_all();
+		}
+	}
+}
+
+void ImageWriter::RethrowError()
+{
+	// Called with the lock held
+	if (pError)
+	{
+		std::exception_ptr e = nullptr;
+		std::swap(e, pError);
+		std::rethrow_exception(e);
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "ImageEncoder.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Encodes and writes images on background threads. Submit only copies the pixels into a
+// pooled Surface, so screenshots and frame dumps don't stall the render thread.
+class ImageWriter
+{
+public:
+	// What Submit does when the queue is full
+	enum class OverflowPolicy
+	{
+		Block, // wait for a slot (nothing is lost, the caller slows down)
+		Drop   // give the image up and return false
+	};
+	struct Statistics
+	{
+		unsigned long long submitted;
+		unsigned long long written;
+		unsigned long long dropped;
+		unsigned long long failed;
+		unsigned int queueDepth;
+		unsigned int maxQueueDepth;
+		float blockedTime; // seconds spent by Submit waiting for a slot
+		float copyTime;    // seconds spent by Submit copying the pixels
+		float encodeTime;  // seconds spent by the writer threads encoding and writing
+	};
+public:
+	ImageWriter(unsigned int capacity = 4u, OverflowPolicy policy = OverflowPolicy::Block, unsigned int nThreads = 1u);
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator = (const ImageWriter&) = delete;
+	// Writes everything still queued before returning
+	~ImageWriter();
+	// Snapshot the image and queue it (the format comes from the extension). Without alpha (the
+	// default, like Surface::Save) the file is stored opaque. Returns false if it was dropped.
+	// Rethrows the first failed write
+	bool Submit(const SurfaceView& image, std::string filename, bool alpha = false);
+	// Wait until every queued image is written. Rethrows the first failed write
+	void Flush();
+	Statistics GetStatistics() const noexcept;
+	unsigned int GetQueueDepth() const noexcept;
+	unsigned int GetCapacity() const noexcept;
+private:
+	struct Job
+	{
+		Surface image;
+		std::string filename;
+		ImageEncoder::Format format;
+		bool alpha;
+	};
+private:
+	void WriterLoop();
+	void RethrowError();
+private:
+	const unsigned int capacity;
+	const unsigned int nThreads;
+	const OverflowPolicy policy;
+	mutable std::mutex mtx;
+	std::condition_variable cvJob;
+	std::condition_variable cvSlot;
+	std::condition_variable cvIdle;
+	std::deque<Job> jobs;
+	// Slots taken by Submit (the copy is done outside of the lock) or waiting in jobs
+	unsigned int nQueued = 0u;
+	unsigned int nBusy = 0u;
+	bool quitting = false;
+	// Snapshot Surfaces given back by the writers
+	std::vector<Surface> pool;
+	std::exception_ptr pError;
+	Statistics stats = {};
+	std::vector<std::thread> threads;
+};
@@ -0,0 +1,422 @@
+#include "LineRenderer.h"
+#include "ThreadPool.h"
+#include "TeslaTimer.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+	// Vertices and lines handed to each task of the parallel loops
+	constexpr size_t VertexBlockSize = 4096u;
+	constexpr size_t LineChunkSize = 4096u;
+	// Bits of the fixed point minor axis coordinate
+	constexpr int FractionBits = 16;
+	constexpr long long FixedOne = 1ll << FractionBits;
+	constexpr long long FixedHalf = FixedOne / 2;
+
+	// src over dst with coverage a (0 - 255), src is opaque; two channels per multiply,
+	// rounded like x / 255 for each channel
+	constexpr unsigned int BlendCoverage(unsigned int dst, unsigned int src, unsigned int a) noexcept
+	{
+		const unsigned int b = 255u - a;
+		unsigned int rb = (src & 0x00FF00FFu) * a + (dst & 0x00FF00FFu) * b + 0x00800080u;
+		unsigned int ag = (((src >> 8) & 0x000000FFu) | 0x00FF0000u) * a + ((dst >> 8) & 0x00FF00FFu) * b + 0x00800080u;
+		rb = ((rb + ((rb >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+		ag = (ag + ((ag >> 8) & 0x00FF00FFu)) & 0xFF00FF00u;
+		return ag | rb;
+	}
+
+	// Shorten [t0, t1] (parameters from a to b) to where da + (db - da) * t >= 0; false if nothing is left
+	bool ClipParameter(float da, float db, float& t0, float& t1) noexcept
+	{
+		if (da < 0.0f && db < 0.0f)
+		{
+			return false;
+		}
+		if (da < 0.0f)
+		{
+			t0 = std::max(t0, da / (da - db));
+		}
+		else if (db < 0.0f)
+		{
+			t1 = std::min(t1, da / (da - db));
+		}
+		return t0 <= t1;
+	}
+}
+
+LineRenderer::LineRenderer(ThreadPool* pPool) noexcept
+	:
+	pPool(pPool)
+{
+}
+
+void LineRenderer::Begin(Surface& target) noexcept
+{
+	pTarget = &target;
+	width = target.GetWidth();
+	height = target.GetHeight();
+	nChunks = 0u;
+	stats = {};
+}
+
+void LineRenderer::DrawIndexed(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t nIndices,
+	const Matrix& transform, Color color)
+{
+	assert(pTarget != nullptr && "Draw called outside of Begin / End");
+	TeslaTimer<float> timer;
+
+	// Every vertex is transformed once, no matter how many lines share it
+	clipPositions.resize(nVertices);
+	const auto TransformBlock = [&](size_t begin, size_t end)
+	{
+		const float(&m)[4][4] = transform.elements;
+		for (size_t i = begin; i < end; i++)
+		{
+			const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(pPositions) + i * stride);
+			ClipVertex& c = clipPositions[i];
+			c.x = m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3];
+			c.y = m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3];
+			c.z = m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3];
+			c.w = m[3][0] * p[0] + m[3][1] * p[1] + m[3][2] * p[2] + m[3][3];
+		}
+	};
+	const unsigned int nVertexBlocks = (unsigned int)((nVertices + VertexBlockSize - 1u) / VertexBlockSize);
+	if (pPool != nullptr && nVertexBlocks > 1u)
+	{
+		pPool->ParallelFor(nVertexBlocks, [&](unsigned int b)
+		{
+			TransformBlock(b * VertexBlockSize, std::min(nVertices, (b + 1u) * VertexBlockSize));
+		});
+	}
+	else
+	{
+		TransformBlock(0u, nVertices);
+	}
+
+	// Line setup, each chunk filling its own list
+	const size_t nLines = nIndices / 2u;
+	const unsigned int nNewChunks = (unsigned int)((nLines + LineChunkSize - 1u) / LineChunkSize);
+	if (chunks.size() < nChunks + nNewChunks)
+	{
+		chunks.resize(nChunks + nNewChunks);
+	}
+	const auto SetupChunkAt = [&](unsigned int c)
+	{
+		const size_t first = c * LineChunkSize;
+		const size_t count = std::min(LineChunkSize, nLines - first);
+		SetupLines(pIndices + first * 2u, count, color, chunks[nChunks + c]);
+	};
+	if (pPool != nullptr && nNewChunks > 1u)
+	{
+		pPool->ParallelFor(nNewChunks, SetupChunkAt);
+	}
+	else
+	{
+		for (unsigned int c = 0u; c < nNewChunks; c++)
+		{
+			SetupChunkAt(c);
+		}
+	}
+	for (unsigned int c = 0u; c < nNewChunks; c++)
+	{
+		stats.linesCulled += chunks[nChunks + c].culled;
+		stats.linesClipped += chunks[nChunks + c].clipped;
+	}
+	nChunks += nNewChunks;
+	stats.linesSubmitted += nLines;
+	stats.transformTime += timer.Mark();
+}
+
+void LineRenderer::End()
+{
+	assert(pTarget != nullptr && "End called without Begin");
+	TeslaTimer<float> timer;
+
+	// Counting sort of the lines into the bands they cross, in draw order
+	const unsigned int nBands = (height + BandHeight - 1u) / BandHeight;
+	binStart.assign((size_t)nBands + 1u, 0u);
+	for (size_t c = 0u; c < nChunks; c++)
+	{
+		for (const Segment& s : chunks[c].segments)
+		{
+			for (unsigned int b = s.minRow / BandHeight; b <= s.maxRow / BandHeight; b++)
+			{
+				binStart[b + 1u]++;
+			}
+		}
+	}
+	bands.clear();
+	for (unsigned int b = 0u; b < nBands; b++)
+	{
+		if (binStart[b + 1u] != 0u)
+		{
+			bands.push_back(b);
+		}
+		binStart[b + 1u] += binStart[b];
+	}
+	binEntries.resize(binStart.back());
+	for (size_t c = 0u; c < nChunks; c++)
+	{
+		for (const Segment& s : chunks[c].segments)
+		{
+			for (unsigned int b = s.minRow / BandHeight; b <= s.maxRow / BandHeight; b++)
+			{
+				binEntries[binStart[b]++] = &s;
+			}
+		}
+	}
+	// Every start moved up by one bin: shift them back
+	std::copy_backward(binStart.begin(), binStart.end() - 1, binStart.end());
+	binStart[0] = 0u;
+	stats.bandEntries = binEntries.size();
+	stats.binTime = timer.Mark();
+
+	// Bands own their rows and their dirty flags: no synchronization needed
+	bandCounters.assign(bands.size(), {});
+	if (pPool != nullptr && bands.size() > 1u)
+	{
+		pPool->ParallelFor((unsigned int)bands.size(), [this](unsigned int i)
+		{
+			DrawBand(bands[i], bandCounters[i]);
+		});
+	}
+	else
+	{
+		for (size_t i = 0u; i < bands.size(); i++)
+		{
+			DrawBand(bands[i], bandCounters[i]);
+		}
+	}
+	for (size_t i = 0u; i < bands.size(); i++)
+	{
+		stats.pixelsWritten += bandCounters[i].written;
+	}
+	stats.drawTime = timer.Mark();
+}
+
+void LineRenderer::SetMode(Mode mode_in) noexcept
+{
+	mode = mode_in;
+}
+
+LineRenderer::Mode LineRenderer::GetMode() const noexcept
+{
+	return mode;
+}
+
+const LineRenderer::Statistics& LineRenderer::GetStatistics() const noexcept
+{
+	return stats;
+}
+
+void LineRenderer::SetupLines(const unsigned int* pIndices, size_t nLines, Color color, SetupChunk& chunk) const
+{
+	chunk.segments.clear();
+	chunk.culled = 0u;
+	chunk.clipped = 0u;
+	const size_t nVertices = clipPositions.size();
+	// One pixel of margin keeps the anti-aliased edges of lines along the borders
+	const float left = -1.0f;
+	const float top = -1.0f;
+	const float right = (float)width + 1.0f;
+	const float bottom = (float)height + 1.0f;
+	for (size_t l = 0u; l < nLines; l++)
+	{
+		const unsigned int i0 = pIndices[l * 2u + 0u];
+		const unsigned int i1 = pIndices[l * 2u + 1u];
+		if (i0 >= nVertices || i1 >= nVertices)
+		{
+			chunk.culled++;
+			continue;
+		}
+
+		// Near (z >= 0) and far (z <= w) planes in clip space
+		const ClipVertex& a = clipPositions[i0];
+		const ClipVertex& b = clipPositions[i1];
+		float t0 = 0.0f;
+		float t1 = 1.0f;
+		if (!ClipParameter(a.z, b.z, t0, t1) || !ClipParameter(a.w - a.z, b.w - b.z, t0, t1))
+		{
+			chunk.culled++;
+			continue;
+		}
+		bool clipped = t0 > 0.0f || t1 < 1.0f;
+		const ClipVertex ca = { a.x + (b.x - a.x) * t0, a.y + (b.y - a.y) * t0, a.z + (b.z - a.z) * t0, a.w + (b.w - a.w) * t0 };
+		const ClipVertex cb = { a.x + (b.x - a.x) * t1, a.y + (b.y - a.y) * t1, a.z + (b.z - a.z) * t1, a.w + (b.w - a.w) * t1 };
+		if (ca.w <= 0.0f || cb.w <= 0.0f)
+		{
+			chunk.culled++;
+			continue;
+		}
+
+		// Screen space (NDC y goes up, rows go down), then Liang-Barsky against the target
+		const float ax = (ca.x / ca.w * 0.5f + 0.5f) * (float)width;
+		const float ay = (0.5f - ca.y / ca.w * 0.5f) * (float)height;
+		const float dx = (cb.x / cb.w * 0.5f + 0.5f) * (float)width - ax;
+		const float dy = (0.5f - cb.y / cb.w * 0.5f) * (float)height - ay;
+		float s0 = 0.0f;
+		float s1 = 1.0f;
+		if (!ClipParameter(ax - left, ax + dx - left, s0, s1) || !ClipParameter(right - ax, right - ax - dx, s0, s1) ||
+			!ClipParameter(ay - top, ay + dy - top, s0, s1) || !ClipParameter(bottom - ay, bottom - ay - dy, s0, s1))
+		{
+			chunk.culled++;
+			continue;
+		}
+		clipped = clipped || s0 > 0.0f || s1 < 1.0f;
+
+		Segment s;
+		s.x0 = ax + dx * s0;
+		s.y0 = ay + dy * s0;
+		s.x1 = ax + dx * s1;
+		s.y1 = ay + dy * s1;
+		if (s.x0 == s.x1 && s.y0 == s.y1)
+		{
+			chunk.culled++;
+			continue;
+		}
+		// Anti-aliased lines reach half a pixel past the line on both sides
+		const float minY = std::max(std::min(s.y0, s.y1) - 1.0f, 0.0f);
+		const float maxY = std::min(std::max(s.y0, s.y1) + 1.0f, (float)(height - 1u));
+		if (height == 0u || minY > maxY)
+		{
+			chunk.culled++;
+			continue;
+		}
+		s.minRow = (unsigned int)minY;
+		s.maxRow = (unsigned int)maxY;
+		s.color = color;
+		chunk.segments.push_back(s);
+		if (clipped)
+		{
+			chunk.clipped++;
+		}
+	}
+}
+
+void LineRenderer::DrawBand(unsigned int band, BandCounters& counters) const noexcept
+{
+	const unsigned int rowBegin = band * BandHeight;
+	const unsigned int rowEnd = std::min(rowBegin + BandHeight, height);
+	counters.minX = width;
+	counters.maxX = 0u;
+	for (unsigned int k = binStart[band]; k < binStart[band + 1u]; k++)
+	{
+		const Segment& s = *binEntries[k];
+		if (mode == Mode::AntiAliased)
+		{
+			DrawSegment<true>(s, rowBegin, rowEnd, counters);
+		}
+		else
+		{
+			DrawSegment<false>(s, rowBegin, rowEnd, counters);
+		}
+		// Columns it may have written
+		const float minX = std::max(std::min(s.x0, s.x1) - 1.0f, 0.0f);
+		const float maxX = std::min(std::max(s.x0, s.x1) + 1.0f, (float)(width - 1u));
+		counters.minX = std::min(counters.minX, (unsigned int)minX);
+		counters.maxX = std::max(counters.maxX, (unsigned int)maxX);
+	}
+	if (counters.written != 0u)
+	{
+		pTarget->MarkDirty({ counters.minX, rowBegin, counters.maxX + 1u, rowEnd });
+	}
+}
+
+// The pixels of a line depend only on the line, not on where a band starts: the minor axis
+// coordinate of step k is computed from the first step in fixed point, never accumulated
+template<bool antiAliased>
+void LineRenderer::DrawSegment(const Segment& s, unsigned int rowBegin, unsigned int rowEnd, BandCounters& counters) const noexcept
+{
+	const unsigned int color = s.color.dword;
+	const auto Plot = [&](int x, int y, unsigned int coverage)
+	{
+		if (x < 0 || x >= (int)width || y < (int)rowBegin || y >= (int)rowEnd || coverage == 0u)
+		{
+			return;
+		}
+		Color& dst = pTarget->GetRowPtr((unsigned int)y)[x];
+		dst = coverage == 255u ? Color(color) : Color(BlendCoverage(dst.dword, color, coverage));
+		counters.written++;
+	};
+	// Minor axis position in fixed point at the center of the pixel: one pixel (aliased), or
+	// the pixels above and below the line weighted by their distance from it (Wu)
+	const auto PlotStep = [&](int major, long long minorFixed, bool xMajor)
+	{
+		if constexpr (antiAliased)
+		{
+			const long long t = minorFixed - FixedHalf;
+			const int minor = (int)(t >> FractionBits);
+			const unsigned int fraction = (unsigned int)((t >> (FractionBits - 8)) & 0xFF);
+			if (xMajor)
+			{
+				Plot(major, minor, 255u - fraction);
+				Plot(major, minor + 1, fraction);
+			}
+			else
+			{
+				Plot(minor, major, 255u - fraction);
+				Plot(minor + 1, major, fraction);
+			}
+		}
+		else
+		{
+			const int minor = (int)(minorFixed >> FractionBits);
+			if (xMajor)
+			{
+				Plot(major, minor, 255u);
+			}
+			else
+			{
+				Plot(minor, major, 255u);
+			}
+		}
+	};
+
+	float x0 = s.x0;
+	float y0 = s.y0;
+	float x1 = s.x1;
+	float y1 = s.y1;
+	const bool xMajor = std::abs(x1 - x0) >= std::abs(y1 - y0);
+	if (!xMajor)
+	{
+		std::swap(x0, y0);
+		std::swap(x1, y1);
+	}
+	if (x0 > x1)
+	{
+		std::swap(x0, x1);
+		std::swap(y0, y1);
+	}
+	// Steps whose pixel centers are in [x0, x1) along the major axis
+	const int first = (int)std::ceil(x0 - 0.5f);
+	const int last = (int)std::ceil(x1 - 0.5f);
+	if (first >= last)
+	{
+		return;
+	}
+	const float slope = (y1 - y0) / (x1 - x0);
+	const long long slopeFixed = std::llround((double)slope * (double)FixedOne);
+	const long long minorFirst = std::llround(((double)y0 + ((double)first + 0.5 - (double)x0) * (double)slope) * (double)FixedOne);
+
+	// Steps that can reach the rows of the band
+	int kBegin = 0;
+	int kEnd = last - first;
+	if (!xMajor)
+	{
+		kBegin = std::max(kBegin, (int)rowBegin - first);
+		kEnd = std::min(kEnd, (int)rowEnd - first);
+	}
+	else if (slopeFixed != 0)
+	{
+		const double kTop = ((double)((long long)rowBegin - 1) * (double)FixedOne - (double)minorFirst) / (double)slopeFixed;
+		const double kBottom = ((double)((long long)rowEnd + 1) * (double)FixedOne - (double)minorFirst) / (double)slopeFixed;
+		kBegin = std::max(kBegin, (int)std::floor(std::min(kTop, kBottom)) - 1);
+		kEnd = std::min(kEnd, (int)std::ceil(std::max(kTop, kBottom)) + 1);
+	}
+	for (int k = kBegin; k < kEnd; k++)
+	{
+		PlotStep(first + k, minorFirst + slopeFixed * k, xMajor);
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include "Surface.h"
+#include "Rasterizer.h"
+#include <vector>
+
+class ThreadPool;
+
+// Batched line drawing for wireframes and overlays (no depth test, later lines on top).
+// Draw transforms the vertices of a whole line list once, clips the lines against the near
+// and far planes and the target and sets them up in screen space; End bins them into bands
+// of BandHeight rows and draws the bands in parallel.
+//   lines.Begin(surface);
+//   lines.Draw(lineList, transform, color); // any number of times
+//   lines.End();
+// Lines are opaque (the alpha of the color is ignored); anti-aliased lines blend their edges.
+// Matrices and line lists follow the same conventions as the Rasterizer (Tesla::Mat4 and
+// Tesla::IndexedLineList).
+class LineRenderer
+{
+public:
+	enum class Mode
+	{
+		Aliased,     // one pixel per step along the major axis (same pixels as Bresenham)
+		AntiAliased  // Wu: two pixels per step, weighted by the distance from the line
+	};
+	using Matrix = Rasterizer::Matrix;
+	// Of the frame ended by the last End
+	struct Statistics
+	{
+		unsigned long long linesSubmitted;
+		unsigned long long linesCulled;    // completely outside, or shorter than a pixel
+		unsigned long long linesClipped;   // shortened by the near/far planes or the target edges
+		unsigned long long bandEntries;    // drawn lines times the bands they cross
+		unsigned long long pixelsWritten;
+		float transformTime;               // seconds spent in Draw
+		float binTime;                     // seconds spent binning in End
+		float drawTime;                    // seconds spent drawing the bands in End
+	};
+	// Rows per band, a multiple of the dirty tiles so that concurrent bands never share a dirty flag
+	static constexpr unsigned int BandHeight = Surface::DirtyTileSize;
+public:
+	// Without a pool everything runs on the calling thread
+	LineRenderer(ThreadPool* pPool = nullptr) noexcept;
+	LineRenderer(const LineRenderer&) = delete;
+	LineRenderer& operator = (const LineRenderer&) = delete;
+	// Start a frame drawing into target (which must outlive the frame)
+	void Begin(Surface& target) noexcept;
+	// transform goes from the positions of the list to clip space
+	template<typename Lines, typename Mat>
+	void Draw(const Lines& lines, const Mat& transform, Color color)
+	{
+		if (lines.vertices.empty() || lines.indices.empty())
+		{
+			return;
+		}
+		DrawIndexed(&lines.vertices[0].pos.x, sizeof(lines.vertices[0]), lines.vertices.size(),
+			lines.indices.data(), lines.indices.size(), Rasterizer::ToMatrix(transform), color);
+	}
+	// positions: x, y, z floats of vertex i at (const char*)pPositions + i * stride
+	void DrawIndexed(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t nIndices,
+		const Matrix& transform, Color color);
+	// Draw everything submitted since Begin
+	void End();
+	void SetMode(Mode mode) noexcept;
+	Mode GetMode() const noexcept;
+	const Statistics& GetStatistics() const noexcept;
+private:
+	struct ClipVertex
+	{
+		float x;
+		float y;
+		float z;
+		float w;
+	};
+	// Screen space line ready for the bands
+	struct Segment
+	{
+		// Ends in pixels (the center of pixel (x, y) is at x + 0.5, y + 0.5)
+		float x0;
+		float y0;
+		float x1;
+		float y1;
+		// Rows it can write, clamped to the target
+		unsigned int minRow;
+		unsigned int maxRow;
+		Color color;
+	};
+	// Lines set up by one slice of a Draw, and its counters
+	struct SetupChunk
+	{
+		std::vector<Segment> segments;
+		unsigned long long culled;
+		unsigned long long clipped;
+	};
+	// Counters and written columns of one band, summed by End
+	struct BandCounters
+	{
+		unsigned long long written;
+		unsigned int minX;
+		unsigned int maxX;
+	};
+private:
+	void SetupLines(const unsigned int* pIndices, size_t nLines, Color color, SetupChunk& chunk) const;
+	void DrawBand(unsigned int band, BandCounters& counters) const noexcept;
+	template<bool antiAliased>
+	void DrawSegment(const Segment& s, unsigned int rowBegin, unsigned int rowEnd, BandCounters& counters) const noexcept;
+private:
+	ThreadPool* pPool;
+	Surface* pTarget = nullptr;
+	unsigned int width = 0u;
+	unsigned int height = 0u;
+	Mode mode = Mode::AntiAliased;
+	// Per Draw scratch: clip space positions of the vertices
+	std::vector<ClipVertex> clipPositions;
+	// Lines of the frame, in chunks filled in parallel (kept in draw order)
+	std::vector<SetupChunk> chunks;
+	size_t nChunks = 0u;
+	// Line references per band: band b owns [binStart[b], binStart[b + 1]) of binEntries
+	std::vector<const Segment*> binEntries;
+	std::vector<unsigned int> binStart;
+	std::vector<unsigned int> bands;
+	std::vector<BandCounters> bandCounters;
+	Statistics stats = {};
+};
@@ -0,0 +1,136 @@
+#include "MappedFile.h"
+#include <sstream>
+#ifdef _WIN32
+#define FULL_WINTARD
+#include "TeslaWin.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	auto Fail = [&filename](int line, const char* what, long long error)
+	{
+		std::stringstream ss;
+		ss << "Mapping [" << filename << "]: " << what << " (error " << error << ").";
+		throw Exception(line, __FILE__, ss.str());
+	};
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		Fail(__LINE__, "failed to open the file", (long long)GetLastError());
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize))
+	{
+		const DWORD error = GetLastError();
+		CloseHandle(hFile);
+		Fail(__LINE__, "failed to get the file size", (long long)error);
+	}
+	size = (size_t)fileSize.QuadPart;
+	if (size == 0u)
+	{
+		CloseHandle(hFile);
+		return;
+	}
+	// The view keeps the mapping (and the file) alive, the handles can go right away
+	HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0u, 0u, nullptr);
+	const DWORD mappingError = GetLastError();
+	CloseHandle(hFile);
+	if (hMapping == nullptr)
+	{
+		Fail(__LINE__, "failed to create the file mapping", (long long)mappingError);
+	}
+	pData = static_cast<const unsigned char*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0u, 0u, 0u));
+	const DWORD viewError = GetLastError();
+	CloseHandle(hMapping);
+	if (pData == nullptr)
+	{
+		Fail(__LINE__, "failed to map the file", (long long)viewError);
+	}
+#else
+	const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		Fail(__LINE__, "failed to open the file", errno);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		const int error = errno;
+		close(fd);
+		Fail(__LINE__, "failed to get the file size", error);
+	}
+	size = (size_t)st.st_size;
+	if (size == 0u)
+	{
+		close(fd);
+		return;
+	}
+	// The mapping stays valid after the descriptor is closed
+	void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	const int error = errno;
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		Fail(__LINE__, "failed to map the file", error);
+	}
+	pData = static_cast<const unsigned char*>(p);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	if (pData == nullptr)
+	{
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(pData);
+#else
+	munmap(const_cast<unsigned char*>(pData), size);
+#endif
+}
+
+const unsigned char* MappedFile::GetData() const noexcept
+{
+	return pData;
+}
+
+size_t MappedFile::GetSize() const noexcept
+{
+	return size;
+}
+
+/***************************************************************************************/
+/********************************** EXCEPTION LAND *************************************/
+MappedFile::Exception::Exception(int line, const char* file, std::string note) noexcept
+	:
+	TeslaException(line, file),
+	note(std::move(note))
+{
+}
+
+const char* MappedFile::Exception::what() const noexcept
+{
+	std::ostringstream oss;
+	oss << TeslaException::what() << std::endl
+		<< "[Note] " << GetNote();
+	whatBuffer = oss.str();
+	return whatBuffer.c_str();
+}
+
+const char* MappedFile::Exception::GetType() const noexcept
+{
+	return "Tesla Mapped File Exception!";
+}
+
+const std::string& MappedFile::Exception::GetNote() const noexcept
+{
+	return note;
+}
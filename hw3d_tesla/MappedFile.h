@@ -0,0 +1,31 @@
+#pragma once
+#include "TeslaException.h"
+#include <string>
+
+// Read-only memory mapping of a whole file. The pages are loaded by the OS on first
+// access and are shared with the file cache, nothing is copied into the process heap.
+class MappedFile
+{
+public:
+	class Exception : public TeslaException
+	{
+	public:
+		Exception(int line, const char* file, std::string note) noexcept;
+		virtual const char* what() const noexcept override;
+		virtual const char* GetType() const noexcept override;
+		const std::string& GetNote() const noexcept;
+	private:
+		std::string note;
+	};
+public:
+	MappedFile(const std::string& filename);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+	~MappedFile();
+	// Start of the mapping (page aligned), nullptr for an empty file
+	const unsigned char* GetData() const noexcept;
+	size_t GetSize() const noexcept;
+private:
+	const unsigned char* pData = nullptr;
+	size_t size = 0u;
+};
@@ -0,0 +1,258 @@
+#ifdef TESLA_HEADLESS
+#include "Benchmark.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// The steps of Geometry::OBJModel (map, count, size the arrays, parse)
+static void LoadOBJ(const std::string& filename, ThreadPool* pPool, ObjParser::Counts& counts, size_t& size)
+{
+	const MappedFile file{ filename };
+	size = file.GetSize();
+	const ObjParser parser{ reinterpret_cast<const char*>(file.GetData()), size, pPool };
+	counts = parser.GetCounts();
+	std::vector<float> positions(counts.positions * 3u);
+	std::vector<float> texCoords(counts.texCoords * 2u);
+	std::vector<float> normals(counts.normals * 3u);
+	std::vector<unsigned int> posIndices(counts.triangles * 3u);
+	std::vector<unsigned int> texIndices(counts.texCoords > 0u ? counts.triangles * 3u : 0u);
+	std::vector<unsigned int> norIndices(counts.normals > 0u ? counts.triangles * 3u : 0u);
+	parser.Parse({ positions.data(), texCoords.data(), normals.data(), posIndices.data(), texIndices.data(), norIndices.data() }, filename);
+}
+
+// OBJ load speed, serial and on the pool
+int Benchmark::OBJ(const std::string& filename, unsigned int nRuns)
+{
+	ThreadPool pool;
+	ObjParser::Counts counts = {};
+	size_t size = 0u;
+	const float bestSerial = BestOf(nRuns, [&]() { LoadOBJ(filename, nullptr, counts, size); });
+	const float bestPool = BestOf(nRuns, [&]() { LoadOBJ(filename, &pool, counts, size); });
+	const float megabytes = (float)size / (1024.0f * 1024.0f);
+	std::cout << filename << ": " << megabytes << " MB, " << counts.positions << " positions, " << counts.texCoords << " texture coordinates, "
+		<< counts.normals << " normals, " << counts.triangles << " triangles" << std::endl
+		<< "serial:  " << 1000.0f * bestSerial << " ms (best of " << nRuns << "), " << megabytes / bestSerial << " MB/s" << std::endl
+		<< "pool:    " << 1000.0f * bestPool << " ms (" << pool.GetThreadCount() << " threads), " << megabytes / bestPool << " MB/s" << std::endl;
+	return 0;
+}
+
+// Vertex of the mesh load benchmark, the attributes missing in the file are left at zero
+struct BenchmarkVertex
+{
+	float pos[3];
+	float tex[2];
+	float n[3];
+};
+
+// The steps of Import::FromFileTexNor (parse, weld the corners, gather the vertices) on the
+// attributes the file has
+static void ImportOBJ(const std::string& filename, std::vector<BenchmarkVertex>& vertices, std::vector<unsigned int>& indices)
+{
+	const MappedFile file{ filename };
+	const ObjParser parser{ reinterpret_cast<const char*>(file.GetData()), file.GetSize() };
+	const ObjParser::Counts& counts = parser.GetCounts();
+	std::vector<float> positions(counts.positions * 3u);
+	std::vector<float> texCoords(counts.texCoords * 2u);
+	std::vector<float> normals(counts.normals * 3u);
+	std::vector<unsigned int> posIndices(counts.triangles * 3u);
+	std::vector<unsigned int> texIndices(counts.texCoords > 0u ? counts.triangles * 3u : 0u);
+	std::vector<unsigned int> norIndices(counts.normals > 0u ? counts.triangles * 3u : 0u);
+	parser.Parse({ positions.data(), texCoords.data(), normals.data(), posIndices.data(), texIndices.data(), norIndices.data() }, filename);
+
+	std::vector<unsigned int> firstCorners;
+	indices.resize(posIndices.size());
+	ObjParser::Weld(posIndices.data(), texIndices.empty() ? nullptr : texIndices.data(), norIndices.empty() ? nullptr : norIndices.data(),
+		posIndices.size(), indices.data(), firstCorners);
+	vertices.assign(firstCorners.size(), BenchmarkVertex{});
+	for (size_t i = 0u; i < firstCorners.size(); i++)
+	{
+		const unsigned int c = firstCorners[i];
+		std::copy_n(&positions[posIndices[c] * 3u], 3, vertices[i].pos);
+		if (!texIndices.empty())
+		{
+			std::copy_n(&texCoords[texIndices[c] * 2u], 2, vertices[i].tex);
+		}
+		if (!norIndices.empty())
+		{
+			std::copy_n(&normals[norIndices[c] * 3u], 3, vertices[i].n);
+		}
+	}
+}
+
+// Sum of the mesh data, so that every page of it is really read
+static float TouchMesh(const BenchmarkVertex* pVertices, size_t nVertices, const unsigned int* pIndices, size_t nIndices)
+{
+	float sum = 0.0f;
+	for (size_t i = 0u; i < nVertices; i++)
+	{
+		sum += pVertices[i].pos[0] + pVertices[i].tex[0] + pVertices[i].n[0];
+	}
+	for (size_t i = 0u; i < nIndices; i++)
+	{
+		sum += (float)pIndices[i];
+	}
+	return sum;
+}
+
+// First load of a mesh in a process: importing the OBJ against mapping the MeshCache written
+// from it (what Import::FromFileCached does), using all of the data in both cases
+int Benchmark::MeshLoad(const std::string& filename, unsigned int nRuns)
+{
+	const MeshCache::Layout layout = { (unsigned int)sizeof(BenchmarkVertex), (unsigned int)offsetof(BenchmarkVertex, pos),
+		(unsigned int)offsetof(BenchmarkVertex, tex), (unsigned int)offsetof(BenchmarkVertex, n) };
+	const std::string cacheFile = filename + ".bench.tmesh";
+	size_t nVertices = 0u;
+	size_t nIndices = 0u;
+	{
+		std::vector<BenchmarkVertex> vertices;
+		std::vector<unsigned int> indices;
+		ImportOBJ(filename, vertices, indices);
+		MeshCache::Write(cacheFile, MeshCache::DescribeSource(filename), layout,
+			vertices.empty() ? MeshCuller::Bounds{} : MeshCuller::ComputeBounds(vertices[0].pos, sizeof(BenchmarkVertex), vertices.size()),
+			vertices.data(), vertices.size(), indices.data(), indices.size());
+		nVertices = vertices.size();
+		nIndices = indices.size();
+	}
+
+	float importSum = 0.0f;
+	const float bestImport = BestOf(nRuns, [&]()
+	{
+		std::vector<BenchmarkVertex> vertices;
+		std::vector<unsigned int> indices;
+		ImportOBJ(filename, vertices, indices);
+		importSum = TouchMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+	});
+	bool rejected = false;
+	float cacheSum = 0.0f;
+	const float bestCache = BestOf(nRuns, [&]()
+	{
+		const auto pCache = MeshCache::Open(cacheFile, filename, layout);
+		rejected = rejected || !pCache;
+		cacheSum = pCache ? TouchMesh(static_cast<const BenchmarkVertex*>(pCache->GetVertices()), pCache->GetVertexCount(),
+			pCache->GetIndices(), pCache->GetIndexCount()) : 0.0f;
+	});
+	std::filesystem::remove(cacheFile);
+	if (rejected)
+	{
+		std::cerr << "The cache of [" << filename << "] was rejected" << std::endl;
+		return -1;
+	}
+	std::cout << filename << ": " << nVertices << " vertices, " << nIndices / 3u << " triangles" << (cacheSum == importSum ? "" : " (the cache differs!)") << std::endl
+		<< "import:  " << 1000.0f * bestImport << " ms (best of " << nRuns << ")" << std::endl
+		<< "cache:   " << 1000.0f * bestCache << " ms (open, validate, read all), " << bestImport / bestCache << "x faster" << std::endl;
+	return cacheSum == importSum ? 0 : -1;
+}
+
+// Corners of the triangles a corpus file must give (<name>.expected next to <name>.obj): one line
+// per triangle, three corners p, p/t, p//n or p/t/n of zero based indices (~0u when missing)
+struct ExpectedCorners
+{
+	std::vector<unsigned int> pos;
+	std::vector<unsigned int> tex;
+	std::vector<unsigned int> nor;
+};
+
+static ExpectedCorners LoadExpected(const std::filesystem::path& file)
+{
+	ExpectedCorners expected;
+	std::ifstream in(file);
+	std::string corner;
+	while (in >> corner)
+	{
+		unsigned int indices[3] = { ~0u, ~0u, ~0u };
+		const char* p = corner.data();
+		const char* const pEnd = p + corner.size();
+		for (int i = 0; i < 3 && p < pEnd; i++)
+		{
+			p = std::from_chars(p, pEnd, indices[i]).ptr;
+			p += p < pEnd && *p == '/' ? 1 : 0;
+		}
+		expected.pos.push_back(indices[0]);
+		expected.tex.push_back(indices[1]);
+		expected.nor.push_back(indices[2]);
+	}
+	return expected;
+}
+
+// Parse objFile serial and on the pool, with the default chunks and with tiny ones so that even a
+// small file crosses many chunk boundaries, and compare every corner with the expected ones
+static bool CheckOBJ(const std::filesystem::path& objFile, ThreadPool& pool)
+{
+	const ExpectedCorners expected = LoadExpected(std::filesystem::path(objFile).replace_extension(".expected"));
+	const MappedFile file{ objFile.string() };
+	bool passed = true;
+	for (const size_t chunkSize : { ObjParser::DefaultChunkSize, (size_t)64u })
+	{
+		for (ThreadPool* pPool : { (ThreadPool*)nullptr, &pool })
+		{
+			const ObjParser parser{ reinterpret_cast<const char*>(file.GetData()), file.GetSize(), pPool, chunkSize };
+			const ObjParser::Counts& counts = parser.GetCounts();
+			std::vector<float> positions(counts.positions * 3u);
+			std::vector<float> texCoords(counts.texCoords * 2u);
+			std::vector<float> normals(counts.normals * 3u);
+			std::vector<unsigned int> posIndices(counts.triangles * 3u);
+			std::vector<unsigned int> texIndices(counts.texCoords > 0u ? counts.triangles * 3u : 0u, ~0u);
+			std::vector<unsigned int> norIndices(counts.normals > 0u ? counts.triangles * 3u : 0u, ~0u);
+			std::string error;
+			try
+			{
+				parser.Parse({ positions.data(), texCoords.data(), normals.data(), posIndices.data(), texIndices.data(), norIndices.data() }, objFile.string());
+			}
+			catch (const ObjParser::Exception& e)
+			{
+				error = e.GetNote();
+			}
+			if (error.empty() && posIndices.size() != expected.pos.size())
+			{
+				error = std::to_string(posIndices.size() / 3u) + " triangles instead of " + std::to_string(expected.pos.size() / 3u);
+			}
+			for (size_t c = 0u; error.empty() && c < posIndices.size(); c++)
+			{
+				if (posIndices[c] != expected.pos[c] || (!texIndices.empty() && texIndices[c] != expected.tex[c]) ||
+					(!norIndices.empty() && norIndices[c] != expected.nor[c]))
+				{
+					error = "triangle " + std::to_string(c / 3u) + " differs";
+				}
+			}
+			if (!error.empty())
+			{
+				std::cout << objFile.filename().string() << " (" << (pPool ? "pool" : "serial") << ", " << chunkSize << " byte chunks): " << error << std::endl;
+				passed = false;
+			}
+		}
+	}
+	if (passed)
+	{
+		std::cout << objFile.filename().string() << ": " << expected.pos.size() / 3u << " triangles, ok" << std::endl;
+	}
+	return passed;
+}
+
+// Every OBJ of the corpus folder against its expected triangles
+int Benchmark::CheckOBJCorpus(const std::string& folder)
+{
+	ThreadPool pool;
+	std::vector<std::filesystem::path> files;
+	for (const auto& entry : std::filesystem::directory_iterator(folder))
+	{
+		if (entry.path().extension() == ".obj")
+		{
+			files.push_back(entry.path());
+		}
+	}
+	std::sort(files.begin(), files.end());
+	unsigned int nFailed = 0u;
+	for (const auto& file : files)
+	{
+		nFailed += CheckOBJ(file, pool) ? 0u : 1u;
+	}
+	std::cout << files.size() - nFailed << "/" << files.size() << " files passed" << std::endl;
+	return nFailed == 0u && !files.empty() ? 0 : -1;
+}
+#endif
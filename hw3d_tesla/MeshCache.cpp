@@ -0,0 +1,267 @@
+#include "MeshCache.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	unsigned long long AlignUp(unsigned long long offset) noexcept
+	{
+		return (offset + MeshCache::Alignment - 1u) / MeshCache::Alignment * MeshCache::Alignment;
+	}
+
+	bool SameLayout(const MeshCache::Layout& lhs, const MeshCache::Layout& rhs) noexcept
+	{
+		return lhs.vertexSize == rhs.vertexSize && lhs.posOffset == rhs.posOffset &&
+			lhs.texOffset == rhs.texOffset && lhs.norOffset == rhs.norOffset;
+	}
+
+	// Same size and time: same source. Only when the time changed (a copy, a checkout) the contents are
+	// hashed, and if they still match source.writeTime takes the new time (see Restamp)
+	bool IsSourceOf(MeshCache::Source& source, const std::string& sourceFile)
+	{
+		std::error_code error;
+		const unsigned long long size = std::filesystem::file_size(sourceFile, error);
+		if (error)
+		{
+			// Without a source (assets shipped without it) the cache is trusted
+			return true;
+		}
+		if (size != source.size)
+		{
+			return false;
+		}
+		const auto writeTime = std::filesystem::last_write_time(sourceFile, error);
+		if (!error && (long long)writeTime.time_since_epoch().count() == source.writeTime)
+		{
+			return true;
+		}
+		try
+		{
+			const MeshCache::Source current = MeshCache::DescribeSource(sourceFile);
+			if (current.size != source.size || current.hash != source.hash)
+			{
+				return false;
+			}
+			source.writeTime = current.writeTime;
+			return true;
+		}
+		catch (const MappedFile::Exception&)
+		{
+			return false;
+		}
+	}
+
+	// Store the new write time of a source confirmed by its hash in the header of the cache, so that
+	// the next runs don't hash it again. Only those 8 bytes are written (the cache may be mapped
+	// meanwhile); if the cache can't be written the hash is just checked again next time
+	void Restamp(const std::string& cacheFile, long long writeTime)
+	{
+		std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+		if (file)
+		{
+			file.seekp((std::streamoff)(offsetof(MeshCache::Header, source) + offsetof(MeshCache::Source, writeTime)));
+			file.write(reinterpret_cast<const char*>(&writeTime), sizeof(writeTime));
+		}
+	}
+
+	[[noreturn]] void Fail(int line, const std::string& cacheFile, const char* reason)
+	{
+		std::stringstream ss;
+		ss << "Writing mesh cache [" << cacheFile << "]: " << reason;
+		throw MeshCache::Exception(line, __FILE__, ss.str());
+	}
+}
+
+MeshCache::Exception::Exception(int line, const char* file, std::string note) noexcept
+	:
+	TeslaException(line, file),
+	note(std::move(note))
+{
+}
+
+const char* MeshCache::Exception::what() const noexcept
+{
+	std::ostringstream oss;
+	oss << TeslaException::what() << std::endl
+		<< "[Note] " << GetNote();
+	whatBuffer = oss.str();
+	return whatBuffer.c_str();
+}
+
+const char* MeshCache::Exception::GetType() const noexcept
+{
+	return "Tesla Mesh Cache Exception!";
+}
+
+const std::string& MeshCache::Exception::GetNote() const noexcept
+{
+	return note;
+}
+
+MeshCache::Source MeshCache::DescribeSource(const std::string& sourceFile)
+{
+	const MappedFile file{ sourceFile };
+	Source source = {};
+	source.size = file.GetSize();
+	source.writeTime = (long long)std::filesystem::last_write_time(sourceFile).time_since_epoch().count();
+	source.hash = Hash(file.GetData(), file.GetSize());
+	return source;
+}
+
+void MeshCache::Write(const std::string& cacheFile, const Source& source, const Layout& layout, const MeshCuller::Bounds& bounds,
+	const void* pVertices, size_t nVertices, const unsigned int* pIndices, size_t nIndices)
+{
+	Header header = { { 'T', 'M', 'S', 'H' }, Version, source, layout, bounds, nVertices, nIndices, 0u, 0u };
+	header.vertexOffset = AlignUp(sizeof(Header));
+	header.indexOffset = AlignUp(header.vertexOffset + (unsigned long long)nVertices * layout.vertexSize);
+
+	const std::string tempFile = cacheFile + ".tmp";
+	{
+		std::ofstream file(tempFile, std::ios::binary);
+		if (!file)
+		{
+			Fail(__LINE__, cacheFile, "failed to open the file.");
+		}
+		static constexpr char zeros[Alignment] = {};
+		const size_t vertexBytes = nVertices * layout.vertexSize;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		file.write(zeros, (std::streamsize)(header.vertexOffset - sizeof(Header)));
+		file.write(static_cast<const char*>(pVertices), (std::streamsize)vertexBytes);
+		file.write(zeros, (std::streamsize)(header.indexOffset - header.vertexOffset - vertexBytes));
+		file.write(reinterpret_cast<const char*>(pIndices), (std::streamsize)(nIndices * sizeof(unsigned int)));
+		if (!file.flush())
+		{
+			file.close();
+			std::filesystem::remove(tempFile);
+			Fail(__LINE__, cacheFile, "failed to write.");
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempFile, cacheFile, error);
+	if (error)
+	{
+		std::filesystem::remove(tempFile, error);
+		Fail(__LINE__, cacheFile, "failed to replace the previous cache.");
+	}
+}
+
+std::shared_ptr<const MeshCache> MeshCache::Open(const std::string& cacheFile, const std::string& sourceFile, const Layout& layout)
+{
+	std::error_code error;
+	if (!std::filesystem::is_regular_file(cacheFile, error))
+	{
+		return nullptr;
+	}
+	std::shared_ptr<MeshCache> pCache;
+	try
+	{
+		pCache.reset(new MeshCache(cacheFile));
+	}
+	catch (const MappedFile::Exception&)
+	{
+		return nullptr;
+	}
+
+	// The blobs have to be where the header says, inside the file
+	const Header& header = pCache->header;
+	const unsigned long long size = pCache->file.GetSize();
+	if (size < sizeof(Header) || memcmp(header.magic, "TMSH", 4u) != 0 || header.version != Version || !SameLayout(header.layout, layout) ||
+		layout.vertexSize == 0u || header.vertexOffset % Alignment != 0u || header.indexOffset % Alignment != 0u ||
+		header.vertexOffset < sizeof(Header) || header.vertexOffset > size || header.nVertices > (size - header.vertexOffset) / layout.vertexSize ||
+		header.indexOffset < header.vertexOffset + header.nVertices * layout.vertexSize || header.indexOffset > size ||
+		header.nIndices > (size - header.indexOffset) / sizeof(unsigned int))
+	{
+		return nullptr;
+	}
+
+	Source source = header.source;
+	if (!IsSourceOf(source, sourceFile))
+	{
+		return nullptr;
+	}
+
+	// The renderers index the vertices without checks: one index past them means a damaged cache
+	const unsigned int* pIndices = pCache->GetIndices();
+	unsigned int maxIndex = 0u;
+	for (size_t i = 0u; i < (size_t)header.nIndices; i++)
+	{
+		maxIndex = std::max(maxIndex, pIndices[i]);
+	}
+	if (header.nIndices % 3u != 0u || (header.nIndices > 0u && maxIndex >= header.nVertices))
+	{
+		return nullptr;
+	}
+	if (source.writeTime != header.source.writeTime)
+	{
+		Restamp(cacheFile, source.writeTime);
+		pCache->header.source.writeTime = source.writeTime;
+	}
+	return pCache;
+}
+
+const void* MeshCache::GetVertices() const noexcept
+{
+	return file.GetData() + header.vertexOffset;
+}
+
+size_t MeshCache::GetVertexCount() const noexcept
+{
+	return (size_t)header.nVertices;
+}
+
+const unsigned int* MeshCache::GetIndices() const noexcept
+{
+	return reinterpret_cast<const unsigned int*>(file.GetData() + header.indexOffset);
+}
+
+size_t MeshCache::GetIndexCount() const noexcept
+{
+	return (size_t)header.nIndices;
+}
+
+const MeshCuller::Bounds& MeshCache::GetBounds() const noexcept
+{
+	return header.bounds;
+}
+
+unsigned long long MeshCache::Hash(const unsigned char* pData, size_t size) noexcept
+{
+	// Four independent multiply-rotate lanes, 32 bytes per step, then the bytes left one by one
+	constexpr unsigned long long Prime1 = 0x9E3779B185EBCA87ull;
+	constexpr unsigned long long Prime2 = 0xC2B2AE3D27D4EB4Full;
+	unsigned long long lanes[4] = { Prime1 + Prime2, Prime2, 0ull, 0ull - Prime1 };
+	size_t i = 0u;
+	for (; i + 32u <= size; i += 32u)
+	{
+		for (int l = 0; l < 4; l++)
+		{
+			unsigned long long word;
+			memcpy(&word, pData + i + l * 8, sizeof(word));
+			lanes[l] = std::rotl(lanes[l] + word * Prime2, 31) * Prime1;
+		}
+	}
+	unsigned long long hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18) + size;
+	for (; i < size; i++)
+	{
+		hash = std::rotl(hash ^ (pData[i] * Prime1), 11) * Prime2;
+	}
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+MeshCache::MeshCache(const std::string& cacheFile)
+	:
+	file(cacheFile)
+{
+	if (file.GetSize() >= sizeof(Header))
+	{
+		memcpy(&header, file.GetData(), sizeof(Header));
+	}
+}
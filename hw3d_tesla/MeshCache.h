@@ -0,0 +1,80 @@
+#pragma once
+#include "MeshCuller.h"
+#include "MappedFile.h"
+#include <memory>
+#include <string>
+
+// Binary container for imported meshes, written once and then mapped and used in place (see
+// Tesla::Import::FromFileCached). Vertices and indices are stored as they are in memory, so the
+// vertex layout is part of the file and has to match the one asked for.
+class MeshCache
+{
+public:
+	class Exception : public TeslaException
+	{
+	public:
+		Exception(int line, const char* file, std::string note) noexcept;
+		virtual const char* what() const noexcept override;
+		virtual const char* GetType() const noexcept override;
+		const std::string& GetNote() const noexcept;
+	private:
+		std::string note;
+	};
+	// Byte offsets of the attributes in a vertex (NoAttribute for the ones it doesn't have)
+	struct Layout
+	{
+		unsigned int vertexSize;
+		unsigned int posOffset;
+		unsigned int texOffset;
+		unsigned int norOffset;
+	};
+	static constexpr unsigned int NoAttribute = ~0u;
+	// The file a cache was made from. The cache is valid while the size and write time of the
+	// file match, or, when only the time changed, while its contents still hash the same (Open
+	// then stores the new time in the cache, so the file is hashed once per change of time)
+	struct Source
+	{
+		unsigned long long size;
+		long long writeTime;
+		unsigned long long hash;
+	};
+	// Header of the files (native byte order), the vertices and the indices follow at their offsets
+	struct Header
+	{
+		char magic[4];                  // "TMSH"
+		unsigned int version;
+		Source source;
+		Layout layout;
+		MeshCuller::Bounds bounds;
+		unsigned long long nVertices;
+		unsigned long long nIndices;
+		unsigned long long vertexOffset;  // in bytes from the start of the file
+		unsigned long long indexOffset;
+	};
+	static constexpr unsigned int Version = 1u;
+	// Vertices and indices start on this boundary (as long as the mapping is page aligned)
+	static constexpr unsigned int Alignment = 64u;
+public:
+	// Size, write time and hash of the contents of a file
+	static Source DescribeSource(const std::string& sourceFile);
+	// Write the cache of a mesh made from source. The data goes to a temporary file renamed
+	// at the end, so a cache is never seen half written
+	static void Write(const std::string& cacheFile, const Source& source, const Layout& layout, const MeshCuller::Bounds& bounds,
+		const void* pVertices, size_t nVertices, const unsigned int* pIndices, size_t nIndices);
+	// Map a cache written for sourceFile with the same layout. nullptr when there is none, it was
+	// made from another version of the source (without a source it is trusted) or it is damaged:
+	// blobs outside of the file, or indices past the vertices (all of them are read once)
+	static std::shared_ptr<const MeshCache> Open(const std::string& cacheFile, const std::string& sourceFile, const Layout& layout);
+	const void* GetVertices() const noexcept;
+	size_t GetVertexCount() const noexcept;
+	const unsigned int* GetIndices() const noexcept;
+	size_t GetIndexCount() const noexcept;
+	const MeshCuller::Bounds& GetBounds() const noexcept;
+	// 64 bit hash of a block of memory (not cryptographic)
+	static unsigned long long Hash(const unsigned char* pData, size_t size) noexcept;
+private:
+	MeshCache(const std::string& cacheFile);
+private:
+	MappedFile file;
+	Header header = {};
+};
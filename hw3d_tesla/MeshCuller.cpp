@@ -0,0 +1,318 @@
+#include "MeshCuller.h"
+#include "Simd.h"
+#include "TeslaTimer.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace
+{
+	// Triangles this close to edge on (the squared cosine of the angle between their normal and
+	// the direction to the eye) are kept whichever way they face, rounding can't tell
+	constexpr float EdgeOnTolerance = 1e-6f;
+
+	MeshCuller::Matrix Multiply(const MeshCuller::Matrix& lhs, const MeshCuller::Matrix& rhs) noexcept
+	{
+		MeshCuller::Matrix res;
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				res.elements[i][j] = lhs.elements[i][0] * rhs.elements[0][j] + lhs.elements[i][1] * rhs.elements[1][j] +
+					lhs.elements[i][2] * rhs.elements[2][j] + lhs.elements[i][3] * rhs.elements[3][j];
+			}
+		}
+		return res;
+	}
+
+	float Det3(const float(&a)[3], const float(&b)[3], const float(&c)[3]) noexcept
+	{
+		return a[0] * (b[1] * c[2] - b[2] * c[1]) - a[1] * (b[0] * c[2] - b[2] * c[0]) + a[2] * (b[0] * c[1] - b[1] * c[0]);
+	}
+
+	// The point of mesh space that m takes to clip x = y = w = 0 (the eye, at infinity for
+	// orthographic projections), scaled so that eye . p = det(row 0, row 1, row 3, p).
+	// The sign of the screen area of a triangle in front of the eye is the sign of
+	// cross(b - a, c - a) . (eye.xyz - a * eye.w)
+	void EyeOf(const MeshCuller::Matrix& m, float(&eye)[4]) noexcept
+	{
+		const float(&e)[4][4] = m.elements;
+		for (int j = 0; j < 4; j++)
+		{
+			float r[3][3];
+			for (int k = 0, c = 0; k < 4; k++)
+			{
+				if (k != j)
+				{
+					r[0][c] = e[0][k];
+					r[1][c] = e[1][k];
+					r[2][c] = e[3][k];
+					c++;
+				}
+			}
+			eye[j] = ((j & 1) == 0 ? -1.0f : 1.0f) * Det3(r[0], r[1], r[2]);
+		}
+	}
+
+	// Positions of up to Lanes triangles, one component per array (triangles with an index out
+	// of range are left at zero and out of validMask)
+	template<size_t Lanes>
+	struct TriangleBlock
+	{
+		alignas(32) float p[9][Lanes];
+		unsigned int validMask;
+	};
+
+	template<size_t Lanes>
+	void Gather(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t count, TriangleBlock<Lanes>& block) noexcept
+	{
+		block.validMask = 0u;
+		for (size_t t = 0u; t < Lanes; t++)
+		{
+			bool valid = t < count;
+			for (size_t v = 0u; v < 3u && valid; v++)
+			{
+				valid = pIndices[t * 3u + v] < nVertices;
+			}
+			for (size_t v = 0u; v < 3u; v++)
+			{
+				const float* p = valid ? reinterpret_cast<const float*>(reinterpret_cast<const char*>(pPositions) + pIndices[t * 3u + v] * stride) : nullptr;
+				block.p[v * 3u + 0u][t] = valid ? p[0] : 0.0f;
+				block.p[v * 3u + 1u][t] = valid ? p[1] : 0.0f;
+				block.p[v * 3u + 2u][t] = valid ? p[2] : 0.0f;
+			}
+			block.validMask |= (valid ? 1u : 0u) << t;
+		}
+	}
+
+	// Bit t set: triangle t of the block is kept. keepSign is +1 to keep positive areas, -1 for negative ones
+	template<size_t Lanes>
+	unsigned int FacingScalar(const TriangleBlock<Lanes>& block, const float(&eye)[4], float keepSign) noexcept
+	{
+		unsigned int mask = 0u;
+		for (size_t t = 0u; t < Lanes; t++)
+		{
+			const float ax = block.p[0][t], ay = block.p[1][t], az = block.p[2][t];
+			const float e1x = block.p[3][t] - ax, e1y = block.p[4][t] - ay, e1z = block.p[5][t] - az;
+			const float e2x = block.p[6][t] - ax, e2y = block.p[7][t] - ay, e2z = block.p[8][t] - az;
+			const float nx = e1y * e2z - e1z * e2y;
+			const float ny = e1z * e2x - e1x * e2z;
+			const float nz = e1x * e2y - e1y * e2x;
+			const float dx = eye[0] - ax * eye[3];
+			const float dy = eye[1] - ay * eye[3];
+			const float dz = eye[2] - az * eye[3];
+			const float facing = nx * dx + ny * dy + nz * dz;
+			const float nn = nx * nx + ny * ny + nz * nz;
+			const float dd = dx * dx + dy * dy + dz * dz;
+			if (facing * keepSign > 0.0f || facing * facing <= EdgeOnTolerance * nn * dd)
+			{
+				mask |= 1u << t;
+			}
+		}
+		return mask & block.validMask;
+	}
+
+#ifdef TESLA_SIMD_X86
+	// Same operations as the scalar version, in the same order: the same triangles are kept
+	unsigned int FacingSSE2(const TriangleBlock<4>& block, const float(&eye)[4], float keepSign) noexcept
+	{
+		const __m128 ax = _mm_load_ps(block.p[0]), ay = _mm_load_ps(block.p[1]), az = _mm_load_ps(block.p[2]);
+		const __m128 e1x = _mm_sub_ps(_mm_load_ps(block.p[3]), ax), e1y = _mm_sub_ps(_mm_load_ps(block.p[4]), ay), e1z = _mm_sub_ps(_mm_load_ps(block.p[5]), az);
+		const __m128 e2x = _mm_sub_ps(_mm_load_ps(block.p[6]), ax), e2y = _mm_sub_ps(_mm_load_ps(block.p[7]), ay), e2z = _mm_sub_ps(_mm_load_ps(block.p[8]), az);
+		const __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+		const __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+		const __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+		const __m128 ew = _mm_set1_ps(eye[3]);
+		const __m128 dx = _mm_sub_ps(_mm_set1_ps(eye[0]), _mm_mul_ps(ax, ew));
+		const __m128 dy = _mm_sub_ps(_mm_set1_ps(eye[1]), _mm_mul_ps(ay, ew));
+		const __m128 dz = _mm_sub_ps(_mm_set1_ps(eye[2]), _mm_mul_ps(az, ew));
+		const __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx), _mm_mul_ps(ny, dy)), _mm_mul_ps(nz, dz));
+		const __m128 nn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+		const __m128 dd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		const __m128 front = _mm_cmpgt_ps(_mm_mul_ps(facing, _mm_set1_ps(keepSign)), _mm_setzero_ps());
+		const __m128 edgeOn = _mm_cmple_ps(_mm_mul_ps(facing, facing), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(EdgeOnTolerance), nn), dd));
+		return (unsigned int)_mm_movemask_ps(_mm_or_ps(front, edgeOn)) & block.validMask;
+	}
+
+	TESLA_TARGET_AVX2
+	unsigned int FacingAVX2(const TriangleBlock<8>& block, const float(&eye)[4], float keepSign) noexcept
+	{
+		const __m256 ax = _mm256_load_ps(block.p[0]), ay = _mm256_load_ps(block.p[1]), az = _mm256_load_ps(block.p[2]);
+		const __m256 e1x = _mm256_sub_ps(_mm256_load_ps(block.p[3]), ax), e1y = _mm256_sub_ps(_mm256_load_ps(block.p[4]), ay), e1z = _mm256_sub_ps(_mm256_load_ps(block.p[5]), az);
+		const __m256 e2x = _mm256_sub_ps(_mm256_load_ps(block.p[6]), ax), e2y = _mm256_sub_ps(_mm256_load_ps(block.p[7]), ay), e2z = _mm256_sub_ps(_mm256_load_ps(block.p[8]), az);
+		const __m256 nx = _mm256_sub_ps(_mm256_mul_ps(e1y, e2z), _mm256_mul_ps(e1z, e2y));
+		const __m256 ny = _mm256_sub_ps(_mm256_mul_ps(e1z, e2x), _mm256_mul_ps(e1x, e2z));
+		const __m256 nz = _mm256_sub_ps(_mm256_mul_ps(e1x, e2y), _mm256_mul_ps(e1y, e2x));
+		const __m256 ew = _mm256_set1_ps(eye[3]);
+		const __m256 dx = _mm256_sub_ps(_mm256_set1_ps(eye[0]), _mm256_mul_ps(ax, ew));
+		const __m256 dy = _mm256_sub_ps(_mm256_set1_ps(eye[1]), _mm256_mul_ps(ay, ew));
+		const __m256 dz = _mm256_sub_ps(_mm256_set1_ps(eye[2]), _mm256_mul_ps(az, ew));
+		const __m256 facing = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, dx), _mm256_mul_ps(ny, dy)), _mm256_mul_ps(nz, dz));
+		const __m256 nn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz));
+		const __m256 dd = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		const __m256 front = _mm256_cmp_ps(_mm256_mul_ps(facing, _mm256_set1_ps(keepSign)), _mm256_setzero_ps(), _CMP_GT_OQ);
+		const __m256 edgeOn = _mm256_cmp_ps(_mm256_mul_ps(facing, facing), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(EdgeOnTolerance), nn), dd), _CMP_LE_OQ);
+		return (unsigned int)_mm256_movemask_ps(_mm256_or_ps(front, edgeOn)) & block.validMask;
+	}
+#endif
+
+	template<size_t Lanes, typename FacingFunc>
+	void CullBlocks(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t nTriangles,
+		const float(&eye)[4], float keepSign, std::vector<unsigned int>& frontIndices, FacingFunc facingFunc)
+	{
+		TriangleBlock<Lanes> block;
+		for (size_t first = 0u; first < nTriangles; first += Lanes)
+		{
+			const unsigned int* pBlock = pIndices + first * 3u;
+			Gather(pPositions, stride, nVertices, pBlock, std::min(Lanes, nTriangles - first), block);
+			for (unsigned int mask = facingFunc(block, eye, keepSign); mask != 0u; mask &= mask - 1u)
+			{
+				const unsigned int* pTriangle = pBlock + std::countr_zero(mask) * 3u;
+				frontIndices.insert(frontIndices.end(), pTriangle, pTriangle + 3);
+			}
+		}
+	}
+}
+
+MeshCuller::Bounds MeshCuller::ComputeBounds(const float* pPositions, size_t stride, size_t nVertices) noexcept
+{
+	Bounds bounds = {};
+	if (nVertices == 0u)
+	{
+		return bounds;
+	}
+	const auto PositionAt = [&](size_t i)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const char*>(pPositions) + i * stride);
+	};
+	BoundingBox& box = bounds.box;
+	box = { PositionAt(0u)[0], PositionAt(0u)[1], PositionAt(0u)[2], PositionAt(0u)[0], PositionAt(0u)[1], PositionAt(0u)[2] };
+	for (size_t i = 1u; i < nVertices; i++)
+	{
+		const float* p = PositionAt(i);
+		box.minX = std::min(box.minX, p[0]);
+		box.minY = std::min(box.minY, p[1]);
+		box.minZ = std::min(box.minZ, p[2]);
+		box.maxX = std::max(box.maxX, p[0]);
+		box.maxY = std::max(box.maxY, p[1]);
+		box.maxZ = std::max(box.maxZ, p[2]);
+	}
+	BoundingSphere& sphere = bounds.sphere;
+	sphere.x = (box.minX + box.maxX) * 0.5f;
+	sphere.y = (box.minY + box.maxY) * 0.5f;
+	sphere.z = (box.minZ + box.maxZ) * 0.5f;
+	float radiusSq = 0.0f;
+	for (size_t i = 0u; i < nVertices; i++)
+	{
+		const float* p = PositionAt(i);
+		const float dx = p[0] - sphere.x;
+		const float dy = p[1] - sphere.y;
+		const float dz = p[2] - sphere.z;
+		radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+	}
+	// Rounded up a little, so that the farthest vertex stays inside
+	sphere.radius = std::sqrt(radiusSq) * 1.0001f;
+	return bounds;
+}
+
+void MeshCuller::Begin(const Matrix& viewProj_in) noexcept
+{
+	viewProj = viewProj_in;
+	stats = {};
+}
+
+bool MeshCuller::IsVisible(const Bounds& bounds, const Matrix& world) noexcept
+{
+	stats.meshesTested++;
+	// Frustum planes in mesh space, the inside where a * x + b * y + c * z + d >= 0:
+	// -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip space
+	const Matrix m = Multiply(viewProj, world);
+	const float(&e)[4][4] = m.elements;
+	float planes[6][4];
+	for (int j = 0; j < 4; j++)
+	{
+		planes[0][j] = e[3][j] + e[0][j];
+		planes[1][j] = e[3][j] - e[0][j];
+		planes[2][j] = e[3][j] + e[1][j];
+		planes[3][j] = e[3][j] - e[1][j];
+		planes[4][j] = e[2][j];
+		planes[5][j] = e[3][j] - e[2][j];
+	}
+	const BoundingSphere& s = bounds.sphere;
+	const BoundingBox& b = bounds.box;
+	for (const float(&p)[4] : planes)
+	{
+		// The sphere first, then the corner of the box farthest inside
+		const float distance = p[0] * s.x + p[1] * s.y + p[2] * s.z + p[3];
+		if (distance < -s.radius * std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]))
+		{
+			stats.meshesCulled++;
+			return false;
+		}
+		const float x = p[0] >= 0.0f ? b.maxX : b.minX;
+		const float y = p[1] >= 0.0f ? b.maxY : b.minY;
+		const float z = p[2] >= 0.0f ? b.maxZ : b.minZ;
+		if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f)
+		{
+			stats.meshesCulled++;
+			return false;
+		}
+	}
+	return true;
+}
+
+void MeshCuller::CullMeshes(const Instance* pInstances, size_t count, std::vector<unsigned int>& visible)
+{
+	TeslaTimer<float> timer;
+	visible.clear();
+	for (size_t i = 0u; i < count; i++)
+	{
+		if (IsVisible(*pInstances[i].pBounds, pInstances[i].world))
+		{
+			visible.push_back((unsigned int)i);
+		}
+	}
+	stats.time += timer.Mark();
+}
+
+void MeshCuller::CullTrianglesIndexed(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t nIndices,
+	const Matrix& world, CullMode mode, std::vector<unsigned int>& frontIndices)
+{
+	TeslaTimer<float> timer;
+	frontIndices.clear();
+	const size_t nTriangles = nIndices / 3u;
+	stats.trianglesTested += nTriangles;
+	if (mode == CullMode::None)
+	{
+		frontIndices.assign(pIndices, pIndices + nTriangles * 3u);
+		stats.time += timer.Mark();
+		return;
+	}
+
+	float eye[4];
+	EyeOf(Multiply(viewProj, world), eye);
+	// Positive facing is counter-clockwise on screen (y goes down on screen, up in clip space)
+	const float keepSign = mode == CullMode::Back ? 1.0f : -1.0f;
+	frontIndices.reserve(nTriangles * 3u);
+	switch (Simd::GetLevel())
+	{
+#ifdef TESLA_SIMD_X86
+	case Simd::Level::AVX2:
+		CullBlocks<8u>(pPositions, stride, nVertices, pIndices, nTriangles, eye, keepSign, frontIndices, FacingAVX2);
+		break;
+	case Simd::Level::SSE2:
+		CullBlocks<4u>(pPositions, stride, nVertices, pIndices, nTriangles, eye, keepSign, frontIndices, FacingSSE2);
+		break;
+#endif
+	default:
+		CullBlocks<4u>(pPositions, stride, nVertices, pIndices, nTriangles, eye, keepSign, frontIndices, FacingScalar<4u>);
+		break;
+	}
+	stats.trianglesCulled += nTriangles - frontIndices.size() / 3u;
+	stats.time += timer.Mark();
+}
+
+const MeshCuller::Statistics& MeshCuller::GetStatistics() const noexcept
+{
+	return stats;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "Rasterizer.h"
+#include <vector>
+
+// Culling done before any vertex is transformed. Whole meshes are tested by their bounding
+// sphere, then box, against the six planes of the view frustum; the triangles of the meshes
+// left are tested for facing in mesh space (4 or 8 at a time, SSE2/AVX2), so that only the
+// ones that can be seen are handed to the Rasterizer.
+//   culler.Begin(viewProj);
+//   culler.CullMeshes(instances, count, visible);
+//   for each visible mesh: culler.CullTriangles(mesh, world, Rasterizer::CullMode::Back, indices);
+//                          rasterizer.DrawIndexed(..., indices.data(), indices.size(), ...);
+// Matrices follow the Rasterizer (Tesla::Mat4, column vectors, D3D clip space with 0 <= z <= w),
+// so any projection works, Tesla::Mat4::PerspectiveHFOV included.
+class MeshCuller
+{
+public:
+	using Matrix = Rasterizer::Matrix;
+	using CullMode = Rasterizer::CullMode;
+	struct BoundingSphere
+	{
+		float x;
+		float y;
+		float z;
+		float radius;
+	};
+	struct BoundingBox
+	{
+		float minX;
+		float minY;
+		float minZ;
+		float maxX;
+		float maxY;
+		float maxZ;
+	};
+	// In the space of the positions they were computed from
+	struct Bounds
+	{
+		BoundingSphere sphere;
+		BoundingBox box;
+	};
+	// One mesh for CullMeshes: its bounds and the matrix taking it to the world
+	struct Instance
+	{
+		const Bounds* pBounds;
+		Matrix world;
+	};
+	// Of the frame started by the last Begin
+	struct Statistics
+	{
+		unsigned long long meshesTested;
+		unsigned long long meshesCulled;     // outside the frustum
+		unsigned long long trianglesTested;
+		unsigned long long trianglesCulled;  // facing away (or with an index out of range)
+		float time;                          // seconds spent culling
+	};
+public:
+	// Box of the positions, and the sphere around its center that holds them all (empty: all zeros)
+	static Bounds ComputeBounds(const float* pPositions, size_t stride, size_t nVertices) noexcept;
+	// Start a frame seen through viewProj, reset the statistics
+	void Begin(const Matrix& viewProj) noexcept;
+	// False when the bounds, taken to the world by world, are completely outside the frustum
+	bool IsVisible(const Bounds& bounds, const Matrix& world) noexcept;
+	// visible gets the positions in pInstances of the instances that can be seen
+	void CullMeshes(const Instance* pInstances, size_t count, std::vector<unsigned int>& visible);
+	// frontIndices gets the indices of the triangles that the Rasterizer would not cull with mode
+	// (plus the ones too close to edge on to tell). The Rasterizer decides on vertices snapped to
+	// its subpixel grid, which can flip specks smaller than a pixel: those may differ on silhouettes
+	template<typename Mesh, typename Mat>
+	void CullTriangles(const Mesh& mesh, const Mat& world, CullMode mode, std::vector<unsigned int>& frontIndices)
+	{
+		frontIndices.clear();
+		if (mesh.vertices.empty() || mesh.indices.empty())
+		{
+			return;
+		}
+		CullTrianglesIndexed(&mesh.vertices[0].pos.x, sizeof(mesh.vertices[0]), mesh.vertices.size(),
+			mesh.indices.data(), mesh.indices.size(), Rasterizer::ToMatrix(world), mode, frontIndices);
+	}
+	// positions: x, y, z floats of vertex i at (const char*)pPositions + i * stride
+	void CullTrianglesIndexed(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t nIndices,
+		const Matrix& world, CullMode mode, std::vector<unsigned int>& frontIndices);
+	const Statistics& GetStatistics() const noexcept;
+private:
+	Matrix viewProj = {};
+	Statistics stats = {};
+};
@@ -0,0 +1,518 @@
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include <charconv>
+#include <algorithm>
+#include <bit>
+#include <exception>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+	enum class Record
+	{
+		Other,
+		Position,
+		TexCoord,
+		Normal,
+		Face
+	};
+
+	bool IsBlank(char c) noexcept
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	const char* SkipBlanks(const char* p, const char* pLineEnd) noexcept
+	{
+		while (p < pLineEnd && IsBlank(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	const char* FindLineEnd(const char* p, const char* pEnd) noexcept
+	{
+		const void* pNewLine = memchr(p, '\n', (size_t)(pEnd - p));
+		return pNewLine ? static_cast<const char*>(pNewLine) : pEnd;
+	}
+
+	// p at the first character of the line, moved past the keyword of the records it knows
+	Record ReadRecord(const char*& p, const char* pLineEnd) noexcept
+	{
+		const size_t length = (size_t)(pLineEnd - p);
+		if (length >= 2u && p[0] == 'v')
+		{
+			if (p[1] == ' ' || p[1] == '\t')
+			{
+				p += 2;
+				return Record::Position;
+			}
+			if (length >= 3u && (p[2] == ' ' || p[2] == '\t'))
+			{
+				if (p[1] == 't')
+				{
+					p += 3;
+					return Record::TexCoord;
+				}
+				if (p[1] == 'n')
+				{
+					p += 3;
+					return Record::Normal;
+				}
+			}
+		}
+		else if (length >= 2u && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			p += 2;
+			return Record::Face;
+		}
+		return Record::Other;
+	}
+
+	// Most numbers in OBJ files have few enough digits to be read exactly with one float division
+	// (mantissa and power of ten both exact in a float, so the quotient is rounded once, like
+	// from_chars does). The rest, exponents included, goes through from_chars
+	bool ReadFloat(const char*& p, const char* pLineEnd, float& value) noexcept
+	{
+		static constexpr float powersOf10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+		p = SkipBlanks(p, pLineEnd);
+		const char* pNumber = p;
+		const bool negative = p < pLineEnd && *p == '-';
+		// from_chars takes no plus sign
+		if (p < pLineEnd && (*p == '-' || *p == '+'))
+		{
+			p++;
+		}
+		const char* pDigits = p;
+		unsigned int mantissa = 0u;
+		int nDigits = 0;
+		int nFraction = 0;
+		for (; p < pLineEnd && (unsigned int)(*p - '0') < 10u; p++, nDigits++)
+		{
+			mantissa = mantissa * 10u + (unsigned int)(*p - '0');
+		}
+		if (p < pLineEnd && *p == '.')
+		{
+			for (p++; p < pLineEnd && (unsigned int)(*p - '0') < 10u; p++, nDigits++, nFraction++)
+			{
+				mantissa = mantissa * 10u + (unsigned int)(*p - '0');
+			}
+		}
+		const bool simple = nDigits > 0 && nDigits <= 9 && mantissa <= (1u << 24) && nFraction <= 10 &&
+			(p == pLineEnd || IsBlank(*p) || *p == '#');
+		if (simple)
+		{
+			value = (float)mantissa / powersOf10[nFraction];
+			value = negative ? -value : value;
+			return true;
+		}
+		const auto result = std::from_chars(*pNumber == '+' ? pDigits : pNumber, pLineEnd, value);
+		p = result.ptr;
+		return result.ec == std::errc{};
+	}
+
+	// Plain decimal digits with an optional minus (from_chars would take them too, only slower)
+	bool ReadIndex(const char*& p, const char* pLineEnd, long long& value) noexcept
+	{
+		const bool negative = p < pLineEnd && *p == '-';
+		p += negative ? 1 : 0;
+		const char* pDigits = p;
+		long long v = 0;
+		for (; p < pLineEnd && (unsigned int)(*p - '0') < 10u && v <= 0xFFFFFFFF; p++)
+		{
+			v = v * 10 + (*p - '0');
+		}
+		value = negative ? -v : v;
+		return p != pDigits && v <= 0xFFFFFFFF;
+	}
+
+	// Zero based index of a record from the 1 based one of the text (negative: -1 is the last record
+	// read, nRead of them so far). total (out of range) for 0 or a record that doesn't exist
+	size_t ResolveIndex(long long index, size_t nRead, size_t total) noexcept
+	{
+		if (index > 0 && (unsigned long long)index <= total)
+		{
+			return (size_t)index - 1u;
+		}
+		if (index < 0 && (unsigned long long)-index <= nRead)
+		{
+			return nRead - (size_t)-index;
+		}
+		return total;
+	}
+
+	// Vertices of a face: words up to the end of the line or a comment, 8 characters at a time
+	// (a character is blank when below '!' and non blank when its top bit is set, without carries
+	// between the bytes). Control characters count as blanks here, so the count is never lower
+	// than what Parse reads: when it is higher, Parse fails on that line
+	size_t CountFaceVertices(const char* p, const char* pLineEnd) noexcept
+	{
+		static_assert(std::endian::native == std::endian::little, "The first character has to be the low byte.");
+		constexpr unsigned long long Low7 = 0x7F7F7F7F7F7F7F7Full;
+		constexpr unsigned long long TopBits = 0x8080808080808080ull;
+		constexpr unsigned long long ToTopBit = 0x5F5F5F5F5F5F5F5Full;   // 0x21 + 0x5F = 0x80
+		if (const void* pComment = memchr(p, '#', (size_t)(pLineEnd - p)))
+		{
+			pLineEnd = static_cast<const char*>(pComment);
+		}
+		size_t nVertices = 0u;
+		unsigned long long previous = 0u;   // top bit of the character before (the blank after 'f')
+		for (; pLineEnd - p >= 8; p += 8)
+		{
+			unsigned long long word;
+			memcpy(&word, p, sizeof(word));
+			const unsigned long long nonBlank = (((word & Low7) + ToTopBit) | word) & TopBits;
+			// Word starts have their top bit set, the multiplication sums the bytes into the top one
+			const unsigned long long starts = (nonBlank & ~((nonBlank << 8) | previous)) >> 7;
+			nVertices += (size_t)((starts * 0x0101010101010101ull) >> 56);
+			previous = nonBlank >> 56;
+		}
+		for (; p < pLineEnd; p++)
+		{
+			const unsigned long long nonBlank = (unsigned char)*p > ' ' ? 0x80u : 0u;
+			nVertices += (nonBlank & ~previous) != 0u ? 1u : 0u;
+			previous = nonBlank;
+		}
+		return nVertices;
+	}
+
+	// One vertex of a face: p, p/t, p//n or p/t/n. Missing indices are left at 0
+	bool ReadFaceVertex(const char*& p, const char* pLineEnd, long long(&indices)[3]) noexcept
+	{
+		indices[0] = indices[1] = indices[2] = 0;
+		p = SkipBlanks(p, pLineEnd);
+		if (!ReadIndex(p, pLineEnd, indices[0]))
+		{
+			return false;
+		}
+		for (int i = 1; i < 3 && p < pLineEnd && *p == '/'; i++)
+		{
+			p++;
+			if (i == 1 && p < pLineEnd && *p == '/')
+			{
+				continue;
+			}
+			if (!ReadIndex(p, pLineEnd, indices[i]))
+			{
+				return false;
+			}
+		}
+		// A comment can start right after a vertex (and ends the face), as after the numbers of other records
+		return p == pLineEnd || IsBlank(*p) || *p == '#';
+	}
+
+	[[noreturn]] void Fail(int line, const std::string& filename, size_t textLine, const char* reason)
+	{
+		std::stringstream ss;
+		ss << "Loading OBJ [" << filename << "], line " << textLine << ": " << reason;
+		throw ObjParser::Exception(line, __FILE__, ss.str());
+	}
+}
+
+ObjParser::Exception::Exception(int line, const char* file, std::string note) noexcept
+	:
+	TeslaException(line, file),
+	note(std::move(note))
+{
+}
+
+const char* ObjParser::Exception::what() const noexcept
+{
+	std::ostringstream oss;
+	oss << TeslaException::what() << std::endl
+		<< "[Note] " << GetNote();
+	whatBuffer = oss.str();
+	return whatBuffer.c_str();
+}
+
+const char* ObjParser::Exception::GetType() const noexcept
+{
+	return "Tesla OBJ Parser Exception!";
+}
+
+const std::string& ObjParser::Exception::GetNote() const noexcept
+{
+	return note;
+}
+
+ObjParser::ObjParser(const char* pText, size_t size, ThreadPool* pPool, size_t chunkSize)
+	:
+	pPool(pPool)
+{
+	// Chunks end after the first new line past chunkSize bytes
+	const char* const pEnd = pText + size;
+	for (const char* p = pText; p < pEnd;)
+	{
+		const char* pChunkEnd = pEnd;
+		if ((size_t)(pEnd - p) > chunkSize)
+		{
+			pChunkEnd = FindLineEnd(p + chunkSize, pEnd);
+			pChunkEnd += pChunkEnd < pEnd ? 1 : 0;
+		}
+		chunks.push_back({ p, pChunkEnd });
+		p = pChunkEnd;
+	}
+	if (pPool != nullptr && chunks.size() > 1u)
+	{
+		pPool->ParallelFor((unsigned int)chunks.size(), [this](unsigned int i)
+		{
+			CountChunk(chunks[i]);
+		});
+	}
+	else
+	{
+		for (Chunk& chunk : chunks)
+		{
+			CountChunk(chunk);
+		}
+	}
+
+	// Offsets of every chunk, and a new mesh where a chunk starting with a position follows one ending with a face
+	bool previousWasFace = false;
+	size_t line = 1u;
+	for (Chunk& chunk : chunks)
+	{
+		chunk.offsets = counts;
+		chunk.firstLine = line;
+		counts.positions += chunk.counts.positions;
+		counts.texCoords += chunk.counts.texCoords;
+		counts.normals += chunk.counts.normals;
+		counts.triangles += chunk.counts.triangles;
+		counts.nMeshes += chunk.counts.nMeshes + (previousWasFace && chunk.first == Boundary::Position ? 1u : 0u);
+		previousWasFace = chunk.last == Boundary::None ? previousWasFace : chunk.last == Boundary::Face;
+		line += chunk.nLines;
+	}
+}
+
+const ObjParser::Counts& ObjParser::GetCounts() const noexcept
+{
+	return counts;
+}
+
+void ObjParser::Parse(const Output& output, const std::string& filename) const
+{
+	if (pPool != nullptr && chunks.size() > 1u)
+	{
+		// Keep the error of every chunk, to report the first one in the text
+		std::vector<std::exception_ptr> errors(chunks.size());
+		pPool->ParallelFor((unsigned int)chunks.size(), [&](unsigned int i)
+		{
+			try
+			{
+				ParseChunk(chunks[i], counts, output, filename);
+			}
+			catch (...)
+			{
+				errors[i] = std::current_exception();
+			}
+		});
+		for (const std::exception_ptr& pError : errors)
+		{
+			if (pError)
+			{
+				std::rethrow_exception(pError);
+			}
+		}
+	}
+	else
+	{
+		for (const Chunk& chunk : chunks)
+		{
+			ParseChunk(chunk, counts, output, filename);
+		}
+	}
+}
+
+void ObjParser::Weld(const unsigned int* pPosIndices, const unsigned int* pTexIndices, const unsigned int* pNorIndices, size_t count,
+	unsigned int* pIndices, std::vector<unsigned int>& firstCorners)
+{
+	// Open addressing with linear probing, at most half full: every slot holds a vertex (or
+	// Empty), whose tuple is read back through its first corner
+	constexpr unsigned int Empty = ~0u;
+	const size_t nSlots = std::bit_ceil(std::max(count * 2u, (size_t)16u));
+	const size_t mask = nSlots - 1u;
+	std::vector<unsigned int> slots(nSlots, Empty);
+	firstCorners.clear();
+	for (size_t c = 0u; c < count; c++)
+	{
+		const unsigned int pos = pPosIndices[c];
+		const unsigned int tex = pTexIndices ? pTexIndices[c] : 0u;
+		const unsigned int nor = pNorIndices ? pNorIndices[c] : 0u;
+		const unsigned long long hash = ((unsigned long long)pos * 0x9E3779B97F4A7C15ull) ^
+			((unsigned long long)tex * 0xC2B2AE3D27D4EB4Full) ^ ((unsigned long long)nor * 0x165667B19E3779F9ull);
+		for (size_t s = (size_t)(hash >> 32) & mask;; s = (s + 1u) & mask)
+		{
+			const unsigned int vertex = slots[s];
+			if (vertex == Empty)
+			{
+				slots[s] = (unsigned int)firstCorners.size();
+				pIndices[c] = slots[s];
+				firstCorners.push_back((unsigned int)c);
+				break;
+			}
+			const unsigned int first = firstCorners[vertex];
+			if (pPosIndices[first] == pos && (!pTexIndices || pTexIndices[first] == tex) && (!pNorIndices || pNorIndices[first] == nor))
+			{
+				pIndices[c] = vertex;
+				break;
+			}
+		}
+	}
+}
+
+void ObjParser::CountChunk(Chunk& chunk) noexcept
+{
+	chunk.counts = {};
+	chunk.first = Boundary::None;
+	chunk.last = Boundary::None;
+	chunk.nLines = 0u;
+	for (const char* p = chunk.pBegin; p < chunk.pEnd; chunk.nLines++)
+	{
+		const char* pLineEnd = FindLineEnd(p, chunk.pEnd);
+		const char* pRecord = SkipBlanks(p, pLineEnd);
+		switch (ReadRecord(pRecord, pLineEnd))
+		{
+		case Record::Position:
+			chunk.counts.nMeshes += chunk.last == Boundary::Face ? 1u : 0u;
+			chunk.first = chunk.first == Boundary::None ? Boundary::Position : chunk.first;
+			chunk.last = Boundary::Position;
+			chunk.counts.positions++;
+			break;
+		case Record::TexCoord:
+			chunk.counts.texCoords++;
+			break;
+		case Record::Normal:
+			chunk.counts.normals++;
+			break;
+		case Record::Face:
+		{
+			// Faces with less than three vertices are malformed, Parse stops at them
+			const size_t nVertices = CountFaceVertices(pRecord, pLineEnd);
+			chunk.first = chunk.first == Boundary::None ? Boundary::Face : chunk.first;
+			chunk.last = Boundary::Face;
+			chunk.counts.triangles += nVertices > 2u ? nVertices - 2u : 0u;
+			break;
+		}
+		default:
+			break;
+		}
+		p = pLineEnd + (pLineEnd < chunk.pEnd ? 1 : 0);
+	}
+}
+
+void ObjParser::ParseChunk(const Chunk& chunk, const Counts& totals, const Output& output, const std::string& filename)
+{
+	float* pPosition = output.pPositions + chunk.offsets.positions * 3u;
+	float* pTexCoord = output.pTexCoords + chunk.offsets.texCoords * 2u;
+	float* pNormal = output.pNormals + chunk.offsets.normals * 3u;
+	unsigned int* pPosIndex = output.pPosIndices + chunk.offsets.triangles * 3u;
+	unsigned int* pTexIndex = output.pTexIndices + (totals.texCoords > 0u ? chunk.offsets.triangles * 3u : 0u);
+	unsigned int* pNorIndex = output.pNorIndices + (totals.normals > 0u ? chunk.offsets.triangles * 3u : 0u);
+	size_t textLine = chunk.firstLine;
+	for (const char* p = chunk.pBegin; p < chunk.pEnd; textLine++)
+	{
+		const char* pLineEnd = FindLineEnd(p, chunk.pEnd);
+		const char* pRecord = SkipBlanks(p, pLineEnd);
+		switch (ReadRecord(pRecord, pLineEnd))
+		{
+		case Record::Position:
+			// A fourth coordinate (w) or vertex colors may follow, they are ignored
+			if (!ReadFloat(pRecord, pLineEnd, pPosition[0]) || !ReadFloat(pRecord, pLineEnd, pPosition[1]) || !ReadFloat(pRecord, pLineEnd, pPosition[2]))
+			{
+				Fail(__LINE__, filename, textLine, "malformed position (v x y z)");
+			}
+			pPosition += 3;
+			break;
+		case Record::TexCoord:
+			if (!ReadFloat(pRecord, pLineEnd, pTexCoord[0]))
+			{
+				Fail(__LINE__, filename, textLine, "malformed texture coordinate (vt u [v])");
+			}
+			if (SkipBlanks(pRecord, pLineEnd) == pLineEnd)
+			{
+				pTexCoord[1] = 0.0f;
+			}
+			else if (!ReadFloat(pRecord, pLineEnd, pTexCoord[1]))
+			{
+				Fail(__LINE__, filename, textLine, "malformed texture coordinate (vt u [v])");
+			}
+			pTexCoord += 2;
+			break;
+		case Record::Normal:
+			if (!ReadFloat(pRecord, pLineEnd, pNormal[0]) || !ReadFloat(pRecord, pLineEnd, pNormal[1]) || !ReadFloat(pRecord, pLineEnd, pNormal[2]))
+			{
+				Fail(__LINE__, filename, textLine, "malformed normal (vn x y z)");
+			}
+			pNormal += 3;
+			break;
+		case Record::Face:
+		{
+			// Fan triangulation, straight into the output: (first, previous, current) for every vertex
+			// after the second one. Negative indices count back from the records read so far
+			const size_t nPositions = (size_t)(pPosition - output.pPositions) / 3u;
+			const size_t nTexCoords = (size_t)(pTexCoord - output.pTexCoords) / 2u;
+			const size_t nNormals = (size_t)(pNormal - output.pNormals) / 3u;
+			size_t first[3] = {};
+			size_t previous[3] = {};
+			size_t nVertices = 0u;
+			for (pRecord = SkipBlanks(pRecord, pLineEnd); pRecord < pLineEnd && *pRecord != '#'; pRecord = SkipBlanks(pRecord, pLineEnd), nVertices++)
+			{
+				long long indices[3];
+				if (!ReadFaceVertex(pRecord, pLineEnd, indices))
+				{
+					Fail(__LINE__, filename, textLine, "malformed face (f with at least three vertices p, p/t, p//n or p/t/n)");
+				}
+				const size_t current[3] = {
+					ResolveIndex(indices[0], nPositions, totals.positions),
+					ResolveIndex(indices[1], nTexCoords, totals.texCoords),
+					ResolveIndex(indices[2], nNormals, totals.normals) };
+				if (current[0] >= totals.positions)
+				{
+					Fail(__LINE__, filename, textLine, "position index out of range");
+				}
+				if (totals.texCoords > 0u && current[1] >= totals.texCoords)
+				{
+					Fail(__LINE__, filename, textLine, "texture coordinate index missing or out of range");
+				}
+				if (totals.normals > 0u && current[2] >= totals.normals)
+				{
+					Fail(__LINE__, filename, textLine, "normal index missing or out of range");
+				}
+				if (nVertices == 0u)
+				{
+					std::copy_n(current, 3, first);
+				}
+				else if (nVertices >= 2u)
+				{
+					*pPosIndex++ = (unsigned int)first[0];
+					*pPosIndex++ = (unsigned int)previous[0];
+					*pPosIndex++ = (unsigned int)current[0];
+					if (totals.texCoords > 0u)
+					{
+						*pTexIndex++ = (unsigned int)first[1];
+						*pTexIndex++ = (unsigned int)previous[1];
+						*pTexIndex++ = (unsigned int)current[1];
+					}
+					if (totals.normals > 0u)
+					{
+						*pNorIndex++ = (unsigned int)first[2];
+						*pNorIndex++ = (unsigned int)previous[2];
+						*pNorIndex++ = (unsigned int)current[2];
+					}
+				}
+				std::copy_n(current, 3, previous);
+			}
+			if (nVertices < 3u)
+			{
+				Fail(__LINE__, filename, textLine, "malformed face (f with at least three vertices p, p/t, p//n or p/t/n)");
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		p = pLineEnd + (pLineEnd < chunk.pEnd ? 1 : 0);
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "TeslaException.h"
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Portable Wavefront OBJ parser behind Geometry::OBJModel. The text is read in place (usually
+// a MappedFile) and numbers are parsed with std::from_chars, so nothing is allocated per line:
+// the constructor goes through the text once to size the arrays, Parse writes the records straight
+// into them. Both split the text in chunks at line boundaries and run them on the pool if any.
+// Records: v x y z, vt u [v], vn x y z and f with three or more vertices, each one p, p/t, p//n
+// or p/t/n (1 based, or negative counting back from the last record read). Faces are triangulated
+// as fans while parsing. Everything else (comments, groups, materials) is skipped.
+class ObjParser
+{
+public:
+	class Exception : public TeslaException
+	{
+	public:
+		Exception(int line, const char* file, std::string note) noexcept;
+		virtual const char* what() const noexcept override;
+		virtual const char* GetType() const noexcept override;
+		const std::string& GetNote() const noexcept;
+	private:
+		std::string note;
+	};
+	struct Counts
+	{
+		size_t positions;
+		size_t texCoords;
+		size_t normals;
+		size_t triangles;       // n - 2 per face of n vertices
+		unsigned int nMeshes;   // positions following a face (where a new mesh starts)
+	};
+	// Where Parse writes: x, y, z per position and normal, u, v per texture coordinate and three
+	// zero based indices per triangle. When the text has texture coordinates (normals) every face
+	// vertex must refer to one, otherwise pTexIndices (pNorIndices) is not used
+	struct Output
+	{
+		float* pPositions;
+		float* pTexCoords;
+		float* pNormals;
+		unsigned int* pPosIndices;
+		unsigned int* pTexIndices;
+		unsigned int* pNorIndices;
+	};
+public:
+	// Small enough to balance the threads on files of a few MB
+	static constexpr size_t DefaultChunkSize = 1u << 20;
+public:
+	// Count the records of the text, which has to stay valid until Parse is done. Chunks end at the
+	// first line end past chunkSize bytes (small ones make tests on small files cross them)
+	ObjParser(const char* pText, size_t size, ThreadPool* pPool = nullptr, size_t chunkSize = DefaultChunkSize);
+	const Counts& GetCounts() const noexcept;
+	// Fill output (arrays sized from GetCounts) with the records. Every chunk writes from the
+	// offset given by the counts of the chunks before it: the result is the same as in one pass.
+	// Malformed records and indices out of range throw, the first one in the text when there are
+	// more (the filename is only used for the error messages)
+	void Parse(const Output& output, const std::string& filename) const;
+	// Weld the face corners that refer to the same (position, texture coordinate, normal): the
+	// unique tuples become the vertices of an indexed mesh, in order of first use. pIndices gets
+	// the vertex of every corner, firstCorners the corner each vertex was first seen at.
+	// pTexIndices or pNorIndices can be nullptr to leave that attribute out of the comparison
+	static void Weld(const unsigned int* pPosIndices, const unsigned int* pTexIndices, const unsigned int* pNorIndices, size_t count,
+		unsigned int* pIndices, std::vector<unsigned int>& firstCorners);
+private:
+	// Positions and faces, the records telling where a mesh starts
+	enum class Boundary
+	{
+		None,
+		Position,
+		Face
+	};
+	struct Chunk
+	{
+		const char* pBegin = nullptr;
+		const char* pEnd = nullptr;
+		Counts counts = {};                // of this chunk alone, nMeshes as if it followed a position
+		Boundary first = Boundary::None;   // first position or face record
+		Boundary last = Boundary::None;    // last position or face record
+		size_t nLines = 0u;
+		Counts offsets = {};               // records in the chunks before
+		size_t firstLine = 0u;
+	};
+private:
+	static void CountChunk(Chunk& chunk) noexcept;
+	static void ParseChunk(const Chunk& chunk, const Counts& totals, const Output& output, const std::string& filename);
+private:
+	std::vector<Chunk> chunks;
+	Counts counts = {};
+	ThreadPool* pPool;
+};
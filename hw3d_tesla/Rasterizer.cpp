@@ -0,0 +1,960 @@
+#include "Rasterizer.h"
+#include "ThreadPool.h"
+#include "TeslaTimer.h"
+#include "Simd.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	// Vertices and triangles handed to each task of the parallel loops
+	constexpr size_t VertexBlockSize = 4096u;
+	constexpr size_t TriangleChunkSize = 2048u;
+	// Triangles are clipped in x and y only when they leave this many viewports around the
+	// target; the rest is cut by the bounding box (keeps the fixed point coordinates small)
+	constexpr float GuardBand = 4.0f;
+	// Triangles with a bounding box up to this many pixels wide and high skip the 4x4 blocks
+	constexpr unsigned int SmallTriangleSize = 8u;
+
+	enum ClipPlane : unsigned int
+	{
+		Near = 1u << 0,
+		Far = 1u << 1,
+		Left = 1u << 2,
+		Right = 1u << 3,
+		Bottom = 1u << 4,
+		Top = 1u << 5
+	};
+
+	// Signed distance of v from plane (inside when >= 0)
+	template<typename V>
+	float PlaneDistance(const V& v, unsigned int plane) noexcept
+	{
+		switch (plane)
+		{
+		case Near:   return v.z;
+		case Far:    return v.w - v.z;
+		case Left:   return v.x + GuardBand * v.w;
+		case Right:  return GuardBand * v.w - v.x;
+		case Bottom: return v.y + GuardBand * v.w;
+		default:     return GuardBand * v.w - v.y;
+		}
+	}
+
+	template<typename V>
+	unsigned int OutCode(const V& v) noexcept
+	{
+		unsigned int code = 0u;
+		for (unsigned int plane = Near; plane <= Top; plane <<= 1)
+		{
+			if (PlaneDistance(v, plane) < 0.0f)
+			{
+				code |= plane;
+			}
+		}
+		return code;
+	}
+
+	// Floor of a / 2^SubpixelBits for negative values too
+	int FixedFloor(int a) noexcept
+	{
+		return a >> Rasterizer::SubpixelBits;
+	}
+
+	// Depth range of the blocks under a small triangle: up to 3 x 3, read with a fixed count
+	// (repeating the last column and row) so that the tiny loops don't mispredict
+	static_assert(SmallTriangleSize <= 2u * DepthSurface::BlockSize);
+
+	void SmallRegionRange(const float* pMin, const float* pMax, size_t nBlocksX, unsigned int left, unsigned int top, unsigned int right, unsigned int bottom, float& lo, float& hi) noexcept
+	{
+		const size_t base = nBlocksX * top + left;
+		const size_t cols[3] = { 0u, std::min(right - left, 1u), right - left };
+		const size_t rows[3] = { 0u, nBlocksX * std::min(bottom - top, 1u), nBlocksX * (bottom - top) };
+		for (size_t row : rows)
+		{
+			for (size_t col : cols)
+			{
+				lo = std::min(lo, pMin[base + row + col]);
+				hi = std::max(hi, pMax[base + row + col]);
+			}
+		}
+	}
+
+	/*************************** 4x4 block kernels ****************************/
+	// One triangle over a 4x4 pixel block: edge functions at the top left pixel center and their
+	// steps (zero for the edges that contain the whole block), depth plane and target pixels.
+	// All the versions compute the same depths in the same order, so they write the same pixels
+	struct Block
+	{
+		int edge[3];
+		int stepX[3];
+		int stepY[3];
+		unsigned int x;
+		unsigned int y;
+		float z0;
+		float dzdx;
+		float dzdy;
+		Color color;
+		Color* pColor;
+		size_t colorPitch;
+		float* pDepth;
+		size_t depthPitch;
+	};
+
+	float RowDepth(const Block& b, unsigned int r) noexcept
+	{
+		return b.z0 + b.dzdy * ((float)(b.y + r) + 0.5f);
+	}
+
+	// Nearest and farthest depth of the plane of b over the pixels [x0, x1] x [y0, y1]. The depth of
+	// a pixel is the rounded sum of a term monotonic in x and one monotonic in y (the same operations
+	// as the kernels), so it's monotonic in both directions and the extremes are at the corners
+	void DepthRange(const Block& b, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, float& zNear, float& zFar) noexcept
+	{
+		const float row0 = b.z0 + b.dzdy * ((float)y0 + 0.5f);
+		const float row1 = b.z0 + b.dzdy * ((float)y1 + 0.5f);
+		const float col0 = b.dzdx * ((float)x0 + 0.5f);
+		const float col1 = b.dzdx * ((float)x1 + 0.5f);
+		const float z00 = row0 + col0;
+		const float z10 = row0 + col1;
+		const float z01 = row1 + col0;
+		const float z11 = row1 + col1;
+		zNear = std::min(std::min(z00, z10), std::min(z01, z11));
+		zFar = std::max(std::max(z00, z10), std::max(z01, z11));
+	}
+
+	// Also handles the blocks cut by the right and bottom borders of the target.
+	// inFront: the depth test is known to pass, the pixels inside are written without it
+	void RasterizeBlockScalar(const Block& b, unsigned int nCols, unsigned int nRows, bool inFront, unsigned long long& tested, unsigned long long& written) noexcept
+	{
+		for (unsigned int r = 0u; r < nRows; r++)
+		{
+			int e0 = b.edge[0] + b.stepY[0] * (int)r;
+			int e1 = b.edge[1] + b.stepY[1] * (int)r;
+			int e2 = b.edge[2] + b.stepY[2] * (int)r;
+			const float zRow = RowDepth(b, r);
+			Color* pColor = b.pColor + b.colorPitch * r;
+			float* pDepth = b.pDepth + b.depthPitch * r;
+			for (unsigned int c = 0u; c < nCols; c++)
+			{
+				if ((e0 | e1 | e2) >= 0)
+				{
+					tested++;
+					const float z = zRow + b.dzdx * ((float)b.x + 0.5f + (float)c);
+					if (inFront || z < pDepth[c])
+					{
+						pDepth[c] = z;
+						pColor[c] = b.color;
+						written++;
+					}
+				}
+				e0 += b.stepX[0];
+				e1 += b.stepX[1];
+				e2 += b.stepX[2];
+			}
+		}
+	}
+
+#ifdef TESLA_SIMD_X86
+	// A row of the block at a time
+	void RasterizeBlockSSE2(const Block& b, bool inFront, unsigned long long& tested, unsigned long long& written) noexcept
+	{
+		__m128i e[3];
+		__m128i stepY[3];
+		for (int i = 0; i < 3; i++)
+		{
+			e[i] = _mm_add_epi32(_mm_set1_epi32(b.edge[i]), _mm_setr_epi32(0, b.stepX[i], b.stepX[i] * 2, b.stepX[i] * 3));
+			stepY[i] = _mm_set1_epi32(b.stepY[i]);
+		}
+		const __m128 zCols = _mm_mul_ps(_mm_set1_ps(b.dzdx), _mm_add_ps(_mm_set1_ps((float)b.x + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)));
+		const __m128 color = _mm_castsi128_ps(_mm_set1_epi32((int)b.color.dword));
+		for (unsigned int r = 0u; r < 4u; r++)
+		{
+			const __m128 inside = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e[0], e[1]), e[2]), _mm_set1_epi32(-1)));
+			const int insideMask = _mm_movemask_ps(inside);
+			if (insideMask != 0)
+			{
+				tested += (unsigned int)std::popcount((unsigned int)insideMask);
+				float* pDepth = b.pDepth + b.depthPitch * r;
+				const __m128 z = _mm_add_ps(_mm_set1_ps(RowDepth(b, r)), zCols);
+				const __m128 d = _mm_loadu_ps(pDepth);
+				const __m128 pass = inFront ? inside : _mm_and_ps(inside, _mm_cmplt_ps(z, d));
+				const int passMask = _mm_movemask_ps(pass);
+				if (passMask != 0)
+				{
+					written += (unsigned int)std::popcount((unsigned int)passMask);
+					float* pColor = (float*)(b.pColor + b.colorPitch * r);
+					_mm_storeu_ps(pDepth, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, d)));
+					_mm_storeu_ps(pColor, _mm_or_ps(_mm_and_ps(pass, color), _mm_andnot_ps(pass, _mm_loadu_ps(pColor))));
+				}
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				e[i] = _mm_add_epi32(e[i], stepY[i]);
+			}
+		}
+	}
+
+	// Two rows of the block at a time
+	TESLA_TARGET_AVX2
+	void RasterizeBlockAVX2(const Block& b, bool inFront, unsigned long long& tested, unsigned long long& written) noexcept
+	{
+		__m256i e[3];
+		__m256i stepY[3];
+		for (int i = 0; i < 3; i++)
+		{
+			const int sx = b.stepX[i];
+			const int sy = b.stepY[i];
+			e[i] = _mm256_add_epi32(_mm256_set1_epi32(b.edge[i]), _mm256_setr_epi32(0, sx, sx * 2, sx * 3, sy, sx + sy, sx * 2 + sy, sx * 3 + sy));
+			stepY[i] = _mm256_set1_epi32(sy * 2);
+		}
+		const __m256 zCols = _mm256_mul_ps(_mm256_set1_ps(b.dzdx), _mm256_add_ps(_mm256_set1_ps((float)b.x + 0.5f), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 0.0f, 1.0f, 2.0f, 3.0f)));
+		const __m256 color = _mm256_castsi256_ps(_mm256_set1_epi32((int)b.color.dword));
+		for (unsigned int r = 0u; r < 4u; r += 2u)
+		{
+			const __m256 inside = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(e[0], e[1]), e[2]), _mm256_set1_epi32(-1)));
+			const int insideMask = _mm256_movemask_ps(inside);
+			if (insideMask != 0)
+			{
+				tested += (unsigned int)std::popcount((unsigned int)insideMask);
+				float* pDepth0 = b.pDepth + b.depthPitch * r;
+				float* pDepth1 = pDepth0 + b.depthPitch;
+				const __m256 zRows = _mm256_set_m128(_mm_set1_ps(RowDepth(b, r + 1u)), _mm_set1_ps(RowDepth(b, r)));
+				const __m256 z = _mm256_add_ps(zRows, zCols);
+				const __m256 d = _mm256_set_m128(_mm_loadu_ps(pDepth1), _mm_loadu_ps(pDepth0));
+				const __m256 pass = inFront ? inside : _mm256_and_ps(inside, _mm256_cmp_ps(z, d, _CMP_LT_OQ));
+				const int passMask = _mm256_movemask_ps(pass);
+				if (passMask != 0)
+				{
+					written += (unsigned int)std::popcount((unsigned int)passMask);
+					float* pColor0 = (float*)(b.pColor + b.colorPitch * r);
+					float* pColor1 = (float*)(b.pColor + b.colorPitch * (r + 1u));
+					const __m256 depths = _mm256_blendv_ps(d, z, pass);
+					const __m256 colors = _mm256_blendv_ps(_mm256_set_m128(_mm_loadu_ps(pColor1), _mm_loadu_ps(pColor0)), color, pass);
+					_mm_storeu_ps(pDepth0, _mm256_castps256_ps128(depths));
+					_mm_storeu_ps(pDepth1, _mm256_extractf128_ps(depths, 1));
+					_mm_storeu_ps(pColor0, _mm256_castps256_ps128(colors));
+					_mm_storeu_ps(pColor1, _mm256_extractf128_ps(colors, 1));
+				}
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				e[i] = _mm256_add_epi32(e[i], stepY[i]);
+			}
+		}
+	}
+#endif
+}
+
+Rasterizer::Rasterizer(ThreadPool* pPool) noexcept
+	:
+	pPool(pPool)
+{
+}
+
+void Rasterizer::Begin(Surface& target, bool clearDepth)
+{
+	pTarget = &target;
+	width = target.GetWidth();
+	height = target.GetHeight();
+	nTilesX = (width + TileSize - 1u) / TileSize;
+	nTilesY = (height + TileSize - 1u) / TileSize;
+	if (depth.GetWidth() != width || depth.GetHeight() != height)
+	{
+		depth = DepthSurface(width, height);
+	}
+	else if (clearDepth)
+	{
+		depth.Clear();
+	}
+	nChunks = 0u;
+	stats = {};
+}
+
+void Rasterizer::DrawIndexed(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t nIndices,
+	const Matrix& world, const Matrix& viewProj, Color color)
+{
+	assert(pTarget != nullptr && "Draw called outside of Begin / End");
+	TeslaTimer<float> timer;
+
+	// Every vertex is transformed (and projected) once, no matter how many triangles share it.
+	// With fewer indices than vertices some of them are surely unused: only transform the listed ones
+	worldPositions.resize(nVertices * 3u);
+	processed.resize(nVertices);
+	const bool sparse = nIndices < nVertices;
+	if (sparse)
+	{
+		// Stamped instead of cleared, so a small part of a big vertex buffer costs its indices only
+		if (vertexStamps.size() < nVertices)
+		{
+			vertexStamps.resize(nVertices, 0u);
+		}
+		if (++drawStamp == 0u)
+		{
+			std::fill(vertexStamps.begin(), vertexStamps.end(), 0u);
+			drawStamp = 1u;
+		}
+		usedVertices.clear();
+		for (size_t i = 0u; i < nIndices; i++)
+		{
+			const unsigned int index = pIndices[i];
+			if (index < nVertices && vertexStamps[index] != drawStamp)
+			{
+				vertexStamps[index] = drawStamp;
+				usedVertices.push_back(index);
+			}
+		}
+	}
+	const size_t nTransformed = sparse ? usedVertices.size() : nVertices;
+	const auto TransformBlock = [&](size_t begin, size_t end)
+	{
+		const float(&w)[4][4] = world.elements;
+		const float(&vp)[4][4] = viewProj.elements;
+		for (size_t k = begin; k < end; k++)
+		{
+			const size_t i = sparse ? usedVertices[k] : k;
+			const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(pPositions) + i * stride);
+			float wp[4];
+			for (int r = 0; r < 4; r++)
+			{
+				wp[r] = w[r][0] * p[0] + w[r][1] * p[1] + w[r][2] * p[2] + w[r][3];
+			}
+			worldPositions[i * 3u + 0u] = wp[0];
+			worldPositions[i * 3u + 1u] = wp[1];
+			worldPositions[i * 3u + 2u] = wp[2];
+			ProcessedVertex& v = processed[i];
+			ClipVertex& c = v.clip;
+			c.x = vp[0][0] * wp[0] + vp[0][1] * wp[1] + vp[0][2] * wp[2] + vp[0][3] * wp[3];
+			c.y = vp[1][0] * wp[0] + vp[1][1] * wp[1] + vp[1][2] * wp[2] + vp[1][3] * wp[3];
+			c.z = vp[2][0] * wp[0] + vp[2][1] * wp[1] + vp[2][2] * wp[2] + vp[2][3] * wp[3];
+			c.w = vp[3][0] * wp[0] + vp[3][1] * wp[1] + vp[3][2] * wp[2] + vp[3][3] * wp[3];
+			v.outCode = OutCode(c);
+			if (v.outCode == 0u)
+			{
+				v.screen = ToScreen(c);
+			}
+		}
+	};
+	const unsigned int nVertexBlocks = (unsigned int)((nTransformed + VertexBlockSize - 1u) / VertexBlockSize);
+	if (pPool != nullptr && nVertexBlocks > 1u)
+	{
+		pPool->ParallelFor(nVertexBlocks, [&](unsigned int b)
+		{
+			TransformBlock(b * VertexBlockSize, std::min(nTransformed, (b + 1u) * VertexBlockSize));
+		});
+	}
+	else
+	{
+		TransformBlock(0u, nTransformed);
+	}
+
+	// Triangle setup, each chunk filling its own list
+	const size_t nTriangles = nIndices / 3u;
+	const unsigned int nNewChunks = (unsigned int)((nTriangles + TriangleChunkSize - 1u) / TriangleChunkSize);
+	if (chunks.size() < nChunks + nNewChunks)
+	{
+		chunks.resize(nChunks + nNewChunks);
+	}
+	const auto SetupChunkAt = [&](unsigned int c)
+	{
+		const size_t first = c * TriangleChunkSize;
+		const size_t count = std::min(TriangleChunkSize, nTriangles - first);
+		SetupTriangles(pIndices + first * 3u, count, color, chunks[nChunks + c]);
+	};
+	if (pPool != nullptr && nNewChunks > 1u)
+	{
+		pPool->ParallelFor(nNewChunks, SetupChunkAt);
+	}
+	else
+	{
+		for (unsigned int c = 0u; c < nNewChunks; c++)
+		{
+			SetupChunkAt(c);
+		}
+	}
+	for (unsigned int c = 0u; c < nNewChunks; c++)
+	{
+		stats.trianglesCulled += chunks[nChunks + c].culled;
+		stats.trianglesClipped += chunks[nChunks + c].clipped;
+	}
+	nChunks += nNewChunks;
+	stats.trianglesSubmitted += nTriangles;
+	stats.indicesSubmitted += nTriangles * 3u;
+	stats.verticesTransformed += nTransformed;
+	stats.transformTime += timer.Mark();
+}
+
+void Rasterizer::End()
+{
+	assert(pTarget != nullptr && "End called without Begin");
+	TeslaTimer<float> timer;
+
+	// Counting sort of the triangles into the tiles their bounding box touches, in draw order
+	binStart.assign((size_t)nTilesX * nTilesY + 1u, 0u);
+	for (size_t c = 0u; c < nChunks; c++)
+	{
+		for (const Triangle& tri : chunks[c].triangles)
+		{
+			for (unsigned int ty = tri.minY / TileSize; ty <= (tri.maxY - 1u) / TileSize; ty++)
+			{
+				for (unsigned int tx = tri.minX / TileSize; tx <= (tri.maxX - 1u) / TileSize; tx++)
+				{
+					binStart[tx + (size_t)nTilesX * ty + 1u]++;
+				}
+			}
+		}
+		stats.trianglesSetUp += chunks[c].triangles.size();
+	}
+	tiles.clear();
+	for (size_t t = 0u; t + 1u < binStart.size(); t++)
+	{
+		if (binStart[t + 1u] != 0u)
+		{
+			tiles.push_back((unsigned int)t);
+		}
+		binStart[t + 1u] += binStart[t];
+	}
+	binEntries.resize(binStart.back());
+	for (size_t c = 0u; c < nChunks; c++)
+	{
+		for (const Triangle& tri : chunks[c].triangles)
+		{
+			for (unsigned int ty = tri.minY / TileSize; ty <= (tri.maxY - 1u) / TileSize; ty++)
+			{
+				for (unsigned int tx = tri.minX / TileSize; tx <= (tri.maxX - 1u) / TileSize; tx++)
+				{
+					binEntries[binStart[tx + (size_t)nTilesX * ty]++] = &tri;
+				}
+			}
+		}
+	}
+	// Every start moved up by one bin: shift them back
+	std::copy_backward(binStart.begin(), binStart.end() - 1, binStart.end());
+	binStart[0] = 0u;
+	stats.binEntries = binEntries.size();
+	stats.binTime = timer.Mark();
+
+	// Tiles own their pixels, their depth and their dirty flags: no synchronization needed
+	tileCounters.assign(tiles.size(), {});
+	if (pPool != nullptr && tiles.size() > 1u)
+	{
+		pPool->ParallelFor((unsigned int)tiles.size(), [this](unsigned int i)
+		{
+			RasterizeTile(tiles[i], tileCounters[i]);
+		});
+	}
+	else
+	{
+		for (size_t i = 0u; i < tiles.size(); i++)
+		{
+			RasterizeTile(tiles[i], tileCounters[i]);
+		}
+	}
+	for (size_t i = 0u; i < tiles.size(); i++)
+	{
+		stats.blocksRejected += tileCounters[i].blocksRejected;
+		stats.blocksAccepted += tileCounters[i].blocksAccepted;
+		stats.blocksPartial += tileCounters[i].blocksPartial;
+		stats.trianglesHidden += tileCounters[i].trianglesHidden;
+		stats.blocksHidden += tileCounters[i].blocksHidden;
+		stats.pixelsInFront += tileCounters[i].pixelsInFront;
+		stats.pixelsTested += tileCounters[i].tested;
+		stats.pixelsWritten += tileCounters[i].written;
+	}
+	stats.rasterTime = timer.Mark();
+}
+
+void Rasterizer::SetCullMode(CullMode mode) noexcept
+{
+	cullMode = mode;
+}
+
+Rasterizer::CullMode Rasterizer::GetCullMode() const noexcept
+{
+	return cullMode;
+}
+
+void Rasterizer::SetLightDirection(float x, float y, float z) noexcept
+{
+	const float length = std::sqrt(x * x + y * y + z * z);
+	if (length > 0.0f)
+	{
+		lightX = x / length;
+		lightY = y / length;
+		lightZ = z / length;
+	}
+}
+
+float Rasterizer::GetDepth(unsigned int x, unsigned int y) const noexcept
+{
+	return depth.GetDepth(x, y);
+}
+
+const DepthSurface& Rasterizer::GetDepthSurface() const noexcept
+{
+	return depth;
+}
+
+const Rasterizer::Statistics& Rasterizer::GetStatistics() const noexcept
+{
+	return stats;
+}
+
+void Rasterizer::SetupTriangles(const unsigned int* pIndices, size_t nTriangles, Color color, SetupChunk& chunk) const
+{
+	chunk.triangles.clear();
+	chunk.culled = 0u;
+	chunk.clipped = 0u;
+	const size_t nVertices = processed.size();
+	for (size_t t = 0u; t < nTriangles; t++)
+	{
+		const unsigned int i0 = pIndices[t * 3u + 0u];
+		const unsigned int i1 = pIndices[t * 3u + 1u];
+		const unsigned int i2 = pIndices[t * 3u + 2u];
+		if (i0 >= nVertices || i1 >= nVertices || i2 >= nVertices)
+		{
+			chunk.culled++;
+			continue;
+		}
+		const ProcessedVertex& v0 = processed[i0];
+		const ProcessedVertex& v1 = processed[i1];
+		const ProcessedVertex& v2 = processed[i2];
+		// All the vertices outside the same plane
+		if ((v0.outCode & v1.outCode & v2.outCode) != 0u)
+		{
+			chunk.culled++;
+			continue;
+		}
+		const float* pWorld = worldPositions.data();
+
+		if ((v0.outCode | v1.outCode | v2.outCode) == 0u)
+		{
+			Triangle tri;
+			if (SetupScreenTriangle(v0.screen, v1.screen, v2.screen, tri))
+			{
+				tri.color = Shade(pWorld + i0 * 3u, pWorld + i1 * 3u, pWorld + i2 * 3u, color);
+				chunk.triangles.push_back(tri);
+			}
+			else
+			{
+				chunk.culled++;
+			}
+			continue;
+		}
+
+		// Sutherland-Hodgman against the planes the triangle crosses (3 + 6 vertices at most)
+		chunk.clipped++;
+		ClipVertex polygon[2][9] = { { v0.clip, v1.clip, v2.clip } };
+		unsigned int nPolygon = 3u;
+		unsigned int current = 0u;
+		const unsigned int crossed = v0.outCode | v1.outCode | v2.outCode;
+		for (unsigned int plane = Near; plane <= Top && nPolygon >= 3u; plane <<= 1)
+		{
+			if ((crossed & plane) == 0u)
+			{
+				continue;
+			}
+			const ClipVertex* pIn = polygon[current];
+			ClipVertex* pOut = polygon[current ^ 1u];
+			unsigned int nOut = 0u;
+			for (unsigned int k = 0u; k < nPolygon; k++)
+			{
+				const ClipVertex& a = pIn[k];
+				const ClipVertex& b = pIn[(k + 1u) % nPolygon];
+				const float da = PlaneDistance(a, plane);
+				const float db = PlaneDistance(b, plane);
+				if (da >= 0.0f)
+				{
+					pOut[nOut++] = a;
+				}
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					const float s = da / (da - db);
+					pOut[nOut++] = { a.x + (b.x - a.x) * s, a.y + (b.y - a.y) * s, a.z + (b.z - a.z) * s, a.w + (b.w - a.w) * s };
+				}
+			}
+			nPolygon = nOut;
+			current ^= 1u;
+		}
+		if (nPolygon < 3u)
+		{
+			chunk.culled++;
+			continue;
+		}
+
+		// Fan of the clipped polygon, all its triangles share the shading of the original one
+		const Color shaded = Shade(pWorld + i0 * 3u, pWorld + i1 * 3u, pWorld + i2 * 3u, color);
+		const ClipVertex* pPolygon = polygon[current];
+		const ScreenVertex s0 = ToScreen(pPolygon[0]);
+		ScreenVertex s1 = ToScreen(pPolygon[1]);
+		for (unsigned int k = 2u; k < nPolygon; k++)
+		{
+			const ScreenVertex s2 = ToScreen(pPolygon[k]);
+			Triangle tri;
+			if (SetupScreenTriangle(s0, s1, s2, tri))
+			{
+				tri.color = shaded;
+				chunk.triangles.push_back(tri);
+			}
+			s1 = s2;
+		}
+	}
+}
+
+Rasterizer::ScreenVertex Rasterizer::ToScreen(const ClipVertex& v) const noexcept
+{
+	// Inside the clip planes w is positive. NDC y goes up, rows go down
+	const float invW = 1.0f / v.w;
+	const float scale = (float)(1 << SubpixelBits);
+	return {
+		(int)std::lrint((v.x * invW * 0.5f + 0.5f) * (float)width * scale),
+		(int)std::lrint((0.5f - v.y * invW * 0.5f) * (float)height * scale),
+		v.z * invW
+	};
+}
+
+bool Rasterizer::SetupScreenTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2, Triangle& tri) const noexcept
+{
+	// Positive area: clockwise on screen
+	const long long area = (long long)(v1.x - v0.x) * (v2.y - v0.y) - (long long)(v2.x - v0.x) * (v1.y - v0.y);
+	if (area == 0 || (cullMode == CullMode::Back && area < 0) || (cullMode == CullMode::Front && area > 0))
+	{
+		return false;
+	}
+	if (area < 0)
+	{
+		std::swap(v1, v2);
+	}
+
+	// Pixels whose center (x + 0.5, y + 0.5) can be inside
+	const int half = 1 << (SubpixelBits - 1);
+	const int minX = std::min({ v0.x, v1.x, v2.x }) - half;
+	const int minY = std::min({ v0.y, v1.y, v2.y }) - half;
+	const int maxX = std::max({ v0.x, v1.x, v2.x }) - half;
+	const int maxY = std::max({ v0.y, v1.y, v2.y }) - half;
+	const int pixelMinX = std::max(FixedFloor(minX + (1 << SubpixelBits) - 1), 0);
+	const int pixelMinY = std::max(FixedFloor(minY + (1 << SubpixelBits) - 1), 0);
+	const int pixelMaxX = std::min(FixedFloor(maxX) + 1, (int)width);
+	const int pixelMaxY = std::min(FixedFloor(maxY) + 1, (int)height);
+	if (pixelMinX >= pixelMaxX || pixelMinY >= pixelMaxY)
+	{
+		return false;
+	}
+	tri.x[0] = v0.x;
+	tri.x[1] = v1.x;
+	tri.x[2] = v2.x;
+	tri.y[0] = v0.y;
+	tri.y[1] = v1.y;
+	tri.y[2] = v2.y;
+	tri.minX = (unsigned int)pixelMinX;
+	tri.minY = (unsigned int)pixelMinY;
+	tri.maxX = (unsigned int)pixelMaxX;
+	tri.maxY = (unsigned int)pixelMaxY;
+
+	// Depth plane in pixel units, from the snapped vertices
+	const float scale = 1.0f / (float)(1 << SubpixelBits);
+	const float x0 = (float)v0.x * scale;
+	const float y0 = (float)v0.y * scale;
+	const float dx1 = (float)(v1.x - v0.x) * scale;
+	const float dy1 = (float)(v1.y - v0.y) * scale;
+	const float dx2 = (float)(v2.x - v0.x) * scale;
+	const float dy2 = (float)(v2.y - v0.y) * scale;
+	const float dz1 = v1.z - v0.z;
+	const float dz2 = v2.z - v0.z;
+	const float invArea = 1.0f / (dx1 * dy2 - dx2 * dy1);
+	tri.dzdx = (dz1 * dy2 - dz2 * dy1) * invArea;
+	tri.dzdy = (dz2 * dx1 - dz1 * dx2) * invArea;
+	tri.z0 = v0.z - tri.dzdx * x0 - tri.dzdy * y0;
+	return true;
+}
+
+Color Rasterizer::Shade(const float* w0, const float* w1, const float* w2, Color color) const noexcept
+{
+	// Lambert with the world space face normal, lit on both sides
+	const float e1[3] = { w1[0] - w0[0], w1[1] - w0[1], w1[2] - w0[2] };
+	const float e2[3] = { w2[0] - w0[0], w2[1] - w0[1], w2[2] - w0[2] };
+	const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+	const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	const float lambert = length > 0.0f ? std::abs(n[0] * lightX + n[1] * lightY + n[2] * lightZ) / length : 0.0f;
+	const float intensity = 0.2f + 0.8f * lambert;
+	return Color(255u,
+		(unsigned char)((float)color.GetR() * intensity),
+		(unsigned char)((float)color.GetG() * intensity),
+		(unsigned char)((float)color.GetB() * intensity));
+}
+
+void Rasterizer::RasterizeTile(unsigned int tile, TileCounters& counters) noexcept
+{
+	const unsigned int tileLeft = tile % nTilesX * TileSize;
+	const unsigned int tileTop = tile / nTilesX * TileSize;
+	const unsigned int tileRight = std::min(tileLeft + TileSize, width);
+	const unsigned int tileBottom = std::min(tileTop + TileSize, height);
+	const int one = 1 << SubpixelBits;
+	const int half = one / 2;
+	const Simd::Level level = Simd::GetLevel();
+	const size_t pitch = pTarget->GetPitch();
+	Color* const pColorBase = pTarget->GetBufferPtr();
+	const size_t depthPitch = depth.GetPitch();
+	float* const pDepthBase = depth.GetRowPtr(0u);
+	const size_t nBlocksX = depth.GetBlocksX();
+	float* const pBlockMinBase = depth.GetBlockMinRow(0u);
+	float* const pBlockMaxBase = depth.GetBlockMaxRow(0u);
+	unsigned long long tested = 0u;
+	unsigned long long written = 0u;
+	// Nearest depth written by the small triangles so far: instead of lowering the minimum
+	// of every block they touch, it's taken as the minimum of every block of the tile
+	float smallMin = std::numeric_limits<float>::infinity();
+	// Nearest of the farthest depths of the blocks of the tile
+	float tileNearestMax = std::numeric_limits<float>::infinity();
+	for (unsigned int by = tileTop / DepthSurface::BlockSize; by <= (tileBottom - 1u) / DepthSurface::BlockSize; by++)
+	{
+		const float* pMax = pBlockMaxBase + nBlocksX * by;
+		for (unsigned int bx = tileLeft / DepthSurface::BlockSize; bx <= (tileRight - 1u) / DepthSurface::BlockSize; bx++)
+		{
+			tileNearestMax = std::min(tileNearestMax, pMax[bx]);
+		}
+	}
+
+	for (unsigned int k = binStart[tile]; k < binStart[tile + 1u]; k++)
+	{
+		const Triangle& tri = *binEntries[k];
+		const unsigned int x0 = std::max(tri.minX, tileLeft);
+		const unsigned int y0 = std::max(tri.minY, tileTop);
+		const unsigned int x1 = std::min(tri.maxX, tileRight);
+		const unsigned int y1 = std::min(tri.maxY, tileBottom);
+		if (x0 >= x1 || y0 >= y1)
+		{
+			continue;
+		}
+
+		Block block;
+		block.z0 = tri.z0;
+		block.dzdx = tri.dzdx;
+		block.dzdy = tri.dzdy;
+		block.color = tri.color;
+		block.colorPitch = pitch;
+		block.depthPitch = depthPitch;
+
+		// Small triangles (most of them in dense meshes) cost more in block setup than in
+		// pixels: their bounding box, cut to the tile, is walked like a single block
+		const bool small = tri.maxX - tri.minX <= SmallTriangleSize && tri.maxY - tri.minY <= SmallTriangleSize;
+
+		// Hierarchical Z: the triangle is hidden if it's behind the farthest depth of every block
+		// it touches in the tile. Only the triangles behind the nearest of those in the whole tile
+		// can be, the blocks of the others aren't even read
+		float zNear;
+		float zFar;
+		DepthRange(block, x0, y0, x1 - 1u, y1 - 1u, zNear, zFar);
+		const unsigned int blockLeft = x0 / DepthSurface::BlockSize;
+		const unsigned int blockRight = (x1 - 1u) / DepthSurface::BlockSize;
+		const unsigned int blockTop = y0 / DepthSurface::BlockSize;
+		const unsigned int blockBottom = (y1 - 1u) / DepthSurface::BlockSize;
+		// Not read: as if something was in front
+		float regionMin = -std::numeric_limits<float>::infinity();
+		if (zNear >= tileNearestMax)
+		{
+			regionMin = std::numeric_limits<float>::infinity();
+			float regionMax = -std::numeric_limits<float>::infinity();
+			if (small)
+			{
+				SmallRegionRange(pBlockMinBase, pBlockMaxBase, nBlocksX, blockLeft, blockTop, blockRight, blockBottom, regionMin, regionMax);
+				// Writes of the small triangles lower the block minimums at the end of the tile
+				regionMin = std::min(regionMin, smallMin);
+			}
+			else
+			{
+				for (unsigned int by = blockTop; by <= blockBottom; by++)
+				{
+					const float* pMax = pBlockMaxBase + nBlocksX * by;
+					for (unsigned int bx = blockLeft; bx <= blockRight; bx++)
+					{
+						regionMax = std::max(regionMax, pMax[bx]);
+					}
+				}
+			}
+			if (zNear >= regionMax)
+			{
+				counters.trianglesHidden++;
+				continue;
+			}
+		}
+
+		// Edge i goes from vertex i to vertex i + 1, the inside is where all three are >= 0.
+		// Top-left rule: pixels exactly on an edge belong to the triangle only if the edge is
+		// a top edge (horizontal, going right) or a left edge (going up), so that a pixel on
+		// an edge shared by two triangles is drawn exactly once.
+		// The edges are walked in 64 bit at the top left pixel of every 4x4 block (aligned to the
+		// target, the tiles are multiples of 4), together with their smallest and largest value
+		// over the block's pixels
+		const unsigned int bx0 = small ? x0 : x0 & ~3u;
+		const unsigned int by0 = small ? y0 : y0 & ~3u;
+		const int px = (int)bx0 * one + half;
+		const int py = (int)by0 * one + half;
+		long long row[3];
+		long long stepX[3];
+		long long stepY[3];
+		long long minOffset[3];
+		long long maxOffset[3];
+		for (int i = 0; i < 3; i++)
+		{
+			const int j = (i + 1) % 3;
+			const long long dx = (long long)tri.x[j] - tri.x[i];
+			const long long dy = (long long)tri.y[j] - tri.y[i];
+			const bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+			row[i] = dx * (py - tri.y[i]) - dy * (px - tri.x[i]) + (topLeft ? 0 : -1);
+			stepX[i] = -dy * one;
+			stepY[i] = dx * one;
+			minOffset[i] = std::min(stepX[i] * 3, 0ll) + std::min(stepY[i] * 3, 0ll);
+			maxOffset[i] = std::max(stepX[i] * 3, 0ll) + std::max(stepY[i] * 3, 0ll);
+		}
+
+		if (small)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				block.edge[i] = (int)row[i];
+				block.stepX[i] = (int)stepX[i];
+				block.stepY[i] = (int)stepY[i];
+			}
+			block.x = x0;
+			block.y = y0;
+			block.pColor = pColorBase + pitch * y0 + x0;
+			block.pDepth = pDepthBase + depthPitch * y0 + x0;
+			counters.blocksPartial++;
+			const bool inFront = zFar < regionMin;
+			const unsigned long long testedBefore = tested;
+			RasterizeBlockScalar(block, x1 - x0, y1 - y0, inFront, tested, written);
+			if (inFront)
+			{
+				counters.pixelsInFront += tested - testedBefore;
+			}
+			smallMin = std::min(smallMin, zNear);
+			continue;
+		}
+		for (unsigned int by = by0; by < y1; by += 4u)
+		{
+			long long e[3] = { row[0], row[1], row[2] };
+			bool inRun = false;
+			for (unsigned int bx = bx0; bx < x1; bx += 4u, e[0] += stepX[0] * 4, e[1] += stepX[1] * 4, e[2] += stepX[2] * 4)
+			{
+				if (e[0] + maxOffset[0] < 0 || e[1] + maxOffset[1] < 0 || e[2] + maxOffset[2] < 0)
+				{
+					counters.blocksRejected++;
+					// The triangle is convex: once its blocks in this row are over, so is the row
+					if (inRun)
+					{
+						break;
+					}
+					continue;
+				}
+				inRun = true;
+				// Edges the block is completely inside of don't need to be evaluated: their value
+				// and steps become zero. The ones crossing it fit 32 bits inside the block
+				// (less than 3 * (|stepX| + |stepY|) away from zero)
+				bool accepted = true;
+				for (int i = 0; i < 3; i++)
+				{
+					if (e[i] + minOffset[i] >= 0)
+					{
+						block.edge[i] = 0;
+						block.stepX[i] = 0;
+						block.stepY[i] = 0;
+					}
+					else
+					{
+						block.edge[i] = (int)e[i];
+						block.stepX[i] = (int)stepX[i];
+						block.stepY[i] = (int)stepY[i];
+						accepted = false;
+					}
+				}
+				if (accepted)
+				{
+					counters.blocksAccepted++;
+				}
+				else
+				{
+					counters.blocksPartial++;
+				}
+
+				float zBlockNear;
+				float zBlockFar;
+				DepthRange(block, bx, by, bx + 3u, by + 3u, zBlockNear, zBlockFar);
+				const size_t blockIndex = nBlocksX * (by / DepthSurface::BlockSize) + bx / DepthSurface::BlockSize;
+				float& blockMin = pBlockMinBase[blockIndex];
+				float& blockMax = pBlockMaxBase[blockIndex];
+				if (zBlockNear >= blockMax)
+				{
+					counters.blocksHidden++;
+					continue;
+				}
+				const bool inFront = zBlockFar < std::min(blockMin, smallMin);
+
+				block.x = bx;
+				block.y = by;
+				block.pColor = pColorBase + pitch * by + bx;
+				block.pDepth = pDepthBase + depthPitch * by + bx;
+				const unsigned int nCols = std::min(4u, width - bx);
+				const unsigned int nRows = std::min(4u, height - by);
+				const unsigned long long testedBefore = tested;
+				if (nCols < 4u || nRows < 4u)
+				{
+					RasterizeBlockScalar(block, nCols, nRows, inFront, tested, written);
+				}
+				else
+				{
+					switch (level)
+					{
+#ifdef TESLA_SIMD_X86
+					case Simd::Level::AVX2:
+						RasterizeBlockAVX2(block, inFront, tested, written);
+						break;
+					case Simd::Level::SSE2:
+						RasterizeBlockSSE2(block, inFront, tested, written);
+						break;
+#endif
+					default:
+						RasterizeBlockScalar(block, 4u, 4u, inFront, tested, written);
+						break;
+					}
+				}
+				if (inFront)
+				{
+					counters.pixelsInFront += tested - testedBefore;
+				}
+				// Every pixel of an accepted block now holds min(old depth, triangle depth)
+				if (accepted)
+				{
+					blockMax = inFront ? zBlockFar : std::min(blockMax, zBlockFar);
+					tileNearestMax = std::min(tileNearestMax, blockMax);
+				}
+				blockMin = std::min(blockMin, zBlockNear);
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				row[i] += stepY[i] * 4;
+			}
+		}
+	}
+	if (smallMin != std::numeric_limits<float>::infinity())
+	{
+		for (unsigned int by = tileTop / DepthSurface::BlockSize; by <= (tileBottom - 1u) / DepthSurface::BlockSize; by++)
+		{
+			float* pMin = pBlockMinBase + nBlocksX * by;
+			for (unsigned int bx = tileLeft / DepthSurface::BlockSize; bx <= (tileRight - 1u) / DepthSurface::BlockSize; bx++)
+			{
+				pMin[bx] = std::min(pMin[bx], smallMin);
+			}
+		}
+	}
+	counters.tested = tested;
+	counters.written = written;
+	if (binStart[tile + 1u] != binStart[tile])
+	{
+		pTarget->MarkDirty({ tileLeft, tileTop, tileRight, tileBottom });
+	}
+}
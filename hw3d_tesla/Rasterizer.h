@@ -0,0 +1,205 @@
+#pragma once
+#include "Surface.h"
+#include "DepthSurface.h"
+#include <vector>
+
+class ThreadPool;
+
+// Software triangle pipeline drawing indexed meshes into a Surface with a DepthSurface.
+// Draw transforms the vertices, clips the triangles and sets them up in screen space;
+// End bins them into TileSize x TileSize screen tiles and rasterizes the tiles in parallel,
+// 4x4 pixel blocks at a time (SSE2/AVX2, see Simd::GetLevel).
+//   rasterizer.Begin(surface);
+//   rasterizer.Draw(mesh, world, viewProj, color); // any number of times
+//   rasterizer.End();
+// Triangles are flat shaded: color scaled by a Lambert term of the world space face normal.
+// Matrices follow Tesla::Mat4 (column vectors, elements[row][col]) and any type with a
+// float elements[4][4] works; meshes follow Tesla::IndexedTriangleList (vertices with a
+// pos made of three consecutive floats x, y, z, and index_type indices).
+class Rasterizer
+{
+public:
+	enum class CullMode
+	{
+		None,
+		Back,  // skip triangles that are counter-clockwise on screen
+		Front  // skip triangles that are clockwise on screen
+	};
+	struct Matrix
+	{
+		float elements[4][4];
+	};
+	// Of the frame ended by the last End
+	struct Statistics
+	{
+		unsigned long long indicesSubmitted;
+		unsigned long long verticesTransformed; // once per Draw, only the referenced ones for sparse draws
+		unsigned long long trianglesSubmitted;
+		unsigned long long trianglesCulled;    // back faces, zero area and completely outside
+		unsigned long long trianglesClipped;   // crossing the near, far or guard band planes
+		unsigned long long trianglesSetUp;     // sent to the tiles (clipping can make more than one)
+		unsigned long long binEntries;         // set up triangles times the tiles they touch
+		unsigned long long blocksRejected;     // 4x4 pixel blocks of the bin entries outside the triangle
+		unsigned long long blocksAccepted;     // completely inside (no edge functions evaluated)
+		unsigned long long blocksPartial;      // crossed by an edge (or small triangles), evaluated per pixel
+		unsigned long long trianglesHidden;    // bin entries behind the depth of all their blocks in the tile
+		unsigned long long blocksHidden;       // blocks behind the depth they cover (after the edge tests)
+		unsigned long long pixelsInFront;      // tested pixels known to pass without reading the depth
+		unsigned long long pixelsTested;       // inside a triangle and not hidden, sent to the depth test
+		unsigned long long pixelsWritten;      // passed the depth test
+		float transformTime;                   // seconds spent in Draw
+		float binTime;                         // seconds spent binning in End
+		float rasterTime;                      // seconds spent rasterizing the tiles in End
+		// Indices served by each transformed vertex (a per index pipeline would be at 1)
+		double GetVertexReuse() const noexcept
+		{
+			return verticesTransformed != 0u ? (double)indicesSubmitted / (double)verticesTransformed : 0.0;
+		}
+	};
+	// Screen tile size (in pixels), a multiple of the dirty tiles so that
+	// concurrent tiles never share a dirty flag
+	static constexpr unsigned int TileSize = 64u;
+	static_assert(TileSize % Surface::DirtyTileSize == 0u);
+	// Fractional bits of the screen coordinates
+	static constexpr int SubpixelBits = 4;
+public:
+	// Without a pool everything runs on the calling thread
+	Rasterizer(ThreadPool* pPool = nullptr) noexcept;
+	Rasterizer(const Rasterizer&) = delete;
+	Rasterizer& operator = (const Rasterizer&) = delete;
+	// Start a frame drawing into target (which must outlive the frame). The depth buffer is
+	// resized to the target (starting cleared) or, if asked, cleared to the far plane (1.0)
+	void Begin(Surface& target, bool clearDepth = true);
+	template<typename Mesh, typename Mat>
+	void Draw(const Mesh& mesh, const Mat& world, const Mat& viewProj, Color color)
+	{
+		if (mesh.vertices.empty() || mesh.indices.empty())
+		{
+			return;
+		}
+		DrawIndexed(&mesh.vertices[0].pos.x, sizeof(mesh.vertices[0]), mesh.vertices.size(),
+			mesh.indices.data(), mesh.indices.size(), ToMatrix(world), ToMatrix(viewProj), color);
+	}
+	// positions: x, y, z floats of vertex i at (const char*)pPositions + i * stride.
+	// Each vertex is transformed once, however many triangles share it: all of them when the indices
+	// can cover the vertices (whole meshes), only the referenced ones when there are fewer indices
+	// than vertices (a part of a mesh sharing its vertex buffer)
+	void DrawIndexed(const float* pPositions, size_t stride, size_t nVertices, const unsigned int* pIndices, size_t nIndices,
+		const Matrix& world, const Matrix& viewProj, Color color);
+	// Rasterize everything drawn since Begin
+	void End();
+	void SetCullMode(CullMode mode) noexcept;
+	CullMode GetCullMode() const noexcept;
+	// Direction the light travels (world space, doesn't need to be normalized)
+	void SetLightDirection(float x, float y, float z) noexcept;
+	// Depth of pixel (x, y) after End: 0 at the near plane, 1 at the far plane
+	float GetDepth(unsigned int x, unsigned int y) const noexcept;
+	const DepthSurface& GetDepthSurface() const noexcept;
+	const Statistics& GetStatistics() const noexcept;
+	template<typename Mat>
+	static Matrix ToMatrix(const Mat& m) noexcept
+	{
+		Matrix res;
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				res.elements[i][j] = (float)m.elements[i][j];
+			}
+		}
+		return res;
+	}
+private:
+	struct ClipVertex
+	{
+		float x;
+		float y;
+		float z;
+		float w;
+	};
+	// Fixed point (SubpixelBits) screen position and depth
+	struct ScreenVertex
+	{
+		int x;
+		int y;
+		float z;
+	};
+	// Output of the transform: the screen position is only valid when no clip plane cuts the vertex
+	struct ProcessedVertex
+	{
+		ClipVertex clip;
+		ScreenVertex screen;
+		unsigned int outCode;
+	};
+	// Screen space triangle ready for the tiles
+	struct Triangle
+	{
+		// Vertices in fixed point (SubpixelBits), wound so that the inside has positive edge functions
+		int x[3];
+		int y[3];
+		// Depth plane: z = z0 + dzdx * px + dzdy * py at the pixel center (px, py)
+		float z0;
+		float dzdx;
+		float dzdy;
+		// Pixels possibly covered, [minX, maxX) x [minY, maxY) clamped to the target
+		unsigned int minX;
+		unsigned int minY;
+		unsigned int maxX;
+		unsigned int maxY;
+		Color color;
+	};
+	// Counters of one tile, summed by End
+	struct TileCounters
+	{
+		unsigned long long blocksRejected;
+		unsigned long long blocksAccepted;
+		unsigned long long blocksPartial;
+		unsigned long long trianglesHidden;
+		unsigned long long blocksHidden;
+		unsigned long long pixelsInFront;
+		unsigned long long tested;
+		unsigned long long written;
+	};
+	// Triangles set up by one slice of a Draw, and its counters
+	struct SetupChunk
+	{
+		std::vector<Triangle> triangles;
+		unsigned long long culled;
+		unsigned long long clipped;
+	};
+private:
+	void SetupTriangles(const unsigned int* pIndices, size_t nTriangles, Color color, SetupChunk& chunk) const;
+	ScreenVertex ToScreen(const ClipVertex& v) const noexcept;
+	// Winding, culling, bounding box and depth plane (false if nothing is left to draw)
+	bool SetupScreenTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2, Triangle& tri) const noexcept;
+	Color Shade(const float* w0, const float* w1, const float* w2, Color color) const noexcept;
+	void RasterizeTile(unsigned int tile, TileCounters& counters) noexcept;
+private:
+	ThreadPool* pPool;
+	Surface* pTarget = nullptr;
+	unsigned int width = 0u;
+	unsigned int height = 0u;
+	unsigned int nTilesX = 0u;
+	unsigned int nTilesY = 0u;
+	CullMode cullMode = CullMode::Back;
+	float lightX = 0.0f;
+	float lightY = 0.0f;
+	float lightZ = 1.0f;
+	DepthSurface depth = DepthSurface(0u, 0u);
+	// Per Draw scratch: world positions (x, y, z) and the rest of the transformed vertices
+	std::vector<float> worldPositions;
+	std::vector<ProcessedVertex> processed;
+	// Vertices used by a sparse Draw, found by stamping them with the number of the Draw
+	std::vector<unsigned int> usedVertices;
+	std::vector<unsigned int> vertexStamps;
+	unsigned int drawStamp = 0u;
+	// Triangles of the frame, in chunks filled in parallel (kept in draw order)
+	std::vector<SetupChunk> chunks;
+	size_t nChunks = 0u;
+	// Triangle references per tile: tile t owns [binStart[t], binStart[t + 1]) of binEntries
+	std::vector<const Triangle*> binEntries;
+	std::vector<unsigned int> binStart;
+	std::vector<unsigned int> tiles;
+	std::vector<TileCounters> tileCounters;
+	Statistics stats = {};
+};
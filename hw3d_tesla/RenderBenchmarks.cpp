@@ -0,0 +1,453 @@
+#ifdef TESLA_HEADLESS
+#include "Benchmark.h"
+#include "Rasterizer.h"
+#include "LineRenderer.h"
+#include "MappedFile.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// Matrices of the Rasterizer and the LineRenderer (Tesla::Mat4 layout: column vectors, elements[row][col])
+static Rasterizer::Matrix Identity() noexcept
+{
+	Rasterizer::Matrix res = {};
+	for (int i = 0; i < 4; i++)
+	{
+		res.elements[i][i] = 1.0f;
+	}
+	return res;
+}
+
+static Rasterizer::Matrix Multiply(const Rasterizer::Matrix& lhs, const Rasterizer::Matrix& rhs) noexcept
+{
+	Rasterizer::Matrix res = {};
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				res.elements[i][j] += lhs.elements[i][k] * rhs.elements[k][j];
+			}
+		}
+	}
+	return res;
+}
+
+// Unit sphere tessellated like Geometry::Sphere (rings of nLon vertices between the poles), with 32 bit indices
+static void MakeSphere(unsigned int nLat, unsigned int nLon, std::vector<float>& positions, std::vector<unsigned int>& indices)
+{
+	constexpr float PI = 3.14159265f;
+	positions = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, -1.0f };
+	for (unsigned int iLat = 1u; iLat < nLat; iLat++)
+	{
+		for (unsigned int iLon = 0u; iLon < nLon; iLon++)
+		{
+			const float phi = (float)iLat * PI / (float)nLat;
+			const float theta = (float)iLon * 2.0f * PI / (float)nLon;
+			positions.insert(positions.end(), { std::sin(phi) * std::cos(theta), std::sin(phi) * std::sin(theta), std::cos(phi) });
+		}
+	}
+	const auto ring = [&](unsigned int iLat, unsigned int iLon)
+	{
+		return 2u + (iLat - 1u) * nLon + iLon % nLon;
+	};
+	indices.clear();
+	for (unsigned int iLon = 0u; iLon < nLon; iLon++)
+	{
+		indices.insert(indices.end(), { 0u, ring(1u, iLon + 1u), ring(1u, iLon) });
+		indices.insert(indices.end(), { 1u, ring(nLat - 1u, iLon), ring(nLat - 1u, iLon + 1u) });
+		for (unsigned int iLat = 1u; iLat < nLat - 1u; iLat++)
+		{
+			indices.insert(indices.end(), { ring(iLat, iLon), ring(iLat, iLon + 1u), ring(iLat + 1u, iLon) });
+			indices.insert(indices.end(), { ring(iLat + 1u, iLon), ring(iLat, iLon + 1u), ring(iLat + 1u, iLon + 1u) });
+		}
+	}
+}
+
+// Positions and triangles of an OBJ file, parsed by ObjParser (the other attributes are dropped)
+static void LoadOBJ(const std::string& filename, std::vector<float>& positions, std::vector<unsigned int>& indices)
+{
+	const MappedFile file{ filename };
+	const ObjParser parser{ reinterpret_cast<const char*>(file.GetData()), file.GetSize() };
+	const ObjParser::Counts& counts = parser.GetCounts();
+	std::vector<float> texCoords(counts.texCoords * 2u);
+	std::vector<float> normals(counts.normals * 3u);
+	std::vector<unsigned int> texIndices(counts.texCoords > 0u ? counts.triangles * 3u : 0u);
+	std::vector<unsigned int> norIndices(counts.normals > 0u ? counts.triangles * 3u : 0u);
+	positions.resize(counts.positions * 3u);
+	indices.resize(counts.triangles * 3u);
+	parser.Parse({ positions.data(), texCoords.data(), normals.data(), indices.data(), texIndices.data(), norIndices.data() }, filename);
+}
+
+// Size of the frames of the raster mode
+static constexpr unsigned int RasterWidth = 1280u;
+static constexpr unsigned int RasterHeight = 720u;
+
+// Left handed perspective (depth 0 at the near plane) looking down z at the origin from 3 units away
+static Rasterizer::Matrix RasterViewProj() noexcept
+{
+	const float zNear = 0.5f;
+	const float zFar = 10.0f;
+	const float yScale = 1.0f / std::tan(0.5f * 1.0f);
+	const float q = zFar / (zFar - zNear);
+	return { { { yScale * RasterHeight / RasterWidth, 0.0f, 0.0f, 0.0f }, { 0.0f, yScale, 0.0f, 0.0f },
+		{ 0.0f, 0.0f, q, 3.0f * q - zNear * q }, { 0.0f, 0.0f, 1.0f, 3.0f } } };
+}
+
+// Draw the mesh as nParts runs of consecutive triangles sharing the whole vertex buffer (each one
+// with fewer indices than vertices is a sparse draw, only its referenced vertices are transformed)
+static void DrawInParts(Rasterizer& rasterizer, const float* pPositions, size_t stride, size_t nVertices,
+	const std::vector<unsigned int>& indices, unsigned int nParts, const Rasterizer::Matrix& world, const Rasterizer::Matrix& viewProj)
+{
+	const size_t partSize = (indices.size() / 3u + nParts - 1u) / nParts * 3u;
+	for (size_t first = 0u; first < indices.size(); first += partSize)
+	{
+		rasterizer.DrawIndexed(pPositions, stride, nVertices, indices.data() + first, std::min(partSize, indices.size() - first),
+			world, viewProj, Color::White);
+	}
+}
+
+// nFrames of a mesh turning in front of the camera, serial and on the pool, drawn whole or in nParts
+// (see DrawInParts). The rates are over the wall time of Draw + End: submitted triangles and tested
+// pixels (what the setup and the tiles chew through)
+static void BenchmarkRasterMesh(const char* name, const float* pPositions, size_t stride, size_t nVertices,
+	const std::vector<unsigned int>& indices, const Rasterizer::Matrix& model, unsigned int nFrames, ThreadPool& pool,
+	unsigned int nParts = 1u)
+{
+	const Rasterizer::Matrix viewProj = RasterViewProj();
+	Surface target{ RasterWidth, RasterHeight };
+	for (ThreadPool* pPool : { (ThreadPool*)nullptr, &pool })
+	{
+		Rasterizer rasterizer{ pPool };
+		Rasterizer::Statistics total = {};
+		float time = 0.0f;
+		for (unsigned int f = 0u; f <= nFrames; f++)
+		{
+			const float angle = 0.01f * (float)f;
+			const Rasterizer::Matrix rotation = { { { std::cos(angle), 0.0f, std::sin(angle), 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f },
+				{ -std::sin(angle), 0.0f, std::cos(angle), 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+			TeslaTimer<float> timer;
+			rasterizer.Begin(target);
+			DrawInParts(rasterizer, pPositions, stride, nVertices, indices, nParts, Multiply(rotation, model), viewProj);
+			rasterizer.End();
+			const float frameTime = timer.Mark();
+			// The first frame sizes the buffers
+			if (f > 0u)
+			{
+				const Rasterizer::Statistics& stats = rasterizer.GetStatistics();
+				time += frameTime;
+				total.indicesSubmitted += stats.indicesSubmitted;
+				total.verticesTransformed += stats.verticesTransformed;
+				total.trianglesSubmitted += stats.trianglesSubmitted;
+				total.trianglesSetUp += stats.trianglesSetUp;
+				total.pixelsTested += stats.pixelsTested;
+				total.pixelsWritten += stats.pixelsWritten;
+				total.transformTime += stats.transformTime;
+				total.binTime += stats.binTime;
+				total.rasterTime += stats.rasterTime;
+			}
+		}
+		std::cout << name << (pPool ? " pool:   " : " serial: ") << time * 1000.0f / (float)nFrames << " ms/frame, "
+			<< (double)total.trianglesSubmitted / time / 1e6 << " Mtriangles/s, " << (double)total.pixelsTested / time / 1e6 << " Mpixels/s ("
+			<< total.trianglesSubmitted / nFrames << " triangles, " << total.trianglesSetUp / nFrames << " set up, "
+			<< total.pixelsWritten / nFrames << " pixels written per frame, vertex reuse " << total.GetVertexReuse() << "; transform " << total.transformTime * 1000.0f / (float)nFrames
+			<< " ms, bin " << total.binTime * 1000.0f / (float)nFrames << " ms, raster " << total.rasterTime * 1000.0f / (float)nFrames << " ms)" << std::endl;
+	}
+}
+
+// The same frame drawn whole and in nParts must come out with the same pixels and depths
+static bool CheckPartsMatchWhole(const float* pPositions, size_t stride, size_t nVertices, const std::vector<unsigned int>& indices,
+	unsigned int nParts, ThreadPool& pool)
+{
+	const float angle = 0.7f;
+	const Rasterizer::Matrix rotation = { { { std::cos(angle), 0.0f, std::sin(angle), 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f },
+		{ -std::sin(angle), 0.0f, std::cos(angle), 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+	Surface whole{ RasterWidth, RasterHeight };
+	Surface parts{ RasterWidth, RasterHeight };
+	Rasterizer wholeRasterizer{ &pool };
+	Rasterizer partsRasterizer{ &pool };
+	wholeRasterizer.Begin(whole);
+	DrawInParts(wholeRasterizer, pPositions, stride, nVertices, indices, 1u, rotation, RasterViewProj());
+	wholeRasterizer.End();
+	partsRasterizer.Begin(parts);
+	DrawInParts(partsRasterizer, pPositions, stride, nVertices, indices, nParts, rotation, RasterViewProj());
+	partsRasterizer.End();
+	for (unsigned int y = 0u; y < RasterHeight; y++)
+	{
+		for (unsigned int x = 0u; x < RasterWidth; x++)
+		{
+			if (whole.GetRowPtr(y)[x].dword != parts.GetRowPtr(y)[x].dword || wholeRasterizer.GetDepth(x, y) != partsRasterizer.GetDepth(x, y))
+			{
+				std::cout << "drawn in " << nParts << " parts: pixel (" << x << ", " << y << ") differs from the whole mesh" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Rasterizer throughput on a dense sphere, whole and in parts sharing its vertex buffer (checked
+// against the whole mesh), and, if given, an OBJ scaled to the unit sphere
+int Benchmark::Raster(const std::string& filename, unsigned int nFrames)
+{
+	constexpr unsigned int SphereParts = 64u;
+	ThreadPool pool;
+	std::vector<float> positions;
+	std::vector<unsigned int> indices;
+	MakeSphere(180u, 360u, positions, indices);
+	BenchmarkRasterMesh("sphere", positions.data(), 3u * sizeof(float), positions.size() / 3u, indices, Identity(), nFrames, pool);
+	BenchmarkRasterMesh("sphere in 64 parts", positions.data(), 3u * sizeof(float), positions.size() / 3u, indices, Identity(), nFrames, pool, SphereParts);
+	if (!CheckPartsMatchWhole(positions.data(), 3u * sizeof(float), positions.size() / 3u, indices, SphereParts, pool))
+	{
+		return -1;
+	}
+	if (filename.empty())
+	{
+		return 0;
+	}
+
+	positions.clear();
+	indices.clear();
+	LoadOBJ(filename, positions, indices);
+	if (indices.empty())
+	{
+		std::cout << filename << " has no triangles" << std::endl;
+		return -1;
+	}
+	float lo[3] = { positions[0], positions[1], positions[2] };
+	float hi[3] = { lo[0], lo[1], lo[2] };
+	for (size_t v = 0u; v < positions.size(); v += 3u)
+	{
+		for (size_t i = 0u; i < 3u; i++)
+		{
+			lo[i] = std::min(lo[i], positions[v + i]);
+			hi[i] = std::max(hi[i], positions[v + i]);
+		}
+	}
+	const float radius = std::max(0.5f * std::sqrt((hi[0] - lo[0]) * (hi[0] - lo[0]) + (hi[1] - lo[1]) * (hi[1] - lo[1]) +
+		(hi[2] - lo[2]) * (hi[2] - lo[2])), 1e-6f);
+	const float s = 1.0f / radius;
+	const Rasterizer::Matrix model = { { { s, 0.0f, 0.0f, -0.5f * (lo[0] + hi[0]) * s }, { 0.0f, s, 0.0f, -0.5f * (lo[1] + hi[1]) * s },
+		{ 0.0f, 0.0f, s, -0.5f * (lo[2] + hi[2]) * s }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+	BenchmarkRasterMesh("obj   ", positions.data(), 3u * sizeof(float), positions.size() / 3u, indices, model, nFrames, pool);
+	return 0;
+}
+
+// The cells x cells grid of Geometry::Grid (Tesla.h needs DirectXMath, so it is built here) covering the
+// whole target, its inner vertices jittered by up to a fifth of a cell (the triangles never fold). On
+// snapped grids the vertices are moved to the nearest half pixel, so edges run through pixel centers.
+// Every triangle gets its own copy of the vertices, nearer than the triangles drawn before it: a pixel
+// covered twice is tested and written twice instead of being hidden by the depth test
+static std::vector<float> MakeJitteredGrid(unsigned int width, unsigned int height, unsigned int cellsX, unsigned int cellsY, bool snapped)
+{
+	std::mt19937 rng(cellsX * 1000u + width);
+	std::uniform_real_distribution<float> jitter(-0.2f, 0.2f);
+	std::vector<float> grid((cellsX + 1u) * (cellsY + 1u) * 2u);
+	for (unsigned int j = 0u; j <= cellsY; j++)
+	{
+		for (unsigned int i = 0u; i <= cellsX; i++)
+		{
+			float x = (float)i + (i > 0u && i < cellsX ? jitter(rng) : 0.0f);
+			float y = (float)j + (j > 0u && j < cellsY ? jitter(rng) : 0.0f);
+			// In pixels
+			x *= (float)width / (float)cellsX;
+			y *= (float)height / (float)cellsY;
+			if (snapped)
+			{
+				x = std::round(x * 2.0f) / 2.0f;
+				y = std::round(y * 2.0f) / 2.0f;
+			}
+			// To NDC (y up), the identity matrices keep it there
+			grid[(j * (cellsX + 1u) + i) * 2u + 0u] = x / (float)width * 2.0f - 1.0f;
+			grid[(j * (cellsX + 1u) + i) * 2u + 1u] = 1.0f - y / (float)height * 2.0f;
+		}
+	}
+	const auto index = [&](unsigned int i, unsigned int j)
+	{
+		return j * (cellsX + 1u) + i;
+	};
+	std::vector<unsigned int> corners;
+	for (unsigned int j = 0u; j < cellsY; j++)
+	{
+		for (unsigned int i = 0u; i < cellsX; i++)
+		{
+			corners.insert(corners.end(), { index(i, j), index(i, j + 1u), index(i + 1u, j) });
+			corners.insert(corners.end(), { index(i + 1u, j), index(i, j + 1u), index(i + 1u, j + 1u) });
+		}
+	}
+	std::vector<float> positions;
+	positions.reserve(corners.size() * 3u);
+	for (size_t c = 0u; c < corners.size(); c++)
+	{
+		const float z = 0.9f - 0.8f * (float)(c / 3u) / (float)(corners.size() / 3u);
+		positions.insert(positions.end(), { grid[corners[c] * 2u], grid[corners[c] * 2u + 1u], z });
+	}
+	return positions;
+}
+
+// Every pixel of the target has to be covered exactly once by the grids of 3 to 200 cells
+int Benchmark::CheckWatertight()
+{
+	ThreadPool pool;
+	const Rasterizer::Matrix identity = Identity();
+	const unsigned int sizes[][2] = { { 250u, 187u }, { 256u, 256u }, { 333u, 201u } };
+	unsigned int nFailed = 0u;
+	for (const auto& size : sizes)
+	{
+		Surface target{ size[0], size[1] };
+		for (ThreadPool* pPool : { (ThreadPool*)nullptr, &pool })
+		{
+			Rasterizer rasterizer{ pPool };
+			rasterizer.SetCullMode(Rasterizer::CullMode::None);
+			unsigned int nGrids = 0u;
+			for (unsigned int cells = 3u; cells <= 200u; cells++)
+			{
+				const unsigned int cellsY = std::max(3u, cells * size[1] / size[0]);
+				const std::vector<float> positions = MakeJitteredGrid(size[0], size[1], cells, cellsY, cells % 2u == 1u);
+				std::vector<unsigned int> indices(positions.size() / 3u);
+				for (unsigned int i = 0u; i < (unsigned int)indices.size(); i++)
+				{
+					indices[i] = i;
+				}
+				rasterizer.Begin(target);
+				rasterizer.DrawIndexed(positions.data(), 3u * sizeof(float), indices.size(), indices.data(), indices.size(), identity, identity, Color::White);
+				rasterizer.End();
+				const Rasterizer::Statistics& stats = rasterizer.GetStatistics();
+				const unsigned long long nPixels = (unsigned long long)size[0] * size[1];
+				if (stats.pixelsTested != nPixels || stats.pixelsWritten != nPixels)
+				{
+					std::cout << size[0] << "x" << size[1] << " " << (pPool ? "pool" : "serial") << ", " << cells << "x" << cellsY << " cells: "
+						<< stats.pixelsTested << " tested, " << stats.pixelsWritten << " written of " << nPixels << " pixels" << std::endl;
+					nFailed++;
+				}
+				nGrids++;
+			}
+			std::cout << size[0] << "x" << size[1] << " " << (pPool ? "pool:   " : "serial: ") << nGrids << " grids checked" << std::endl;
+		}
+	}
+	std::cout << (nFailed == 0u ? "watertight" : std::to_string(nFailed) + " grids with holes or overlaps") << std::endl;
+	return nFailed == 0u ? 0 : -1;
+}
+
+// LineRenderer in lines/s, aliased and Wu, serial and on the pool: 100k lines of 4 to 100 pixels
+// at random over a 1920x1080 target (starting up to 1% past its edges, so that some get clipped)
+int Benchmark::Lines(unsigned int nFrames)
+{
+	constexpr unsigned int Width = 1920u;
+	constexpr unsigned int Height = 1080u;
+	constexpr unsigned int LineCount = 100000u;
+	ThreadPool pool;
+	std::mt19937 rng(16u);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<float> positions;
+	for (unsigned int i = 0u; i < LineCount; i++)
+	{
+		// In pixels, then NDC (y up)
+		const float x = unit(rng) * (float)Width * 1.02f - 0.01f * (float)Width;
+		const float y = unit(rng) * (float)Height * 1.02f - 0.01f * (float)Height;
+		const float length = 4.0f + 96.0f * unit(rng);
+		const float angle = 6.2831853f * unit(rng);
+		for (const float t : { 0.0f, 1.0f })
+		{
+			positions.insert(positions.end(), { (x + t * length * std::cos(angle)) / (float)Width * 2.0f - 1.0f,
+				1.0f - (y + t * length * std::sin(angle)) / (float)Height * 2.0f, 0.5f });
+		}
+	}
+	std::vector<unsigned int> indices(LineCount * 2u);
+	for (unsigned int i = 0u; i < (unsigned int)indices.size(); i++)
+	{
+		indices[i] = i;
+	}
+	const LineRenderer::Matrix identity = Identity();
+
+	Surface target{ Width, Height };
+	for (const LineRenderer::Mode mode : { LineRenderer::Mode::Aliased, LineRenderer::Mode::AntiAliased })
+	{
+		for (ThreadPool* pPool : { (ThreadPool*)nullptr, &pool })
+		{
+			LineRenderer lines{ pPool };
+			lines.SetMode(mode);
+			LineRenderer::Statistics total = {};
+			float time = 0.0f;
+			for (unsigned int f = 0u; f <= nFrames; f++)
+			{
+				TeslaTimer<float> timer;
+				lines.Begin(target);
+				lines.DrawIndexed(positions.data(), 3u * sizeof(float), positions.size() / 3u, indices.data(), indices.size(), identity, Color::White);
+				lines.End();
+				const float frameTime = timer.Mark();
+				// The first frame sizes the buffers
+				if (f > 0u)
+				{
+					const LineRenderer::Statistics& stats = lines.GetStatistics();
+					time += frameTime;
+					total.linesSubmitted += stats.linesSubmitted;
+					total.pixelsWritten += stats.pixelsWritten;
+					total.transformTime += stats.transformTime;
+					total.binTime += stats.binTime;
+					total.drawTime += stats.drawTime;
+				}
+			}
+			std::cout << (mode == LineRenderer::Mode::Aliased ? "aliased " : "Wu      ") << (pPool ? "pool:   " : "serial: ")
+				<< time * 1000.0f / (float)nFrames << " ms/frame, " << (double)total.linesSubmitted / time / 1e6 << " Mlines/s, "
+				<< (double)total.pixelsWritten / time / 1e6 << " Mpixels/s (transform " << total.transformTime * 1000.0f / (float)nFrames
+				<< " ms, bin " << total.binTime * 1000.0f / (float)nFrames << " ms, draw " << total.drawTime * 1000.0f / (float)nFrames << " ms)" << std::endl;
+		}
+	}
+	return 0;
+}
+
+// Simd::TransformPositions at every Simd::Level, in Mvertices/s: 1M packed positions (stride 12) and
+// 1M positions inside 32 byte vertices (position, normal, texture coordinates). Every level has to
+// give the same positions as Level::None, to a few ulps
+int Benchmark::Transform(unsigned int nRuns)
+{
+	constexpr size_t VertexCount = 1000000u;
+	const float m[4][4] = { { 0.8f, 0.1f, -0.6f, 0.0f }, { -0.2f, 0.9f, 0.3f, 0.0f }, { 0.5f, 0.4f, 0.7f, 0.0f }, { 1.5f, -2.0f, 3.0f, 1.0f } };
+	std::mt19937 rng(18u);
+	std::uniform_real_distribution<float> unit(-10.0f, 10.0f);
+	std::vector<float> source(VertexCount * 3u);
+	for (float& v : source)
+	{
+		v = unit(rng);
+	}
+	unsigned int nFailed = 0u;
+	for (const size_t stride : { (size_t)12u, (size_t)32u })
+	{
+		const size_t nFloats = stride / sizeof(float);
+		std::vector<float> reference;
+		std::vector<float> vertices(VertexCount * nFloats);
+		std::cout << (stride == 12u ? "packed: " : "strided:");
+		ForEachLevel([&](Simd::Level level)
+		{
+			const float best = BestOf(nRuns, [&]()
+			{
+				for (size_t i = 0u; i < VertexCount; i++)
+				{
+					std::copy_n(&source[i * 3u], 3, &vertices[i * nFloats]);
+				}
+			}, [&]()
+			{
+				Simd::TransformPositions(vertices.data(), stride, VertexCount, m);
+			});
+			if (reference.empty())
+			{
+				reference = vertices;
+			}
+			float maxError = 0.0f;
+			for (size_t i = 0u; i < vertices.size(); i++)
+			{
+				maxError = std::max(maxError, std::abs(vertices[i] - reference[i]) / std::max(1.0f, std::abs(reference[i])));
+			}
+			nFailed += maxError > 1e-6f ? 1u : 0u;
+			std::cout << (level == Simd::Level::None ? " " : ", ") << Simd::GetLevelName(level) << " " << (double)VertexCount / best / 1e6
+				<< (maxError > 1e-6f ? " (DIFFERENT POSITIONS)" : "");
+		});
+		std::cout << " Mvertices/s" << std::endl;
+	}
+	return nFailed == 0u ? 0 : -1;
+}
+#endif
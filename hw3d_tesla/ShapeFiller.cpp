@@ -0,0 +1,220 @@
+#include "ShapeFiller.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// First pixel whose center is at or right of (below) v, kept inside [lo, hi]
+	int FirstPixel(double v, int lo, int hi) noexcept
+	{
+		return (int)std::clamp(std::ceil(v - 0.5), (double)lo, (double)hi);
+	}
+}
+
+void ShapeFiller::FillRect(Surface& target, int left, int top, int right, int bottom, Color color, const Surface::Rect& clip) noexcept
+{
+	const Surface::Rect area = ClipToTarget(target, clip);
+	const int x0 = std::max(left, (int)area.left);
+	const int y0 = std::max(top, (int)area.top);
+	const int x1 = std::min(right, (int)area.right);
+	const int y1 = std::min(bottom, (int)area.bottom);
+	stats.shapes++;
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return;
+	}
+	// One span per row, no need to store them
+	for (int y = y0; y < y1; y++)
+	{
+		Simd::Fill32Cached(reinterpret_cast<unsigned int*>(target.GetRowPtr((unsigned int)y) + x0), (size_t)(x1 - x0), color.dword);
+	}
+	stats.spans += (unsigned long long)(y1 - y0);
+	stats.pixels += (unsigned long long)(x1 - x0) * (unsigned long long)(y1 - y0);
+	target.MarkDirty({ (unsigned int)x0, (unsigned int)y0, (unsigned int)x1, (unsigned int)y1 });
+}
+
+void ShapeFiller::FillCircle(Surface& target, float centerX, float centerY, float radius, Color color, const Surface::Rect& clip)
+{
+	FillEllipse(target, centerX, centerY, radius, radius, color, clip);
+}
+
+void ShapeFiller::FillEllipse(Surface& target, float centerX, float centerY, float radiusX, float radiusY, Color color, const Surface::Rect& clip)
+{
+	MakeEllipseSpans(centerX, centerY, radiusX, radiusY, ClipToTarget(target, clip));
+	FillSpans(target, color);
+}
+
+void ShapeFiller::FillPolygon(Surface& target, const Point* pPoints, size_t count, Color color, FillRule rule, const Surface::Rect& clip)
+{
+	MakePolygonSpans(pPoints, count, rule, ClipToTarget(target, clip));
+	FillSpans(target, color);
+}
+
+const std::vector<ShapeFiller::Span>& ShapeFiller::MakeEllipseSpans(float centerX, float centerY, float radiusX, float radiusY, const Surface::Rect& clip)
+{
+	spans.clear();
+	if (!(radiusX > 0.0f && radiusY > 0.0f))
+	{
+		return spans;
+	}
+	const int left = (int)std::min(clip.left, 0x7FFFFFFFu);
+	const int top = (int)std::min(clip.top, 0x7FFFFFFFu);
+	const int right = (int)std::min(clip.right, 0x7FFFFFFFu);
+	const int bottom = (int)std::min(clip.bottom, 0x7FFFFFFFu);
+	// Each row is the chord through the center of its pixels
+	const int y0 = FirstPixel((double)centerY - radiusY, top, bottom);
+	const int y1 = FirstPixel((double)centerY + radiusY, top, bottom);
+	for (int y = y0; y < y1; y++)
+	{
+		const double dy = ((double)y + 0.5 - centerY) / radiusY;
+		const double halfWidth = radiusX * std::sqrt(std::max(1.0 - dy * dy, 0.0));
+		const int x0 = FirstPixel(centerX - halfWidth, left, right);
+		const int x1 = FirstPixel(centerX + halfWidth, left, right);
+		if (x0 < x1)
+		{
+			spans.push_back({ y, x0, x1 });
+		}
+	}
+	return spans;
+}
+
+const std::vector<ShapeFiller::Span>& ShapeFiller::MakePolygonSpans(const Point* pPoints, size_t count, FillRule rule, const Surface::Rect& clip)
+{
+	spans.clear();
+	const int left = (int)std::min(clip.left, 0x7FFFFFFFu);
+	const int top = (int)std::min(clip.top, 0x7FFFFFFFu);
+	const int right = (int)std::min(clip.right, 0x7FFFFFFFu);
+	const int bottom = (int)std::min(clip.bottom, 0x7FFFFFFFu);
+
+	// Edge table: the edges crossing the center of at least one row inside the clip,
+	// starting at the first of those rows (horizontal edges never do)
+	edges.clear();
+	for (size_t i = 0u; i < count; i++)
+	{
+		Point a = pPoints[i];
+		Point b = pPoints[i + 1u < count ? i + 1u : 0u];
+		int winding = 1;
+		if (a.y > b.y)
+		{
+			std::swap(a, b);
+			winding = -1;
+		}
+		const int yBegin = FirstPixel(a.y, top, bottom);
+		const int yEnd = FirstPixel(b.y, top, bottom);
+		if (yBegin >= yEnd)
+		{
+			continue;
+		}
+		const double dxdy = ((double)b.x - a.x) / ((double)b.y - a.y);
+		edges.push_back({ a.x + ((double)yBegin + 0.5 - a.y) * dxdy, dxdy, yBegin, yEnd, winding });
+	}
+	if (edges.empty())
+	{
+		return spans;
+	}
+	std::sort(edges.begin(), edges.end(), [](const Edge& lhs, const Edge& rhs)
+	{
+		return lhs.yBegin < rhs.yBegin;
+	});
+
+	active.clear();
+	size_t next = 0u;
+	for (int y = edges.front().yBegin; !active.empty() || next < edges.size(); y++)
+	{
+		// Drop the edges that ended, skip the rows with nothing on them and pick up the new ones
+		active.erase(std::remove_if(active.begin(), active.end(), [y](const Edge& e)
+		{
+			return e.yEnd <= y;
+		}), active.end());
+		if (active.empty())
+		{
+			if (next == edges.size())
+			{
+				break;
+			}
+			y = std::max(y, edges[next].yBegin);
+		}
+		for (; next < edges.size() && edges[next].yBegin == y; next++)
+		{
+			active.push_back(edges[next]);
+		}
+		// Insertion sort: from one row to the next the order only changes where edges cross
+		for (size_t i = 1u; i < active.size(); i++)
+		{
+			const Edge e = active[i];
+			size_t j = i;
+			for (; j > 0u && active[j - 1u].x > e.x; j--)
+			{
+				active[j] = active[j - 1u];
+			}
+			active[j] = e;
+		}
+
+		int winding = 0;
+		for (size_t i = 0u; i + 1u < active.size(); i++)
+		{
+			winding += rule == FillRule::EvenOdd ? 1 : active[i].winding;
+			const bool inside = rule == FillRule::EvenOdd ? (winding & 1) != 0 : winding != 0;
+			if (!inside)
+			{
+				continue;
+			}
+			const int x0 = FirstPixel(active[i].x, left, right);
+			const int x1 = FirstPixel(active[i + 1u].x, left, right);
+			if (x0 >= x1)
+			{
+				continue;
+			}
+			// Runs of the same row that touch become one span
+			if (!spans.empty() && spans.back().y == y && spans.back().x1 >= x0)
+			{
+				spans.back().x1 = std::max(spans.back().x1, x1);
+			}
+			else
+			{
+				spans.push_back({ y, x0, x1 });
+			}
+		}
+		for (Edge& e : active)
+		{
+			e.x += e.dxdy;
+		}
+	}
+	return spans;
+}
+
+const ShapeFiller::Statistics& ShapeFiller::GetStatistics() const noexcept
+{
+	return stats;
+}
+
+Surface::Rect ShapeFiller::ClipToTarget(const Surface& target, const Surface::Rect& clip) noexcept
+{
+	return {
+		std::min(clip.left, target.GetWidth()),
+		std::min(clip.top, target.GetHeight()),
+		std::min(clip.right, target.GetWidth()),
+		std::min(clip.bottom, target.GetHeight())
+	};
+}
+
+void ShapeFiller::FillSpans(Surface& target, Color color) noexcept
+{
+	stats.shapes++;
+	if (spans.empty())
+	{
+		return;
+	}
+	int minX = spans.front().x0;
+	int maxX = spans.front().x1;
+	for (const Span& s : spans)
+	{
+		Simd::Fill32Cached(reinterpret_cast<unsigned int*>(target.GetRowPtr((unsigned int)s.y) + s.x0), (size_t)(s.x1 - s.x0), color.dword);
+		minX = std::min(minX, s.x0);
+		maxX = std::max(maxX, s.x1);
+		stats.pixels += (unsigned long long)(s.x1 - s.x0);
+	}
+	stats.spans += spans.size();
+	target.MarkDirty({ (unsigned int)minX, (unsigned int)spans.front().y, (unsigned int)maxX, (unsigned int)spans.back().y + 1u });
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "Surface.h"
+#include <vector>
+
+// Filled rectangles, circles, ellipses and polygons (convex or not). Every shape is turned
+// into horizontal spans, which are filled a whole run at a time (Simd::Fill32Cached) with
+// one MarkDirty per shape. Polygons go through an active edge table: the edges are sorted
+// by their first row, and each row only looks at the edges crossing it.
+// A pixel belongs to a shape when its center (x + 0.5, y + 0.5) is inside, so shapes sharing
+// an edge neither overlap nor leave a gap between them.
+class ShapeFiller
+{
+public:
+	// Which parts of a self-intersecting polygon are inside
+	enum class FillRule
+	{
+		EvenOdd,  // crossed by an odd number of edges
+		NonZero   // wound around a non zero number of times
+	};
+	struct Point
+	{
+		float x;
+		float y;
+	};
+	// Pixels [x0, x1) of row y
+	struct Span
+	{
+		int y;
+		int x0;
+		int x1;
+	};
+	struct Statistics
+	{
+		unsigned long long shapes;
+		unsigned long long spans;
+		unsigned long long pixels;
+	};
+public:
+	ShapeFiller() = default;
+	ShapeFiller(const ShapeFiller&) = delete;
+	ShapeFiller& operator = (const ShapeFiller&) = delete;
+	// Pixels [left, right) x [top, bottom)
+	void FillRect(Surface& target, int left, int top, int right, int bottom, Color color, const Surface::Rect& clip = Surface::NoClip) noexcept;
+	void FillCircle(Surface& target, float centerX, float centerY, float radius, Color color, const Surface::Rect& clip = Surface::NoClip);
+	void FillEllipse(Surface& target, float centerX, float centerY, float radiusX, float radiusY, Color color, const Surface::Rect& clip = Surface::NoClip);
+	// The last point connects back to the first one
+	void FillPolygon(Surface& target, const Point* pPoints, size_t count, Color color, FillRule rule = FillRule::NonZero, const Surface::Rect& clip = Surface::NoClip);
+	// Any container of anything with an x and a y (e.g. std::vector<Tesla::Vec2>)
+	template<typename Points>
+	void FillPolygon(Surface& target, const Points& points, Color color, FillRule rule = FillRule::NonZero, const Surface::Rect& clip = Surface::NoClip)
+	{
+		vertices.clear();
+		for (const auto& p : points)
+		{
+			vertices.push_back({ (float)p.x, (float)p.y });
+		}
+		FillPolygon(target, vertices.data(), vertices.size(), color, rule, clip);
+	}
+	// The spans of a shape without drawing them, in row order and clipped to clip (which
+	// must be finite). They stay valid until the next call
+	const std::vector<Span>& MakeEllipseSpans(float centerX, float centerY, float radiusX, float radiusY, const Surface::Rect& clip);
+	const std::vector<Span>& MakePolygonSpans(const Point* pPoints, size_t count, FillRule rule, const Surface::Rect& clip);
+	const Statistics& GetStatistics() const noexcept;
+private:
+	struct Edge
+	{
+		// Where the edge crosses the center of the current row, and how much that moves per row
+		double x;
+		double dxdy;
+		// Rows [yBegin, yEnd) whose center it crosses
+		int yBegin;
+		int yEnd;
+		// +1 going down, -1 going up
+		int winding;
+	};
+private:
+	static Surface::Rect ClipToTarget(const Surface& target, const Surface::Rect& clip) noexcept;
+	void FillSpans(Surface& target, Color color) noexcept;
+private:
+	std::vector<Point> vertices;
+	// Edge table sorted by first row, and the edges crossing the current row sorted by x
+	std::vector<Edge> edges;
+	std::vector<Edge> active;
+	std::vector<Span> spans;
+	Statistics stats = {};
+};
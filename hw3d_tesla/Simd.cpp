@@ -0,0 +1,237 @@
+#include "Simd.h"
+#include <atomic>
+#include <cstdint>
+#ifdef _WIN32
+#define FULL_WINTARD
+#include "TeslaWin.h"
+#include <intrin.h>
+#include <vector>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+	Simd::Level DetectLevel() noexcept
+	{
+#if defined(TESLA_SIMD_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		const int nIds = info[0];
+		__cpuid(info, 1);
+		const bool sse2    = (info[3] & (1 << 26)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx     = (info[2] & (1 << 28)) != 0;
+		bool avx2 = false;
+		// AVX2 needs the OS to save the ymm registers too
+		if (nIds >= 7 && osxsave && avx && (_xgetbv(0) & 0x6u) == 0x6u)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+		if (avx2)
+		{
+			return Simd::Level::AVX2;
+		}
+		return sse2 ? Simd::Level::SSE2 : Simd::Level::None;
+#elif defined(TESLA_SIMD_X86)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+		{
+			return Simd::Level::AVX2;
+		}
+		return __builtin_cpu_supports("sse2") ? Simd::Level::SSE2 : Simd::Level::None;
+#else
+		return Simd::Level::None;
+#endif
+	}
+
+	size_t DetectLastLevelCacheSize() noexcept
+	{
+		size_t size = 0u;
+#ifdef _WIN32
+		DWORD bufferSize = 0u;
+		GetLogicalProcessorInformation(nullptr, &bufferSize);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(bufferSize / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (!infos.empty() && GetLogicalProcessorInformation(infos.data(), &bufferSize) != FALSE)
+		{
+			unsigned int level = 0u;
+			for (const auto& info : infos)
+			{
+				if (info.Relationship == RelationCache && info.Cache.Level >= level)
+				{
+					level = info.Cache.Level;
+					size = info.Cache.Size;
+				}
+			}
+		}
+#else
+		long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+		long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		size = l3 > 0 ? (size_t)l3 : (l2 > 0 ? (size_t)l2 : 0u);
+#endif
+		// Sensible default when the OS doesn't tell us
+		return size != 0u ? size : (size_t)8u * 1024u * 1024u;
+	}
+
+	std::atomic<Simd::Level>& CurrentLevel() noexcept
+	{
+		static std::atomic<Simd::Level> level(Simd::GetSupportedLevel());
+		return level;
+	}
+
+	void Fill32Scalar(unsigned int* pDst, size_t count, unsigned int value) noexcept
+	{
+		unsigned int* pEnd = pDst + count;
+		for (unsigned int* p = pDst; p < pEnd; p++)
+		{
+			*p = value;
+		}
+	}
+
+#ifdef TESLA_SIMD_X86
+	// Write the dwords one by one until pDst is aligned to 'alignment' bytes
+	unsigned int* FillHead(unsigned int* pDst, size_t& count, unsigned int value, uintptr_t alignment) noexcept
+	{
+		while (count > 0u && ((uintptr_t)pDst & (alignment - 1u)) != 0u)
+		{
+			*pDst++ = value;
+			count--;
+		}
+		return pDst;
+	}
+
+	void Fill32SSE2(unsigned int* pDst, size_t count, unsigned int value, bool streaming) noexcept
+	{
+		pDst = FillHead(pDst, count, value, 16u);
+		const __m128i v = _mm_set1_epi32((int)value);
+		__m128i* p = reinterpret_cast<__m128i*>(pDst);
+		__m128i* pEnd = p + (count / 16u) * 4u;
+		if (streaming)
+		{
+			for (; p < pEnd; p += 4)
+			{
+				_mm_stream_si128(p + 0, v);
+				_mm_stream_si128(p + 1, v);
+				_mm_stream_si128(p + 2, v);
+				_mm_stream_si128(p + 3, v);
+			}
+			_mm_sfence();
+		}
+		else
+		{
+			for (; p < pEnd; p += 4)
+			{
+				_mm_store_si128(p + 0, v);
+				_mm_store_si128(p + 1, v);
+				_mm_store_si128(p + 2, v);
+				_mm_store_si128(p + 3, v);
+			}
+		}
+		Fill32Scalar(reinterpret_cast<unsigned int*>(pEnd), count % 16u, value);
+	}
+
+	TESLA_TARGET_AVX2
+	void Fill32AVX2(unsigned int* pDst, size_t count, unsigned int value, bool streaming) noexcept
+	{
+		pDst = FillHead(pDst, count, value, 32u);
+		const __m256i v = _mm256_set1_epi32((int)value);
+		__m256i* p = reinterpret_cast<__m256i*>(pDst);
+		__m256i* pEnd = p + (count / 32u) * 4u;
+		if (streaming)
+		{
+			for (; p < pEnd; p += 4)
+			{
+				_mm256_stream_si256(p + 0, v);
+				_mm256_stream_si256(p + 1, v);
+				_mm256_stream_si256(p + 2, v);
+				_mm256_stream_si256(p + 3, v);
+			}
+			_mm_sfence();
+		}
+		else
+		{
+			for (; p < pEnd; p += 4)
+			{
+				_mm256_store_si256(p + 0, v);
+				_mm256_store_si256(p + 1, v);
+				_mm256_store_si256(p + 2, v);
+				_mm256_store_si256(p + 3, v);
+			}
+		}
+		Fill32Scalar(reinterpret_cast<unsigned int*>(pEnd), count % 32u, value);
+	}
+#endif
+
+	void Fill32Dispatch(unsigned int* pDst, size_t count, unsigned int value, bool streaming) noexcept
+	{
+		switch (Simd::GetLevel())
+		{
+#ifdef TESLA_SIMD_X86
+		case Simd::Level::AVX2:
+			Fill32AVX2(pDst, count, value, streaming);
+			break;
+		case Simd::Level::SSE2:
+			Fill32SSE2(pDst, count, value, streaming);
+			break;
+#endif
+		default:
+			Fill32Scalar(pDst, count, value);
+			break;
+		}
+	}
+}
+
+Simd::Level Simd::GetSupportedLevel() noexcept
+{
+	static const Level supported = DetectLevel();
+	return supported;
+}
+
+Simd::Level Simd::GetLevel() noexcept
+{
+	return CurrentLevel().load(std::memory_order_relaxed);
+}
+
+void Simd::SetLevel(Level level) noexcept
+{
+	if (level > GetSupportedLevel())
+	{
+		level = GetSupportedLevel();
+	}
+	CurrentLevel().store(level, std::memory_order_relaxed);
+}
+
+const char* Simd::GetLevelName(Level level) noexcept
+{
+	switch (level)
+	{
+	case Level::AVX2:
+		return "AVX2";
+	case Level::SSE2:
+		return "SSE2";
+	default:
+		return "None";
+	}
+}
+
+size_t Simd::GetLastLevelCacheSize() noexcept
+{
+	static const size_t size = DetectLastLevelCacheSize();
+	return size;
+}
+
+void Simd::Fill32(unsigned int* pDst, size_t count, unsigned int value) noexcept
+{
+	Fill32Dispatch(pDst, count, value, count * sizeof(unsigned int) > GetLastLevelCacheSize());
+}
+
+void Simd::Fill32Cached(unsigned int* pDst, size_t count, unsigned int value) noexcept
+{
+	Fill32Dispatch(pDst, count, value, false);
+}
+
+void Simd::Fill32Streaming(unsigned int* pDst, size_t count, unsigned int value) noexcept
+{
+	Fill32Dispatch(pDst, count, value, true);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+
+// x86 SIMD kernels are compiled only where the intrinsics exist
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TESLA_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// MSVC lets every function use every instruction set, GCC and Clang need to be told per function
+#if defined(TESLA_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TESLA_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TESLA_TARGET_AVX2
+#endif
+
+// Runtime CPU dispatch for the Surface and vertex kernels
+namespace Simd
+{
+	enum class Level
+	{
+		None,
+		SSE2,
+		AVX2
+	};
+	// Best instruction set the CPU supports (detected once)
+	Level GetSupportedLevel() noexcept;
+	// Instruction set the kernels are currently using
+	Level GetLevel() noexcept;
+	// Force the kernels down to a lower level (useful to compare them), clamped to the supported one
+	void SetLevel(Level level) noexcept;
+	const char* GetLevelName(Level level) noexcept;
+	// Size of the last level cache in bytes (detected once)
+	size_t GetLastLevelCacheSize() noexcept;
+
+	// Write 'value' to 'count' consecutive dwords. Buffers bigger than the last level
+	// cache are written with non-temporal stores, so they don't evict everything else
+	void Fill32(unsigned int* pDst, size_t count, unsigned int value) noexcept;
+	// Same as Fill32, but always with regular (cached) stores
+	void Fill32Cached(unsigned int* pDst, size_t count, unsigned int value) noexcept;
+	// Same as Fill32, but always with non-temporal stores
+	void Fill32Streaming(unsigned int* pDst, size_t count, unsigned int value) noexcept;
+
+	// Row kernels of the Surface blits (pDst and pSrc must not overlap, no alignment needed).
+	// Copy the source pixels whose RGB differs from the key (alpha is not compared)
+	void BlitColorKey32(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int key) noexcept;
+	// Straight alpha: dst = src * a + dst * (1 - a), the alpha channel becomes a + dstA * (1 - a)
+	void BlendAlpha32(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept;
+	// Premultiplied alpha: dst = src + dst * (1 - a) (saturated)
+	void BlendPremultiplied32(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept;
+	// Multiply every channel of src by tint (alpha included), then blend it as straight alpha
+	void BlendTinted32(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int tint) noexcept;
+
+	// Transform 'count' positions in place: x, y, z floats, one every 'stride' bytes (>= 12, so the
+	// position can sit inside a bigger vertex). Row vectors with w = 1 times the rows of m, w is
+	// dropped: the same as XMVector3Transform with an XMFLOAT4X4 of the matrix
+	void TransformPositions(float* pPositions, size_t stride, size_t count, const float(&m)[4][4]) noexcept;
+}
@@ -0,0 +1,424 @@
+#include "Simd.h"
+
+// Row kernels of the Surface blits. All the versions compute exactly the same values:
+// x / 255 is always rounded with Div255, so the scalar code is also the reference.
+namespace
+{
+	constexpr unsigned int Div255(unsigned int t) noexcept
+	{
+		t += 128u;
+		return (t + (t >> 8)) >> 8;
+	}
+
+	unsigned int BlendPixel(unsigned int d, unsigned int s) noexcept
+	{
+		// The alpha channel blends a source value of 255 (so it becomes a + dstA * (1 - a))
+		const unsigned int a = s >> 24;
+		s |= 0xFF000000u;
+		unsigned int result = 0u;
+		for (unsigned int shift = 0u; shift < 32u; shift += 8u)
+		{
+			const unsigned int sc = (s >> shift) & 0xFFu;
+			const unsigned int dc = (d >> shift) & 0xFFu;
+			result |= Div255(sc * a + dc * (255u - a)) << shift;
+		}
+		return result;
+	}
+
+	unsigned int BlendPremultipliedPixel(unsigned int d, unsigned int s) noexcept
+	{
+		const unsigned int a = s >> 24;
+		unsigned int result = 0u;
+		for (unsigned int shift = 0u; shift < 32u; shift += 8u)
+		{
+			const unsigned int sc = (s >> shift) & 0xFFu;
+			const unsigned int dc = (d >> shift) & 0xFFu;
+			const unsigned int c = sc + Div255(dc * (255u - a));
+			result |= (c > 255u ? 255u : c) << shift;
+		}
+		return result;
+	}
+
+	unsigned int TintPixel(unsigned int s, unsigned int tint) noexcept
+	{
+		unsigned int result = 0u;
+		for (unsigned int shift = 0u; shift < 32u; shift += 8u)
+		{
+			result |= Div255(((s >> shift) & 0xFFu) * ((tint >> shift) & 0xFFu)) << shift;
+		}
+		return result;
+	}
+
+	void BlitColorKeyScalar(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int key) noexcept
+	{
+		for (size_t i = 0u; i < count; i++)
+		{
+			if (((pSrc[i] ^ key) & 0x00FFFFFFu) != 0u)
+			{
+				pDst[i] = pSrc[i];
+			}
+		}
+	}
+
+	void BlendAlphaScalar(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+	{
+		for (size_t i = 0u; i < count; i++)
+		{
+			const unsigned int a = pSrc[i] >> 24;
+			if (a == 255u)
+			{
+				pDst[i] = pSrc[i];
+			}
+			else if (a != 0u)
+			{
+				pDst[i] = BlendPixel(pDst[i], pSrc[i]);
+			}
+		}
+	}
+
+	void BlendPremultipliedScalar(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+	{
+		for (size_t i = 0u; i < count; i++)
+		{
+			if ((pSrc[i] >> 24) == 255u)
+			{
+				pDst[i] = pSrc[i];
+			}
+			else if (pSrc[i] != 0u)
+			{
+				pDst[i] = BlendPremultipliedPixel(pDst[i], pSrc[i]);
+			}
+		}
+	}
+
+	void BlendTintedScalar(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int tint) noexcept
+	{
+		for (size_t i = 0u; i < count; i++)
+		{
+			const unsigned int s = TintPixel(pSrc[i], tint);
+			if ((s >> 24) != 0u)
+			{
+				pDst[i] = BlendPixel(pDst[i], s);
+			}
+		}
+	}
+
+#ifdef TESLA_SIMD_X86
+	/************************************* SSE2 ****************************************/
+	// Rounded x / 255 of 16 bit lanes holding at most 255 * 255
+	__m128i Div255SSE2(__m128i t) noexcept
+	{
+		t = _mm_add_epi16(t, _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	}
+
+	// Alpha of each pixel copied to its four 16 bit lanes
+	__m128i BroadcastAlphaSSE2(__m128i pixels16) noexcept
+	{
+		return _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	// Two pixels widened to 16 bits: (s * a + d * (255 - a)) / 255, the alpha lanes of s are 255
+	__m128i Blend16SSE2(__m128i s16, __m128i d16, __m128i a16) noexcept
+	{
+		const __m128i t = _mm_add_epi16(_mm_mullo_epi16(s16, a16), _mm_mullo_epi16(d16, _mm_sub_epi16(_mm_set1_epi16(255), a16)));
+		return Div255SSE2(t);
+	}
+
+	__m128i BlendSSE2(__m128i s, __m128i d) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i sOpaque = _mm_or_si128(s, _mm_set1_epi32((int)0xFF000000u));
+		const __m128i lo = Blend16SSE2(_mm_unpacklo_epi8(sOpaque, zero), _mm_unpacklo_epi8(d, zero), BroadcastAlphaSSE2(_mm_unpacklo_epi8(s, zero)));
+		const __m128i hi = Blend16SSE2(_mm_unpackhi_epi8(sOpaque, zero), _mm_unpackhi_epi8(d, zero), BroadcastAlphaSSE2(_mm_unpackhi_epi8(s, zero)));
+		return _mm_packus_epi16(lo, hi);
+	}
+
+	__m128i TintSSE2(__m128i s, __m128i tint16) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i lo = Div255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), tint16));
+		const __m128i hi = Div255SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), tint16));
+		return _mm_packus_epi16(lo, hi);
+	}
+
+	void BlitColorKeySSE2(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int key) noexcept
+	{
+		const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+		const __m128i keyRgb = _mm_set1_epi32((int)(key & 0x00FFFFFFu));
+		size_t i = 0u;
+		for (; i + 4u <= count; i += 4u)
+		{
+			const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst + i));
+			const __m128i keyed = _mm_cmpeq_epi32(_mm_and_si128(s, rgbMask), keyRgb);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_or_si128(_mm_and_si128(keyed, d), _mm_andnot_si128(keyed, s)));
+		}
+		BlitColorKeyScalar(pDst + i, pSrc + i, count - i, key);
+	}
+
+	void BlendAlphaSSE2(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i opaque = _mm_set1_epi32(255);
+		size_t i = 0u;
+		for (; i + 4u <= count; i += 4u)
+		{
+			const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+			const __m128i a = _mm_srli_epi32(s, 24);
+			// Sprites are mostly fully transparent or fully opaque: skip the math then
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xFFFF)
+			{
+				continue;
+			}
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, opaque)) == 0xFFFF)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), s);
+				continue;
+			}
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), BlendSSE2(s, d));
+		}
+		BlendAlphaScalar(pDst + i, pSrc + i, count - i);
+	}
+
+	void BlendPremultipliedSSE2(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i opaque = _mm_set1_epi32(255);
+		size_t i = 0u;
+		for (; i + 4u <= count; i += 4u)
+		{
+			const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xFFFF)
+			{
+				continue;
+			}
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(s, 24), opaque)) == 0xFFFF)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), s);
+				continue;
+			}
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst + i));
+			const __m128i inv255 = _mm_set1_epi16(255);
+			const __m128i lo = Div255SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(inv255, BroadcastAlphaSSE2(_mm_unpacklo_epi8(s, zero)))));
+			const __m128i hi = Div255SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(inv255, BroadcastAlphaSSE2(_mm_unpackhi_epi8(s, zero)))));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+		}
+		BlendPremultipliedScalar(pDst + i, pSrc + i, count - i);
+	}
+
+	void BlendTintedSSE2(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int tint) noexcept
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i tint16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)tint), zero);
+		size_t i = 0u;
+		for (; i + 4u <= count; i += 4u)
+		{
+			const __m128i s = TintSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i)), tint16);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(s, 24), zero)) == 0xFFFF)
+			{
+				continue;
+			}
+			const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), BlendSSE2(s, d));
+		}
+		BlendTintedScalar(pDst + i, pSrc + i, count - i, tint);
+	}
+
+	/************************************* AVX2 ****************************************/
+	// Same as the SSE2 versions, 8 pixels at a time (unpack and pack work per 128 bit lane,
+	// so the pixels come back in their order)
+	TESLA_TARGET_AVX2
+	__m256i Div255AVX2(__m256i t) noexcept
+	{
+		t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+		return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+	}
+
+	TESLA_TARGET_AVX2
+	__m256i BroadcastAlphaAVX2(__m256i pixels16) noexcept
+	{
+		return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	TESLA_TARGET_AVX2
+	__m256i Blend16AVX2(__m256i s16, __m256i d16, __m256i a16) noexcept
+	{
+		const __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(s16, a16), _mm256_mullo_epi16(d16, _mm256_sub_epi16(_mm256_set1_epi16(255), a16)));
+		return Div255AVX2(t);
+	}
+
+	TESLA_TARGET_AVX2
+	__m256i BlendAVX2(__m256i s, __m256i d) noexcept
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i sOpaque = _mm256_or_si256(s, _mm256_set1_epi32((int)0xFF000000u));
+		const __m256i lo = Blend16AVX2(_mm256_unpacklo_epi8(sOpaque, zero), _mm256_unpacklo_epi8(d, zero), BroadcastAlphaAVX2(_mm256_unpacklo_epi8(s, zero)));
+		const __m256i hi = Blend16AVX2(_mm256_unpackhi_epi8(sOpaque, zero), _mm256_unpackhi_epi8(d, zero), BroadcastAlphaAVX2(_mm256_unpackhi_epi8(s, zero)));
+		return _mm256_packus_epi16(lo, hi);
+	}
+
+	TESLA_TARGET_AVX2
+	void BlitColorKeyAVX2(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int key) noexcept
+	{
+		const __m256i rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+		const __m256i keyRgb = _mm256_set1_epi32((int)(key & 0x00FFFFFFu));
+		size_t i = 0u;
+		for (; i + 8u <= count; i += 8u)
+		{
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDst + i));
+			const __m256i keyed = _mm256_cmpeq_epi32(_mm256_and_si256(s, rgbMask), keyRgb);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), _mm256_blendv_epi8(s, d, keyed));
+		}
+		BlitColorKeyScalar(pDst + i, pSrc + i, count - i, key);
+	}
+
+	TESLA_TARGET_AVX2
+	void BlendAlphaAVX2(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i opaque = _mm256_set1_epi32(255);
+		size_t i = 0u;
+		for (; i + 8u <= count; i += 8u)
+		{
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+			const __m256i a = _mm256_srli_epi32(s, 24);
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, zero)) == -1)
+			{
+				continue;
+			}
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, opaque)) == -1)
+			{
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), s);
+				continue;
+			}
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDst + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), BlendAVX2(s, d));
+		}
+		BlendAlphaScalar(pDst + i, pSrc + i, count - i);
+	}
+
+	TESLA_TARGET_AVX2
+	void BlendPremultipliedAVX2(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i opaque = _mm256_set1_epi32(255);
+		const __m256i inv255 = _mm256_set1_epi16(255);
+		size_t i = 0u;
+		for (; i + 8u <= count; i += 8u)
+		{
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1)
+			{
+				continue;
+			}
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_srli_epi32(s, 24), opaque)) == -1)
+			{
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), s);
+				continue;
+			}
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDst + i));
+			const __m256i lo = Div255AVX2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_sub_epi16(inv255, BroadcastAlphaAVX2(_mm256_unpacklo_epi8(s, zero)))));
+			const __m256i hi = Div255AVX2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_sub_epi16(inv255, BroadcastAlphaAVX2(_mm256_unpackhi_epi8(s, zero)))));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+		}
+		BlendPremultipliedScalar(pDst + i, pSrc + i, count - i);
+	}
+
+	TESLA_TARGET_AVX2
+	void BlendTintedAVX2(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int tint) noexcept
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i tint16 = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)tint), zero);
+		size_t i = 0u;
+		for (; i + 8u <= count; i += 8u)
+		{
+			const __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+			const __m256i lo = Div255AVX2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(raw, zero), tint16));
+			const __m256i hi = Div255AVX2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(raw, zero), tint16));
+			const __m256i s = _mm256_packus_epi16(lo, hi);
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_srli_epi32(s, 24), zero)) == -1)
+			{
+				continue;
+			}
+			const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDst + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), BlendAVX2(s, d));
+		}
+		BlendTintedScalar(pDst + i, pSrc + i, count - i, tint);
+	}
+#endif
+}
+
+void Simd::BlitColorKey32(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int key) noexcept
+{
+	switch (GetLevel())
+	{
+#ifdef TESLA_SIMD_X86
+	case Level::AVX2:
+		BlitColorKeyAVX2(pDst, pSrc, count, key);
+		break;
+	case Level::SSE2:
+		BlitColorKeySSE2(pDst, pSrc, count, key);
+		break;
+#endif
+	default:
+		BlitColorKeyScalar(pDst, pSrc, count, key);
+		break;
+	}
+}
+
+void Simd::BlendAlpha32(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+{
+	switch (GetLevel())
+	{
+#ifdef TESLA_SIMD_X86
+	case Level::AVX2:
+		BlendAlphaAVX2(pDst, pSrc, count);
+		break;
+	case Level::SSE2:
+		BlendAlphaSSE2(pDst, pSrc, count);
+		break;
+#endif
+	default:
+		BlendAlphaScalar(pDst, pSrc, count);
+		break;
+	}
+}
+
+void Simd::BlendPremultiplied32(unsigned int* pDst, const unsigned int* pSrc, size_t count) noexcept
+{
+	switch (GetLevel())
+	{
+#ifdef TESLA_SIMD_X86
+	case Level::AVX2:
+		BlendPremultipliedAVX2(pDst, pSrc, count);
+		break;
+	case Level::SSE2:
+		BlendPremultipliedSSE2(pDst, pSrc, count);
+		break;
+#endif
+	default:
+		BlendPremultipliedScalar(pDst, pSrc, count);
+		break;
+	}
+}
+
+void Simd::BlendTinted32(unsigned int* pDst, const unsigned int* pSrc, size_t count, unsigned int tint) noexcept
+{
+	switch (GetLevel())
+	{
+#ifdef TESLA_SIMD_X86
+	case Level::AVX2:
+		BlendTintedAVX2(pDst, pSrc, count, tint);
+		break;
+	case Level::SSE2:
+		BlendTintedSSE2(pDst, pSrc, count, tint);
+		break;
+#endif
+	default:
+		BlendTintedScalar(pDst, pSrc, count, tint);
+		break;
+	}
+}
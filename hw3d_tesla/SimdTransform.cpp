@@ -0,0 +1,175 @@
+#include "Simd.h"
+
+// Vertex position kernels. The positions are interleaved with the rest of the vertex (AoS),
+// the SIMD versions load a few of them, shuffle them to x, y and z registers (SoA), transform
+// them all at once and shuffle them back. Every version does the same multiplies and adds in
+// the same order as XMVector3Transform (((z * r2 + r3) + y * r1) + x * r0), so they all match it
+// to the bit.
+namespace
+{
+	float* PositionAt(float* pPositions, size_t stride, size_t i) noexcept
+	{
+		return reinterpret_cast<float*>(reinterpret_cast<char*>(pPositions) + i * stride);
+	}
+
+	void TransformPositionsScalar(float* pPositions, size_t stride, size_t count, const float(&m)[4][4]) noexcept
+	{
+		for (size_t i = 0u; i < count; i++)
+		{
+			float* p = PositionAt(pPositions, stride, i);
+			const float x = p[0];
+			const float y = p[1];
+			const float z = p[2];
+			p[0] = ((z * m[2][0] + m[3][0]) + y * m[1][0]) + x * m[0][0];
+			p[1] = ((z * m[2][1] + m[3][1]) + y * m[1][1]) + x * m[0][1];
+			p[2] = ((z * m[2][2] + m[3][2]) + y * m[1][2]) + x * m[0][2];
+		}
+	}
+
+#ifdef TESLA_SIMD_X86
+	// r[row][column] holds m[row][column] in every lane
+	void TransformSoASSE2(const __m128(&r)[4][3], __m128& x, __m128& y, __m128& z) noexcept
+	{
+		const __m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(z, r[2][0]), r[3][0]), _mm_mul_ps(y, r[1][0])), _mm_mul_ps(x, r[0][0]));
+		const __m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(z, r[2][1]), r[3][1]), _mm_mul_ps(y, r[1][1])), _mm_mul_ps(x, r[0][1]));
+		const __m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(z, r[2][2]), r[3][2]), _mm_mul_ps(y, r[1][2])), _mm_mul_ps(x, r[0][2]));
+		x = rx;
+		y = ry;
+		z = rz;
+	}
+
+	void TransformPositionsSSE2(float* pPositions, size_t stride, size_t count, const float(&m)[4][4]) noexcept
+	{
+		__m128 r[4][3];
+		for (int row = 0; row < 4; row++)
+		{
+			for (int col = 0; col < 3; col++)
+			{
+				r[row][col] = _mm_set1_ps(m[row][col]);
+			}
+		}
+		size_t i = 0u;
+		if (stride == 3u * sizeof(float))
+		{
+			// Tightly packed: 4 positions are 3 whole vectors
+			for (; i + 4u <= count; i += 4u)
+			{
+				float* p = pPositions + i * 3u;
+				// v0 = x0 y0 z0 x1, v1 = y1 z1 x2 y2, v2 = z2 x3 y3 z3
+				const __m128 v0 = _mm_loadu_ps(p + 0);
+				const __m128 v1 = _mm_loadu_ps(p + 4);
+				const __m128 v2 = _mm_loadu_ps(p + 8);
+				__m128 x = _mm_shuffle_ps(v0, _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+				__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+				__m128 z = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+				TransformSoASSE2(r, x, y, z);
+				_mm_storeu_ps(p + 0, _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+			}
+		}
+		else
+		{
+			// Inside bigger vertices (stride >= 16): the vectors load and store the float after each
+			// position too, written back as it was. It's inside the buffer for every vertex but the
+			// last one, which is left to the scalar tail
+			for (; i + 4u < count; i += 4u)
+			{
+				float* p0 = PositionAt(pPositions, stride, i + 0u);
+				float* p1 = PositionAt(pPositions, stride, i + 1u);
+				float* p2 = PositionAt(pPositions, stride, i + 2u);
+				float* p3 = PositionAt(pPositions, stride, i + 3u);
+				__m128 x = _mm_loadu_ps(p0);
+				__m128 y = _mm_loadu_ps(p1);
+				__m128 z = _mm_loadu_ps(p2);
+				__m128 w = _mm_loadu_ps(p3);
+				_MM_TRANSPOSE4_PS(x, y, z, w);
+				TransformSoASSE2(r, x, y, z);
+				_MM_TRANSPOSE4_PS(x, y, z, w);
+				_mm_storeu_ps(p0, x);
+				_mm_storeu_ps(p1, y);
+				_mm_storeu_ps(p2, z);
+				_mm_storeu_ps(p3, w);
+			}
+		}
+		TransformPositionsScalar(PositionAt(pPositions, stride, i), stride, count - i, m);
+	}
+
+	// Same as the packed SSE2 version, 8 positions at a time: the shuffles stay inside 128 bit
+	// lanes, so positions i to i + 3 go in the low lanes and i + 4 to i + 7 in the high ones
+	TESLA_TARGET_AVX2
+	void TransformSoAAVX2(const __m256(&r)[4][3], __m256& x, __m256& y, __m256& z) noexcept
+	{
+		const __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(z, r[2][0]), r[3][0]), _mm256_mul_ps(y, r[1][0])), _mm256_mul_ps(x, r[0][0]));
+		const __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(z, r[2][1]), r[3][1]), _mm256_mul_ps(y, r[1][1])), _mm256_mul_ps(x, r[0][1]));
+		const __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(z, r[2][2]), r[3][2]), _mm256_mul_ps(y, r[1][2])), _mm256_mul_ps(x, r[0][2]));
+		x = rx;
+		y = ry;
+		z = rz;
+	}
+
+	TESLA_TARGET_AVX2
+	__m256 LoadLanesAVX2(const float* pLow, const float* pHigh) noexcept
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pLow)), _mm_loadu_ps(pHigh), 1);
+	}
+
+	TESLA_TARGET_AVX2
+	void StoreLanesAVX2(float* pLow, float* pHigh, __m256 v) noexcept
+	{
+		_mm_storeu_ps(pLow, _mm256_castps256_ps128(v));
+		_mm_storeu_ps(pHigh, _mm256_extractf128_ps(v, 1));
+	}
+
+	TESLA_TARGET_AVX2
+	void TransformPositionsAVX2(float* pPositions, size_t stride, size_t count, const float(&m)[4][4]) noexcept
+	{
+		__m256 r[4][3];
+		for (int row = 0; row < 4; row++)
+		{
+			for (int col = 0; col < 3; col++)
+			{
+				r[row][col] = _mm256_set1_ps(m[row][col]);
+			}
+		}
+		// Positions inside bigger vertices are bound by the loads and stores, the SSE2 version does as well
+		size_t i = 0u;
+		if (stride == 3u * sizeof(float))
+		{
+			for (; i + 8u <= count; i += 8u)
+			{
+				float* p = pPositions + i * 3u;
+				const __m256 v0 = LoadLanesAVX2(p + 0, p + 12);
+				const __m256 v1 = LoadLanesAVX2(p + 4, p + 16);
+				const __m256 v2 = LoadLanesAVX2(p + 8, p + 20);
+				__m256 x = _mm256_shuffle_ps(v0, _mm256_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+				__m256 y = _mm256_shuffle_ps(_mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+				__m256 z = _mm256_shuffle_ps(_mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+				TransformSoAAVX2(r, x, y, z);
+				StoreLanesAVX2(p + 0, p + 12, _mm256_shuffle_ps(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+				StoreLanesAVX2(p + 4, p + 16, _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+				StoreLanesAVX2(p + 8, p + 20, _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+			}
+		}
+		TransformPositionsSSE2(PositionAt(pPositions, stride, i), stride, count - i, m);
+	}
+#endif
+}
+
+void Simd::TransformPositions(float* pPositions, size_t stride, size_t count, const float(&m)[4][4]) noexcept
+{
+	switch (GetLevel())
+	{
+#ifdef TESLA_SIMD_X86
+	case Level::AVX2:
+		TransformPositionsAVX2(pPositions, stride, count, m);
+		break;
+	case Level::SSE2:
+		TransformPositionsSSE2(pPositions, stride, count, m);
+		break;
+#endif
+	default:
+		TransformPositionsScalar(pPositions, stride, count, m);
+		break;
+	}
+}
@@ -0,0 +1,145 @@
+#include "SpriteAtlas.h"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+// imgui compiles its own static copy, this one is private to the atlas as well
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imgui/imstb_rectpack.h"
+
+SpriteAtlas::SpriteAtlas(unsigned int pageWidth, unsigned int pageHeight) noexcept
+	:
+	// stbrp stores the coordinates in 16 bits
+	pageWidth(std::clamp(pageWidth, 1u, 0xFFFFu)),
+	pageHeight(std::clamp(pageHeight, 1u, 0xFFFFu))
+{
+}
+
+unsigned int SpriteAtlas::Add(const SurfaceView& image)
+{
+	if (image.GetWidth() > pageWidth || image.GetHeight() > pageHeight)
+	{
+		std::stringstream ss;
+		ss << "Adding a " << image.GetWidth() << "x" << image.GetHeight() << " image to an atlas of "
+			<< pageWidth << "x" << pageHeight << " pages: the image doesn't fit in a page.";
+		throw Exception(__LINE__, __FILE__, ss.str());
+	}
+	pending.push_back(image);
+	return (unsigned int)(sprites.size() + pending.size() - 1u);
+}
+
+unsigned int SpriteAtlas::AddFile(const std::string& filename)
+{
+	return Add(SurfaceView::MapFile(filename));
+}
+
+void SpriteAtlas::Build()
+{
+	const unsigned int firstId = (unsigned int)sprites.size();
+	sprites.resize(sprites.size() + pending.size());
+
+	std::vector<stbrp_rect> rects(pending.size());
+	for (size_t i = 0u; i < pending.size(); i++)
+	{
+		rects[i] = {};
+		rects[i].id = (int)i;
+		rects[i].w = (stbrp_coord)pending[i].GetWidth();
+		rects[i].h = (stbrp_coord)pending[i].GetHeight();
+	}
+	// stbrp needs one node per pixel of width to pack optimally
+	std::vector<stbrp_node> nodes(pageWidth);
+
+	// Fill one page at a time with whatever didn't fit in the previous ones
+	size_t nRemaining = rects.size();
+	while (nRemaining > 0u)
+	{
+		stbrp_context context;
+		stbrp_init_target(&context, (int)pageWidth, (int)pageHeight, nodes.data(), (int)nodes.size());
+		stbrp_pack_rects(&context, rects.data(), (int)nRemaining);
+
+		unsigned int usedHeight = 1u;
+		for (size_t i = 0u; i < nRemaining; i++)
+		{
+			if (rects[i].was_packed)
+			{
+				usedHeight = std::max(usedHeight, (unsigned int)(rects[i].y + rects[i].h));
+			}
+		}
+		const unsigned int pageIndex = (unsigned int)pages.size();
+		Surface& page = pages.emplace_back(pageWidth, usedHeight);
+		page.Clear(Color(0u));
+		for (size_t i = 0u; i < nRemaining; i++)
+		{
+			const stbrp_rect& r = rects[i];
+			if (r.was_packed)
+			{
+				page.Blit(pending[r.id], r.x, r.y);
+				sprites[firstId + r.id] = { pageIndex, { (unsigned int)r.x, (unsigned int)r.y, (unsigned int)(r.x + r.w), (unsigned int)(r.y + r.h) } };
+			}
+		}
+		page.ClearDirty();
+
+		// Every image fits in an empty page, so each page takes at least one
+		const auto firstPacked = std::stable_partition(rects.begin(), rects.begin() + nRemaining, [](const stbrp_rect& r)
+		{
+			return !r.was_packed;
+		});
+		assert(firstPacked != rects.begin() + nRemaining);
+		nRemaining = (size_t)(firstPacked - rects.begin());
+	}
+	pending.clear();
+}
+
+const SpriteAtlas::Sprite& SpriteAtlas::GetSprite(unsigned int id) const noexcept
+{
+	assert(id < sprites.size() && "Sprite not built yet");
+	return sprites[id];
+}
+
+SurfaceView SpriteAtlas::GetView(unsigned int id) const noexcept
+{
+	const Sprite& sprite = GetSprite(id);
+	return SurfaceView(pages[sprite.page]).GetSubView(sprite.rect);
+}
+
+unsigned int SpriteAtlas::GetSpriteCount() const noexcept
+{
+	return (unsigned int)sprites.size();
+}
+
+unsigned int SpriteAtlas::GetPageCount() const noexcept
+{
+	return (unsigned int)pages.size();
+}
+
+const Surface& SpriteAtlas::GetPage(unsigned int page) const noexcept
+{
+	assert(page < pages.size());
+	return pages[page];
+}
+
+SpriteAtlas::Exception::Exception(int line, const char* file, std::string note) noexcept
+	:
+	TeslaException(line, file),
+	note(std::move(note))
+{
+}
+
+const char* SpriteAtlas::Exception::what() const noexcept
+{
+	std::ostringstream oss;
+	oss << TeslaException::what() << std::endl
+		<< "[Note] " << GetNote();
+	whatBuffer = oss.str();
+	return whatBuffer.c_str();
+}
+
+const char* SpriteAtlas::Exception::GetType() const noexcept
+{
+	return "Tesla Sprite Atlas Exception!";
+}
+
+const std::string& SpriteAtlas::Exception::GetNote() const noexcept
+{
+	return note;
+}
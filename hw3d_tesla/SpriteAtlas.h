@@ -0,0 +1,53 @@
+#pragma once
+#include "SurfaceView.h"
+#include <string>
+#include <vector>
+
+// Packs many small images into a few big Surfaces (pages), so that sprites share their
+// storage instead of being scattered in one allocation each. Add the images, then Build.
+class SpriteAtlas
+{
+public:
+	class Exception : public TeslaException
+	{
+	public:
+		Exception(int line, const char* file, std::string note) noexcept;
+		virtual const char* what() const noexcept override;
+		virtual const char* GetType() const noexcept override;
+		const std::string& GetNote() const noexcept;
+	private:
+		std::string note;
+	};
+	// Where a sprite ended up
+	struct Sprite
+	{
+		unsigned int page;
+		Surface::Rect rect;
+	};
+public:
+	SpriteAtlas(unsigned int pageWidth = 1024u, unsigned int pageHeight = 1024u) noexcept;
+	SpriteAtlas(const SpriteAtlas&) = delete;
+	SpriteAtlas& operator = (const SpriteAtlas&) = delete;
+	// Queue an image for the next Build and get its sprite id. The pixels are read by Build,
+	// so a view of a Surface needs the Surface to stay alive until then
+	unsigned int Add(const SurfaceView& image);
+	// Same as Add, the file is mapped (or decoded) with SurfaceView::MapFile
+	unsigned int AddFile(const std::string& filename);
+	// Pack the queued images into new pages. Images bigger than a page throw
+	void Build();
+	const Sprite& GetSprite(unsigned int id) const noexcept;
+	// View of the sprite pixels inside its page
+	SurfaceView GetView(unsigned int id) const noexcept;
+	// Number of built sprites
+	unsigned int GetSpriteCount() const noexcept;
+	unsigned int GetPageCount() const noexcept;
+	const Surface& GetPage(unsigned int page) const noexcept;
+private:
+	unsigned int pageWidth;
+	unsigned int pageHeight;
+	// Pages are cut to the height actually used, and cleared to transparent black
+	std::vector<Surface> pages;
+	std::vector<Sprite> sprites;
+	// Images added since the last Build (their ids follow the built ones)
+	std::vector<SurfaceView> pending;
+};
@@ -0,0 +1,205 @@
+#include "SpriteBatch.h"
+#include "ThreadPool.h"
+#include "TeslaTimer.h"
+#include <algorithm>
+#include <cassert>
+
+SpriteBatch::SpriteBatch(const SpriteAtlas& atlas) noexcept
+	:
+	atlas(atlas)
+{
+}
+
+void SpriteBatch::Draw(unsigned int sprite, int x, int y, BlendMode mode, Color param, unsigned char layer)
+{
+	assert(sprite < atlas.GetSpriteCount() && "Sprite not built yet");
+	commands.push_back({ x, y, sprite, mode, param, layer });
+}
+
+void SpriteBatch::Flush(Surface& target, ThreadPool* pPool, const Surface::Rect& clip)
+{
+	TeslaTimer<float> timer;
+	const Surface::Rect bounds = {
+		std::min(clip.left, target.GetWidth()),
+		std::min(clip.top, target.GetHeight()),
+		std::min(clip.right, target.GetWidth()),
+		std::min(clip.bottom, target.GetHeight())
+	};
+
+	// Part of the target each sprite covers, and its sort key (layer, page, command index)
+	covered.resize(commands.size());
+	for (size_t i = 0u; i < commands.size(); i++)
+	{
+		const Command& c = commands[i];
+		const Surface::Rect& rect = atlas.GetSprite(c.sprite).rect;
+		const long long left = std::max((long long)c.x, (long long)bounds.left);
+		const long long top = std::max((long long)c.y, (long long)bounds.top);
+		const long long right = std::min((long long)c.x + (rect.right - rect.left), (long long)bounds.right);
+		const long long bottom = std::min((long long)c.y + (rect.bottom - rect.top), (long long)bounds.bottom);
+		covered[i] = left >= right || top >= bottom ? Surface::Rect{ 0u, 0u, 0u, 0u } :
+			Surface::Rect{ (unsigned int)left, (unsigned int)top, (unsigned int)right, (unsigned int)bottom };
+	}
+	auto KeyOf = [this](size_t i)
+	{
+		const Command& c = commands[i];
+		return ((unsigned long long)c.layer << 56) | ((unsigned long long)atlas.GetSprite(c.sprite).page << 32) | i;
+	};
+
+	// Alone, splitting the sprites into tiles only adds a clip and a blit setup per piece:
+	// the visible ones are sorted and blitted whole
+	if (pPool == nullptr || pPool->GetThreadCount() < 2u)
+	{
+		binKeys.clear();
+		for (size_t i = 0u; i < commands.size(); i++)
+		{
+			if (covered[i].left < covered[i].right)
+			{
+				binKeys.push_back(KeyOf(i));
+			}
+		}
+		// Submission order is the key order unless layers or pages are mixed
+		if (!std::is_sorted(binKeys.begin(), binKeys.end()))
+		{
+			std::sort(binKeys.begin(), binKeys.end());
+		}
+		stats.binTime = timer.Mark();
+		for (const unsigned long long key : binKeys)
+		{
+			DrawCommand(target, commands[key & 0xFFFFFFFFu], bounds);
+		}
+		stats.drawTime = timer.Mark();
+		stats.sprites = (unsigned int)commands.size();
+		stats.blits = (unsigned int)binKeys.size();
+		stats.tiles = 0u;
+		commands.clear();
+		return;
+	}
+
+	// On a pool, counting sort into the tiles: count the tiles each sprite touches (only the ones
+	// crossing a tile edge are split)...
+	const unsigned int nTilesX = (target.GetWidth() + TileSize - 1u) / TileSize;
+	const unsigned int nTilesY = (target.GetHeight() + TileSize - 1u) / TileSize;
+	binStart.assign((size_t)nTilesX * nTilesY + 1u, 0u);
+	for (const Surface::Rect& r : covered)
+	{
+		if (r.left >= r.right)
+		{
+			continue;
+		}
+		for (unsigned int ty = r.top / TileSize; ty <= (r.bottom - 1u) / TileSize; ty++)
+		{
+			for (unsigned int tx = r.left / TileSize; tx <= (r.right - 1u) / TileSize; tx++)
+			{
+				binStart[tx + (size_t)nTilesX * ty + 1u]++;
+			}
+		}
+	}
+	tiles.clear();
+	for (size_t t = 0u; t + 1u < binStart.size(); t++)
+	{
+		if (binStart[t + 1u] != 0u)
+		{
+			tiles.push_back((unsigned int)t);
+		}
+		binStart[t + 1u] += binStart[t];
+	}
+
+	// ...then scatter them in submission order (binStart[t] is bumped to the end of bin t on the way)
+	binKeys.resize(binStart.back());
+	for (size_t i = 0u; i < commands.size(); i++)
+	{
+		const Surface::Rect& r = covered[i];
+		if (r.left >= r.right)
+		{
+			continue;
+		}
+		const unsigned long long key = KeyOf(i);
+		for (unsigned int ty = r.top / TileSize; ty <= (r.bottom - 1u) / TileSize; ty++)
+		{
+			for (unsigned int tx = r.left / TileSize; tx <= (r.right - 1u) / TileSize; tx++)
+			{
+				binKeys[binStart[tx + (size_t)nTilesX * ty]++] = key;
+			}
+		}
+	}
+	// Every start moved up by one bin: shift them back
+	std::copy_backward(binStart.begin(), binStart.end() - 1, binStart.end());
+	binStart[0] = 0u;
+
+	// Most tiles hold a single layer and page, already in order
+	for (unsigned int t : tiles)
+	{
+		const auto first = binKeys.begin() + binStart[t];
+		const auto last = binKeys.begin() + binStart[t + 1u];
+		if (!std::is_sorted(first, last))
+		{
+			std::sort(first, last);
+		}
+	}
+	stats.binTime = timer.Mark();
+
+	// Every blit is clipped to its tile, so the tiles are independent
+	pPool->ParallelFor((unsigned int)tiles.size(), [&](unsigned int i)
+	{
+		DrawTile(target, tiles[i], nTilesX, bounds);
+	});
+	stats.drawTime = timer.Mark();
+	stats.sprites = (unsigned int)commands.size();
+	stats.blits = (unsigned int)binKeys.size();
+	stats.tiles = (unsigned int)tiles.size();
+	commands.clear();
+}
+
+void SpriteBatch::Clear() noexcept
+{
+	commands.clear();
+}
+
+unsigned int SpriteBatch::GetQueuedCount() const noexcept
+{
+	return (unsigned int)commands.size();
+}
+
+const SpriteBatch::Statistics& SpriteBatch::GetStatistics() const noexcept
+{
+	return stats;
+}
+
+void SpriteBatch::DrawTile(Surface& target, unsigned int tile, unsigned int nTilesX, const Surface::Rect& clip) const noexcept
+{
+	const unsigned int tx = tile % nTilesX;
+	const unsigned int ty = tile / nTilesX;
+	const Surface::Rect tileClip = {
+		std::max(tx * TileSize, clip.left),
+		std::max(ty * TileSize, clip.top),
+		std::min((tx + 1u) * TileSize, clip.right),
+		std::min((ty + 1u) * TileSize, clip.bottom)
+	};
+	for (unsigned int k = binStart[tile]; k < binStart[tile + 1u]; k++)
+	{
+		DrawCommand(target, commands[binKeys[k] & 0xFFFFFFFFu], tileClip);
+	}
+}
+
+void SpriteBatch::DrawCommand(Surface& target, const Command& c, const Surface::Rect& clip) const noexcept
+{
+	const SurfaceView view = atlas.GetView(c.sprite);
+	switch (c.mode)
+	{
+	case BlendMode::Opaque:
+		target.Blit(view, c.x, c.y, clip);
+		break;
+	case BlendMode::ColorKey:
+		target.BlitColorKey(view, c.x, c.y, c.param, clip);
+		break;
+	case BlendMode::Alpha:
+		target.BlitAlpha(view, c.x, c.y, clip);
+		break;
+	case BlendMode::Premultiplied:
+		target.BlitPremultiplied(view, c.x, c.y, clip);
+		break;
+	case BlendMode::Tinted:
+		target.BlitTinted(view, c.x, c.y, c.param, clip);
+		break;
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "SpriteAtlas.h"
+#include <vector>
+
+class ThreadPool;
+
+// Collects the sprites of a frame and draws them in one go, sorted by layer then atlas page.
+// On a ThreadPool the draws are also binned per destination tile (the sprites crossing a
+// tile edge are split), so that the tiles can be blended in parallel.
+// Sprites of the same layer and page keep the order they were drawn in; overlapping
+// sprites that need a precise order and come from different pages need different layers.
+class SpriteBatch
+{
+public:
+	enum class BlendMode
+	{
+		Opaque,        // Surface::Blit
+		ColorKey,      // Surface::BlitColorKey, param is the key
+		Alpha,         // Surface::BlitAlpha
+		Premultiplied, // Surface::BlitPremultiplied
+		Tinted         // Surface::BlitTinted, param is the tint
+	};
+	// Of the last Flush
+	struct Statistics
+	{
+		unsigned int sprites;
+		unsigned int blits;    // sprites split across tiles count once per tile
+		unsigned int tiles;    // tiles touched (0 when drawn without tiles)
+		float binTime;         // seconds spent binning and sorting
+		float drawTime;        // seconds spent blitting
+	};
+	// Destination tile size (in pixels), a multiple of the dirty tiles so that
+	// concurrent tiles never share a dirty flag
+	static constexpr unsigned int TileSize = 64u;
+	static_assert(TileSize % Surface::DirtyTileSize == 0u);
+public:
+	SpriteBatch(const SpriteAtlas& atlas) noexcept;
+	SpriteBatch(const SpriteBatch&) = delete;
+	SpriteBatch& operator = (const SpriteBatch&) = delete;
+	// Queue a sprite of the atlas with its top left corner at (x, y). Lower layers are drawn first
+	void Draw(unsigned int sprite, int x, int y, BlendMode mode = BlendMode::Alpha, Color param = Color(0xFFFFFFFFu), unsigned char layer = 0u);
+	// Draw everything queued inside the clip rectangle and empty the batch. With a pool of more
+	// than one thread, the tiles are drawn in parallel; otherwise every sprite is blitted whole
+	// (no allocations once the buffers have grown to the frame size)
+	void Flush(Surface& target, ThreadPool* pPool = nullptr, const Surface::Rect& clip = Surface::NoClip);
+	// Drop everything queued
+	void Clear() noexcept;
+	unsigned int GetQueuedCount() const noexcept;
+	const Statistics& GetStatistics() const noexcept;
+private:
+	struct Command
+	{
+		int x;
+		int y;
+		unsigned int sprite;
+		BlendMode mode;
+		Color param;
+		unsigned char layer;
+	};
+private:
+	void DrawTile(Surface& target, unsigned int tile, unsigned int nTilesX, const Surface::Rect& clip) const noexcept;
+	void DrawCommand(Surface& target, const Command& c, const Surface::Rect& clip) const noexcept;
+private:
+	const SpriteAtlas& atlas;
+	std::vector<Command> commands;
+	// Part of the target each command covers (after clipping)
+	std::vector<Surface::Rect> covered;
+	// Sort keys (layer, page, command index): of all the sprites when drawn without tiles,
+	// otherwise of each tile, tile t owning [binStart[t], binStart[t + 1])
+	std::vector<unsigned long long> binKeys;
+	std::vector<unsigned int> binStart;
+	// Non empty tiles
+	std::vector<unsigned int> tiles;
+	Statistics stats = {};
+};
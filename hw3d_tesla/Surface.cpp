@@ -1,5 +1,10 @@
-#define FULL_WINTARD
 #include "Surface.h"
+#include "SurfaceView.h"
+#include "Simd.h"
+#include "ImageDecoder.h"
+#include "ImageEncoder.h"
+#ifndef TESLA_HEADLESS
+#define FULL_WINTARD
 #include "TeslaWin.h"
 #include <algorithm>
 namespace Gdiplus
@@ -8,17 +13,42 @@ namespace Gdiplus
 	using std::max;
 }
 #include <gdiplus.h>
+
+#pragma comment(lib, "gdiplus.lib")
+#endif
 #include <sstream>
+#include <fstream>
+#include <cstring>
 #include <cassert>
+#include <new>
+#include <memory>
+#include <algorithm>
 
-#pragma comment(lib, "gdiplus.lib")
+static constexpr unsigned int AlignPitch(unsigned int pitch) noexcept
+{
+	constexpr unsigned int pixelsPerAlignment = Surface::Alignment / sizeof(Color);
+	return (pitch + pixelsPerAlignment - 1u) / pixelsPerAlignment * pixelsPerAlignment;
+}
+
+static constexpr unsigned int CountTiles(unsigned int pixels) noexcept
+{
+	return (pixels + Surface::DirtyTileSize - 1u) / Surface::DirtyTileSize;
+}
+
+static_assert((Surface::DirtyTileSize & (Surface::DirtyTileSize - 1u)) == 0u, "DirtyTileSize must be a power of two");
 
 Surface::Surface(unsigned int width, unsigned int height, unsigned int pitch) noexcept
 	:
-	pBuffer(std::make_unique<Color[]>((size_t)pitch * height)),
+	pBuffer(AllocateBuffer((size_t)AlignPitch(pitch) * height)),
 	width(width),
-	height(height)
-{}
+	height(height),
+	pitch(AlignPitch(pitch)),
+	dirtyTiles((size_t)CountTiles(width) * CountTiles(height), 1u),
+	nTilesX(CountTiles(width)),
+	nTilesY(CountTiles(height))
+{
+	assert(pitch >= width && "The pitch can't be smaller than the width");
+}
 
 Surface::Surface(unsigned int width, unsigned int height) noexcept
 	:
@@ -27,22 +57,34 @@ Surface::Surface(unsigned int width, unsigned int height) noexcept
 
 Surface::Surface(unsigned int width, unsigned int height, std::unique_ptr<Color[]> pBuffer) noexcept
 	:	
-	pBuffer(std::move(pBuffer)),
+	pBuffer(pBuffer.release(), BufferDeleter{ false }),
 	width(width),
-	height(height)
+	height(height),
+	pitch(width),
+	dirtyTiles((size_t)CountTiles(width) * CountTiles(height), 1u),
+	nTilesX(CountTiles(width)),
+	nTilesY(CountTiles(height))
 {}
 
 Surface::Surface(Surface&& source) noexcept
 	:
 	pBuffer(std::move(source.pBuffer)),
 	width(source.width),
-	height(source.height)
+	height(source.height),
+	pitch(source.pitch),
+	dirtyTiles(std::move(source.dirtyTiles)),
+	nTilesX(source.nTilesX),
+	nTilesY(source.nTilesY)
 {}
 
 Surface& Surface::operator=(Surface&& donor) noexcept
 {
 	width = donor.width;
 	height = donor.height;
+	pitch = donor.pitch;
+	dirtyTiles = std::move(donor.dirtyTiles);
+	nTilesX = donor.nTilesX;
+	nTilesY = donor.nTilesY;
 	pBuffer = std::move(donor.pBuffer);
 	donor.pBuffer = nullptr;
 	return *this;
@@ -50,13 +92,10 @@ Surface& Surface::operator=(Surface&& donor) noexcept
 
 void Surface::Clear(Color fillvalue) noexcept
 {
-	Color* pStart = pBuffer.get();
-	Color* pEnd = &pBuffer[(size_t)width * height];
-
-	for (Color* c = pStart; c < pEnd; c++)
-	{
-		*c = fillvalue;
-	}
+	// SSE2/AVX2 fill picked at runtime, with streaming stores for buffers bigger than the LLC.
+	// The row padding is filled too: one long run is faster than height short ones
+	Simd::Fill32(reinterpret_cast<unsigned int*>(pBuffer.get()), (size_t)pitch * height, fillvalue.dword);
+	MarkAllDirty();
 }
 
 void Surface::PutPixel(unsigned int x, unsigned int y, Color c) noexcept
@@ -65,7 +104,8 @@ void Surface::PutPixel(unsigned int x, unsigned int y, Color c) noexcept
 	assert(x < width && "Attempting to draw outside the surface");
 	assert(y >= 0u && "Attempting to draw outside the surface");
 	assert(y < height && "Attempting to draw outside the surface");
-	pBuffer[x + (size_t)width * y] = c;
+	pBuffer[x + (size_t)pitch * y] = c;
+	dirtyTiles[(x / DirtyTileSize) + (size_t)nTilesX * (y / DirtyTileSize)] = 1u;
 }
 
 Color Surface::Sample(unsigned int x, unsigned int y) const noexcept
@@ -74,7 +114,7 @@ Color Surface::Sample(unsigned int x, unsigned int y) const noexcept
 	assert(x < width && "Attempting sample outside the surface");
 	assert(y >= 0u && "Attempting sample outside the surface");
 	assert(y < height && "Attempting sample outside the surface");
-	return pBuffer[x + (size_t)width * y];
+	return pBuffer[x + (size_t)pitch * y];
 }
 
 unsigned int Surface::GetWidth() const noexcept
@@ -97,14 +137,25 @@ const Color* Surface::GetBufferPtrConst() const noexcept
 	return pBuffer.get();
 }
 
+Color* Surface::GetRowPtr(unsigned int y) const noexcept
+{
+	assert(y < height && "Attempting to access a row outside the surface");
+	return &pBuffer[(size_t)pitch * y];
+}
+
+unsigned int Surface::GetPitch() const noexcept
+{
+	return pitch;
+}
+
 unsigned int Surface::GetRowPitch() const noexcept
 {
-	return width * sizeof(Color);
+	return pitch * sizeof(Color);
 }
 
 unsigned int Surface::GetBufferSize() const noexcept
 {
-	return width * height * sizeof(Color);
+	return pitch * height * sizeof(Color);
 }
 
 unsigned int Surface::GetPixelCount() const noexcept
@@ -112,7 +163,230 @@ unsigned int Surface::GetPixelCount() const noexcept
 	return width * height;
 }
 
+void Surface::Copy(const Surface& src) noexcept
+{
+	assert(width == src.width);
+	assert(height == src.height);
+	if (pitch == src.pitch)
+	{
+		memcpy(static_cast<void*>(pBuffer.get()), src.pBuffer.get(), (size_t)pitch * height * sizeof(Color));
+	}
+	else
+	{
+		for (unsigned int y = 0u; y < height; y++)
+		{
+			memcpy(static_cast<void*>(GetRowPtr(y)), src.GetRowPtr(y), (size_t)width * sizeof(Color));
+		}
+	}
+	MarkAllDirty();
+}
+
+void Surface::Copy(const SurfaceView& src) noexcept
+{
+	assert(width == src.GetWidth());
+	assert(height == src.GetHeight());
+	for (unsigned int y = 0u; y < height; y++)
+	{
+		memcpy(static_cast<void*>(GetRowPtr(y)), src.GetRowPtr(y), (size_t)width * sizeof(Color));
+	}
+	MarkAllDirty();
+}
+
+template<typename RowFunc>
+void Surface::BlitRows(const SurfaceView& src, int x, int y, const Rect& clip, RowFunc rowFunc) noexcept
+{
+	// Destination rectangle of the whole sprite, intersected with the clip and the Surface
+	// (64 bit so that sprites far outside of the Surface can't overflow)
+	const long long left = std::max({ (long long)x, (long long)clip.left, 0ll });
+	const long long top = std::max({ (long long)y, (long long)clip.top, 0ll });
+	const long long right = std::min({ (long long)x + src.GetWidth(), (long long)clip.right, (long long)width });
+	const long long bottom = std::min({ (long long)y + src.GetHeight(), (long long)clip.bottom, (long long)height });
+	if (left >= right || top >= bottom)
+	{
+		return;
+	}
+	const unsigned int srcX = (unsigned int)(left - x);
+	const unsigned int srcY = (unsigned int)(top - y);
+	const size_t count = (size_t)(right - left);
+	const unsigned int nRows = (unsigned int)(bottom - top);
+	for (unsigned int row = 0u; row < nRows; row++)
+	{
+		rowFunc(GetRowPtr((unsigned int)top + row) + left, src.GetRowPtr(srcY + row) + srcX, count);
+	}
+	MarkDirty({ (unsigned int)left, (unsigned int)top, (unsigned int)right, (unsigned int)bottom });
+}
+
+void Surface::Blit(const SurfaceView& src, int x, int y, const Rect& clip) noexcept
+{
+	BlitRows(src, x, y, clip, [](Color* pDst, const Color* pSrc, size_t count)
+	{
+		memcpy(static_cast<void*>(pDst), pSrc, count * sizeof(Color));
+	});
+}
+
+void Surface::BlitColorKey(const SurfaceView& src, int x, int y, Color key, const Rect& clip) noexcept
+{
+	BlitRows(src, x, y, clip, [key](Color* pDst, const Color* pSrc, size_t count)
+	{
+		Simd::BlitColorKey32(&pDst->dword, &pSrc->dword, count, key.dword);
+	});
+}
+
+void Surface::BlitAlpha(const SurfaceView& src, int x, int y, const Rect& clip) noexcept
+{
+	BlitRows(src, x, y, clip, [](Color* pDst, const Color* pSrc, size_t count)
+	{
+		Simd::BlendAlpha32(&pDst->dword, &pSrc->dword, count);
+	});
+}
+
+void Surface::BlitPremultiplied(const SurfaceView& src, int x, int y, const Rect& clip) noexcept
+{
+	BlitRows(src, x, y, clip, [](Color* pDst, const Color* pSrc, size_t count)
+	{
+		Simd::BlendPremultiplied32(&pDst->dword, &pSrc->dword, count);
+	});
+}
+
+void Surface::BlitTinted(const SurfaceView& src, int x, int y, Color tint, const Rect& clip) noexcept
+{
+	BlitRows(src, x, y, clip, [tint](Color* pDst, const Color* pSrc, size_t count)
+	{
+		Simd::BlendTinted32(&pDst->dword, &pSrc->dword, count, tint.dword);
+	});
+}
+
+void Surface::MarkDirty(const Rect& rect) noexcept
+{
+	assert(rect.right <= width && rect.bottom <= height && "Dirty rect outside the surface");
+	if (rect.left >= rect.right || rect.top >= rect.bottom)
+	{
+		return;
+	}
+	const unsigned int tx0 = rect.left / DirtyTileSize;
+	const unsigned int tx1 = (rect.right - 1u) / DirtyTileSize;
+	const unsigned int ty0 = rect.top / DirtyTileSize;
+	const unsigned int ty1 = (rect.bottom - 1u) / DirtyTileSize;
+	for (unsigned int ty = ty0; ty <= ty1; ty++)
+	{
+		memset(&dirtyTiles[tx0 + (size_t)nTilesX * ty], 1, (size_t)tx1 - tx0 + 1u);
+	}
+}
+
+void Surface::MarkAllDirty() noexcept
+{
+	std::fill(dirtyTiles.begin(), dirtyTiles.end(), (unsigned char)1u);
+}
+
+bool Surface::IsDirty() const noexcept
+{
+	return std::find(dirtyTiles.begin(), dirtyTiles.end(), (unsigned char)1u) != dirtyTiles.end();
+}
+
+void Surface::GetDirtyRects(std::vector<Rect>& rects) const
+{
+	rects.clear();
+	for (unsigned int ty = 0u; ty < nTilesY; ty++)
+	{
+		const unsigned char* pRow = &dirtyTiles[(size_t)nTilesX * ty];
+		const unsigned int top    = ty * DirtyTileSize;
+		const unsigned int bottom = std::min(top + DirtyTileSize, height);
+		// Horizontal runs of dirty tiles in this row
+		for (unsigned int tx = 0u; tx < nTilesX; tx++)
+		{
+			if (!pRow[tx])
+			{
+				continue;
+			}
+			const unsigned int runBegin = tx;
+			while (tx < nTilesX && pRow[tx])
+			{
+				tx++;
+			}
+			const unsigned int left  = runBegin * DirtyTileSize;
+			const unsigned int right = std::min(tx * DirtyTileSize, width);
+			// Grow the rect right above if it has the same horizontal extent, otherwise start a new one
+			auto above = std::find_if(rects.begin(), rects.end(), [=](const Rect& r)
+			{
+				return r.bottom == top && r.left == left && r.right == right;
+			});
+			if (above != rects.end())
+			{
+				above->bottom = bottom;
+			}
+			else
+			{
+				rects.push_back({ left, top, right, bottom });
+			}
+		}
+	}
+}
+
+void Surface::ClearDirty() noexcept
+{
+	std::fill(dirtyTiles.begin(), dirtyTiles.end(), (unsigned char)0u);
+}
+
+std::unique_ptr<Color[], Surface::BufferDeleter> Surface::AllocateBuffer(size_t nPixels)
+{
+	Color* p = static_cast<Color*>(::operator new[](nPixels * sizeof(Color), std::align_val_t(Alignment)));
+	std::uninitialized_value_construct_n(p, nPixels);
+	return std::unique_ptr<Color[], BufferDeleter>(p, BufferDeleter{ true });
+}
+
+void Surface::BufferDeleter::operator()(Color* p) const noexcept
+{
+	if (aligned)
+	{
+		::operator delete[](p, std::align_val_t(Alignment));
+	}
+	else
+	{
+		delete[] p;
+	}
+}
+
 Surface Surface::FromFile(const std::string& filename)
+{
+	// Read the whole file in one go
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		std::stringstream ss;
+		ss << "Loading image [" << filename << "]: failed to open the file.";
+		throw Exception(__LINE__, __FILE__, ss.str());
+	}
+	std::vector<unsigned char> data((size_t)file.tellg());
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(data.data()), (std::streamsize)data.size()))
+	{
+		std::stringstream ss;
+		ss << "Loading image [" << filename << "]: failed to read the file.";
+		throw Exception(__LINE__, __FILE__, ss.str());
+	}
+
+	// Formats we know are decoded straight into the Surface rows
+	const auto format = ImageDecoder::DetectFormat(data.data(), data.size(), filename);
+	if (format != ImageDecoder::Format::Unknown)
+	{
+		return ImageDecoder::Decode(data.data(), data.size(), format, filename);
+	}
+#ifndef TESLA_HEADLESS
+	return FromFileGDIPlus(filename);
+#else
+	std::stringstream ss;
+	ss << "Loading image [" << filename << "]: unsupported format (only bmp, tga, png and qoi in the headless build).";
+	throw Exception(__LINE__, __FILE__, ss.str());
+#endif
+}
+
+void Surface::Save(const std::string& filename, bool alpha) const
+{
+	ImageEncoder::Save(*this, filename, alpha);
+}
+
+#ifndef TESLA_HEADLESS
+Surface Surface::FromFileGDIPlus(const std::string& filename)
 {
 	// Increase the reference count on GDIPlus cause you need it 
 	// (will be decreased when we go out of scope)
@@ -143,90 +417,28 @@ Surface Surface::FromFile(const std::string& filename)
 	const unsigned int width  = bitmap.GetWidth();
 	const unsigned int height = bitmap.GetHeight();
 
-	// We prepare the buffer of colors with the right size
-	auto pBuffer = std::make_unique<Color[]>((size_t)width * height);
-
-	// Now look through every pixel in the loaded image and copy it to our pBuffer
-	for (unsigned int y = 0u; y < height; y++)
-	{
-		for (unsigned int x = 0u; x < width; x++)
-		{
-			Gdiplus::Color pixel;
-			bitmap.GetPixel((INT)x, (INT)y, &pixel);
-			pBuffer[x + (size_t)width * y] = pixel.GetValue();
-		}
-	}
-
-	return Surface(width, height, std::move(pBuffer));
-}
-
-void Surface::Save(const std::string& filename) const
-{
-	GDIPlusManager gdipm;
-
-	// Not so easy stuff.
-	auto GetEncoderClsid = [&filename](const WCHAR* format, CLSID* pClsid) -> void
-	{
-		UINT  num = 0;          // Number of image encoders
-		UINT  size = 0;         // Size of the image encoder array in bytes
-
-		Gdiplus::ImageCodecInfo* pImageCodecInfo = nullptr;
-
-		Gdiplus::GetImageEncodersSize(&num, &size);
-		if (size == 0)
-		{
-			std::stringstream ss;
-			ss << "Saving surface to [" << filename << "]: failed to get encoder; size == 0.";
-			throw Exception(__LINE__, __FILE__, ss.str());
-		}
-
-		pImageCodecInfo = (Gdiplus::ImageCodecInfo*)(malloc(size));
-		if (pImageCodecInfo == nullptr)
-		{
-			std::stringstream ss;
-			ss << "Saving surface to [" << filename << "]: failed to get encoder; failed to allocate memory.";
-			throw Exception(__LINE__, __FILE__, ss.str());
-		}
-
-		GetImageEncoders(num, size, pImageCodecInfo);
-
-		for (UINT j = 0; j < num; ++j)
-		{
-			if (wcscmp(pImageCodecInfo[j].MimeType, format) == 0)
-			{
-				*pClsid = pImageCodecInfo[j].Clsid;
-				free(pImageCodecInfo);
-				return;
-			}
-		}
-
-		free(pImageCodecInfo);
-		std::stringstream ss;
-		ss << "Saving surface to [" << filename <<
-			"]: failed to get encoder; failed to find matching encoder.";
-		throw Exception(__LINE__, __FILE__, ss.str());
-	};
-
-	CLSID bmpID;
-	GetEncoderClsid(L"image/bmp", &bmpID);
-
-	// Convert filename to wide string (for Gdiplus)
-	std::wstring wfilename(filename.begin(), filename.end());
-
-	Gdiplus::Bitmap bitmap(width, height, width * sizeof(Color), PixelFormat32bppARGB, (BYTE*)pBuffer.get());
-	if (bitmap.Save(wfilename.c_str(), &bmpID, nullptr) != Gdiplus::Status::Ok)
+	// We prepare the surface with the right size (aligned rows)
+	Surface surface(width, height);
+
+	// Let GDI+ convert the whole image to 32bpp ARGB directly into our rows
+	// (ImageLockModeUserInputBuf makes LockBits write into the buffer we provide)
+	Gdiplus::Rect rect(0, 0, (INT)width, (INT)height);
+	Gdiplus::BitmapData bitmapData;
+	bitmapData.Width       = width;
+	bitmapData.Height      = height;
+	bitmapData.Stride      = (INT)surface.GetRowPitch();
+	bitmapData.PixelFormat = PixelFormat32bppARGB;
+	bitmapData.Scan0       = surface.GetBufferPtr();
+	bitmapData.Reserved    = 0u;
+	if (bitmap.LockBits(&rect, Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf, PixelFormat32bppARGB, &bitmapData) != Gdiplus::Status::Ok)
 	{
 		std::stringstream ss;
-		ss << "Saving surface to [" << filename << "]: failed to save.";
+		ss << "Loading image [" << filename << "]: failed to read the pixels.";
 		throw Exception(__LINE__, __FILE__, ss.str());
 	}
-}
+	bitmap.UnlockBits(&bitmapData);
 
-void Surface::Copy(const Surface& src) noexcept
-{
-	assert(width == src.width);
-	assert(height == src.height);
-	memcpy(pBuffer.get(), src.pBuffer.get(), (size_t)width * height * sizeof(Color));
+	return surface;
 }
 
 /*************************************************************************************/
@@ -254,6 +466,8 @@ Surface::GDIPlusManager::~GDIPlusManager()
 	}
 }
 
+#endif
+
 /***************************************************************************************/
 /********************************** EXCEPTION LAND *************************************/
 Surface::Exception::Exception(int line, const char* file, std::string note) noexcept
@@ -2,8 +2,11 @@
 #include "TeslaException.h"
 #include <string>
 #include <memory>
+#include <vector>
 #include "Color.h"
 
+class SurfaceView;
+
 // Stores an image
 class Surface
 {
@@ -18,6 +21,7 @@ public:
 	private:
 		std::string note;
 	};
+#ifndef TESLA_HEADLESS
 public:
     class GDIPlusManager
     {
@@ -28,9 +32,28 @@ public:
         static unsigned long long token;
         static int refCount;
     };
+#endif
+public:
+    // Pixel rectangle, right and bottom excluded (same convention as D3D11_BOX)
+    struct Rect
+    {
+        unsigned int left;
+        unsigned int top;
+        unsigned int right;
+        unsigned int bottom;
+    };
+public:
+    // Rows start on this boundary (in bytes): cache line size, and enough for any SIMD register
+    static constexpr unsigned int Alignment = 64u;
+    // Writes are tracked per square tile of this size (in pixels, power of two)
+    static constexpr unsigned int DirtyTileSize = 32u;
+    // Clip rectangle of the blits that lets them write anywhere on the Surface
+    static constexpr Rect NoClip = { 0u, 0u, 0xFFFFFFFFu, 0xFFFFFFFFu };
 public:
     Surface() = delete;
+    // Adopt an existing buffer with pitch == width (no alignment guarantee)
 	Surface(unsigned int width, unsigned int height, std::unique_ptr<Color[]> pBuffer) noexcept;
+    // The pitch (in pixels) is rounded up so that every row starts on an Alignment boundary
 	Surface(unsigned int width, unsigned int height, unsigned int pitch) noexcept;
 	Surface(unsigned int width, unsigned int height) noexcept;
 	Surface(Surface&& source) noexcept;
@@ -52,20 +75,67 @@ public:
 	Color* GetBufferPtr() const noexcept;
     // Get a constant pointer to the color buffer
 	const Color* GetBufferPtrConst() const noexcept;
+    // Get a pointer to the first pixel of row y
+	Color* GetRowPtr(unsigned int y) const noexcept;
+    // Get the distance between two rows (in pixels)
+	unsigned int GetPitch() const noexcept;
 	// Get the Row Pitch in bytes
 	unsigned int GetRowPitch() const noexcept;
-    // Get the number bytes in the Surface
+    // Get the number bytes in the Surface (padding included)
     unsigned int GetBufferSize() const noexcept;
     // Get the number of Pixels in the Surface
     unsigned int GetPixelCount() const noexcept;
-	// Load surface from an image file (bmp, png, jpg, etc.)
+	// Load surface from an image file. BMP, TGA, PNG and QOI are decoded by ImageDecoder,
+	// anything else (jpg, gif, etc.) goes through GDI+ (not available in the headless build)
 	static Surface FromFile(const std::string& filename);
-    // Save the Surface to a file (only .bmp)
-	void Save(const std::string& filename) const;
+    // Save the Surface to a .bmp, .png or .qoi file (see ImageWriter to do it in the background).
+    // Like ImageWriter::Submit, it stores the image opaque unless alpha is true: Color(r, g, b)
+    // leaves the alpha at 0, so most drawn pixels would come out fully transparent otherwise
+	void Save(const std::string& filename, bool alpha = false) const;
     // Copy from another Surface having the same size
 	void Copy(const Surface& src) noexcept;
+    // Copy from a read-only view (e.g. a mapped image file) having the same size
+	void Copy(const SurfaceView& src) noexcept;
+    // Draw src with its top left corner at (x, y). Only the pixels inside both the clip
+    // rectangle and the Surface are written (the clipping is done once per call).
+    // Copy the pixels as they are
+	void Blit(const SurfaceView& src, int x, int y, const Rect& clip = NoClip) noexcept;
+    // Skip the pixels whose RGB matches the key
+	void BlitColorKey(const SurfaceView& src, int x, int y, Color key, const Rect& clip = NoClip) noexcept;
+    // Blend with straight (non-premultiplied) alpha
+	void BlitAlpha(const SurfaceView& src, int x, int y, const Rect& clip = NoClip) noexcept;
+    // Blend with premultiplied alpha (color channels already multiplied by alpha)
+	void BlitPremultiplied(const SurfaceView& src, int x, int y, const Rect& clip = NoClip) noexcept;
+    // Multiply src by tint (alpha included, so tint's alpha fades the sprite), then blend with straight alpha
+	void BlitTinted(const SurfaceView& src, int x, int y, Color tint, const Rect& clip = NoClip) noexcept;
+    // Flag a region as modified (needed after writing through the raw buffer pointers)
+	void MarkDirty(const Rect& rect) noexcept;
+	void MarkAllDirty() noexcept;
+	bool IsDirty() const noexcept;
+    // Get the modified regions since the last ClearDirty, merged into as few rectangles as possible
+	void GetDirtyRects(std::vector<Rect>& rects) const;
+	void ClearDirty() noexcept;
+private:
+    // Frees either an aligned buffer allocated by the Surface or an adopted new[] buffer
+    struct BufferDeleter
+    {
+        bool aligned = true;
+        void operator()(Color* p) const noexcept;
+    };
+    static std::unique_ptr<Color[], BufferDeleter> AllocateBuffer(size_t nPixels);
+    // Clip the blit of src at (x, y), run rowFunc(pDst, pSrc, count) on every visible row and mark it dirty
+    template<typename RowFunc>
+    void BlitRows(const SurfaceView& src, int x, int y, const Rect& clip, RowFunc rowFunc) noexcept;
+#ifndef TESLA_HEADLESS
+    static Surface FromFileGDIPlus(const std::string& filename);
+#endif
 private:
-	std::unique_ptr<Color[]> pBuffer;
+	std::unique_ptr<Color[], BufferDeleter> pBuffer;
 	unsigned int width;
 	unsigned int height;
+	unsigned int pitch;
+	// One flag per DirtyTileSize x DirtyTileSize tile
+	std::vector<unsigned char> dirtyTiles;
+	unsigned int nTilesX;
+	unsigned int nTilesY;
 };
\ No newline at end of file
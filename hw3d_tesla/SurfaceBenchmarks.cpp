@@ -0,0 +1,643 @@
+#ifdef TESLA_HEADLESS
+#include "Benchmark.h"
+#include "Surface.h"
+#include "Graphics.h"
+#include "SurfaceTile.h"
+#include "ThreadPool.h"
+#include "ImageDecoder.h"
+#include "ImageEncoder.h"
+#include "SpriteBatch.h"
+#include "TextRenderer.h"
+#include "ShapeFiller.h"
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <functional>
+
+// Surface::Clear before Simd::Fill32, kept to compare against
+static void ClearLoop(Surface& surface, Color fillvalue) noexcept
+{
+	Color* pStart = surface.GetBufferPtr();
+	Color* pEnd = pStart + (size_t)surface.GetWidth() * surface.GetHeight();
+
+	for (Color* c = pStart; c < pEnd; c++)
+	{
+		*c = fillvalue;
+	}
+}
+
+// Surface::Clear at every Simd::Level against the old loop, in GB/s, from 800x600 to 4K. Every
+// measure is the best of 3 runs writing about 300 MB (the big targets go past the last level cache,
+// the small ones don't). Clear picks its stores from the size of the last level cache, so
+// Fill32Cached and Fill32Streaming are also timed on every target: a big cache never lets Clear
+// stream, a small one makes it stream from 800x600 on
+int Benchmark::Clear()
+{
+	const unsigned int sizes[][2] = { { 800u, 600u }, { 1280u, 720u }, { 1920u, 1080u }, { 2560u, 1440u }, { 3840u, 2160u } };
+	std::cout << "last level cache: " << Simd::GetLastLevelCacheSize() / 1024u << " KB" << std::endl;
+	for (const auto& size : sizes)
+	{
+		Surface surface{ size[0], size[1] };
+		unsigned int* const pBuffer = reinterpret_cast<unsigned int*>(surface.GetBufferPtr());
+		const size_t count = (size_t)surface.GetPitch() * size[1];
+		const double bytes = (double)size[0] * size[1] * sizeof(Color);
+		const unsigned int nClears = std::max(4u, (unsigned int)(3e8 / bytes));
+		const auto Measure = [&](auto clear)
+		{
+			const float time = BestOf(3u, [&]()
+			{
+				for (unsigned int i = 0u; i < nClears; i++)
+				{
+					clear(Color(i));
+				}
+			});
+			return bytes * nClears / (double)time / 1e9;
+		};
+		const bool streamed = (double)count * sizeof(Color) > (double)Simd::GetLastLevelCacheSize();
+		std::cout << size[0] << "x" << size[1] << " (Clear " << (streamed ? "streams" : "caches") << "): loop " << Measure([&](Color c) { ClearLoop(surface, c); });
+		ForEachLevel([&](Simd::Level level)
+		{
+			std::cout << ", " << Simd::GetLevelName(level) << " " << Measure([&](Color c) { surface.Clear(c); });
+		});
+		std::cout << " GB/s" << std::endl << "    cached:    ";
+		ForEachLevel([&](Simd::Level level)
+		{
+			std::cout << (level == Simd::Level::None ? "" : ", ") << Simd::GetLevelName(level) << " "
+				<< Measure([&](Color c) { Simd::Fill32Cached(pBuffer, count, c.dword); });
+		});
+		std::cout << " GB/s" << std::endl << "    streaming: ";
+		ForEachLevel([&](Simd::Level level)
+		{
+			std::cout << (level == Simd::Level::None ? "" : ", ") << Simd::GetLevelName(level) << " "
+				<< Measure([&](Color c) { Simd::Fill32Streaming(pBuffer, count, c.dword); });
+		});
+		std::cout << " GB/s" << std::endl;
+	}
+	return 0;
+}
+
+// Full screen per pixel effect (a few sines per pixel) of the effect benchmark
+static Color EffectPixel(unsigned int x, unsigned int y, float t) noexcept
+{
+	const float fx = (float)x * 0.02f;
+	const float fy = (float)y * 0.02f;
+	const float v = std::sin(fx + t) + std::sin(0.7f * fy + t) + std::sin(0.5f * (fx + fy) + t) + std::sin(std::sqrt(fx * fx + fy * fy) + t);
+	const unsigned char c = (unsigned char)((v + 4.0f) * 31.0f);
+	return Color(c, (unsigned char)(255u - c), (unsigned char)(c / 2u));
+}
+
+// Sum of the framebuffer pixels, to check that two ways of drawing gave the same frame
+static unsigned long long SumPixels(const Graphics& gfx) noexcept
+{
+	unsigned long long sum = 0u;
+	for (unsigned int y = 0u; y < Graphics::ScreenHeight; y++)
+	{
+		const Color* const pRow = gfx.GetFramebufferPtrConst() + (size_t)y * gfx.GetFramebufferPitch();
+		for (unsigned int x = 0u; x < Graphics::ScreenWidth; x++)
+		{
+			sum += pRow[x].dword;
+		}
+	}
+	return sum;
+}
+
+// The effect drawn with Graphics::PutPixel on the calling thread, then with ParallelForTiles on 64x64
+// tiles with nWorkers workers (when negative, with 0, 1, 3, 7... up to the default count)
+int Benchmark::Effect(int nWorkers, unsigned int nFrames)
+{
+	std::vector<unsigned int> workerCounts;
+	if (nWorkers >= 0)
+	{
+		workerCounts.push_back((unsigned int)nWorkers);
+	}
+	else
+	{
+		for (unsigned int n = 0u; n < ThreadPool::DefaultWorkerCount(); n = n * 2u + 1u)
+		{
+			workerCounts.push_back(n);
+		}
+		workerCounts.push_back(ThreadPool::DefaultWorkerCount());
+	}
+
+	float serialTime = 0.0f;
+	unsigned long long serialSum = 0u;
+	{
+		Graphics gfx{ std::make_unique<DiscardSink>(), 0u };
+		TeslaTimer<float> timer;
+		for (unsigned int f = 0u; f < nFrames; f++)
+		{
+			for (unsigned int y = 0u; y < Graphics::ScreenHeight; y++)
+			{
+				for (unsigned int x = 0u; x < Graphics::ScreenWidth; x++)
+				{
+					gfx.PutPixel(x, y, EffectPixel(x, y, (float)f));
+				}
+			}
+		}
+		serialTime = timer.Mark() / (float)nFrames;
+		serialSum = SumPixels(gfx);
+	}
+	const double nPixels = (double)Graphics::ScreenWidth * Graphics::ScreenHeight;
+	std::cout << "PutPixel:  " << serialTime * 1000.0f << " ms/frame, " << nPixels / serialTime / 1e6 << " Mpixels/s" << std::endl;
+
+	for (const unsigned int n : workerCounts)
+	{
+		Graphics gfx{ std::make_unique<DiscardSink>(), n };
+		TeslaTimer<float> timer;
+		for (unsigned int f = 0u; f < nFrames; f++)
+		{
+			gfx.ParallelForTiles(64u, [f](SurfaceTile& tile)
+			{
+				for (unsigned int y = tile.GetTop(); y < tile.GetBottom(); y++)
+				{
+					Color* const pRow = tile.GetRowPtr(y);
+					for (unsigned int x = tile.GetLeft(); x < tile.GetRight(); x++)
+					{
+						pRow[x] = EffectPixel(x, y, (float)f);
+					}
+				}
+			});
+		}
+		const float time = timer.Mark() / (float)nFrames;
+		std::cout << "tiles, " << gfx.GetThreadPool().GetThreadCount() << " threads: " << time * 1000.0f << " ms/frame, " << nPixels / time / 1e6
+			<< " Mpixels/s, x" << serialTime / time << (SumPixels(gfx) == serialSum ? "" : " (DIFFERENT PIXELS)") << std::endl;
+	}
+	return 0;
+}
+
+// One pixel read back from a decoded image, called through a pointer so that it can't be inlined
+static Color ReadPixel(const Surface& image, unsigned int x, unsigned int y) noexcept
+{
+	return image.Sample(x, y);
+}
+
+// The shape of the loop Surface::FromFile ran before ImageDecoder: the whole image decoded first (GDI+
+// does that when the Bitmap is made, here ImageDecoder stands in for it), then one call per pixel to
+// copy it into the Surface. Bitmap::GetPixel also locks and converts a 1x1 rectangle on every call,
+// which this can't reproduce without GDI+: it's a lower bound of the cost of the old path
+static Surface DecodePerPixel(const std::vector<unsigned char>& data, ImageDecoder::Format format, const char* name)
+{
+	static Color (*volatile pReadPixel)(const Surface&, unsigned int, unsigned int) = ReadPixel;
+	const Surface decoded = ImageDecoder::Decode(data.data(), data.size(), format, name);
+	Surface surface{ decoded.GetWidth(), decoded.GetHeight() };
+	for (unsigned int y = 0u; y < decoded.GetHeight(); y++)
+	{
+		Color* const pRow = surface.GetRowPtr(y);
+		for (unsigned int x = 0u; x < decoded.GetWidth(); x++)
+		{
+			pRow[x] = pReadPixel(decoded, x, y);
+		}
+	}
+	return surface;
+}
+
+// Decode the same encoded image nRuns times: MB/s of the file and Mpixels/s of the image, best run,
+// and how much faster it is than the per pixel loop. The pixels are compared with pReference when
+// there is one
+static void BenchmarkDecodeFormat(const char* name, const std::vector<unsigned char>& data, ImageDecoder::Format format, unsigned int nRuns, const Surface* pReference)
+{
+	const Surface image = ImageDecoder::Decode(data.data(), data.size(), format, name);
+	const unsigned int width = image.GetWidth();
+	const unsigned int height = image.GetHeight();
+	bool same = true;
+	if (pReference != nullptr)
+	{
+		same = width == pReference->GetWidth() && height == pReference->GetHeight();
+		for (unsigned int y = 0u; same && y < height; y++)
+		{
+			same = std::equal(image.GetRowPtr(y), image.GetRowPtr(y) + width, pReference->GetRowPtr(y),
+				[](Color lhs, Color rhs) { return lhs.dword == rhs.dword; });
+		}
+	}
+	const float best = Benchmark::BestOf(nRuns, [&]() { ImageDecoder::Decode(data.data(), data.size(), format, name); });
+	const float perPixel = Benchmark::BestOf(nRuns, [&]() { DecodePerPixel(data, format, name); });
+	std::cout << name << ": " << data.size() / 1024u << " KB, " << width << "x" << height << ", " << best * 1000.0f << " ms, "
+		<< (double)data.size() / best / 1e6 << " MB/s, " << (double)width * height / best / 1e6 << " Mpixels/s, per pixel loop "
+		<< perPixel * 1000.0f << " ms (x" << perPixel / best << ")" << (same ? "" : " (DIFFERENT PIXELS)") << std::endl;
+}
+
+// ImageDecoder speed per format, against the per pixel loop FromFile used before. Without files a
+// 1920x1080 image (gradients, noise and flat areas) is encoded as BMP, PNG, QOI and raw 32 bpp TGA and decoded back, checking the pixels
+int Benchmark::Decode(const std::vector<std::string>& filenames, unsigned int nRuns)
+{
+	if (!filenames.empty())
+	{
+		for (const std::string& filename : filenames)
+		{
+			std::ifstream file(filename, std::ios::binary);
+			if (!file)
+			{
+				std::cerr << "Can't open [" << filename << "]" << std::endl;
+				return -1;
+			}
+			const std::vector<unsigned char> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+			const ImageDecoder::Format format = ImageDecoder::DetectFormat(data.data(), data.size(), filename);
+			BenchmarkDecodeFormat(filename.c_str(), data, format, nRuns, nullptr);
+		}
+		return 0;
+	}
+
+	constexpr unsigned int Width = 1920u;
+	constexpr unsigned int Height = 1080u;
+	Surface image{ Width, Height };
+	std::mt19937 rng(7u);
+	for (unsigned int y = 0u; y < Height; y++)
+	{
+		for (unsigned int x = 0u; x < Width; x++)
+		{
+			const bool flat = (x / 240u + y / 270u) % 3u == 0u;
+			const unsigned int noise = flat ? 0u : rng() & 15u;
+			image.PutPixel(x, y, Color((unsigned char)(255u - y * 255u / Height), (unsigned char)(x * 255u / Width + noise),
+				(unsigned char)((x + y) / 16u + noise), (unsigned char)(y * 255u / Height)));
+		}
+	}
+	std::vector<unsigned char> bmp;
+	std::vector<unsigned char> png;
+	std::vector<unsigned char> qoi;
+	ImageEncoder::EncodeBMP(image, true, bmp);
+	ImageEncoder::EncodePNG(image, true, png);
+	ImageEncoder::EncodeQOI(image, true, qoi);
+	// Uncompressed truecolor TGA with 8 alpha bits, top-down rows of BGRA
+	std::vector<unsigned char> tga = { 0u, 0u, 2u, 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u,
+		(unsigned char)(Width & 0xFFu), (unsigned char)(Width >> 8u), (unsigned char)(Height & 0xFFu), (unsigned char)(Height >> 8u), 32u, 0x28u };
+	for (unsigned int y = 0u; y < Height; y++)
+	{
+		for (unsigned int x = 0u; x < Width; x++)
+		{
+			const Color c = image.Sample(x, y);
+			tga.insert(tga.end(), { c.GetB(), c.GetG(), c.GetR(), c.GetX() });
+		}
+	}
+	BenchmarkDecodeFormat("bmp", bmp, ImageDecoder::Format::BMP, nRuns, &image);
+	BenchmarkDecodeFormat("tga", tga, ImageDecoder::Format::TGA, nRuns, &image);
+	BenchmarkDecodeFormat("png", png, ImageDecoder::Format::PNG, nRuns, &image);
+	BenchmarkDecodeFormat("qoi", qoi, ImageDecoder::Format::QOI, nRuns, &image);
+	return 0;
+}
+
+// The five Surface blits at every Simd::Level, in Mpixels/s (best of nRuns): a 256x256 sprite (alpha
+// ramps, a key colored border) drawn all over a 1920x1080 target, partly clipped on the right and bottom edges
+int Benchmark::Blit(unsigned int nRuns)
+{
+	constexpr unsigned int SpriteSize = 256u;
+	Surface target{ 1920u, 1080u };
+	Surface sprite{ SpriteSize, SpriteSize };
+	const Color key = Color(255u, 0u, 255u);
+	for (unsigned int y = 0u; y < SpriteSize; y++)
+	{
+		for (unsigned int x = 0u; x < SpriteSize; x++)
+		{
+			const bool border = x < 16u || y < 16u || x >= SpriteSize - 16u || y >= SpriteSize - 16u;
+			sprite.PutPixel(x, y, border ? key : Color((unsigned char)((x + y) / 2u), (unsigned char)x, (unsigned char)y, (unsigned char)(255u - x)));
+		}
+	}
+	struct Mode
+	{
+		const char* name;
+		std::function<void(int, int)> blit;
+	};
+	const Mode modes[] = {
+		{ "opaque", [&](int x, int y) { target.Blit(sprite, x, y); } },
+		{ "key", [&](int x, int y) { target.BlitColorKey(sprite, x, y, key); } },
+		{ "alpha", [&](int x, int y) { target.BlitAlpha(sprite, x, y); } },
+		{ "premultiplied", [&](int x, int y) { target.BlitPremultiplied(sprite, x, y); } },
+		{ "tint", [&](int x, int y) { target.BlitTinted(sprite, x, y, Color(200u, 255u, 128u, 64u)); } }
+	};
+	// The written pixels of a run
+	unsigned long long nPixels = 0u;
+	for (int y = -64; y < (int)target.GetHeight(); y += 97)
+	{
+		for (int x = -64; x < (int)target.GetWidth(); x += 101)
+		{
+			const int w = std::min(x + (int)SpriteSize, (int)target.GetWidth()) - std::max(x, 0);
+			const int h = std::min(y + (int)SpriteSize, (int)target.GetHeight()) - std::max(y, 0);
+			nPixels += (unsigned long long)w * h;
+		}
+	}
+	for (const Mode& mode : modes)
+	{
+		std::cout << mode.name << ":";
+		ForEachLevel([&](Simd::Level level)
+		{
+			const float best = BestOf(nRuns, [&]()
+			{
+				for (int y = -64; y < (int)target.GetHeight(); y += 97)
+				{
+					for (int x = -64; x < (int)target.GetWidth(); x += 101)
+					{
+						mode.blit(x, y);
+					}
+				}
+			});
+			std::cout << (level == Simd::Level::None ? " " : ", ") << Simd::GetLevelName(level) << " " << (double)nPixels / best / 1e6;
+		});
+		std::cout << " Mpixels/s" << std::endl;
+	}
+	return 0;
+}
+
+// SpriteBatch in sprites/s: frames of 10k to 50k alpha blended sprites (16 to 64 pixels, 64 images
+// in an atlas) scattered over a 1920x1080 target, blitted one by one in draw order then flushed
+// from the batch serial and on the pool
+int Benchmark::Sprites(unsigned int nFrames)
+{
+	ThreadPool pool;
+	std::mt19937 rng(11u);
+	std::vector<Surface> images;
+	for (unsigned int i = 0u; i < 64u; i++)
+	{
+		const unsigned int size = 16u + (unsigned int)(rng() % 49u);
+		Surface image{ size, size };
+		for (unsigned int y = 0u; y < size; y++)
+		{
+			for (unsigned int x = 0u; x < size; x++)
+			{
+				image.PutPixel(x, y, Color((unsigned char)(x * 255u / size), (unsigned char)(i * 4u), (unsigned char)(y * 255u / size), (unsigned char)(255u - x * y % 256u)));
+			}
+		}
+		images.push_back(std::move(image));
+	}
+	SpriteAtlas atlas;
+	for (const Surface& image : images)
+	{
+		atlas.Add(image);
+	}
+	atlas.Build();
+
+	Surface target{ 1920u, 1080u };
+	for (const unsigned int nSprites : { 10000u, 50000u })
+	{
+		struct Placed
+		{
+			unsigned int sprite;
+			int x;
+			int y;
+		};
+		std::vector<Placed> placed(nSprites);
+		for (Placed& p : placed)
+		{
+			p = { (unsigned int)(rng() % 64u), (int)(rng() % 1984u) - 32, (int)(rng() % 1144u) - 32 };
+		}
+		const double nTotal = (double)nSprites * nFrames;
+
+		TeslaTimer<float> timer;
+		for (unsigned int f = 0u; f < nFrames; f++)
+		{
+			for (const Placed& p : placed)
+			{
+				target.BlitAlpha(atlas.GetView(p.sprite), p.x, p.y);
+			}
+		}
+		const float blitTime = timer.Mark();
+		std::cout << nSprites << " sprites, one by one: " << blitTime * 1000.0f / (float)nFrames << " ms/frame, "
+			<< nTotal / blitTime / 1e6 << " Msprites/s" << std::endl;
+
+		SpriteBatch batch{ atlas };
+		for (ThreadPool* pPool : { (ThreadPool*)nullptr, &pool })
+		{
+			float binTime = 0.0f;
+			float drawTime = 0.0f;
+			timer.Mark();
+			for (unsigned int f = 0u; f < nFrames; f++)
+			{
+				for (const Placed& p : placed)
+				{
+					batch.Draw(p.sprite, p.x, p.y);
+				}
+				batch.Flush(target, pPool);
+				binTime += batch.GetStatistics().binTime;
+				drawTime += batch.GetStatistics().drawTime;
+			}
+			const float time = timer.Mark();
+			std::cout << nSprites << " sprites, batch " << (pPool ? "pool:   " : "serial: ") << time * 1000.0f / (float)nFrames << " ms/frame, "
+				<< nTotal / time / 1e6 << " Msprites/s (" << batch.GetStatistics().blits << " blits, bin " << binTime * 1000.0f / (float)nFrames
+				<< " ms, draw " << drawTime * 1000.0f / (float)nFrames << " ms)" << std::endl;
+		}
+	}
+	return 0;
+}
+
+// TextRenderer in glyphs/s: a screen of text (1920x1080) at 12 to 48 pixels, from a warm glyph cache
+// and with the cache cleared before every frame (every glyph rasterized once per frame)
+int Benchmark::Text(const std::string& fontFile, unsigned int nFrames)
+{
+	const Font font{ fontFile };
+	TextRenderer text;
+	Surface target{ 1920u, 1080u };
+	std::string line;
+	while (line.size() < 400u)
+	{
+		line += "The quick brown fox jumps over the lazy dog. 0123456789 (Sphinx of black quartz, judge my vow!) ";
+	}
+	for (const unsigned int pixelHeight : { 12u, 16u, 24u, 48u })
+	{
+		std::string page;
+		for (unsigned int y = 0u; y + pixelHeight <= target.GetHeight(); y += pixelHeight)
+		{
+			page += line.substr(y / pixelHeight % 40u, 1920u / (pixelHeight / 2u)) + "\n";
+		}
+		for (const bool cold : { false, true })
+		{
+			text.ClearCache();
+			text.Draw(target, font, pixelHeight, page, 0, 0, Color::White);
+			const TextRenderer::Statistics before = text.GetStatistics();
+			float time = 0.0f;
+			for (unsigned int f = 0u; f < nFrames; f++)
+			{
+				if (cold)
+				{
+					text.ClearCache();
+				}
+				TeslaTimer<float> timer;
+				text.Draw(target, font, pixelHeight, page, 0, 0, Color::White);
+				time += timer.Mark();
+			}
+			const TextRenderer::Statistics& after = text.GetStatistics();
+			const unsigned long long nGlyphs = after.glyphs - before.glyphs;
+			std::cout << pixelHeight << " px, " << (cold ? "cold cache: " : "warm cache: ") << nGlyphs / nFrames << " glyphs, "
+				<< time * 1000.0f / (float)nFrames << " ms/frame, " << (double)nGlyphs / time / 1e6 << " Mglyphs/s ("
+				<< (after.misses - before.misses) / nFrames << " misses per frame)" << std::endl;
+		}
+	}
+	return 0;
+}
+
+// Reference fills for the fill benchmark: every pixel of the bounding box tests whether its center
+// is inside the shape, with the conventions of ShapeFiller (an edge owns the centers on its top end
+// and on its left side, so the results match it pixel for pixel)
+static bool IsInsidePolygon(const ShapeFiller::Point* pPoints, size_t count, ShapeFiller::FillRule rule, double px, double py) noexcept
+{
+	int winding = 0;
+	int crossings = 0;
+	for (size_t i = 0u; i < count; i++)
+	{
+		const ShapeFiller::Point& a = pPoints[i];
+		const ShapeFiller::Point& b = pPoints[(i + 1u) % count];
+		if ((a.y <= py) != (b.y <= py))
+		{
+			const double x = a.x + (py - a.y) * ((double)b.x - a.x) / ((double)b.y - a.y);
+			if (x <= px)
+			{
+				winding += b.y > a.y ? 1 : -1;
+				crossings++;
+			}
+		}
+	}
+	return rule == ShapeFiller::FillRule::EvenOdd ? crossings % 2 == 1 : winding != 0;
+}
+
+static void NaiveFillPolygon(Surface& target, const ShapeFiller::Point* pPoints, size_t count, Color color, ShapeFiller::FillRule rule) noexcept
+{
+	float minX = pPoints[0].x;
+	float minY = pPoints[0].y;
+	float maxX = minX;
+	float maxY = minY;
+	for (size_t i = 1u; i < count; i++)
+	{
+		minX = std::min(minX, pPoints[i].x);
+		minY = std::min(minY, pPoints[i].y);
+		maxX = std::max(maxX, pPoints[i].x);
+		maxY = std::max(maxY, pPoints[i].y);
+	}
+	const unsigned int x0 = (unsigned int)std::clamp(minX, 0.0f, (float)target.GetWidth());
+	const unsigned int y0 = (unsigned int)std::clamp(minY, 0.0f, (float)target.GetHeight());
+	const unsigned int x1 = (unsigned int)std::clamp(std::ceil(maxX), 0.0f, (float)target.GetWidth());
+	const unsigned int y1 = (unsigned int)std::clamp(std::ceil(maxY), 0.0f, (float)target.GetHeight());
+	for (unsigned int y = y0; y < y1; y++)
+	{
+		for (unsigned int x = x0; x < x1; x++)
+		{
+			if (IsInsidePolygon(pPoints, count, rule, x + 0.5, y + 0.5))
+			{
+				target.PutPixel(x, y, color);
+			}
+		}
+	}
+}
+
+static void NaiveFillEllipse(Surface& target, float centerX, float centerY, float radiusX, float radiusY, Color color) noexcept
+{
+	const unsigned int x0 = (unsigned int)std::clamp(centerX - radiusX, 0.0f, (float)target.GetWidth());
+	const unsigned int y0 = (unsigned int)std::clamp(centerY - radiusY, 0.0f, (float)target.GetHeight());
+	const unsigned int x1 = (unsigned int)std::clamp(std::ceil(centerX + radiusX), 0.0f, (float)target.GetWidth());
+	const unsigned int y1 = (unsigned int)std::clamp(std::ceil(centerY + radiusY), 0.0f, (float)target.GetHeight());
+	for (unsigned int y = y0; y < y1; y++)
+	{
+		// The rows whose center is inside the vertical extent, then the chord through that center
+		const double py = y + 0.5;
+		if (py < (double)centerY - radiusY || py >= (double)centerY + radiusY)
+		{
+			continue;
+		}
+		const double dy = (py - centerY) / radiusY;
+		const double halfWidth = radiusX * std::sqrt(std::max(1.0 - dy * dy, 0.0));
+		for (unsigned int x = x0; x < x1; x++)
+		{
+			const double px = x + 0.5;
+			if (px >= centerX - halfWidth && px < centerX + halfWidth)
+			{
+				target.PutPixel(x, y, color);
+			}
+		}
+	}
+}
+
+// ShapeFiller against the per pixel reference fills, in shapes/s and Mpixels/s: random ellipses,
+// concave stars (non-zero) and self-intersecting polygons (even-odd) over a 1920x1080 target.
+// The two targets are compared at the end
+int Benchmark::Fill(unsigned int nFrames)
+{
+	struct Shape
+	{
+		bool ellipse;
+		float centerX;
+		float centerY;
+		float radiusX;
+		float radiusY;
+		std::vector<ShapeFiller::Point> points;
+		ShapeFiller::FillRule rule;
+		Color color;
+	};
+	std::mt19937 rng(17u);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<Shape> shapes(3000u);
+	for (size_t i = 0u; i < shapes.size(); i++)
+	{
+		Shape& shape = shapes[i];
+		shape.ellipse = i % 3u == 0u;
+		shape.centerX = unit(rng) * 2000.0f - 40.0f;
+		shape.centerY = unit(rng) * 1160.0f - 40.0f;
+		shape.radiusX = 4.0f + 120.0f * unit(rng);
+		shape.radiusY = 4.0f + 120.0f * unit(rng);
+		shape.rule = i % 3u == 1u ? ShapeFiller::FillRule::NonZero : ShapeFiller::FillRule::EvenOdd;
+		shape.color = Color((unsigned int)rng() | 0xFF000000u);
+		if (!shape.ellipse)
+		{
+			const unsigned int nPoints = 5u + (unsigned int)(rng() % 12u);
+			for (unsigned int p = 0u; p < nPoints; p++)
+			{
+				// Stars alternate two radii, the others jump around the circle and cross themselves
+				const float angle = 6.2831853f * (shape.rule == ShapeFiller::FillRule::NonZero ? (float)p / (float)nPoints : unit(rng));
+				const float r = shape.rule == ShapeFiller::FillRule::NonZero && p % 2u == 1u ? 0.4f : 1.0f;
+				shape.points.push_back({ shape.centerX + r * shape.radiusX * std::cos(angle), shape.centerY + r * shape.radiusY * std::sin(angle) });
+			}
+		}
+	}
+
+	Surface filled{ 1920u, 1080u };
+	Surface reference{ 1920u, 1080u };
+	ShapeFiller filler;
+	filled.Clear(Color::Black);
+	reference.Clear(Color::Black);
+	TeslaTimer<float> timer;
+	for (unsigned int f = 0u; f < nFrames; f++)
+	{
+		for (const Shape& shape : shapes)
+		{
+			if (shape.ellipse)
+			{
+				filler.FillEllipse(filled, shape.centerX, shape.centerY, shape.radiusX, shape.radiusY, shape.color);
+			}
+			else
+			{
+				filler.FillPolygon(filled, shape.points.data(), shape.points.size(), shape.color, shape.rule);
+			}
+		}
+	}
+	const float fillerTime = timer.Mark();
+	for (unsigned int f = 0u; f < nFrames; f++)
+	{
+		for (const Shape& shape : shapes)
+		{
+			if (shape.ellipse)
+			{
+				NaiveFillEllipse(reference, shape.centerX, shape.centerY, shape.radiusX, shape.radiusY, shape.color);
+			}
+			else
+			{
+				NaiveFillPolygon(reference, shape.points.data(), shape.points.size(), shape.color, shape.rule);
+			}
+		}
+	}
+	const float naiveTime = timer.Mark();
+
+	unsigned long long nDifferent = 0u;
+	for (unsigned int y = 0u; y < filled.GetHeight(); y++)
+	{
+		for (unsigned int x = 0u; x < filled.GetWidth(); x++)
+		{
+			nDifferent += filled.Sample(x, y).dword != reference.Sample(x, y).dword ? 1u : 0u;
+		}
+	}
+	const double nShapes = (double)shapes.size() * nFrames;
+	const double nPixels = (double)filler.GetStatistics().pixels;
+	std::cout << "ShapeFiller: " << fillerTime * 1000.0f / (float)nFrames << " ms/frame, " << nShapes / fillerTime / 1e6 << " Mshapes/s, "
+		<< nPixels / fillerTime / 1e6 << " Mpixels/s (" << filler.GetStatistics().spans / nFrames << " spans per frame)" << std::endl;
+	std::cout << "per pixel:   " << naiveTime * 1000.0f / (float)nFrames << " ms/frame, " << nShapes / naiveTime / 1e6 << " Mshapes/s, "
+		<< nPixels / naiveTime / 1e6 << " Mpixels/s, x" << naiveTime / fillerTime << " slower" << std::endl;
+	std::cout << nDifferent << " pixels differ" << std::endl;
+	return nDifferent == 0u ? 0 : -1;
+}
+#endif
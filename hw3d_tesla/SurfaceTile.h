@@ -0,0 +1,61 @@
+#pragma once
+#include "Surface.h"
+#include <cassert>
+
+// Rectangular window on a Surface, handed to the workers of a parallel loop.
+// Coordinates are the ones of the whole Surface; the tile only lets you touch
+// the pixels inside its rectangle, so tiles can be written concurrently.
+class SurfaceTile
+{
+public:
+	SurfaceTile(Surface& surface, const Surface::Rect& rect) noexcept
+		:
+		pRow0(surface.GetBufferPtr()),
+		pitch(surface.GetPitch()),
+		rect(rect)
+	{
+		assert(rect.right <= surface.GetWidth() && rect.bottom <= surface.GetHeight() && "Tile outside the surface");
+	}
+	void PutPixel(unsigned int x, unsigned int y, Color c) noexcept
+	{
+		assert(x >= rect.left && x < rect.right && "Attempting to draw outside the tile");
+		assert(y >= rect.top && y < rect.bottom && "Attempting to draw outside the tile");
+		pRow0[x + (size_t)pitch * y] = c;
+	}
+	Color Sample(unsigned int x, unsigned int y) const noexcept
+	{
+		assert(x >= rect.left && x < rect.right && "Attempting to sample outside the tile");
+		assert(y >= rect.top && y < rect.bottom && "Attempting to sample outside the tile");
+		return pRow0[x + (size_t)pitch * y];
+	}
+	// Pointer to the pixel (0, y) of the Surface: only [GetLeft(), GetRight()) may be accessed
+	Color* GetRowPtr(unsigned int y) const noexcept
+	{
+		assert(y >= rect.top && y < rect.bottom && "Attempting to access a row outside the tile");
+		return pRow0 + (size_t)pitch * y;
+	}
+	unsigned int GetLeft() const noexcept
+	{
+		return rect.left;
+	}
+	unsigned int GetTop() const noexcept
+	{
+		return rect.top;
+	}
+	unsigned int GetRight() const noexcept
+	{
+		return rect.right;
+	}
+	unsigned int GetBottom() const noexcept
+	{
+		return rect.bottom;
+	}
+	const Surface::Rect& GetRect() const noexcept
+	{
+		return rect;
+	}
+private:
+	Color* pRow0;
+	unsigned int pitch;
+	Surface::Rect rect;
+};
@@ -0,0 +1,174 @@
+#include "SurfaceView.h"
+#include "MappedFile.h"
+#include "ImageDecoder.h"
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+SurfaceView::SurfaceView(const Surface& surface) noexcept
+	:
+	pRow0(surface.GetBufferPtrConst()),
+	width(surface.GetWidth()),
+	height(surface.GetHeight()),
+	pitch((int)surface.GetPitch())
+{}
+
+SurfaceView::SurfaceView(const Color* pRow0, unsigned int width, unsigned int height, int pitch, std::shared_ptr<const void> pOwner) noexcept
+	:
+	pRow0(pRow0),
+	width(width),
+	height(height),
+	pitch(pitch),
+	pOwner(std::move(pOwner))
+{
+	assert((unsigned int)(pitch < 0 ? -pitch : pitch) >= width && "The pitch can't be smaller than the width");
+}
+
+SurfaceView SurfaceView::MapFile(const std::string& filename)
+{
+	auto pFile = std::make_shared<MappedFile>(filename);
+	const unsigned char* pData = pFile->GetData();
+	const size_t size = pFile->GetSize();
+	auto Fail = [&filename](int line, const char* reason)
+	{
+		throw Surface::Exception(line, __FILE__, "Mapping image [" + filename + "]: " + reason);
+	};
+
+	// Our raw format: a header, then the rows exactly as a Surface stores them
+	if (size >= sizeof(RawHeader) && memcmp(pData, "TSRF", 4u) == 0)
+	{
+		RawHeader header;
+		memcpy(&header, pData, sizeof(header));
+		if (header.version != RawVersion)
+		{
+			Fail(__LINE__, "unsupported raw surface version.");
+		}
+		if (header.width == 0u || header.height == 0u || header.pitch < header.width || header.pitch > 0x8000u || header.height > 0x8000u ||
+			header.dataOffset % sizeof(Color) != 0u)
+		{
+			Fail(__LINE__, "invalid raw surface header.");
+		}
+		const size_t end = header.dataOffset + ((size_t)header.pitch * (header.height - 1u) + header.width) * sizeof(Color);
+		if (end > size)
+		{
+			Fail(__LINE__, "truncated raw surface.");
+		}
+		SurfaceView view(reinterpret_cast<const Color*>(pData + header.dataOffset), header.width, header.height, (int)header.pitch, pFile);
+		view.mapped = true;
+		return view;
+	}
+
+	// Uncompressed 32bpp BMP with an alpha channel: the BGRA dwords are Colors already. Only the
+	// header decides (no pixel is read): the channels must have our masks, with the alpha one in
+	// the top byte (V3+ header or BI_ALPHABITFIELDS). In plain BI_RGB files the 4th byte is
+	// usually left at zero, which ImageDecoder reads as opaque, so those are decoded below.
+	// The pixels must be 4 bytes aligned to be used in place
+	if (size >= 70u && pData[0] == 'B' && pData[1] == 'M')
+	{
+		auto Read16 = [pData](size_t offset) { return (unsigned int)pData[offset] | ((unsigned int)pData[offset + 1u] << 8); };
+		auto Read32 = [&Read16](size_t offset) { return Read16(offset) | (Read16(offset + 2u) << 16); };
+		const unsigned int dataOffset  = Read32(10u);
+		const unsigned int headerSize  = Read32(14u);
+		const long long fileWidth      = (int)Read32(18u);
+		const long long fileHeight     = (int)Read32(22u);
+		const unsigned int bpp         = Read16(28u);
+		const unsigned int compression = Read32(30u);
+		const bool alphaMasks = (compression == 3u || compression == 6u) && (headerSize >= 56u || compression == 6u) &&
+			Read32(54u) == 0x00FF0000u && Read32(58u) == 0x0000FF00u && Read32(62u) == 0x000000FFu && Read32(66u) == 0xFF000000u;
+		const long long rows = fileHeight < 0 ? -fileHeight : fileHeight;
+		if (headerSize >= 40u && bpp == 32u && alphaMasks && dataOffset % sizeof(Color) == 0u &&
+			fileWidth > 0 && fileWidth <= 0x8000 && rows > 0 && rows <= 0x8000 &&
+			dataOffset <= size && (size - dataOffset) / sizeof(Color) / (size_t)fileWidth >= (size_t)rows)
+		{
+			const unsigned int width  = (unsigned int)fileWidth;
+			const unsigned int height = (unsigned int)rows;
+			const Color* pPixels = reinterpret_cast<const Color*>(pData + dataOffset);
+			// Bottom-up bitmaps are walked backwards
+			SurfaceView view = fileHeight < 0 ?
+				SurfaceView(pPixels, width, height, (int)width, pFile) :
+				SurfaceView(pPixels + (size_t)width * (height - 1u), width, height, -(int)width, pFile);
+			view.mapped = true;
+			return view;
+		}
+	}
+
+	// Anything else is decoded once (from the mapping when we know the format)
+	const auto format = ImageDecoder::DetectFormat(pData, size, filename);
+	auto pSurface = std::make_shared<Surface>(format != ImageDecoder::Format::Unknown ?
+		ImageDecoder::Decode(pData, size, format, filename) :
+		Surface::FromFile(filename));
+	const Surface& surface = *pSurface;
+	return SurfaceView(surface.GetBufferPtrConst(), surface.GetWidth(), surface.GetHeight(), (int)surface.GetPitch(), std::move(pSurface));
+}
+
+void SurfaceView::SaveRaw(const SurfaceView& src, const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		throw Surface::Exception(__LINE__, __FILE__, "Saving raw surface to [" + filename + "]: failed to open the file.");
+	}
+
+	// Same row alignment as a Surface, so the mapped rows start on 64 bytes boundaries too
+	constexpr unsigned int pixelsPerAlignment = Surface::Alignment / sizeof(Color);
+	RawHeader header = { { 'T', 'S', 'R', 'F' }, RawVersion, src.width, src.height, 0u, RawDataOffset };
+	header.pitch = (src.width + pixelsPerAlignment - 1u) / pixelsPerAlignment * pixelsPerAlignment;
+	static_assert(sizeof(RawHeader) <= RawDataOffset, "The raw header doesn't fit before the pixels");
+	char headerBytes[RawDataOffset] = {};
+	memcpy(headerBytes, &header, sizeof(header));
+	file.write(headerBytes, RawDataOffset);
+
+	const std::vector<Color> padding(header.pitch - src.width);
+	for (unsigned int y = 0u; y < src.height; y++)
+	{
+		file.write(reinterpret_cast<const char*>(src.GetRowPtr(y)), (std::streamsize)src.width * sizeof(Color));
+		file.write(reinterpret_cast<const char*>(padding.data()), (std::streamsize)padding.size() * sizeof(Color));
+	}
+	if (!file)
+	{
+		throw Surface::Exception(__LINE__, __FILE__, "Saving raw surface to [" + filename + "]: failed to write.");
+	}
+}
+
+Color SurfaceView::Sample(unsigned int x, unsigned int y) const noexcept
+{
+	assert(x < width && "Attempting sample outside the view");
+	assert(y < height && "Attempting sample outside the view");
+	return pRow0[(ptrdiff_t)pitch * y + x];
+}
+
+unsigned int SurfaceView::GetWidth() const noexcept
+{
+	return width;
+}
+
+unsigned int SurfaceView::GetHeight() const noexcept
+{
+	return height;
+}
+
+const Color* SurfaceView::GetRowPtr(unsigned int y) const noexcept
+{
+	assert(y < height && "Attempting to access a row outside the view");
+	return pRow0 + (ptrdiff_t)pitch * y;
+}
+
+int SurfaceView::GetPitch() const noexcept
+{
+	return pitch;
+}
+
+bool SurfaceView::IsMapped() const noexcept
+{
+	return mapped;
+}
+
+SurfaceView SurfaceView::GetSubView(const Surface::Rect& rect) const noexcept
+{
+	assert(rect.left <= rect.right && rect.right <= width && "Sub view outside the view");
+	assert(rect.top <= rect.bottom && rect.bottom <= height && "Sub view outside the view");
+	SurfaceView view(pRow0 + (ptrdiff_t)pitch * rect.top + rect.left, rect.right - rect.left, rect.bottom - rect.top, pitch, pOwner);
+	view.mapped = mapped;
+	return view;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "Surface.h"
+#include <memory>
+#include <string>
+
+// Read-only window on pixels stored somewhere else: a Surface, a part of it, or a
+// memory-mapped image file. Views of a Surface don't own anything (the Surface must
+// outlive them); views returned by MapFile keep their storage alive while a copy exists.
+class SurfaceView
+{
+public:
+	// Header of the raw surface files written by SaveRaw (little endian, pixels at dataOffset)
+	struct RawHeader
+	{
+		char magic[4];            // "TSRF"
+		unsigned int version;
+		unsigned int width;
+		unsigned int height;
+		unsigned int pitch;       // in pixels
+		unsigned int dataOffset;  // in bytes from the start of the file
+	};
+	static constexpr unsigned int RawVersion = 1u;
+	// Rows of a raw file start on this boundary (as long as the mapping is page aligned)
+	static constexpr unsigned int RawDataOffset = Surface::Alignment;
+public:
+	// View of a whole Surface
+	SurfaceView(const Surface& surface) noexcept;
+	// pitch is in pixels, negative for images stored bottom-up (pRow0 is then the last row in memory)
+	SurfaceView(const Color* pRow0, unsigned int width, unsigned int height, int pitch, std::shared_ptr<const void> pOwner = nullptr) noexcept;
+	// Map a raw surface file or an uncompressed 32bpp BMP with an alpha channel and use its pixels
+	// in place. Whether a BMP has one is told by its header alone: bitfields with a 0xFF000000 alpha
+	// mask (V3+ header or BI_ALPHABITFIELDS, as ImageEncoder writes them). Other files (BI_RGB,
+	// pixels not 4 bytes aligned in the file) are decoded once into a Surface owned by the view,
+	// without scanning the mapping first, so the pixels are always the ones Surface::FromFile gives
+	static SurfaceView MapFile(const std::string& filename);
+	// Write the pixels in the raw format MapFile reads without any conversion
+	static void SaveRaw(const SurfaceView& src, const std::string& filename);
+	Color Sample(unsigned int x, unsigned int y) const noexcept;
+	unsigned int GetWidth() const noexcept;
+	unsigned int GetHeight() const noexcept;
+	// Get a pointer to the first pixel of row y
+	const Color* GetRowPtr(unsigned int y) const noexcept;
+	// Distance between two rows (in pixels), negative for bottom-up storage
+	int GetPitch() const noexcept;
+	// True if the pixels live in a file mapping (no copy was made)
+	bool IsMapped() const noexcept;
+	// View of a part of this one (sharing the same storage)
+	SurfaceView GetSubView(const Surface::Rect& rect) const noexcept;
+private:
+	const Color* pRow0;
+	unsigned int width;
+	unsigned int height;
+	int pitch;
+	// MappedFile or Surface keeping the pixels alive (nullptr for plain views)
+	std::shared_ptr<const void> pOwner;
+	bool mapped = false;
+};
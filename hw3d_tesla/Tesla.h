@@ -1,7 +1,15 @@
 #pragma once
 #include <DirectXMath.h>
+#include "Simd.h"
+#include "MeshCuller.h"
+#include "MappedFile.h"
+#include "ObjParser.h"
+#include "MeshCache.h"
 #include <fstream>
+#include <memory>
+#include <span>
 #include <sstream>
+#include <type_traits>
 
 namespace Tesla
 {
@@ -83,13 +91,34 @@ namespace Tesla
 		}
 		IndexedTriangleList& Transform(const DirectX::XMMATRIX transformation)
 		{
-			// apply the transformation matrix to every vertex position
-			for (auto& v : vertices)
+			// apply the transformation matrix to every vertex position, 4 or 8 at a time
+			// (same results as XMVector3Transform on each of them)
+			if (!vertices.empty())
 			{
-				DirectX::XMStoreFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(&v.pos), DirectX::XMVector3Transform(DirectX::XMLoadFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(&v.pos)), transformation));
+				DirectX::XMFLOAT4X4 m;
+				DirectX::XMStoreFloat4x4(&m, transformation);
+				Simd::TransformPositions(reinterpret_cast<float*>(&vertices[0].pos), sizeof(Vertex), vertices.size(), m.m);
 			}
+			InvalidateBounds();
 			return *this;
 		}
+		// Bounding sphere and box of the positions (for MeshCuller), computed on first use. Transform
+		// drops them, code changing the positions any other way has to call InvalidateBounds.
+		// Not thread safe: get them once before sharing the list between threads
+		const MeshCuller::Bounds& GetBounds() const
+		{
+			if (!boundsValid)
+			{
+				bounds = vertices.empty() ? MeshCuller::Bounds{} :
+					MeshCuller::ComputeBounds(reinterpret_cast<const float*>(&vertices[0].pos), sizeof(Vertex), vertices.size());
+				boundsValid = true;
+			}
+			return bounds;
+		}
+		void InvalidateBounds() noexcept
+		{
+			boundsValid = false;
+		}
 		IndexedTriangleList& MakeColored(bool join = true)
 		{
 			const float dPhi = twoPI / (float)vertices.size();
@@ -118,6 +147,37 @@ namespace Tesla
 	public:
 		std::vector<index_type> indices;
 		std::vector<Vertex> vertices;
+	private:
+		mutable MeshCuller::Bounds bounds = {};
+		mutable bool boundsValid = false;
+	};
+
+	// Read-only mesh with what the renderers use of an IndexedTriangleList (vertices, indices and
+	// GetBounds) over memory kept alive by pOwner: a mapped MeshCache or a list shared with the view
+	template<typename Vertex>
+	class MeshView
+	{
+	public:
+		MeshView() = default;
+		MeshView(std::span<const Vertex> vertices_in, std::span<const index_type> indices_in, const MeshCuller::Bounds& bounds_in, std::shared_ptr<const void> pOwner_in)
+			:
+			indices(indices_in),
+			vertices(vertices_in),
+			bounds(bounds_in),
+			pOwner(std::move(pOwner_in))
+		{
+			assert(indices.size() % 3 == 0 && "This is not a triangle list! The Number of indices is not a multiple of 3.");
+		}
+		const MeshCuller::Bounds& GetBounds() const noexcept
+		{
+			return bounds;
+		}
+	public:
+		std::span<const index_type> indices;
+		std::span<const Vertex> vertices;
+	private:
+		MeshCuller::Bounds bounds = {};
+		std::shared_ptr<const void> pOwner;
 	};
 
 	template<typename Vertex>
@@ -136,10 +196,13 @@ namespace Tesla
 		}
 		IndexedLineList& Transform(const DirectX::XMMATRIX transformation)
 		{
-			// apply the transformation matrix to every vertex position
-			for (auto& v : vertices)
+			// apply the transformation matrix to every vertex position, 4 or 8 at a time
+			// (same results as XMVector3Transform on each of them)
+			if (!vertices.empty())
 			{
-				DirectX::XMStoreFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(&v.pos), DirectX::XMVector3Transform(DirectX::XMLoadFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(&v.pos)), transformation));
+				DirectX::XMFLOAT4X4 m;
+				DirectX::XMStoreFloat4x4(&m, transformation);
+				Simd::TransformPositions(reinterpret_cast<float*>(&vertices[0].pos), sizeof(Vertex), vertices.size(), m.m);
 			}
 			return *this;
 		}
@@ -158,11 +221,8 @@ namespace Tesla
 			x(x),
 			y(y)
 		{}
-		Generic_Vec2(const Generic_Vec2& v)
-			:
-			x(v.x),
-			y(v.y)
-		{}
+		// Defaulted, so that the vectors (and vertices made of them) stay trivially copyable
+		Generic_Vec2(const Generic_Vec2& v) = default;
 		template<typename Other>
 		Generic_Vec2& operator=(const Other& src)
 		{
@@ -450,7 +510,7 @@ namespace Tesla
 		template<typename S>
 		explicit Generic_Vec3(const Generic_Vec3<S>& other)
 			:
-			Generic_Vec3((T)other.x, (T)other.y),
+			Generic_Vec2<T>((T)other.x, (T)other.y),
 			z((T)other.z)
 		{}
 	public:
@@ -588,7 +648,7 @@ namespace Tesla
 		template<typename S>
 		explicit Generic_Vec4(const Generic_Vec4<S>& other)
 			:
-			Generic_Vec3((T)other.x, (T)other.y, (T)other.z),
+			Generic_Vec3<T>((T)other.x, (T)other.y, (T)other.z),
 			w((T)other.w)
 		{}
 	public:
@@ -1956,223 +2016,33 @@ public:
 		class OBJModel
 		{
 		public:
-			OBJModel(const std::string& filename)
-			{
-				// Open the specified file
-				std::ifstream file;
-				file.open(filename.c_str());
-
-				if (file.is_open())
-				{
-					// Every line will be stored here
-					std::string line;
-					std::stringstream stream;
-
-					// A new mesh is encountered if a vertex is loaded after a face.
-					bool previous_was_a_face = false;
-					nMeshes = 0;
-
-					// Now iterate through every line of the file
-					while (std::getline(file, line))
-					{
-						// Skip if invalid line
-						if (line.size() <= 2)
-						{
-							continue;
-						}
-
-						// Transfer the line into the stream, for easy numeric reading
-						stream = std::stringstream(line);
-
-						// In an OBJ file the first two characters gives information
-						// about the type of data you will find.
-						const char l0 = line[0];
-						const char l1 = line[1];
-						if ((l0 == 'v') && (l1 == ' '))
-						{
-							if (previous_was_a_face)
-							{
-								nMeshes++;
-								previous_was_a_face = false;
-							}
-							LoadPosition(stream); // v 1 2 3
-						}
-						if ((l0 == 'v') && (l1 == 't'))
-						{
-							LoadTexCoord(stream); // vt 0.2 0.7
-							hasTexCoords = true;
-						}
-						if ((l0 == 'v') && (l1 == 'n'))
-						{
-							LoadNormal(stream);   // vn 0.12 -3.5 2.6023
-							hasNormals = true;
-						}
-						if (l0 == 'f')
-						{
-							previous_was_a_face = true;
-							LoadFace(stream);     
-						}
-					}
-				}
-				else
-				{
-					throw std::exception(("Couldn't open the specified file: " + filename).c_str());
-				}
-			}
-		private:
-			void LoadPosition(std::stringstream& stream)
-			{
-				// The position (also called vertex) is in the form "v x y z"
-				Vec3 pos;
-
-				// Junk, for ignoring the first character
-				char skip;
-
-				// Fill the position and accumulate it to the set of positions
-				stream >> skip >> pos.x >> pos.y >> pos.z;
-				positions.push_back(pos);
-			}
-			void LoadTexCoord(std::stringstream& stream)
-			{
-				// The texture coordinate is in the form "vt u v"
-				Vec2 tc;
-
-				// Junk, for ignoring characters
-				char skip;
-
-				// Read the texture coordinate and accumulate it to the set of texture coordinares
-				stream >> skip >> skip >> tc.x >> tc.y >> skip;
-				texCoords.push_back(tc);
-			}
-			void LoadNormal(std::stringstream& stream)
-			{
-				// The normal is in the form "vn x y z"
-				Vec3 n;
-
-				// Junk, for ignoring characters
-				char skip;
-
-				// Fill the normal and accumulate it to the set of normals
-				stream >> skip >> skip >> n.x >> n.y >> n.z;
-				normals.push_back(n);
-			}
-			void LoadFace(std::stringstream& stream)
-			{
-				// The loading of the indices is more tricky. Its form depends on
-				// which kind of data are present in the obj file, and there are four cases.
-				if (!hasNormals && !hasTexCoords)
-				{
-					HandleNoNorNoTex(stream);
-				}
-				if (!hasNormals && hasTexCoords)
-				{
-					HandleNoNorTex(stream);
-				}
-				if (hasNormals && !hasTexCoords)
-				{
-					HandleNorNoTex(stream);
-				}
-				if (hasNormals && hasTexCoords)
-				{
-					HandleNorTex(stream);
-				}
-			}
-			void HandleNoNorNoTex(std::stringstream& stream)
-			{
-				// First case: No textures and no Normals (pos)    
-
-				// Prepare the container for the indices
-				index_type i[3];
-
-				// Junk, for ignoring characters
-				char skip;
-
-				// Read the three indices  f 0 1 2  (pos) 
-				stream >> skip >> i[0] >> i[1] >> i[2];
-
-				// Accumulate the indices in the set of position indices. 
-				// Subtract one because they start from one in obj files (why??)
-				posIndices.push_back(i[0] - 1u);
-				posIndices.push_back(i[1] - 1u);
-				posIndices.push_back(i[2] - 1u);
-			}
-			void HandleNorNoTex(std::stringstream& stream)
-			{
-				// Second case: Only normals 
-				// f 0//1 2//3 4//5  (pos//nor)
-
-				// Prepare the container for the indices
-				index_type i[6];
-
-				// Junk, for ignoring characters
-				char skip;
-
-				// Fill the three position indices and normal indices  f 0//1 2//3 4//5
-				stream >> skip >> i[0] >> skip >> skip >> i[1] >> i[2] >> skip >> skip >> i[3] >> i[4] >> skip >> skip >> i[5];
-
-				// Accumulate to the set of position indices
-				// Subtract one because they start from one in obj files (why??)
-				posIndices.push_back(i[0] - 1u);
-				posIndices.push_back(i[2] - 1u);
-				posIndices.push_back(i[4] - 1u);
-
-				// Accumulate to the set of normal indices
-				norIndices.push_back(i[1] - 1u);
-				norIndices.push_back(i[3] - 1u);
-				norIndices.push_back(i[5] - 1u);
-			}
-			void HandleNoNorTex(std::stringstream& stream)
-			{
-				// Third case: Only textures 
-				// f 0/1 2/3 4/5  (pos/tex) 
-
-				// Prepare the container for the indices
-				index_type i[6];
-
-				// Junk, for ignoring characters
-				char skip;
-
-				// Fill the three position and texture coordinates indices  f 0/1 2/3 4/5
-				stream >> skip >> i[0] >> skip >> i[1] >> i[2] >> skip >> i[3] >> i[4] >> skip >> i[5];
-
-				// Accumulate to the set of position indices
-				// Subtract one because they start from one in obj files (why??)
-				posIndices.push_back(i[0] - 1u);
-				posIndices.push_back(i[2] - 1u);
-				posIndices.push_back(i[4] - 1u);
-
-				// Accumulate to the set of texture coordinates indices (same)
-				texIndices.push_back(i[1] - 1u);
-				texIndices.push_back(i[3] - 1u);
-				texIndices.push_back(i[5] - 1u);
-			}
-			void HandleNorTex(std::stringstream& stream)
-			{
-				// Forth case
-				// f 0/1/2 3/4/5 6/7/8  textures and normals (pos/tex/nor)
-				index_type i[9];
-
-				// Junk, for ignoring characters
-				char skip;
-
-				// Fill the three position indices, the three normal indices and the three texture coordinate indices
-				// f 0/1/2 3/4/5 6/7/8
-				stream >> skip >> i[0] >> skip >> i[1] >> skip >> i[2] >> i[3] >> skip >> i[4] >> skip >> i[5] >> i[6] >> skip >> i[7] >> skip >> i[8];
-
-				// Position indices
-				posIndices.push_back(i[0] - 1u);
-				posIndices.push_back(i[3] - 1u);
-				posIndices.push_back(i[6] - 1u);
-
-				// Texture coordinates indices
-				texIndices.push_back(i[1] - 1u);
-				texIndices.push_back(i[4] - 1u);
-				texIndices.push_back(i[7] - 1u);
-
-				// Normal indices
-				norIndices.push_back(i[2] - 1u);
-				norIndices.push_back(i[5] - 1u);
-				norIndices.push_back(i[8] - 1u);
+			// With a pool, chunks of the file are parsed on all of its threads (same result)
+			OBJModel(const std::string& filename, ThreadPool* pPool = nullptr)
+			{
+				// The whole file is mapped and parsed in place: a first pass counts the records,
+				// the second one writes them straight into the vectors
+				static_assert(sizeof(Vec3) == 3u * sizeof(float) && sizeof(Vec2) == 2u * sizeof(float));
+				const MappedFile file{ filename };
+				const ObjParser parser{ reinterpret_cast<const char*>(file.GetData()), file.GetSize(), pPool };
+				const ObjParser::Counts& counts = parser.GetCounts();
+
+				hasNormals   = counts.normals > 0u;
+				hasTexCoords = counts.texCoords > 0u;
+				nMeshes      = counts.nMeshes;
+				positions.resize(counts.positions);
+				normals.resize(counts.normals);
+				texCoords.resize(counts.texCoords);
+				posIndices.resize(counts.triangles * 3u);
+				norIndices.resize(hasNormals ? counts.triangles * 3u : 0u);
+				texIndices.resize(hasTexCoords ? counts.triangles * 3u : 0u);
+
+				parser.Parse({
+					reinterpret_cast<float*>(positions.data()),
+					reinterpret_cast<float*>(texCoords.data()),
+					reinterpret_cast<float*>(normals.data()),
+					posIndices.data(),
+					texIndices.data(),
+					norIndices.data() }, filename);
 			}
 		public:
 			// Data
@@ -2196,12 +2066,12 @@ public:
 		public:
 			// Requires Vertex that have pos attribute.
 			template<typename Vertex>
-			static IndexedTriangleList<Vertex> FromFile(const std::string& filename)
+			static IndexedTriangleList<Vertex> FromFile(const std::string& filename, ThreadPool* pPool = nullptr)
 			{
 				std::vector<Vertex> vertices;
 				std::vector<index_type> indices;
 
-				OBJModel mesh{ filename };
+				OBJModel mesh{ filename, pPool };
 
 				// Now let's use the aquired data to build our Vertex type.
 
@@ -2219,40 +2089,26 @@ public:
 	
 			// Requires Vertex that have pos and nor attributes.
 			template<typename Vertex>
-			static IndexedTriangleList<Vertex> FromFileNor(const std::string& filename)
+			static IndexedTriangleList<Vertex> FromFileNor(const std::string& filename, ThreadPool* pPool = nullptr)
 			{
 				std::vector<Vertex> vertices;
 				std::vector<index_type> indices;
 
-				OBJModel mesh{ filename };
+				OBJModel mesh{ filename, pPool };
 
 				if (mesh.hasNormals)
 				{
-					Vertex v0;
-					Vertex v1;
-					Vertex v2;
-					// Iterate through every triangle and read the indexed data
-					for (unsigned int i = 0u; i < mesh.posIndices.size(); i += 3u)
+					// Corners with the same position and normal become the same vertex
+					std::vector<index_type> firstCorners;
+					indices.resize(mesh.posIndices.size());
+					ObjParser::Weld(mesh.posIndices.data(), nullptr, mesh.norIndices.data(), mesh.posIndices.size(), indices.data(), firstCorners);
+
+					// Read the position and the normal of every vertex where it was first used
+					vertices.resize(firstCorners.size());
+					for (size_t i = 0u; i < firstCorners.size(); i++)
 					{
-						// Fill the vertex positions from the previously loaded indices
-						v0.pos = mesh.positions[mesh.posIndices[(size_t)i + 0u]];
-						v1.pos = mesh.positions[mesh.posIndices[(size_t)i + 1u]];
-						v2.pos = mesh.positions[mesh.posIndices[(size_t)i + 2u]];
-
-						// Read vertex the normals from the previously loaded indices
-						v0.n = mesh.normals[mesh.norIndices[(size_t)i + 0u]];
-						v1.n = mesh.normals[mesh.norIndices[(size_t)i + 1u]];
-						v2.n = mesh.normals[mesh.norIndices[(size_t)i + 2u]];
-
-						// Push the three vertices
-						vertices.push_back(v0);
-						vertices.push_back(v1);
-						vertices.push_back(v2);
-
-						// Push the corresponding indices
-						indices.push_back(i + 0u);
-						indices.push_back(i + 1u);
-						indices.push_back(i + 2u);
+						vertices[i].pos = mesh.positions[mesh.posIndices[firstCorners[i]]];
+						vertices[i].n = mesh.normals[mesh.norIndices[firstCorners[i]]];
 					}
 				}
 				else
@@ -2265,89 +2121,59 @@ public:
 	
 			// Requires Vertex that have pos and tex attributes.
 			template<typename Vertex>
-			static IndexedTriangleList<Vertex> FromFileTex(const std::string& filename)
+			static IndexedTriangleList<Vertex> FromFileTex(const std::string& filename, ThreadPool* pPool = nullptr)
 			{
 				std::vector<Vertex> vertices;
 				std::vector<index_type> indices;
 
-				OBJModel mesh{ filename };
+				OBJModel mesh{ filename, pPool };
 
 				if (mesh.hasTexCoords)
 				{
-					Vertex v0;
-					Vertex v1;
-					Vertex v2;
-					// Iterate through every triangle and read the indexed data
-					for (unsigned int i = 0u; i < mesh.posIndices.size(); i += 3u)
+					// Corners with the same position and texture coordinate become the same vertex
+					std::vector<index_type> firstCorners;
+					indices.resize(mesh.posIndices.size());
+					ObjParser::Weld(mesh.posIndices.data(), mesh.texIndices.data(), nullptr, mesh.posIndices.size(), indices.data(), firstCorners);
+
+					// Read the position and the texture coordinate of every vertex where it was first used
+					vertices.resize(firstCorners.size());
+					for (size_t i = 0u; i < firstCorners.size(); i++)
 					{
-						// Fill the vertex mesh.positions from the previously loaded indices
-						v0.pos = mesh.positions[mesh.posIndices[(size_t)i + 0u]];
-						v1.pos = mesh.positions[mesh.posIndices[(size_t)i + 1u]];
-						v2.pos = mesh.positions[mesh.posIndices[(size_t)i + 2u]];
-
-						// Read the vertex texture coordinates from the previously loaded indices
-						v0.tex = mesh.texCoords[mesh.texIndices[(size_t)i + 0u]];
-						v1.tex = mesh.texCoords[mesh.texIndices[(size_t)i + 1u]];
-						v2.tex = mesh.texCoords[mesh.texIndices[(size_t)i + 2u]];
-
-						// Push the three vertices
-						vertices.push_back(v0);
-						vertices.push_back(v1);
-						vertices.push_back(v2);
-
-						// Push the corresponding indices
-						indices.push_back(i + 0u);
-						indices.push_back(i + 1u);
-						indices.push_back(i + 2u);
+						vertices[i].pos = mesh.positions[mesh.posIndices[firstCorners[i]]];
+						vertices[i].tex = mesh.texCoords[mesh.texIndices[firstCorners[i]]];
 					}
 				}
 				else
 				{
 					throw std::exception((std::string("The loaded file doesn't have texture coordinates! ") + filename).c_str());
 				}
+
+				return { std::move(vertices),std::move(indices) };
 			}
 	
 			// Requires Vertex that have pos, tex and nor attributes.
 			template<typename Vertex>
-			static IndexedTriangleList<Vertex> FromFileTexNor(const std::string& filename)
+			static IndexedTriangleList<Vertex> FromFileTexNor(const std::string& filename, ThreadPool* pPool = nullptr)
 			{
 				std::vector<Vertex> vertices;
 				std::vector<index_type> indices;
 
-				OBJModel mesh{ filename };
+				OBJModel mesh{ filename, pPool };
 
 				if (mesh.hasNormals && mesh.hasTexCoords)
 				{
-					Vertex v0;
-					Vertex v1;
-					Vertex v2;
-					// Iterate through every triangle and read the indexed data
-					for (unsigned int i = 0u; i < mesh.posIndices.size(); i += 3u)
+					// Corners with the same position, texture coordinate and normal become the same vertex
+					std::vector<index_type> firstCorners;
+					indices.resize(mesh.posIndices.size());
+					ObjParser::Weld(mesh.posIndices.data(), mesh.texIndices.data(), mesh.norIndices.data(), mesh.posIndices.size(), indices.data(), firstCorners);
+
+					// Read the attributes of every vertex where it was first used
+					vertices.resize(firstCorners.size());
+					for (size_t i = 0u; i < firstCorners.size(); i++)
 					{
-						// Fill the vertex mesh.positions from the previously loaded indices
-						v0.pos = mesh.positions[mesh.posIndices[(size_t)i + 0u]];
-						v1.pos = mesh.positions[mesh.posIndices[(size_t)i + 1u]];
-						v2.pos = mesh.positions[mesh.posIndices[(size_t)i + 2u]];
-
-						// Read the vertex texture coordinates from the previously loaded indices
-						v0.tex = mesh.texCoords[mesh.texIndices[(size_t)i + 0u]];
-						v1.tex = mesh.texCoords[mesh.texIndices[(size_t)i + 1u]];
-						v2.tex = mesh.texCoords[mesh.texIndices[(size_t)i + 2u]];
-
-						// Read the normal coodinates from the previously loaded indices
-						v0.n = mesh.normals[mesh.norIndices[(size_t)i + 0u]];
-						v1.n = mesh.normals[mesh.norIndices[(size_t)i + 1u]];
-						v2.n = mesh.normals[mesh.norIndices[(size_t)i + 2u]];
-
-						// Push the three vertices
-						vertices.push_back(v0);
-						vertices.push_back(v1);
-						vertices.push_back(v2);
-
-						// Push the corresponding indices (stupid ascending order)
-						indices.push_back(i + 0u);
-						indices.push_back(i + 1u);
-						indices.push_back(i + 2u);
+						vertices[i].pos = mesh.positions[mesh.posIndices[firstCorners[i]]];
+						vertices[i].tex = mesh.texCoords[mesh.texIndices[firstCorners[i]]];
+						vertices[i].n = mesh.normals[mesh.norIndices[firstCorners[i]]];
 					}
 				}
 				else
@@ -2367,6 +2193,81 @@ public:
 				}
 				return { std::move(vertices),std::move(indices) };
 			}
+
+			// Import through a binary cache next to the file (filename.tmesh). When it was made from this
+			// version of the file for the same Vertex layout it is mapped and used in place, otherwise the
+			// file is imported (FromFileTexNor, FromFileNor, FromFileTex or FromFile, after the attributes
+			// Vertex has) and the cache written for the next run. A cache that can't be written is skipped
+			template<typename Vertex>
+			static MeshView<Vertex> FromFileCached(const std::string& filename, ThreadPool* pPool = nullptr)
+			{
+				static_assert(std::is_trivially_copyable_v<Vertex>, "The cache stores the vertices as they are in memory.");
+				const std::string cacheFile = filename + ".tmesh";
+				const MeshCache::Layout layout = LayoutOf<Vertex>();
+				if (const auto pCache = MeshCache::Open(cacheFile, filename, layout))
+				{
+					return { { static_cast<const Vertex*>(pCache->GetVertices()), pCache->GetVertexCount() },
+						{ pCache->GetIndices(), pCache->GetIndexCount() }, pCache->GetBounds(), pCache };
+				}
+
+				// Described before the import: if the file changes meanwhile, the cache is stale next time
+				const MeshCache::Source source = MeshCache::DescribeSource(filename);
+				const auto pList = std::make_shared<IndexedTriangleList<Vertex>>(ImportAttributes<Vertex>(filename, pPool));
+				try
+				{
+					MeshCache::Write(cacheFile, source, layout, pList->GetBounds(),
+						pList->vertices.data(), pList->vertices.size(), pList->indices.data(), pList->indices.size());
+				}
+				catch (const MeshCache::Exception&)
+				{
+					// read-only folder: the file is imported again next time
+				}
+				return { pList->vertices, pList->indices, pList->GetBounds(), pList };
+			}
+		private:
+			// Offsets taken from an object: the vectors derive from each other, so the vertices are
+			// not standard layout and offsetof is only conditionally supported on them
+			template<typename Vertex>
+			static MeshCache::Layout LayoutOf() noexcept
+			{
+				const Vertex vertex = {};
+				const auto OffsetOf = [&vertex](const auto& member)
+				{
+					return (unsigned int)(reinterpret_cast<const char*>(&member) - reinterpret_cast<const char*>(&vertex));
+				};
+				MeshCache::Layout layout = { (unsigned int)sizeof(Vertex), OffsetOf(vertex.pos), MeshCache::NoAttribute, MeshCache::NoAttribute };
+				if constexpr (requires(const Vertex& v) { v.tex; })
+				{
+					layout.texOffset = OffsetOf(vertex.tex);
+				}
+				if constexpr (requires(const Vertex& v) { v.n; })
+				{
+					layout.norOffset = OffsetOf(vertex.n);
+				}
+				return layout;
+			}
+			template<typename Vertex>
+			static IndexedTriangleList<Vertex> ImportAttributes(const std::string& filename, ThreadPool* pPool)
+			{
+				constexpr bool hasTex = requires(const Vertex& v) { v.tex; };
+				constexpr bool hasNor = requires(const Vertex& v) { v.n; };
+				if constexpr (hasTex && hasNor)
+				{
+					return FromFileTexNor<Vertex>(filename, pPool);
+				}
+				else if constexpr (hasNor)
+				{
+					return FromFileNor<Vertex>(filename, pPool);
+				}
+				else if constexpr (hasTex)
+				{
+					return FromFileTex<Vertex>(filename, pPool);
+				}
+				else
+				{
+					return FromFile<Vertex>(filename, pPool);
+				}
+			}
 		};
 
 		class Circle
@@ -0,0 +1,23 @@
+#ifndef TESLA_HEADLESS
+#include "Tesla.h"
+
+// Nothing in the framework includes Tesla.h (it is there for the code in Game), so its templates
+// are only compiled when they get used. The ones with requirements on the vertex types are
+// instantiated here with vertices made of the framework's own vectors, to keep them building.
+namespace
+{
+	struct PosVertex
+	{
+		Tesla::Vec3 pos;
+	};
+	struct PosNorTexVertex
+	{
+		Tesla::Vec3 pos;
+		Tesla::Vec3 n;
+		Tesla::Vec2 tex;
+	};
+}
+
+template Tesla::MeshView<PosVertex> Tesla::Geometry::Import::FromFileCached<PosVertex>(const std::string&, ThreadPool*);
+template Tesla::MeshView<PosNorTexVertex> Tesla::Geometry::Import::FromFileCached<PosNorTexVertex>(const std::string&, ThreadPool*);
+#endif
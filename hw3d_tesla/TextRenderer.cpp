@@ -0,0 +1,273 @@
+#include "TextRenderer.h"
+#include "SurfaceView.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Next codepoint of a UTF-8 string (U+FFFD for malformed sequences)
+	unsigned int DecodeUTF8(const std::string& text, size_t& i) noexcept
+	{
+		const unsigned char lead = (unsigned char)text[i++];
+		if (lead < 0x80u)
+		{
+			return lead;
+		}
+		unsigned int nTrail;
+		unsigned int codepoint;
+		if ((lead & 0xE0u) == 0xC0u)
+		{
+			nTrail = 1u;
+			codepoint = lead & 0x1Fu;
+		}
+		else if ((lead & 0xF0u) == 0xE0u)
+		{
+			nTrail = 2u;
+			codepoint = lead & 0x0Fu;
+		}
+		else if ((lead & 0xF8u) == 0xF0u)
+		{
+			nTrail = 3u;
+			codepoint = lead & 0x07u;
+		}
+		else
+		{
+			return 0xFFFDu;
+		}
+		for (unsigned int k = 0u; k < nTrail; k++)
+		{
+			if (i >= text.size() || ((unsigned char)text[i] & 0xC0u) != 0x80u)
+			{
+				return 0xFFFDu;
+			}
+			codepoint = (codepoint << 6) | ((unsigned char)text[i++] & 0x3Fu);
+		}
+		return codepoint;
+	}
+
+	unsigned long long MakeKey(const Font& font, unsigned int pixelHeight, int glyph) noexcept
+	{
+		return ((unsigned long long)font.GetId() << 32) | ((unsigned long long)pixelHeight << 16) | (unsigned long long)(glyph & 0xFFFF);
+	}
+}
+
+TextRenderer::TextRenderer(unsigned int cellSize, unsigned int cellCount)
+	:
+	cellSize(std::max(cellSize, 1u)),
+	cellsPerRow(std::max(1u, std::min(std::max(cellCount, 1u), 4096u / std::max(cellSize, 1u)))),
+	cellCount(std::max(cellCount, 1u)),
+	cache(cellsPerRow * this->cellSize, (this->cellCount + cellsPerRow - 1u) / cellsPerRow * this->cellSize),
+	cells(this->cellCount)
+{
+	cache.Clear(Color(0u));
+	lookup.reserve(this->cellCount);
+}
+
+void TextRenderer::Draw(Surface& target, const Font& font, unsigned int pixelHeight, const std::string& text, int x, int y, Color color, const Surface::Rect& clip)
+{
+	pixelHeight = std::clamp(pixelHeight, 1u, 0xFFFFu);
+	const float scale = font.GetScale(pixelHeight);
+	const Font::LineMetrics metrics = font.GetLineMetrics(scale);
+	const Color tint = color.dword | 0xFF000000u;
+
+	int baseline = y - metrics.ascent;
+	float penX = (float)x;
+	int previous = -1;
+	size_t i = 0u;
+	while (i < text.size())
+	{
+		const unsigned int codepoint = DecodeUTF8(text, i);
+		if (codepoint == '\n')
+		{
+			baseline += metrics.lineAdvance;
+			penX = (float)x;
+			previous = -1;
+			continue;
+		}
+		if (codepoint == '\r')
+		{
+			continue;
+		}
+		const int glyph = font.GetGlyphIndex(codepoint);
+		if (previous >= 0 && font.HasKerning())
+		{
+			penX += (float)font.GetKerning(previous, glyph) * scale;
+		}
+		DrawGlyph(target, font, pixelHeight, scale, glyph, (int)std::lround(penX), baseline, tint, clip);
+		penX += (float)font.GetAdvance(glyph) * scale;
+		previous = glyph;
+	}
+}
+
+int TextRenderer::GetTextWidth(const Font& font, unsigned int pixelHeight, const std::string& text) const
+{
+	const float scale = font.GetScale(std::clamp(pixelHeight, 1u, 0xFFFFu));
+	float width = 0.0f;
+	float penX = 0.0f;
+	int previous = -1;
+	size_t i = 0u;
+	while (i < text.size())
+	{
+		const unsigned int codepoint = DecodeUTF8(text, i);
+		if (codepoint == '\n')
+		{
+			penX = 0.0f;
+			previous = -1;
+			continue;
+		}
+		if (codepoint == '\r')
+		{
+			continue;
+		}
+		const int glyph = font.GetGlyphIndex(codepoint);
+		if (previous >= 0 && font.HasKerning())
+		{
+			penX += (float)font.GetKerning(previous, glyph) * scale;
+		}
+		penX += (float)font.GetAdvance(glyph) * scale;
+		width = std::max(width, penX);
+		previous = glyph;
+	}
+	return (int)std::ceil(width);
+}
+
+void TextRenderer::ClearCache() noexcept
+{
+	lookup.clear();
+	nUsedCells = 0u;
+	head = NoCell;
+	tail = NoCell;
+}
+
+const TextRenderer::Statistics& TextRenderer::GetStatistics() const noexcept
+{
+	return stats;
+}
+
+const Surface& TextRenderer::GetCache() const noexcept
+{
+	return cache;
+}
+
+void TextRenderer::DrawGlyph(Surface& target, const Font& font, unsigned int pixelHeight, float scale, int glyph, int x, int y, Color tint, const Surface::Rect& clip)
+{
+	stats.glyphs++;
+	const unsigned long long key = MakeKey(font, pixelHeight, glyph);
+	const auto found = lookup.find(key);
+	if (found != lookup.end())
+	{
+		stats.hits++;
+		const unsigned int cell = found->second;
+		if (cell != head)
+		{
+			Unlink(cell);
+			PushFront(cell);
+		}
+		const Cell& c = cells[cell];
+		if (c.width != 0u)
+		{
+			const unsigned int left = cell % cellsPerRow * cellSize;
+			const unsigned int top = cell / cellsPerRow * cellSize;
+			target.BlitTinted(SurfaceView(cache).GetSubView({ left, top, left + c.width, top + c.height }), x + c.offsetX, y + c.offsetY, tint, clip);
+		}
+		return;
+	}
+
+	const Font::GlyphBox box = font.GetGlyphBox(glyph, scale);
+	const unsigned int width = (unsigned int)std::max(box.x1 - box.x0, 0);
+	const unsigned int height = (unsigned int)std::max(box.y1 - box.y0, 0);
+	coverage.resize((size_t)width * height);
+	if (width != 0u && height != 0u)
+	{
+		font.RasterizeGlyph(glyph, scale, coverage.data(), (int)width, (int)height, (int)width);
+	}
+
+	// Too big for a cell: draw it from the scratch buffer and forget it
+	if (width > cellSize || height > cellSize)
+	{
+		stats.uncached++;
+		scratch.resize(coverage.size());
+		for (size_t i = 0u; i < coverage.size(); i++)
+		{
+			scratch[i] = Color(((unsigned int)coverage[i] << 24) | 0x00FFFFFFu);
+		}
+		target.BlitTinted(SurfaceView(scratch.data(), width, height, (int)width), x + box.x0, y + box.y0, tint, clip);
+		return;
+	}
+
+	// Take a free cell, or the least recently used one
+	stats.misses++;
+	unsigned int cell;
+	if (nUsedCells < cellCount)
+	{
+		cell = nUsedCells++;
+	}
+	else
+	{
+		stats.evictions++;
+		cell = tail;
+		Unlink(cell);
+		lookup.erase(cells[cell].key);
+	}
+	const unsigned int left = cell % cellsPerRow * cellSize;
+	const unsigned int top = cell / cellsPerRow * cellSize;
+	for (unsigned int row = 0u; row < height; row++)
+	{
+		Color* pRow = cache.GetRowPtr(top + row) + left;
+		const unsigned char* pCoverage = &coverage[(size_t)row * width];
+		for (unsigned int col = 0u; col < width; col++)
+		{
+			pRow[col] = Color(((unsigned int)pCoverage[col] << 24) | 0x00FFFFFFu);
+		}
+	}
+	Cell& c = cells[cell];
+	c.key = key;
+	c.width = width;
+	c.height = height;
+	c.offsetX = box.x0;
+	c.offsetY = box.y0;
+	PushFront(cell);
+	lookup.emplace(key, cell);
+
+	if (width != 0u)
+	{
+		target.BlitTinted(SurfaceView(cache).GetSubView({ left, top, left + width, top + height }), x + box.x0, y + box.y0, tint, clip);
+	}
+}
+
+void TextRenderer::Unlink(unsigned int cell) noexcept
+{
+	Cell& c = cells[cell];
+	if (c.prev != NoCell)
+	{
+		cells[c.prev].next = c.next;
+	}
+	else
+	{
+		head = c.next;
+	}
+	if (c.next != NoCell)
+	{
+		cells[c.next].prev = c.prev;
+	}
+	else
+	{
+		tail = c.prev;
+	}
+}
+
+void TextRenderer::PushFront(unsigned int cell) noexcept
+{
+	Cell& c = cells[cell];
+	c.prev = NoCell;
+	c.next = head;
+	if (head != NoCell)
+	{
+		cells[head].prev = cell;
+	}
+	head = cell;
+	if (tail == NoCell)
+	{
+		tail = cell;
+	}
+}
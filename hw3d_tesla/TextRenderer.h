@@ -0,0 +1,71 @@
+#pragma once
+#include "Font.h"
+#include "Surface.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Draws UTF-8 text with TrueType fonts. Glyphs are rasterized once into a cache Surface
+// (white, coverage in the alpha channel) and then blitted tinted with the text color.
+// The cache is a grid of square cells; when it's full the least recently used glyph
+// (of any font and size) gives its cell away.
+class TextRenderer
+{
+public:
+	struct Statistics
+	{
+		unsigned long long glyphs;    // glyphs drawn
+		unsigned long long hits;      // found in the cache
+		unsigned long long misses;    // rasterized into the cache
+		unsigned long long evictions; // misses that took the cell of another glyph
+		unsigned long long uncached;  // bigger than a cell, rasterized every time
+	};
+public:
+	// Glyphs bigger than cellSize x cellSize pixels are not cached
+	TextRenderer(unsigned int cellSize = 64u, unsigned int cellCount = 256u);
+	TextRenderer(const TextRenderer&) = delete;
+	TextRenderer& operator = (const TextRenderer&) = delete;
+	// Draw text with the top left corner of its first line at (x, y); '\n' starts a new line.
+	// The text is opaque, the alpha of color is ignored
+	void Draw(Surface& target, const Font& font, unsigned int pixelHeight, const std::string& text, int x, int y, Color color, const Surface::Rect& clip = Surface::NoClip);
+	// Width of the longest line of text (in pixels)
+	int GetTextWidth(const Font& font, unsigned int pixelHeight, const std::string& text) const;
+	// Forget every cached glyph
+	void ClearCache() noexcept;
+	const Statistics& GetStatistics() const noexcept;
+	const Surface& GetCache() const noexcept;
+private:
+	struct Cell
+	{
+		unsigned long long key;
+		// Glyph pixels inside the cell and their offset from the pen position
+		unsigned int width;
+		unsigned int height;
+		int offsetX;
+		int offsetY;
+		// Least recently used list, from head (just drawn) to tail (next to go)
+		unsigned int prev;
+		unsigned int next;
+	};
+	static constexpr unsigned int NoCell = 0xFFFFFFFFu;
+private:
+	void DrawGlyph(Surface& target, const Font& font, unsigned int pixelHeight, float scale, int glyph, int x, int y, Color tint, const Surface::Rect& clip);
+	void Unlink(unsigned int cell) noexcept;
+	void PushFront(unsigned int cell) noexcept;
+private:
+	unsigned int cellSize;
+	unsigned int cellsPerRow;
+	unsigned int cellCount;
+	Surface cache;
+	std::vector<Cell> cells;
+	// Cells handed out so far (they're all used before the first eviction)
+	unsigned int nUsedCells = 0u;
+	unsigned int head = NoCell;
+	unsigned int tail = NoCell;
+	// (font id, pixel height, glyph) -> cell
+	std::unordered_map<unsigned long long, unsigned int> lookup;
+	// Coverage of the glyph being rasterized, and the white pixels of the uncached ones
+	std::vector<unsigned char> coverage;
+	std::vector<Color> scratch;
+	Statistics stats = {};
+};
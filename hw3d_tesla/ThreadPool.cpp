@@ -0,0 +1,174 @@
+#include "ThreadPool.h"
+#include <cassert>
+
+ThreadPool::ThreadPool(unsigned int nWorkers)
+	:
+	slices(std::make_unique<Slice[]>((size_t)nWorkers + 1u))
+{
+	workers.reserve(nWorkers);
+	for (unsigned int i = 0u; i < nWorkers; i++)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, i + 1u);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		quitting = true;
+	}
+	jobCv.notify_all();
+	for (auto& t : workers)
+	{
+		t.join();
+	}
+}
+
+void ThreadPool::ParallelFor(unsigned int count, const std::function<void(unsigned int)>& task)
+{
+	assert(pTask == nullptr && "ThreadPool::ParallelFor is not reentrant");
+	if (count == 0u)
+	{
+		return;
+	}
+	// Nothing to share
+	if (workers.empty() || count == 1u)
+	{
+		for (unsigned int i = 0u; i < count; i++)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	// Hand out contiguous slices, the workers are asleep so no need to lock them
+	const unsigned int nParticipants = GetThreadCount();
+	for (unsigned int i = 0u; i < nParticipants; i++)
+	{
+		slices[i].begin = (unsigned int)((unsigned long long)count * i / nParticipants);
+		slices[i].end   = (unsigned int)((unsigned long long)count * (i + 1u) / nParticipants);
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		pTask = &task;
+		busyWorkers = (unsigned int)workers.size();
+		generation++;
+	}
+	jobCv.notify_all();
+
+	// The caller is participant 0
+	RunParticipant(0u);
+
+	// The task lives in our stack frame: wait for every worker to let go of it
+	{
+		std::unique_lock<std::mutex> lock(jobMutex);
+		doneCv.wait(lock, [this] { return busyWorkers == 0u; });
+		pTask = nullptr;
+	}
+
+	if (pException)
+	{
+		std::exception_ptr e = nullptr;
+		std::swap(e, pException);
+		std::rethrow_exception(e);
+	}
+}
+
+unsigned int ThreadPool::GetThreadCount() const noexcept
+{
+	return (unsigned int)workers.size() + 1u;
+}
+
+unsigned int ThreadPool::DefaultWorkerCount() noexcept
+{
+	const unsigned int nHardwareThreads = std::thread::hardware_concurrency();
+	return nHardwareThreads > 1u ? nHardwareThreads - 1u : 0u;
+}
+
+void ThreadPool::WorkerLoop(unsigned int index)
+{
+	unsigned long long seenGeneration = 0u;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobCv.wait(lock, [&] { return quitting || generation != seenGeneration; });
+			if (quitting)
+			{
+				return;
+			}
+			seenGeneration = generation;
+		}
+
+		RunParticipant(index);
+
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			if (--busyWorkers == 0u)
+			{
+				doneCv.notify_all();
+			}
+		}
+	}
+}
+
+void ThreadPool::RunParticipant(unsigned int index)
+{
+	unsigned int item;
+	while (PopOwn(index, item) || (Steal(index) && PopOwn(index, item)))
+	{
+		try
+		{
+			(*pTask)(item);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(exceptionMutex);
+			if (!pException)
+			{
+				pException = std::current_exception();
+			}
+		}
+	}
+}
+
+bool ThreadPool::PopOwn(unsigned int index, unsigned int& item)
+{
+	Slice& own = slices[index];
+	std::lock_guard<std::mutex> lock(own.mtx);
+	if (own.begin < own.end)
+	{
+		item = own.begin++;
+		return true;
+	}
+	return false;
+}
+
+bool ThreadPool::Steal(unsigned int index)
+{
+	const unsigned int nParticipants = GetThreadCount();
+	for (unsigned int i = 1u; i < nParticipants; i++)
+	{
+		Slice& victim = slices[(index + i) % nParticipants];
+		unsigned int stolenBegin;
+		unsigned int stolenEnd;
+		{
+			std::lock_guard<std::mutex> lock(victim.mtx);
+			if (victim.begin >= victim.end)
+			{
+				continue;
+			}
+			// Take the back half, the victim keeps working on the front
+			stolenEnd   = victim.end;
+			stolenBegin = victim.end - (victim.end - victim.begin + 1u) / 2u;
+			victim.end  = stolenBegin;
+		}
+		Slice& own = slices[index];
+		std::lock_guard<std::mutex> lock(own.mtx);
+		own.begin = stolenBegin;
+		own.end   = stolenEnd;
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <memory>
+
+// Fixed set of worker threads running parallel loops. Every participant (the workers
+// plus the calling thread) starts with its own slice of the loop and, when it runs dry,
+// steals half of what is left in somebody else's slice.
+class ThreadPool
+{
+public:
+	// By default one worker per hardware thread, minus the caller which works too
+	ThreadPool(unsigned int nWorkers = DefaultWorkerCount());
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator = (const ThreadPool&) = delete;
+	~ThreadPool();
+	// Call task(i) for every i in [0, count) and wait for all of them to finish.
+	// The first exception thrown by a task is rethrown here. Not reentrant.
+	void ParallelFor(unsigned int count, const std::function<void(unsigned int)>& task);
+	// Number of threads taking part to a ParallelFor (caller included)
+	unsigned int GetThreadCount() const noexcept;
+	static unsigned int DefaultWorkerCount() noexcept;
+private:
+	struct Slice
+	{
+		std::mutex mtx;
+		unsigned int begin = 0u;
+		unsigned int end = 0u;
+	};
+private:
+	void WorkerLoop(unsigned int index);
+	void RunParticipant(unsigned int index);
+	bool PopOwn(unsigned int index, unsigned int& item);
+	bool Steal(unsigned int index);
+private:
+	std::vector<std::thread> workers;
+	// One slice per participant, index 0 is the calling thread
+	std::unique_ptr<Slice[]> slices;
+	std::mutex jobMutex;
+	std::condition_variable jobCv;
+	std::condition_variable doneCv;
+	const std::function<void(unsigned int)>* pTask = nullptr;
+	unsigned long long generation = 0u;
+	unsigned int busyWorkers = 0u;
+	bool quitting = false;
+	std::mutex exceptionMutex;
+	std::exception_ptr pException;
+};
@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <atomic>
+
+// What Publish does when the consumer hasn't picked up the previous frame yet
+enum class TripleBufferMode
+{
+	// Wait for it: every published frame is consumed, in order
+	FIFO,
+	// Overwrite it: the producer never waits, the consumer only sees the newest frame
+	Mailbox
+};
+
+// Lock-free hand-off of frames between one producer and one consumer. The producer
+// owns the back slot, the consumer the front slot, and they trade through the middle
+// one with a single atomic exchange.
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer(T back, T middle, T front, TripleBufferMode mode = TripleBufferMode::FIFO)
+		:
+		slots{ std::move(back), std::move(middle), std::move(front) },
+		mode(mode)
+	{}
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator = (const TripleBuffer&) = delete;
+	// Producer side: the slot being filled
+	T& GetBack() noexcept
+	{
+		return slots[back];
+	}
+	// Producer side: hand the back slot to the consumer and take a new one. In FIFO mode this
+	// blocks while the middle slot holds a frame the consumer hasn't taken yet. Returns true
+	// when a frame was overwritten (Mailbox mode only)
+	bool Publish() noexcept
+	{
+		unsigned int expected = state.load(std::memory_order_acquire);
+		while (true)
+		{
+			if (mode == TripleBufferMode::FIFO && (expected & FreshBit))
+			{
+				state.wait(expected, std::memory_order_acquire);
+				expected = state.load(std::memory_order_acquire);
+				continue;
+			}
+			if (state.compare_exchange_weak(expected, back | FreshBit | (expected & CancelBit), std::memory_order_acq_rel))
+			{
+				break;
+			}
+		}
+		back = expected & IndexMask;
+		state.notify_all();
+		return (expected & FreshBit) != 0u;
+	}
+	// Consumer side: block until a frame newer than the front one is published, then take it.
+	// Returns false once Cancel was called and every published frame was taken
+	bool AcquireFront() noexcept
+	{
+		unsigned int current = state.load(std::memory_order_acquire);
+		while (true)
+		{
+			if (current & FreshBit)
+			{
+				if (state.compare_exchange_weak(current, front | (current & CancelBit), std::memory_order_acq_rel))
+				{
+					front = current & IndexMask;
+					// A FIFO producer may be waiting for the middle slot
+					state.notify_all();
+					return true;
+				}
+				continue;
+			}
+			if (current & CancelBit)
+			{
+				return false;
+			}
+			state.wait(current, std::memory_order_acquire);
+			current = state.load(std::memory_order_acquire);
+		}
+	}
+	// Consumer side: the slot being consumed
+	T& GetFront() noexcept
+	{
+		return slots[front];
+	}
+	// Wake the consumer up for good (it still drains the last published frame)
+	void Cancel() noexcept
+	{
+		state.fetch_or(CancelBit, std::memory_order_acq_rel);
+		state.notify_all();
+	}
+private:
+	static constexpr unsigned int IndexMask = 0x3u;
+	static constexpr unsigned int FreshBit  = 0x4u;
+	static constexpr unsigned int CancelBit = 0x8u;
+private:
+	std::array<T, 3> slots;
+	unsigned int back = 0u;
+	unsigned int front = 2u;
+	TripleBufferMode mode;
+	// Index of the middle slot, plus the flags
+	std::atomic<unsigned int> state{ 1u };
+};
@@ -1,3 +1,4 @@
+#ifndef TESLA_HEADLESS
 #include "Window.h"
 #include "Game.h"
 
@@ -33,4 +34,5 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 		MessageBox(nullptr, "No details available", "Unknown Exception", MB_OK | MB_ICONEXCLAMATION);
 	}
 	return -1;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file